@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+#
+# Render the debug port output of the glutt-o-logique, which mixes text
+# messages with binary log_bin() records, see src/common/Core/log_bin.h.
+#
+# The format strings come from the firmware build, in
+# src/glutt-o-logique/bin/log_fmt.bin, and must match the running firmware.
+#
+# Usage: logdecode.py log_fmt.bin [capture file or serial device]
+#
+# A serial device must be configured beforehand, e.g.
+#   stty -F /dev/ttyUSB0 9600 raw
+import re
+import sys
+
+SYNC = 0x00
+HEADER_LEN = 8
+
+# printf conversions, with flags and width, and length modifiers to drop
+conversion_re = re.compile(r'%([-+ #0]*[0-9]*(?:\.[0-9]+)?)(?:hh|h|ll|l)?([diuxXc%s])')
+
+
+def load_formats(path):
+    with open(path, 'rb') as f:
+        return f.read()
+
+
+def format_at(formats, offset):
+    end = formats.find(b'\0', offset)
+    if end < 0:
+        return None
+    return formats[offset:end].decode('ascii', errors='replace')
+
+
+def decode_args(data):
+    args = []
+    z = 0
+    shift = 0
+    for b in data:
+        z |= (b & 0x7F) << shift
+        shift += 7
+        if b & 0x80 == 0:
+            v = (z >> 1) ^ -(z & 1)
+            args.append(v & 0xFFFFFFFF)
+            z = 0
+            shift = 0
+    return args
+
+
+def render(fmt, args):
+    args = iter(args)
+
+    def convert(m):
+        flags, conv = m.group(1), m.group(2)
+        if conv == '%':
+            return '%'
+        value = next(args, 0)
+        if conv in 'di':
+            if value >= 1 << 31:
+                value -= 1 << 32
+            return ('%' + flags + 'd') % value
+        elif conv == 'u':
+            return ('%' + flags + 'd') % value
+        elif conv in 'xX':
+            return ('%' + flags + conv) % value
+        elif conv == 'c':
+            return ('%' + flags + 'c') % (value & 0xFF)
+        return '?'
+
+    return conversion_re.sub(convert, fmt)
+
+
+class Decoder:
+    def __init__(self, formats):
+        self.formats = formats
+        self.buf = bytearray()
+        # The target sends the milliseconds modulo 2^32
+        self.last_ts = 0
+        self.ts_wraps = 0
+
+    def feed(self, data):
+        self.buf += data
+        out = []
+
+        while self.buf:
+            if self.buf[0] != SYNC:
+                end = self.buf.find(SYNC)
+                if end < 0:
+                    end = len(self.buf)
+                out.append(self.buf[:end].decode('ascii', errors='replace'))
+                del self.buf[:end]
+                continue
+
+            if len(self.buf) < HEADER_LEN:
+                break
+
+            length = HEADER_LEN + self.buf[1] + 1
+            if len(self.buf) < length:
+                break
+
+            record = self.buf[:length]
+            fmt = format_at(self.formats, record[2] | (record[3] << 8))
+            if sum(record[:-1]) & 0xFF != record[-1] or fmt is None:
+                # Not a record, resynchronise on the next byte
+                del self.buf[:1]
+                continue
+
+            ts = int.from_bytes(record[4:8], 'little')
+            if ts < self.last_ts and self.last_ts - ts > 1 << 31:
+                self.ts_wraps += 1
+            self.last_ts = ts
+
+            args = decode_args(record[HEADER_LEN:-1])
+            out.append('[{}] {}'.format(ts + (self.ts_wraps << 32), render(fmt, args)))
+            del self.buf[:length]
+
+        return ''.join(out)
+
+
+def main():
+    if len(sys.argv) < 2:
+        print('Usage: {} log_fmt.bin [capture file or serial device]'.format(sys.argv[0]))
+        sys.exit(1)
+
+    decoder = Decoder(load_formats(sys.argv[1]))
+    source = open(sys.argv[2], 'rb', buffering=0) if len(sys.argv) > 2 else sys.stdin.buffer
+
+    while True:
+        data = source.read(256)
+        if not data:
+            break
+        sys.stdout.write(decoder.feed(data).replace('\r\n', '\n'))
+        sys.stdout.flush()
+
+
+if __name__ == '__main__':
+    main()
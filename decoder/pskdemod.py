@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+#
+# Demodulate the PSK modes of the glutt-o-logique (see src/common/Audio/psk.h)
+# from FM demodulated audio, and write one bit per byte like the psk125.bit of
+# analyse_capture.py, for varidecode.py and telemdecode.py.
+#
+# BPSK is detected differentially. QPSK goes through a soft decision Viterbi
+# decoder of the PSK31 convolutional code (K=5, polynomials 0x17 and 0x19).
+#
+# Usage: pskdemod.py MODE audio.wav [output.bit] [--freq HZ] [--reverse]
+# MODE is one of PSK31 PSK63 PSK125 PSK250 PSK500 QPSK31 QPSK63 QPSK125. The
+# statistics are sent at 588 Hz, which is the default frequency. --reverse
+# swaps the direction of the QPSK phase changes, for a receiver on the other
+# sideband.
+#
+# Example with an RTLSDR:
+#   rtl_fm -f 145725000 -s 16000 - | sox -t raw -r 16000 -e signed -b 16 -c 1 - audio.wav
+#   ./pskdemod.py PSK250 audio.wav psk250.bit
+import cmath
+import math
+import sys
+import wave
+
+MODES = {
+    'PSK31': (31.25, False),
+    'PSK63': (62.5, False),
+    'PSK125': (125.0, False),
+    'PSK250': (250.0, False),
+    'PSK500': (500.0, False),
+    'QPSK31': (31.25, True),
+    'QPSK63': (62.5, True),
+    'QPSK125': (125.0, True),
+}
+
+QPSK_CONSTRAINT = 5
+QPSK_POLYS = (0x17, 0x19)
+
+# Timing loop gain, as a fraction of the symbol per symbol
+TIMING_GAIN = 0.05
+
+
+def read_wav(path):
+    with wave.open(path, 'rb') as w:
+        if w.getsampwidth() != 2:
+            raise ValueError('{}: 16-bit samples expected'.format(path))
+        channels = w.getnchannels()
+        rate = w.getframerate()
+        data = w.readframes(w.getnframes())
+
+    samples = []
+    frame = 2 * channels
+    for i in range(0, len(data) - frame + 1, frame):
+        total = 0
+        for c in range(channels):
+            total += int.from_bytes(data[i + 2 * c:i + 2 * c + 2], 'little', signed=True)
+        samples.append(total / channels)
+    return samples, rate
+
+
+def baseband(samples, rate, frequency, window):
+    """Mix down and integrate over window samples, centred on each sample."""
+    step = cmath.exp(-2j * math.pi * frequency / rate)
+    rotation = 1 + 0j
+    cumulative = [0j]
+    for i, x in enumerate(samples):
+        cumulative.append(cumulative[-1] + x * rotation)
+        rotation *= step
+        # Keep the rotation on the unit circle
+        if i % 1024 == 0:
+            rotation /= abs(rotation)
+
+    half = window // 2
+    n = len(samples)
+    return [cumulative[min(i + half, n)] - cumulative[max(i - half, 0)] for i in range(n)]
+
+
+def symbols(y, sps):
+    """Sample y at the symbol boundaries, where the phase is settled."""
+    # Initial timing at the largest magnitude over the first symbols
+    span = min(len(y), int(64 * sps))
+    candidates = [int(k * sps / 16) for k in range(16)]
+    offset = max(candidates, key=lambda o: sum(
+        abs(y[int(o + k * sps)]) for k in range(int((span - o) / sps))))
+
+    t = float(offset)
+    quarter = sps / 4
+    out = []
+    while t + quarter + 1 < len(y):
+        out.append(y[int(round(t))])
+        early = abs(y[int(round(t - quarter))]) if t >= quarter else 0
+        late = abs(y[int(round(t + quarter))])
+        if early + late > 0:
+            t += TIMING_GAIN * sps * (late - early) / (early + late)
+        t += sps
+    return out
+
+
+def differential(z):
+    out = []
+    for a, b in zip(z[1:], z[:-1]):
+        d = a * b.conjugate()
+        out.append(d / abs(d) if d != 0 else 0j)
+    return out
+
+
+def parity(value):
+    return bin(value).count('1') & 1
+
+
+def qpsk_viterbi(d, reverse):
+    num_states = 1 << (QPSK_CONSTRAINT - 1)
+
+    # Expected differential phase for each state and bit. The carrier phase
+    # is delayed by the phase changes, see Audio/psk.c.
+    expected = {}
+    for state in range(num_states):
+        for bit in (0, 1):
+            register = (state << 1) | bit
+            sym = parity(register & QPSK_POLYS[0]) | (parity(register & QPSK_POLYS[1]) << 1)
+            quarter_turns = (2 - sym) & 3
+            angle = (1 if reverse else -1) * quarter_turns * math.pi / 2
+            expected[state, bit] = cmath.exp(-1j * angle)
+
+    metrics = [0.0] + [-1e9] * (num_states - 1)
+    decisions = []
+    for v in d:
+        new_metrics = [-1e18] * num_states
+        decision = [0] * num_states
+        for state in range(num_states):
+            for bit in (0, 1):
+                next_state = ((state << 1) | bit) & (num_states - 1)
+                metric = metrics[state] + (v * expected[state, bit]).real
+                if metric > new_metrics[next_state]:
+                    new_metrics[next_state] = metric
+                    decision[next_state] = state
+        metrics = new_metrics
+        decisions.append(decision)
+
+    state = max(range(num_states), key=lambda s: metrics[s])
+    bits = []
+    for decision in reversed(decisions):
+        bits.append(state & 1)
+        state = decision[state]
+    bits.reverse()
+    return bits
+
+
+def main():
+    args = [a for a in sys.argv[1:] if not a.startswith('--')]
+    frequency = 588.0
+    reverse = '--reverse' in sys.argv
+    for i, a in enumerate(sys.argv):
+        if a == '--freq' and i + 1 < len(sys.argv):
+            frequency = float(sys.argv[i + 1])
+            args.remove(sys.argv[i + 1])
+
+    if len(args) < 2 or args[0].upper() not in MODES:
+        print('Usage: {} MODE audio.wav [output.bit] [--freq HZ] [--reverse]'.format(sys.argv[0]))
+        print('MODE is one of ' + ' '.join(MODES))
+        return 1
+
+    mode = args[0].upper()
+    baud, qpsk = MODES[mode]
+    output = args[2] if len(args) > 2 else './{}.bit'.format(mode.lower())
+
+    samples, rate = read_wav(args[1])
+    sps = rate / baud
+    y = baseband(samples, rate, frequency, int(sps / 2))
+    d = differential(symbols(y, sps))
+
+    if qpsk:
+        bits = qpsk_viterbi(d, reverse)
+    else:
+        bits = [1 if v.real > 0 else 0 for v in d]
+
+    with open(output, 'wb') as f:
+        f.write(bytes(bits))
+    print('{}: {} symbols written to {}'.format(mode, len(bits), output))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,243 @@
+#!/usr/bin/env python3
+#
+# Decode the binary telemetry frame that replaces the PSK statistics text
+# when the relay runs in QRP, see src/common/Core/telemetry.h.
+#
+# The input is the same as for varidecode.py: one demodulated PSK bit per
+# byte, a 0 being a phase change. Every frame found is printed.
+#
+# Usage: telemdecode.py [psk250.bit]
+import datetime
+import sys
+import zlib
+
+VERSION = 1
+PAYLOAD_LEN = 55
+FRAME_LEN = PAYLOAD_LEN + 4
+
+SYNC = 0x1ACFFC1D
+SYNC_BITS = 32
+# Mismatches accepted in the sync word
+SYNC_MAX_ERRORS = 4
+
+CONSTRAINT = 7
+POLYS = (0o171, 0o133)
+INFO_BITS = 8 * FRAME_LEN + CONSTRAINT - 1
+CODED_BITS = 2 * INFO_BITS
+
+INTERLEAVER_ROWS = 16
+INTERLEAVER_COLUMNS = (CODED_BITS + INTERLEAVER_ROWS - 1) // INTERLEAVER_ROWS
+FRAME_SYMBOLS = INTERLEAVER_ROWS * INTERLEAVER_COLUMNS
+
+NUM_STATES = 1 << (CONSTRAINT - 1)
+
+# Same buckets as src/common/Core/histogram.c
+HISTOGRAM_SUB_BITS = 2
+
+PERCENTILES = [
+    ('QSO p50,p90', 1000, 's'),
+    ('SQ ouvert p50,p90', 1000, 's'),
+    ('SQ pause p50,p90', 1000, 's'),
+    ('Latence 1750 p50,p90', 1, 'ms'),
+    ('Occupation horaire p50,max', 10, '%'),
+]
+
+
+def parity(value):
+    return bin(value).count('1') & 1
+
+
+def read_bits(path):
+    with open(path, 'rb') as f:
+        return [b & 1 for b in f.read()]
+
+
+def find_frames(bits):
+    sync = [(SYNC >> (SYNC_BITS - 1 - i)) & 1 for i in range(SYNC_BITS)]
+    i = 0
+    while i + SYNC_BITS + FRAME_SYMBOLS <= len(bits):
+        errors = sum(a != b for a, b in zip(bits[i:i + SYNC_BITS], sync))
+        # The PSK demodulator can be locked on the opposite phase
+        if errors <= SYNC_MAX_ERRORS or errors >= SYNC_BITS - SYNC_MAX_ERRORS:
+            symbols = bits[i + SYNC_BITS:i + SYNC_BITS + FRAME_SYMBOLS]
+            if errors > SYNC_MAX_ERRORS:
+                symbols = [1 - b for b in symbols]
+            yield i, symbols
+            i += SYNC_BITS + FRAME_SYMBOLS
+        else:
+            i += 1
+
+
+def deinterleave(symbols):
+    coded = []
+    for n in range(CODED_BITS):
+        row = n // INTERLEAVER_COLUMNS
+        column = n % INTERLEAVER_COLUMNS
+        coded.append(symbols[column * INTERLEAVER_ROWS + row])
+    return coded
+
+
+def viterbi(coded):
+    # Outputs of the encoder for each state and input bit
+    outputs = {}
+    for state in range(NUM_STATES):
+        for bit in (0, 1):
+            register = (state << 1) | bit
+            outputs[state, bit] = [parity(register & p) for p in POLYS]
+
+    inf = float('inf')
+    metrics = [0] + [inf] * (NUM_STATES - 1)
+    decisions = []
+    for step in range(INFO_BITS):
+        received = coded[2 * step:2 * step + 2]
+        new_metrics = [inf] * NUM_STATES
+        decision = [None] * NUM_STATES
+        for state in range(NUM_STATES):
+            if metrics[state] == inf:
+                continue
+            for bit in (0, 1):
+                distance = sum(a != b for a, b in zip(outputs[state, bit], received))
+                next_state = ((state << 1) | bit) & (NUM_STATES - 1)
+                metric = metrics[state] + distance
+                if metric < new_metrics[next_state]:
+                    new_metrics[next_state] = metric
+                    decision[next_state] = state
+        metrics = new_metrics
+        decisions.append(decision)
+
+    # The encoder is flushed to state 0
+    bits = []
+    state = 0
+    for decision in reversed(decisions):
+        bits.append(state & 1)
+        state = decision[state]
+    bits.reverse()
+
+    frame = bytearray()
+    for i in range(0, 8 * FRAME_LEN, 8):
+        byte = 0
+        for bit in bits[i:i + 8]:
+            byte = (byte << 1) | bit
+        frame.append(byte)
+    return bytes(frame), metrics[0]
+
+
+def bucket_low(bucket):
+    sub_buckets = 1 << HISTOGRAM_SUB_BITS
+    if bucket < sub_buckets:
+        return bucket
+    shift = (bucket >> HISTOGRAM_SUB_BITS) - 1
+    return (sub_buckets + (bucket & (sub_buckets - 1))) << shift
+
+
+def bucket_middle(bucket):
+    low = bucket_low(bucket)
+    high = bucket_low(bucket + 1) - 1
+    return low + (high - low) // 2
+
+
+def hourly(reference, nibbles):
+    values = []
+    previous = reference
+    for byte in nibbles:
+        for delta in (byte >> 4, byte & 0x0F):
+            if delta >= 8:
+                delta -= 16
+            if delta == -8:
+                values.append(None)
+            else:
+                previous += delta
+                values.append(previous)
+    return values
+
+
+def u16(frame, offset):
+    return (frame[offset] << 8) | frame[offset + 1]
+
+
+def tenths(value, unit):
+    return '{}{}{}'.format(value // 10, unit, value % 10)
+
+
+def render(frame):
+    lines = []
+    flags = frame[0] & 0x0F
+    values_valid = flags & 0x01
+    date = u16(frame, 1)
+    uptime_h = u16(frame, 3)
+
+    if date == 0xFFFF:
+        lines.append('Statistiques de la journee')
+    else:
+        day = datetime.date(2000, 1, 1) + datetime.timedelta(days=date)
+        lines.append('Statistiques du {}'.format(day.isoformat()))
+    lines.append('Uptime= {}j{}h'.format(uptime_h // 24, uptime_h % 24))
+
+    if not values_valid:
+        return lines
+
+    lines.append('U min,max= {},{}'.format(tenths(frame[5], 'V'), tenths(frame[6], 'V')))
+    lines.append('Temps QRP= {}'.format('?' if frame[9] == 0xFF else '{}%'.format(frame[9])))
+
+    volts = hourly(frame[18], frame[19:31])
+    lines.append('U heures pleines= ' + ' '.join(
+        '?' if v is None else tenths(v, 'V') for v in volts))
+    capacity = hourly(u16(frame, 31), frame[33:45])
+    lines.append('Capa heures pleines= ' + ' '.join(
+        '?' if v is None else str(v) for v in capacity))
+
+    lines.append('Nbre de commutations eolienne= {}'.format(frame[10]))
+    if flags & 0x04:
+        temps = [(b - 256 if b >= 128 else b) * 5 for b in frame[7:9]]
+        lines.append('Temp min,max= {:.1f}C,{:.1f}C'.format(temps[0] / 10, temps[1] / 10))
+    lines.append('Nbre de balises= {}'.format(frame[11]))
+    lines.append('Nbre de TX ON/OFF= {}'.format(u16(frame, 12)))
+    lines.append('Nbre anti-bavard= {}'.format(frame[14]))
+    qso = u16(frame, 16)
+    lines.append('QSO le plus long= {}h{}m{}s'.format(qso // 3600, qso // 60 % 60, qso % 60))
+    lines.append('Sat GPS= {}'.format(frame[15]))
+
+    for i, (label, divisor, unit) in enumerate(PERCENTILES):
+        buckets = frame[45 + 2 * i:47 + 2 * i]
+        if 0xFF in buckets:
+            continue
+        values = [bucket_middle(b) for b in buckets]
+        if unit == '%':
+            text = ','.join(tenths(v, '%') for v in values)
+        else:
+            text = ','.join('{}{}'.format(round(v / divisor), unit) for v in values)
+        lines.append('{}= {}'.format(label, text))
+
+    lines.append('Disjoncteur eolienne= {}'.format('Off' if flags & 0x02 else 'On'))
+    return lines
+
+
+def main():
+    path = sys.argv[1] if len(sys.argv) > 1 else './psk250.bit'
+    bits = read_bits(path)
+
+    found = 0
+    for position, symbols in find_frames(bits):
+        frame, errors = viterbi(deinterleave(symbols))
+        payload = frame[:PAYLOAD_LEN]
+        crc = int.from_bytes(frame[PAYLOAD_LEN:], 'big')
+        if zlib.crc32(payload) != crc:
+            print('Frame at bit {}: CRC error'.format(position))
+            continue
+        if payload[0] >> 4 != VERSION:
+            print('Frame at bit {}: unknown version {}'.format(position, payload[0] >> 4))
+            continue
+
+        found += 1
+        print('Frame at bit {}, {} bits corrected'.format(position, errors))
+        for line in render(payload):
+            print(line)
+
+    if found == 0:
+        print('No telemetry frame found')
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
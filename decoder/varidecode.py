@@ -5,6 +5,7 @@
 # https://sdradventure.wordpress.com/2011/10/15/gnuradio-psk31-decoder-part-2/
 import re
 import struct
+import sys
 
 varicode = { # {{{
     '1010101011' : '\x00',    '1011011011' : '\x01',
@@ -73,7 +74,8 @@ varicode = { # {{{
     '1011010111' : '~',       '1110110101' : '\x7F' }
     # }}}
 
-infile = open('./psk125.bit', mode='rb')
+# Usage: varidecode.py [input.bit] [output.txt], psk125.bit and psk125.txt by default
+infile = open(sys.argv[1] if len(sys.argv) > 1 else './psk125.bit', mode='rb')
 
 # Initialize the loop
 bit_stream = ''
@@ -111,7 +113,7 @@ if end_ix != -1:
 
 output_str = output_str[:end_ix]
 
-outfile = open('./psk125.txt', 'w')
+outfile = open(sys.argv[2] if len(sys.argv) > 2 else './psk125.txt', 'w')
 outfile.write(output_str)
 outfile.write("\n")
 
@@ -0,0 +1,62 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "Audio/afsk.h"
+#include "Core/common.h"
+
+#ifdef SIMULATOR
+#include <math.h>
+#define arm_sin_f32 sinf
+#else
+#include "arm_math.h"
+#endif
+
+#define AFSK_AMPLITUDE 10000.0f
+
+void afsk_init(struct afsk_modulator *m, int samplerate)
+{
+    m->samplerate = samplerate;
+    m->nco = 0.0f;
+    m->bit_clock = 0;
+}
+
+int afsk_bit_samples(struct afsk_modulator *m)
+{
+    m->bit_clock += m->samplerate;
+    const int samples = m->bit_clock / AFSK_BAUD;
+    m->bit_clock -= samples * AFSK_BAUD;
+    return samples;
+}
+
+int16_t afsk_sample(struct afsk_modulator *m, uint8_t tone)
+{
+    const int frequency = tone ? AFSK_MARK_HZ : AFSK_SPACE_HZ;
+
+    m->nco += 2.0f * FLOAT_PI * frequency / (float)m->samplerate;
+    if (m->nco > FLOAT_PI) {
+        m->nco -= 2.0f * FLOAT_PI;
+    }
+
+    return AFSK_AMPLITUDE * arm_sin_f32(m->nco);
+}
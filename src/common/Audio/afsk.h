@@ -0,0 +1,56 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Bell 202 AFSK at 1200 Bd for APRS, see Audio/ax25.h.
+ *
+ * The tone changes without phase jump at the bit boundaries. The sample
+ * rate need not be a multiple of 1200: the bits alternate between the two
+ * nearest numbers of samples, 13 and 14 at 16 kHz.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Given as dit_duration to Audio/cw.h, after enum psk_mode_e
+#define AFSK_1200 -9
+
+#define AFSK_BAUD 1200
+#define AFSK_MARK_HZ 1200
+#define AFSK_SPACE_HZ 2200
+
+struct afsk_modulator {
+    int samplerate;
+    float nco;
+    // Remainder of the samples of the previous bits, in 1/AFSK_BAUD
+    int bit_clock;
+};
+
+void afsk_init(struct afsk_modulator *m, int samplerate);
+
+// Number of samples of the next bit
+int afsk_bit_samples(struct afsk_modulator *m);
+
+// Next sample of the mark tone if tone is 1, of the space tone otherwise
+int16_t afsk_sample(struct afsk_modulator *m, uint8_t tone);
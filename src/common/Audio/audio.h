@@ -43,8 +43,14 @@ void audio_set_volume(int volume);
 
 // Start and stop audio playback using DMA.
 // Callback is optional, and called whenever a new buffer is needed.
+// Playback stops after the last buffer when the callback does not provide
+// a new one.
 void audio_play_with_callback(AudioCallbackFunction *callback,void *context);
 
+// Call the callback again if it did not provide the next buffer, and restart
+// the playback if it had stopped. Task context only.
+void audio_resume(void);
+
 // Provide a new buffer to the audio DMA. Output is double buffered, so
 // at least two buffers must be maintained by the program. It is not allowed
 // to overwrite the previously provided buffer until after the next callback
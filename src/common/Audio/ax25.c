@@ -0,0 +1,191 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "Audio/ax25.h"
+#include "Core/crc.h"
+#include <string.h>
+
+#define CALLSIGN_LEN 6
+// Flags after the frame, the first one closes it
+#define TRAILING_FLAGS 2
+
+/* Encode the callsign and SSID that start at address and end at a comma or
+ * the end of the string. Returns the number of characters used, 0 if the
+ * address is invalid.
+ */
+static size_t encode_address(uint8_t *out, const char *address, int last, int command)
+{
+    size_t n = 0;
+    int len = 0;
+    while (address[n] && address[n] != ',' && address[n] != '-') {
+        const char c = address[n++];
+        const int valid = (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+        if (!valid || len == CALLSIGN_LEN) {
+            return 0;
+        }
+        out[len++] = c << 1;
+    }
+
+    if (len == 0) {
+        return 0;
+    }
+    while (len < CALLSIGN_LEN) {
+        out[len++] = ' ' << 1;
+    }
+
+    int ssid = 0;
+    if (address[n] == '-') {
+        n++;
+        const size_t digits_from = n;
+        while (address[n] >= '0' && address[n] <= '9') {
+            ssid = 10 * ssid + address[n++] - '0';
+        }
+        if (n == digits_from || ssid > 15 || (address[n] && address[n] != ',')) {
+            return 0;
+        }
+    }
+
+    out[CALLSIGN_LEN] = (command ? 0x80 : 0) | 0x60 | (ssid << 1) | (last ? 1 : 0);
+    return n;
+}
+
+size_t ax25_ui_frame(uint8_t *frame, size_t size,
+        const char *destination, const char *source, const char *path,
+        const char *info)
+{
+    const size_t info_len = strlen(info);
+    size_t num_path = 0;
+    if (path && *path) {
+        num_path = 1;
+        for (const char *c = path; *c; c++) {
+            num_path += (*c == ',') ? 1 : 0;
+        }
+    }
+
+    const size_t len = AX25_ADDRESS_LEN * (2 + num_path) + 2 + info_len + 2;
+    if (num_path > AX25_MAX_PATH || len > size) {
+        return 0;
+    }
+
+    // APRS sends command frames: C bit set in the destination only
+    uint8_t *p = frame;
+    if (encode_address(p, destination, 0, 1) == 0) {
+        return 0;
+    }
+    p += AX25_ADDRESS_LEN;
+    if (encode_address(p, source, num_path == 0, 0) == 0) {
+        return 0;
+    }
+    p += AX25_ADDRESS_LEN;
+
+    const char *digi = path;
+    for (size_t i = 0; i < num_path; i++) {
+        const size_t used = encode_address(p, digi, i == num_path - 1, 0);
+        if (used == 0) {
+            return 0;
+        }
+        p += AX25_ADDRESS_LEN;
+        digi += used + 1;
+    }
+
+    *p++ = AX25_CONTROL_UI;
+    *p++ = AX25_PID_NO_LAYER3;
+    memcpy(p, info, info_len);
+    p += info_len;
+
+    // The FCS goes out least significant byte first
+    const uint16_t fcs = crc16_x25(frame, p - frame);
+    *p++ = fcs & 0xFF;
+    *p++ = fcs >> 8;
+
+    return p - frame;
+}
+
+struct hdlc_writer {
+    uint8_t *bits;
+    size_t size;
+    size_t pos;
+    // Current tone, NRZI changes it for every 0
+    int tone;
+    int ones;
+};
+
+static void put_bit(struct hdlc_writer *w, int bit)
+{
+    if (!bit) {
+        w->tone = !w->tone;
+    }
+
+    if (w->pos < w->size) {
+        if (w->tone) {
+            w->bits[w->pos / 8] |= 0x80 >> (w->pos % 8);
+        }
+        else {
+            w->bits[w->pos / 8] &= ~(0x80 >> (w->pos % 8));
+        }
+    }
+    w->pos++;
+}
+
+// Bytes go out least significant bit first
+static void put_byte(struct hdlc_writer *w, uint8_t byte, int stuffing)
+{
+    for (int i = 0; i < 8; i++) {
+        const int bit = (byte >> i) & 1;
+        put_bit(w, bit);
+
+        if (!stuffing) {
+            continue;
+        }
+        w->ones = bit ? w->ones + 1 : 0;
+        if (w->ones == 5) {
+            put_bit(w, 0);
+            w->ones = 0;
+        }
+    }
+}
+
+size_t ax25_hdlc_bits(const uint8_t *frame, size_t len, int preamble_flags,
+        uint8_t *bits, size_t bits_size)
+{
+    struct hdlc_writer w = {
+        .bits = bits,
+        .size = bits_size,
+        .pos = 0,
+        .tone = 1,
+        .ones = 0,
+    };
+
+    for (int i = 0; i < preamble_flags; i++) {
+        put_byte(&w, AX25_FLAG, 0);
+    }
+    for (size_t i = 0; i < len; i++) {
+        put_byte(&w, frame[i], 1);
+    }
+    for (int i = 0; i < TRAILING_FLAGS; i++) {
+        put_byte(&w, AX25_FLAG, 0);
+    }
+
+    return w.pos <= bits_size ? w.pos : 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* AX.25 UI frames for APRS, sent in AFSK1200 by Audio/cw.c.
+ *
+ * ax25_ui_frame() gives the bytes of the frame with its FCS,
+ * ax25_hdlc_bits() the bits to modulate: opening flags, the frame with bit
+ * stuffing, closing flags, everything NRZI coded. A 1 is the mark tone, a 0
+ * the space tone, see Audio/afsk.h.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define AX25_FLAG 0x7E
+#define AX25_CONTROL_UI 0x03
+#define AX25_PID_NO_LAYER3 0xF0
+
+// Destination, source and up to AX25_MAX_PATH digipeaters
+#define AX25_MAX_PATH 2
+#define AX25_ADDRESS_LEN 7
+// Without flags, with the FCS
+#define AX25_MAX_FRAME_LEN (AX25_ADDRESS_LEN * (2 + AX25_MAX_PATH) + 2 + 256 + 2)
+
+/* Write the UI frame into frame, with the FCS. Addresses are callsigns with
+ * an optional SSID, like "HB9G" or "WIDE2-1", and path is a comma separated
+ * list of digipeaters, can be NULL. Returns the length of the frame, 0 if an
+ * address is invalid or the frame does not fit into size.
+ */
+size_t ax25_ui_frame(uint8_t *frame, size_t size,
+        const char *destination, const char *source, const char *path,
+        const char *info);
+
+/* Write the HDLC bits of the frame, preceded by preamble_flags flags, packed
+ * most significant bit first into bits, which holds bits_size bits. Returns
+ * the number of bits, 0 if they do not fit.
+ */
+size_t ax25_hdlc_bits(const uint8_t *frame, size_t len, int preamble_flags,
+        uint8_t *bits, size_t bits_size);
@@ -22,7 +22,7 @@
  * SOFTWARE.
 */
 
-/* CW and BPSK{31,63,125} generator
+/* CW, BPSK{31,63,125,250,500}, QPSK{31,63,125} and AFSK1200 generator
  *
  * Concept:
  *
@@ -32,11 +32,18 @@
  *
  * The cw_psk_fill_buffer() function can be called to fetch audio from the
  * audio_queue
+ *
+ * Messages pushed with cw_psk_push_source() carry a function instead of the
+ * text, which cw_psk_task() calls for more characters as it generates the
+ * audio. The symbols are generated one character at a time.
  */
 
 #include "Audio/cw.h"
 #include "Core/common.h"
 #include "Audio/audio.h"
+#include "Audio/varicode.h"
+#include "Audio/psk.h"
+#include "Audio/afsk.h"
 #include <string.h>
 
 #ifdef SIMULATOR
@@ -53,8 +60,15 @@
 #include "queue.h"
 #include "semphr.h"
 
-#define MAX_MESSAGE_LEN 1024
-#define MAX_ON_BUFFER_LEN 8192
+// Longer texts are pulled from a cw_psk_text_source_t
+#define MAX_MESSAGE_LEN 256
+// Longest CW letter or PSK varicode, with the separation
+#define MAX_SYMBOLS_PER_CHAR 32
+// Characters pulled at a time from a text source
+#define SOURCE_CHUNK_LEN 16
+// Line of a text source shown in the GUI
+#define SOURCE_LINE_LEN 64
+#define PSK_IDLE_SYMBOLS 20
 
 const uint8_t cw_mapping[60] = { // {{{
     // Read bits from right to left
@@ -119,141 +133,6 @@ const uint8_t cw_mapping[60] = { // {{{
     0b1010111, // SK , ASCII '\'
 }; //}}}
 
-/*
- * PSK Varicode
- * http://aintel.bi.ehu.es/psk31.html
- */
-const char *psk_varicode[] = { // {{{
-    "1010101011",
-    "1011011011",
-    "1011101101",
-    "1101110111",
-    "1011101011",
-    "1101011111",
-    "1011101111",
-    "1011111101",
-    "1011111111",
-    "11101111",
-    "11101",
-    "1101101111",
-    "1011011101",
-    "11111",
-    "1101110101",
-    "1110101011",
-    "1011110111",
-    "1011110101",
-    "1110101101",
-    "1110101111",
-    "1101011011",
-    "1101101011",
-    "1101101101",
-    "1101010111",
-    "1101111011",
-    "1101111101",
-    "1110110111",
-    "1101010101",
-    "1101011101",
-    "1110111011",
-    "1011111011",
-    "1101111111",
-    "1",
-    "111111111",
-    "101011111",
-    "111110101",
-    "111011011",
-    "1011010101",
-    "1010111011",
-    "101111111",
-    "11111011",
-    "11110111",
-    "101101111",
-    "111011111",
-    "1110101",
-    "110101",
-    "1010111",
-    "110101111",
-    "10110111",
-    "10111101",
-    "11101101",
-    "11111111",
-    "101110111",
-    "101011011",
-    "101101011",
-    "110101101",
-    "110101011",
-    "110110111",
-    "11110101",
-    "110111101",
-    "111101101",
-    "1010101",
-    "111010111",
-    "1010101111",
-    "1010111101",
-    "1111101",
-    "11101011",
-    "10101101",
-    "10110101",
-    "1110111",
-    "11011011",
-    "11111101",
-    "101010101",
-    "1111111",
-    "111111101",
-    "101111101",
-    "11010111",
-    "10111011",
-    "11011101",
-    "10101011",
-    "11010101",
-    "111011101",
-    "10101111",
-    "1101111",
-    "1101101",
-    "101010111",
-    "110110101",
-    "101011101",
-    "101110101",
-    "101111011",
-    "1010101101",
-    "111110111",
-    "111101111",
-    "111111011",
-    "1010111111",
-    "101101101",
-    "1011011111",
-    "1011",
-    "1011111",
-    "101111",
-    "101101",
-    "11",
-    "111101",
-    "1011011",
-    "101011",
-    "1101",
-    "111101011",
-    "10111111",
-    "11011",
-    "111011",
-    "1111",
-    "111",
-    "111111",
-    "110111111",
-    "10101",
-    "10111",
-    "101",
-    "110111",
-    "1111011",
-    "1101011",
-    "11011111",
-    "1011101",
-    "111010101",
-    "1010110111",
-    "110111011",
-    "1010110101",
-    "1011010111",
-    "1110110101",
-}; //}}}
-
 // Function to display message in GUI
 void cw_message_sent(const char* str);
 
@@ -261,6 +140,13 @@ struct cw_message_s {
     char          message[MAX_MESSAGE_LEN];
     size_t        message_len;
 
+    // If not NULL, the text is pulled from it instead of message
+    cw_psk_text_source_t source;
+
+    // If not 0, message holds this many PSK symbols instead of text, most
+    // significant bit first
+    size_t        num_symbols;
+
     int           freq;
 
     // If dit_duration is negative, the message is sent in PSK
@@ -365,6 +251,8 @@ int cw_psk_push_message(const char* text, int dit_duration, int frequency)
         }
     }
     msg.message_len = text_len;
+    msg.source = NULL;
+    msg.num_symbols = 0;
     msg.freq = frequency;
     msg.dit_duration = dit_duration;
 
@@ -377,70 +265,69 @@ int cw_psk_push_message(const char* text, int dit_duration, int frequency)
     return 1;
 }
 
-/* Parse the message and fill the on_buffer with CW on/CW off information.
- * Returns the number of on/off bits written.
- */
-static size_t cw_text_to_on_buffer(const char *msg, uint8_t *on_buffer, size_t on_buffer_size)
+int cw_psk_push_source(cw_psk_text_source_t source, int dit_duration, int frequency)
 {
-    size_t pos = 0;
-    const char* sym = msg;
-    do {
-        if (*sym < '+' || *sym > '\\') {
-            if (pos + 3 < on_buffer_size) {
-                for (int i = 0; i < 3; i++) {
-                    on_buffer[pos++] = 0;
-                }
-            }
-        }
-        else {
-            pos += cw_symbol(*sym - '+', on_buffer + pos, on_buffer_size - pos);
-        }
-        sym++;
-    } while (*sym != '\0');
+    if (source == NULL) {
+        return 0;
+    }
 
-    return pos;
-}
+    // Not on the stack of the calling task
+    static struct cw_message_s msg;
+    msg.message[0] = '\0';
+    msg.message_len = 0;
+    msg.source = source;
+    msg.num_symbols = 0;
+    msg.freq = frequency;
+    msg.dit_duration = dit_duration;
+
+    if (xQueueSendToBack(cw_msg_queue, &msg, portMAX_DELAY) != pdTRUE) {
+        trigger_fault(FAULT_SOURCE_CW_QUEUE);
+    }
 
+    return 1;
+}
 
-/*
- * Turn a null terminated ASCII string into a uint8_t buffer
- * of 0 and 1 representing the PSK varicode for the input.
- *
- * outstr must be at least size 20 + strlen(instr)*12 + 20 to accomodate
- * the header and tail.
- *
- * Returns number of bytes written.
- */
-static size_t psk_text_to_phase_buffer(const char* instr, uint8_t* outbits)
+int cw_psk_push_symbols(const uint8_t *symbols, size_t num_symbols, int dit_duration, int frequency)
 {
-    int i=0, j, k;
-
-    /* Header of 0s */
-    for (j=0; j < 20; j++) {
-        outbits[i++] = 0;
+    const int afsk = dit_duration == AFSK_1200;
+    if ((!psk_mode_valid(dit_duration) && !afsk) ||
+            num_symbols == 0 || num_symbols > 8 * MAX_MESSAGE_LEN) {
+        return 0;
     }
 
-    /* Encode the message, with 00 between letters */
-    for (j=0; j < strlen(instr); j++) {
-        const uint16_t ix = instr[j];
-        if (ix < sizeof(psk_varicode)) {
-            const char* varicode_bits = psk_varicode[ix];
-            for(k=0; k < strlen(varicode_bits); k++) {
-                outbits[i++] = (varicode_bits[k] == '1') ? 1 : 0;
-            }
-            outbits[i++] = 0;
-            outbits[i++] = 0;
-        }
-    }
+    static struct cw_message_s msg;
+    memcpy(msg.message, symbols, (num_symbols + 7) / 8);
+    msg.message_len = 0;
+    msg.source = NULL;
+    msg.num_symbols = num_symbols;
+    msg.freq = frequency;
+    msg.dit_duration = dit_duration;
 
-    /* Tail of 0s */
-    for (j=0; j < 20; j++) {
-        outbits[i++] = 0;
+    if (xQueueSendToBack(cw_msg_queue, &msg, portMAX_DELAY) != pdTRUE) {
+        trigger_fault(FAULT_SOURCE_CW_QUEUE);
     }
 
-    return i;
+    cw_message_sent(afsk ? "[APRS]" : "[telemetrie]");
+
+    return 1;
 }
 
+/* Fill the symbols with CW on/off information for one character.
+ * Returns the number of on/off bits written.
+ */
+static size_t cw_char_to_symbols(char c, uint8_t *symbols, size_t symbols_size)
+{
+    if (c < '+' || c > '\\') {
+        size_t pos = 0;
+        while (pos < 3 && pos < symbols_size) {
+            symbols[pos++] = 0;
+        }
+        return pos;
+    }
+    else {
+        return cw_symbol(c - '+', symbols, symbols_size);
+    }
+}
 
 size_t cw_psk_fill_buffer(int16_t *buf, size_t bufsize)
 {
@@ -453,17 +340,22 @@ size_t cw_psk_fill_buffer(int16_t *buf, size_t bufsize)
 }
 
 static int16_t cw_audio_buf[AUDIO_BUF_LEN];
-static uint8_t cw_psk_buffer[MAX_ON_BUFFER_LEN];
+static int cw_audio_buf_pos = 0;
+static uint8_t cw_psk_symbols[MAX_SYMBOLS_PER_CHAR];
 static struct cw_message_s cw_fill_msg_current;
 
+// Angular frequency of NCO and symbol length of the current message
+static float cw_psk_omega;
+static int cw_psk_samples_per_symbol;
+
 // Routine to generate CW audio
 static float cw_generate_audio_ampl = 0.0f;
 static float cw_generate_audio_nco = 0.0f;
-static int16_t cw_generate_audio(float omega, int i, int __attribute__ ((unused))t)
+static int16_t cw_generate_audio(float omega, uint8_t on)
 {
     int16_t s = 0;
     // Remove clicks from CW
-    if (cw_psk_buffer[i]) {
+    if (on) {
         const float remaining = 32768.0f - cw_generate_audio_ampl;
         cw_generate_audio_ampl += remaining / 64.0f;
     }
@@ -484,120 +376,165 @@ static int16_t cw_generate_audio(float omega, int i, int __attribute__ ((unused)
     return s;
 }
 
-static float psk_generate_audio_nco = 0.0f;
-static int   psk_current_psk_phase = 1;
-static int16_t psk_generate_audio(float omega, int i, int t, int samples_per_symbol)
-{
-    int16_t s = 0;
-    const float base_ampl = 10000.0f;
-    float psk_generate_audio_ampl = 0.0f;
+static struct psk_modulator cw_psk_modulator;
+static struct afsk_modulator cw_afsk_modulator;
 
-    if (cw_psk_buffer[i] == 1) {
-        psk_generate_audio_ampl = base_ampl;
+static void cw_psk_send_audio_buf(void)
+{
+    // It should take AUDIO_BUF_LEN/cw_psk_samplerate seconds to send one buffer.
+    // If it takes more than 4 times as long, we think there is a problem.
+    const TickType_t reasonable_delay = pdMS_TO_TICKS(4000 * AUDIO_BUF_LEN / cw_psk_samplerate);
+    if (xQueueSendToBack(cw_audio_queue, &cw_audio_buf, reasonable_delay) != pdTRUE) {
+        trigger_fault(FAULT_SOURCE_CW_AUDIO_QUEUE);
     }
-    else {
-        psk_generate_audio_ampl = base_ampl * arm_cos_f32(
-                FLOAT_PI*(float)t/(float)samples_per_symbol);
+    cw_audio_buf_pos = 0;
+}
+
+static void cw_psk_send_symbols(const uint8_t *symbols, size_t num_symbols)
+{
+    const int is_cw = cw_fill_msg_current.dit_duration > 0;
+    const int is_afsk = cw_fill_msg_current.dit_duration == AFSK_1200;
+
+    for (size_t i = 0; i < num_symbols; i++) {
+        int samples = cw_psk_samples_per_symbol;
+        if (is_afsk) {
+            // 1200 baud is not an integer number of samples
+            samples = afsk_bit_samples(&cw_afsk_modulator);
+        }
+        else if (!is_cw) {
+            psk_symbol(&cw_psk_modulator, symbols[i]);
+        }
+
+        for (int t = 0; t < samples; t++) {
+            int16_t s = is_cw ?
+                cw_generate_audio(cw_psk_omega, symbols[i]) :
+                is_afsk ? afsk_sample(&cw_afsk_modulator, symbols[i]) :
+                psk_sample(&cw_psk_modulator, t);
+
+            // Stereo
+            for (int channel = 0; channel < 2; channel++) {
+                if (cw_audio_buf_pos == AUDIO_BUF_LEN) {
+                    cw_psk_send_audio_buf();
+                }
+                cw_audio_buf[cw_audio_buf_pos++] = s;
+            }
+        }
     }
+}
 
-    psk_generate_audio_nco += omega;
-    if (psk_generate_audio_nco > FLOAT_PI) {
-        psk_generate_audio_nco -= 2.0f * FLOAT_PI;
+static void cw_psk_send_char(char c)
+{
+    const size_t num_symbols = (cw_fill_msg_current.dit_duration > 0) ?
+        cw_char_to_symbols(c, cw_psk_symbols, MAX_SYMBOLS_PER_CHAR) :
+        varicode_encode(c, cw_psk_symbols, MAX_SYMBOLS_PER_CHAR);
+
+    cw_psk_send_symbols(cw_psk_symbols, num_symbols);
+}
+
+static void cw_psk_send_packed_symbols(const uint8_t *packed, size_t num_symbols)
+{
+    for (size_t i = 0; i < num_symbols; i++) {
+        const uint8_t symbol = (packed[i / 8] >> (7 - i % 8)) & 1;
+        cw_psk_send_symbols(&symbol, 1);
     }
+}
 
-    s = psk_generate_audio_ampl *
-        arm_sin_f32(psk_generate_audio_nco +
-            (psk_current_psk_phase == 1 ? 0.0f : FLOAT_PI));
+// Pull the text from the source, and show it line by line in the GUI
+static void cw_psk_send_source(cw_psk_text_source_t source)
+{
+    char chunk[SOURCE_CHUNK_LEN];
+    char line[SOURCE_LINE_LEN];
+    size_t line_len = 0;
+
+    size_t chunk_len;
+    while ((chunk_len = source(chunk, SOURCE_CHUNK_LEN)) > 0) {
+        for (size_t i = 0; i < chunk_len; i++) {
+            cw_psk_send_char(chunk[i]);
+
+            if (chunk[i] == '\n' || line_len == SOURCE_LINE_LEN - 1) {
+                line[line_len] = '\0';
+                cw_message_sent(line);
+                line_len = 0;
+            }
+            if (chunk[i] != '\n') {
+                line[line_len++] = chunk[i];
+            }
+        }
+    }
 
-    return s;
+    if (line_len) {
+        line[line_len] = '\0';
+        cw_message_sent(line);
+    }
 }
 
 static void cw_psk_task(void __attribute__ ((unused))*pvParameters)
 {
-    int buf_pos = 0;
+    static const uint8_t psk_idle[PSK_IDLE_SYMBOLS] = {0};
 
     while (1) {
         int status = xQueueReceive(cw_msg_queue, &cw_fill_msg_current, portMAX_DELAY);
         if (status == pdTRUE) {
-            size_t cw_psk_buffer_len = 0;
-
             cw_transmit_ongoing = 1;
 
-            if (cw_fill_msg_current.dit_duration == 0) {
+            // The audio playback stops when there is nothing to send
+            audio_resume();
+
+            const int dit_duration = cw_fill_msg_current.dit_duration;
+            const int is_psk = psk_mode_valid(dit_duration);
+            if (dit_duration == 0 ||
+                    (dit_duration < 0 && !is_psk && dit_duration != AFSK_1200)) {
                 // Illegal
                 cw_transmit_ongoing = 0;
                 continue;
             }
-            else if (cw_fill_msg_current.dit_duration > 0) {
-                cw_psk_buffer_len = cw_text_to_on_buffer(
-                        cw_fill_msg_current.message,
-                        cw_psk_buffer,
-                        MAX_ON_BUFFER_LEN);
 
+            cw_psk_omega = 2.0f * FLOAT_PI * cw_fill_msg_current.freq /
+                (float)cw_psk_samplerate;
+
+            if (dit_duration == AFSK_1200) {
+                afsk_init(&cw_afsk_modulator, cw_psk_samplerate);
+            }
+            else if (is_psk) {
+                psk_init(&cw_psk_modulator, dit_duration, cw_psk_omega, cw_psk_samplerate);
+                cw_psk_samples_per_symbol = cw_psk_modulator.samples_per_symbol;
             }
             else {
-                cw_psk_buffer_len = psk_text_to_phase_buffer(
-                        cw_fill_msg_current.message,
-                        cw_psk_buffer);
+                /* CW directly depends on dit_duration, which is in ms */
+                cw_psk_samples_per_symbol = (cw_psk_samplerate * dit_duration) / 1000;
             }
 
-            // Angular frequency of NCO
-            const float omega = 2.0f * FLOAT_PI * cw_fill_msg_current.freq /
-                (float)cw_psk_samplerate;
-
-            const int samples_per_symbol = (cw_fill_msg_current.dit_duration == -1) ?
-                /* BPSK31 is at 31.25 symbols per second. */
-                cw_psk_samplerate * 100 / 3125 :
-                (cw_fill_msg_current.dit_duration == -2) ?
-                /* BPSK63 is at 2*31.25 symbols per second. */
-                cw_psk_samplerate * 50 / 3125 :
-                (cw_fill_msg_current.dit_duration == -3) ?
-                /* BPSK125 is at 4*31.25 symbols per second. */
-                cw_psk_samplerate * 25 / 3125 :
-                /* CW directly depends on dit_duration, which is in ms */
-                (cw_psk_samplerate * cw_fill_msg_current.dit_duration) / 1000;
-
-            psk_current_psk_phase = 1;
-
-            for (int i = 0; i < cw_psk_buffer_len; i++) {
-                for (int t = 0; t < samples_per_symbol; t++) {
-                    int16_t s = (cw_fill_msg_current.dit_duration > 0) ?
-                        cw_generate_audio(omega, i, t) :
-                        psk_generate_audio(omega, i, t, samples_per_symbol);
-
-                    // Stereo
-                    for (int channel = 0; channel < 2; channel++) {
-                        if (buf_pos == AUDIO_BUF_LEN) {
-                            // It should take AUDIO_BUF_LEN/cw_psk_samplerate seconds to send one buffer.
-                            // If it takes more than 4 times as long, we think there is a problem.
-                            const TickType_t reasonable_delay = pdMS_TO_TICKS(4000 * AUDIO_BUF_LEN / cw_psk_samplerate);
-                            if (xQueueSendToBack(cw_audio_queue, &cw_audio_buf, reasonable_delay) != pdTRUE) {
-                                trigger_fault(FAULT_SOURCE_CW_AUDIO_QUEUE);
-                            }
-                            buf_pos = 0;
-                        }
-                        cw_audio_buf[buf_pos++] = s;
-                    }
+            if (is_psk) {
+                cw_psk_send_symbols(psk_idle, PSK_IDLE_SYMBOLS);
+            }
 
+            if (cw_fill_msg_current.source) {
+                cw_psk_send_source(cw_fill_msg_current.source);
+            }
+            else if (cw_fill_msg_current.num_symbols) {
+                cw_psk_send_packed_symbols(
+                        (const uint8_t*)cw_fill_msg_current.message,
+                        cw_fill_msg_current.num_symbols);
+            }
+            else {
+                for (size_t i = 0; i < cw_fill_msg_current.message_len; i++) {
+                    cw_psk_send_char(cw_fill_msg_current.message[i]);
                 }
+            }
 
-                if (cw_psk_buffer[i] == 0) {
-                    psk_current_psk_phase *= -1;
-                }
+            if (is_psk) {
+                cw_psk_send_symbols(psk_idle, PSK_IDLE_SYMBOLS);
             }
 
             // Flush remaining audio buffer
-            if (buf_pos < AUDIO_BUF_LEN) {
-                while (buf_pos < AUDIO_BUF_LEN) {
-                    cw_audio_buf[buf_pos++] = 0;
+            if (cw_audio_buf_pos > 0) {
+                while (cw_audio_buf_pos < AUDIO_BUF_LEN) {
+                    cw_audio_buf[cw_audio_buf_pos++] = 0;
                 }
 
-                const TickType_t reasonable_delay = pdMS_TO_TICKS(4000 * AUDIO_BUF_LEN / cw_psk_samplerate);
-                if (xQueueSendToBack(cw_audio_queue, &cw_audio_buf, reasonable_delay) != pdTRUE) {
-                    trigger_fault(FAULT_SOURCE_CW_AUDIO_QUEUE);
-                }
+                cw_psk_send_audio_buf();
             }
-            buf_pos = 0;
+            cw_audio_buf_pos = 0;
 
             // We have completed this message
             cw_transmit_ongoing = 0;
@@ -609,4 +546,3 @@ int cw_psk_busy(void)
 {
     return cw_transmit_ongoing;
 }
-
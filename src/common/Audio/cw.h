@@ -26,6 +26,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "Audio/psk.h"
 
 // Setup the CW generator to create audio samples at the given
 // samplerate.
@@ -40,13 +41,28 @@ void cw_psk_init(unsigned int samplerate);
 //
 // Supported characters for PSK: 7-bit clean ASCII
 //
-// if dit_duration == -1, message is sent in PSK31
-// if dit_duration == -2, message is sent in PSK63
-// if dit_duration == -3, message is sent in PSK125
+// if dit_duration is one of enum psk_mode_e, message is sent in that PSK
+// mode: -1 PSK31, -2 PSK63, -3 PSK125, -4 PSK250, -5 PSK500, -6 QPSK31,
+// -7 QPSK63, -8 QPSK125
 // otherwise it is sent in CW, with dit_duration in ms
+// AFSK_1200 (-9, see Audio/afsk.h) only applies to cw_psk_push_symbols
 // returns 0 on failure, 1 on success
 int cw_psk_push_message(const char* text, int frequency, int dit_duration);
 
+// Gives the text of a message while it is being sent: writes at most len
+// characters into buf, and returns how many. Returns 0 at the end.
+typedef size_t (*cw_psk_text_source_t)(char *buf, size_t len);
+
+// Append a message whose text is pulled from source during the
+// transmission, without length limit. Same modes as cw_psk_push_message.
+int cw_psk_push_source(cw_psk_text_source_t source, int dit_duration, int frequency);
+
+// Append PSK symbols that are not text, like a telemetry frame, packed most
+// significant bit first. They are modulated like varicode bits, see
+// Audio/psk.h. With AFSK_1200, they are the mark (1) and space (0) tones of
+// an HDLC frame, see Audio/ax25.h. At most 2048 symbols.
+int cw_psk_push_symbols(const uint8_t *symbols, size_t num_symbols, int dit_duration, int frequency);
+
 // Write the waveform into the buffer (stereo), both for cw and psk
 size_t cw_psk_fill_buffer(int16_t *buf, size_t bufsize);
 
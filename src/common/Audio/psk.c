@@ -0,0 +1,121 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "Audio/psk.h"
+#include "Core/common.h"
+
+#ifdef SIMULATOR
+#include <math.h>
+#define arm_cos_f32 cosf
+#define arm_sin_f32 sinf
+#else
+#include "arm_math.h"
+#endif
+
+#define PSK_AMPLITUDE 10000.0f
+
+#define QPSK_POLY_A 0x17
+#define QPSK_POLY_B 0x19
+#define QPSK_CONSTRAINT 5
+
+static const struct {
+    const char *name;
+    // Symbol rate in multiples of 31.25 Bd
+    int rate;
+    int qpsk;
+} psk_modes[] = {
+    {"PSK31", 1, 0},
+    {"PSK63", 2, 0},
+    {"PSK125", 4, 0},
+    {"PSK250", 8, 0},
+    {"PSK500", 16, 0},
+    {"QPSK31", 1, 1},
+    {"QPSK63", 2, 1},
+    {"QPSK125", 4, 1},
+};
+#define NUM_PSK_MODES (sizeof(psk_modes) / sizeof(psk_modes[0]))
+
+// Carrier in quarter turns
+static const float phase_i[4] = {1.0f, 0.0f, -1.0f, 0.0f};
+static const float phase_q[4] = {0.0f, 1.0f, 0.0f, -1.0f};
+
+int psk_mode_valid(int mode)
+{
+    return mode < 0 && -mode <= (int)NUM_PSK_MODES;
+}
+
+const char* psk_mode_name(int mode)
+{
+    return psk_mode_valid(mode) ? psk_modes[-mode - 1].name : "?";
+}
+
+int psk_mode_baud_x100(int mode)
+{
+    return psk_mode_valid(mode) ? 3125 * psk_modes[-mode - 1].rate : 0;
+}
+
+void psk_init(struct psk_modulator *m, int mode, float omega, int samplerate)
+{
+    m->omega = omega;
+    m->nco = 0.0f;
+    m->samples_per_symbol = samplerate * 100 / psk_mode_baud_x100(mode);
+    m->qpsk = psk_modes[-mode - 1].qpsk;
+    m->encoder = 0;
+    m->phase_from = 0;
+    m->phase_to = 0;
+}
+
+void psk_symbol(struct psk_modulator *m, uint8_t bit)
+{
+    int shift;
+    if (m->qpsk) {
+        m->encoder = ((m->encoder << 1) | (bit ? 1 : 0)) & ((1 << QPSK_CONSTRAINT) - 1);
+        const int sym = __builtin_parity(m->encoder & QPSK_POLY_A) |
+            (__builtin_parity(m->encoder & QPSK_POLY_B) << 1);
+        // 0 turns by 180 degrees, 1 by 90, 2 keeps the phase and 3 turns by 270
+        shift = (2 - sym) & 3;
+    }
+    else {
+        shift = bit ? 0 : 2;
+    }
+
+    m->phase_from = m->phase_to;
+    m->phase_to = (m->phase_to + shift) & 3;
+}
+
+int16_t psk_sample(struct psk_modulator *m, int t)
+{
+    const float from = 0.5f +
+        0.5f * arm_cos_f32(FLOAT_PI * (float)t / (float)m->samples_per_symbol);
+    const float i = from * phase_i[m->phase_from] + (1.0f - from) * phase_i[m->phase_to];
+    const float q = from * phase_q[m->phase_from] + (1.0f - from) * phase_q[m->phase_to];
+
+    m->nco += m->omega;
+    if (m->nco > FLOAT_PI) {
+        m->nco -= 2.0f * FLOAT_PI;
+    }
+
+    // A positive phase delays the carrier, as in fldigi
+    return PSK_AMPLITUDE * (i * arm_sin_f32(m->nco) - q * arm_cos_f32(m->nco));
+}
@@ -0,0 +1,83 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* PSK modulator for the BPSK and QPSK modes of Audio/cw.c.
+ *
+ * Every varicode bit gives a phase change: in BPSK, 0 turns the phase by
+ * 180 degrees and 1 keeps it. In QPSK, the bits go through the rate 1/2
+ * convolutional code of PSK31 (K=5, polynomials 0x17 and 0x19), whose two
+ * output bits select a change of 0, 90, 180 or 270 degrees, like fldigi.
+ *
+ * The carrier moves from the phase of the previous symbol to the new one
+ * with a raised cosine over a whole symbol, which limits the bandwidth to
+ * about twice the symbol rate.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// The modes are given as negative dit_duration to Audio/cw.h
+enum psk_mode_e {
+    PSK_BPSK31 = -1,
+    PSK_BPSK63 = -2,
+    PSK_BPSK125 = -3,
+    PSK_BPSK250 = -4,
+    PSK_BPSK500 = -5,
+    PSK_QPSK31 = -6,
+    PSK_QPSK63 = -7,
+    PSK_QPSK125 = -8,
+};
+
+struct psk_modulator {
+    float omega;
+    float nco;
+    int samples_per_symbol;
+    int qpsk;
+    // Last bits given to the convolutional code
+    uint8_t encoder;
+    // Phase at the beginning and at the end of the current symbol, in
+    // quarter turns
+    int phase_from;
+    int phase_to;
+};
+
+// Return 1 if mode is one of enum psk_mode_e
+int psk_mode_valid(int mode);
+
+// Name of the mode as announced in CW, like PSK125 or QPSK63
+const char* psk_mode_name(int mode);
+
+// Symbols per second, times 100
+int psk_mode_baud_x100(int mode);
+
+// Prepare the modulator for a new message, with the carrier at omega
+// radians per sample. The mode must be valid.
+void psk_init(struct psk_modulator *m, int mode, float omega, int samplerate);
+
+// Start the next symbol with one varicode bit
+void psk_symbol(struct psk_modulator *m, uint8_t bit);
+
+// Sample t of the current symbol, t from 0 to samples_per_symbol - 1
+int16_t psk_sample(struct psk_modulator *m, int t);
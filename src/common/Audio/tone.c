@@ -24,7 +24,9 @@
 
 #include "Audio/tone.h"
 #include "Core/common.h"
+#include "Core/power.h"
 #include "GPIO/usart.h"
+#include "Core/log.h"
 
 #include <stdlib.h>
 #include "queue.h"
@@ -116,7 +118,7 @@ static inline void push_dtmf_code(enum dtmf_code code)
     dtmf_sequence[NUM_DTMF_SEQ-1] = code;
 
     if (code != DTMF_NONE) {
-        usart_debug("DTMF: [%s, %s, %s]\r\n",
+        log_msg(AUDIO, LOG_INFO, "DTMF: [%s, %s, %s]\r\n",
                 dtmf_to_str(dtmf_sequence[0]),
                 dtmf_to_str(dtmf_sequence[1]),
                 dtmf_to_str(dtmf_sequence[2]));
@@ -225,12 +227,14 @@ void tone_detector_enable(int enable)
             detectors[det].Q1 = 0;
             detectors[det].Q2 = 0;
         }
+        power_inhibit_stop(POWER_INHIBIT_TONE, 1);
         audio_in_enable(1);
         detectors_enabled = 1;
     }
     else if (!enable && detectors_enabled) {
         audio_in_enable(0);
         detectors_enabled = 0;
+        power_inhibit_stop(POWER_INHIBIT_TONE, 0);
     }
 }
 
@@ -327,20 +331,14 @@ void tone_do_analysis()
 
     analyse_dtmf();
 
-#if PRINT_TONES_STATS
-    static int printcounter = 0;
-    if (++printcounter == 5) {
-        usart_debug("Tones: % 3d % 3d % 3d % 3d % 3d since %d\r\n",
-                normalised_results[0],
-                normalised_results[1],
-                normalised_results[2],
-                normalised_results[3],
-                normalised_results[4],
-                (int)(timestamp_now() - tone_1750_detected_since)
-                );
-
-        printcounter = 0;
-    }
-#endif // PRINT_TONES_STATS
+    // Every analysis block, which only fits the debug port in binary
+    log_bin_msg(AUDIO, LOG_DEBUG, "Tones: % 3d % 3d % 3d % 3d % 3d since %d\r\n",
+            normalised_results[0],
+            normalised_results[1],
+            normalised_results[2],
+            normalised_results[3],
+            normalised_results[4],
+            (int)(timestamp_now() - tone_1750_detected_since)
+            );
 }
 
@@ -0,0 +1,81 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "Core/aprs.h"
+#include "Audio/ax25.h"
+#include <stdio.h>
+
+/* Names are at most 7, 7, 6, 6, 5 characters for the analog values, and
+ * 6, 5, 4, 4 for the bits. The equations give a * x^2 + b * x + c.
+ */
+static const char *definitions[APRS_NUM_DEFINITIONS] = {
+    "PARM.Ubat,Capa,Temp,Charge,Decha,QRP,EolOf,Repl,ROS",
+    "UNIT.V,Ah,degC,A,A,on,open,yes,high",
+    "EQNS.0,0.1,0,0,10,0,0,0.5,-50,0,0.2,0,0,0.2,0",
+    "BITS.11111111,Glutte HB9G",
+};
+
+static int analog(float value)
+{
+    const int x = value + 0.5f;
+    return x < 0 ? 0 : x > 255 ? 255 : x;
+}
+
+size_t aprs_telemetry_info(char *info, size_t len, int seq, const struct aprs_telemetry *t)
+{
+    const int a1 = analog(10.0f * t->voltage);
+    const int a2 = analog(t->capacity_mah / 10000.0f);
+    const int a3 = t->temp_valid ? analog(2.0f * (t->temp + 50.0f)) : 0;
+    const int a4 = t->charge_ma < 0 ? 0 : analog(t->charge_ma / 200.0f);
+    const int a5 = t->discharge_ma < 0 ? 0 : analog(t->discharge_ma / 200.0f);
+
+    const int n = snprintf(info, len, "T#%03d,%03d,%03d,%03d,%03d,%03d,%d%d%d%d0000",
+            seq % 1000, a1, a2, a3, a4, a5,
+            t->qrp ? 1 : 0, t->wind_disconnected ? 1 : 0,
+            t->wind_folded ? 1 : 0, t->swr_high ? 1 : 0);
+    return (n < 0 || (size_t)n >= len) ? 0 : (size_t)n;
+}
+
+size_t aprs_definition_info(char *info, size_t len, int index)
+{
+    if (index < 0 || index >= APRS_NUM_DEFINITIONS) {
+        return 0;
+    }
+
+    // Messages are addressed to a callsign padded to nine characters
+    const int n = snprintf(info, len, ":%-9s:%s", APRS_CALL, definitions[index]);
+    return (n < 0 || (size_t)n >= len) ? 0 : (size_t)n;
+}
+
+size_t aprs_packet_bits(const char *info, uint8_t *bits, size_t bits_size)
+{
+    uint8_t frame[AX25_MAX_FRAME_LEN];
+    const size_t len = ax25_ui_frame(frame, sizeof(frame),
+            APRS_DESTINATION, APRS_CALL, APRS_PATH, info);
+    if (len == 0) {
+        return 0;
+    }
+
+    return ax25_hdlc_bits(frame, len, APRS_PREAMBLE_FLAGS, bits, bits_size);
+}
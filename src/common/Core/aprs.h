@@ -0,0 +1,76 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* APRS telemetry of the relay, sent as AX.25 UI frames, see Audio/ax25.h.
+ *
+ * The telemetry report carries five analog values of 0 to 255 and eight
+ * bits. The PARM, UNIT, EQNS and BITS messages, addressed to the relay
+ * itself, tell the receivers their names and how to scale them. They are
+ * sent with the daily statistics, APRS servers remember them.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define APRS_CALL "HB9G"
+// Experimental software
+#define APRS_DESTINATION "APZGLT"
+#define APRS_PATH "WIDE2-1"
+
+// Flags before the frame, about 130ms to let the receivers detect the carrier
+#define APRS_PREAMBLE_FLAGS 20
+
+#define APRS_NUM_DEFINITIONS 4
+#define APRS_INFO_LEN 80
+
+struct aprs_telemetry {
+    // 0 if unknown
+    float voltage;
+    uint32_t capacity_mah;
+    int temp_valid;
+    float temp;
+    // Battery currents of the coulomb counter, -1 if unknown
+    int32_t charge_ma;
+    int32_t discharge_ma;
+
+    int qrp;
+    int wind_disconnected;
+    // The wind generator is folded out of the wind
+    int wind_folded;
+    int swr_high;
+};
+
+// Write the info field of the telemetry report with sequence number seq,
+// from 0 to 999. Returns its length.
+size_t aprs_telemetry_info(char *info, size_t len, int seq, const struct aprs_telemetry *t);
+
+// Write the info field of the definition message index, from 0 to
+// APRS_NUM_DEFINITIONS - 1. Returns its length.
+size_t aprs_definition_info(char *info, size_t len, int index);
+
+// Write the AFSK bits of the packet from APRS_CALL carrying info, see
+// ax25_hdlc_bits(). Returns the number of bits, 0 if they do not fit.
+size_t aprs_packet_bits(const char *info, uint8_t *bits, size_t bits_size);
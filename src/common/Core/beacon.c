@@ -0,0 +1,86 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "Core/beacon.h"
+
+// Dit duration from dit_high at mah_high down to dit_low at mah_low
+static int interpolate_dit(int32_t mah, int32_t mah_low, int dit_low, int32_t mah_high, int dit_high)
+{
+    if (mah <= mah_low) {
+        return dit_low;
+    }
+    else if (mah >= mah_high) {
+        return dit_high;
+    }
+
+    return dit_low + (int64_t)(dit_high - dit_low) * (mah - mah_low) / (mah_high - mah_low);
+}
+
+void beacon_plan(const struct beacon_input *in, struct beacon_plan *plan)
+{
+    const int low_voltage = in->voltage > 0.0f && in->voltage < BEACON_LOW_VOLTAGE;
+
+    if (!in->qrp) {
+        plan->content = BEACON_CONTENT_FULL;
+        plan->dit_duration = in->soc_valid ?
+            interpolate_dit(in->usable_mah,
+                    CHARGE_QRP, BEACON_DIT_QRP_MS, CHARGE_QRO, BEACON_DIT_QRO_MS) :
+            BEACON_DIT_QRO_MS;
+    }
+    else if (!in->soc_valid || in->usable_mah >= BEACON_LOW_MAH) {
+        plan->content = BEACON_CONTENT_SHORT;
+        plan->dit_duration = in->soc_valid ?
+            interpolate_dit(in->usable_mah,
+                    BEACON_LOW_MAH, BEACON_DIT_MIN_MS, CHARGE_QRP, BEACON_DIT_QRP_MS) :
+            BEACON_DIT_QRP_MS;
+    }
+    else {
+        plan->content = BEACON_CONTENT_MINIMAL;
+        plan->dit_duration = (in->usable_mah < BEACON_CRITICAL_MAH && !in->stats) ?
+            BEACON_PSK_MODE : BEACON_DIT_MIN_MS;
+    }
+
+    if (low_voltage) {
+        plan->content = BEACON_CONTENT_MINIMAL;
+        if (plan->dit_duration > 0) {
+            plan->dit_duration = BEACON_DIT_MIN_MS;
+        }
+    }
+}
+
+uint32_t beacon_energy_mwh(uint32_t tx_ms, int qrp, int32_t tx_rate_mah_h, float voltage)
+{
+    // The transmitter discharges the battery, the fit is negative
+    int32_t current_ma = -tx_rate_mah_h;
+    if (current_ma <= 0) {
+        current_ma = qrp ? BEACON_TX_MA_QRP : BEACON_TX_MA_QRO;
+    }
+
+    if (voltage <= 0.0f) {
+        voltage = BEACON_NOMINAL_VOLTAGE;
+    }
+
+    // mA * ms * V is uWs, 3600000 uWs in one mWh
+    return (uint64_t)tx_ms * current_ma * (uint32_t)(1000.0f * voltage) / 3600000000ull;
+}
@@ -0,0 +1,88 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Beacon policy: the content, the CW speed and the mode of the 2-hour
+ * beacons follow the state of charge, see Core/soc.h.
+ *
+ * Above CHARGE_QRO, the full beacon is sent at BEACON_DIT_QRO_MS, and the
+ * speed increases down to CHARGE_QRP. In QRP, the short beacon speeds up from
+ * BEACON_DIT_QRP_MS to BEACON_DIT_MIN_MS at BEACON_LOW_MAH. Below, only the
+ * call and the voltage are sent, and below BEACON_CRITICAL_MAH they are sent
+ * in PSK, a few seconds instead of ten. The beacon announcing the statistics
+ * stays in CW.
+ *
+ * Without a state of charge, the beacons are those of QRO and QRP. A supply
+ * voltage below BEACON_LOW_VOLTAGE always gives the minimal beacon.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "GPIO/batterycharge.h"
+#include "Audio/psk.h"
+
+#define BEACON_DIT_QRO_MS 110
+#define BEACON_DIT_QRP_MS 70
+// Fastest CW that is still read by ear, about 24 WPM
+#define BEACON_DIT_MIN_MS 50
+
+#define BEACON_LOW_MAH (CHARGE_QRP - 50000)
+#define BEACON_CRITICAL_MAH (CHARGE_QRP - 100000)
+#define BEACON_LOW_VOLTAGE 11.8f
+#define BEACON_PSK_MODE PSK_BPSK125
+
+// Supply current while transmitting, if the state of charge estimator has
+// no fit yet, and supply voltage if not measured
+#define BEACON_TX_MA_QRO 6000
+#define BEACON_TX_MA_QRP 2500
+#define BEACON_NOMINAL_VOLTAGE 12.5f
+
+enum beacon_content {
+    BEACON_CONTENT_FULL,    // Call, locator, voltage, capacity and trend, temperature
+    BEACON_CONTENT_SHORT,   // Call, voltage, capacity, temperature
+    BEACON_CONTENT_MINIMAL, // Call and voltage
+};
+
+struct beacon_input {
+    // QRP, or high SWR: the beacon is sent with low power
+    int qrp;
+    // The beacon announces the statistics in PSK
+    int stats;
+    int soc_valid;
+    int32_t usable_mah;
+    // 0.0f if not measured
+    float voltage;
+};
+
+struct beacon_plan {
+    enum beacon_content content;
+    // Dit duration in ms, or enum psk_mode_e, see Audio/cw.h
+    int dit_duration;
+};
+
+void beacon_plan(const struct beacon_input *in, struct beacon_plan *plan);
+
+// Energy of a transmission of tx_ms, in mWh. tx_rate_mah_h is the fit of
+// the state of charge estimator, 0 if unknown.
+uint32_t beacon_energy_mwh(uint32_t tx_ms, int qrp, int32_t tx_rate_mah_h, float voltage);
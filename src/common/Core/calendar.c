@@ -0,0 +1,141 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "Core/calendar.h"
+
+#define SECONDS_PER_DAY 86400ul
+
+// Local standard time (CET) is UTC+1, summer time (CEST) is UTC+2
+#define LOCAL_TIME_OFFSET 3600ul
+#define DST_OFFSET 3600ul
+
+/* Days since 1970-01-01 for a date in the proleptic gregorian calendar,
+ * month in 1..12. Years start in March for this computation, which places
+ * the leap day at the end of the year.
+ * See http://howardhinnant.github.io/date_algorithms.html
+ */
+static uint32_t days_from_civil(uint32_t year, uint32_t month, uint32_t day)
+{
+    if (month <= 2) {
+        year--;
+    }
+
+    const uint32_t era = year / 400;
+    const uint32_t yoe = year - era * 400;
+    const uint32_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static void civil_from_days(uint32_t days, uint32_t *year, uint32_t *month, uint32_t *day)
+{
+    days += 719468;
+    const uint32_t era = days / 146097;
+    const uint32_t doe = days - era * 146097;
+    const uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const uint32_t mp = (5 * doy + 2) / 153;
+
+    *day = doy - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = yoe + era * 400 + (*month <= 2 ? 1 : 0);
+}
+
+calendar_epoch_t calendar_to_epoch(const struct tm *utc)
+{
+    const uint32_t days = days_from_civil(
+            utc->tm_year + 1900, utc->tm_mon + 1, utc->tm_mday);
+
+    return days * SECONDS_PER_DAY +
+        utc->tm_hour * 3600ul + utc->tm_min * 60ul + utc->tm_sec;
+}
+
+void calendar_from_epoch(calendar_epoch_t epoch, struct tm *t)
+{
+    const uint32_t days = epoch / SECONDS_PER_DAY;
+    uint32_t secs = epoch - days * SECONDS_PER_DAY;
+
+    uint32_t year, month, day;
+    civil_from_days(days, &year, &month, &day);
+
+    t->tm_year = year - 1900;
+    t->tm_mon = month - 1;
+    t->tm_mday = day;
+    t->tm_hour = secs / 3600;
+    secs -= t->tm_hour * 3600;
+    t->tm_min = secs / 60;
+    t->tm_sec = secs - t->tm_min * 60;
+    // 1970-01-01 was a Thursday
+    t->tm_wday = (days + 4) % 7;
+    t->tm_yday = days - days_from_civil(year, 1, 1);
+    t->tm_isdst = 0;
+}
+
+/* The transitions of the most recently used year. Concurrent callers can only
+ * disagree about the year around New Year, where the DST decision is 0 for
+ * both candidate years. Fields are written transitions first, so that a
+ * reader seeing a new year_begin also sees its transitions.
+ */
+static volatile struct {
+    calendar_epoch_t year_begin;
+    calendar_epoch_t year_end;
+    calendar_epoch_t dst_begin;
+    calendar_epoch_t dst_end;
+} dst_cache;
+
+// Epoch of 01:00 UTC on the last Sunday of the given month (31 days long)
+static calendar_epoch_t last_sunday_transition(uint32_t year, uint32_t month)
+{
+    const uint32_t days_last = days_from_civil(year, month, 31);
+    const uint32_t wday_last = (days_last + 4) % 7;
+    return (days_last - wday_last) * SECONDS_PER_DAY + 3600ul;
+}
+
+static void dst_cache_fill(calendar_epoch_t utc)
+{
+    uint32_t year, month, day;
+    civil_from_days(utc / SECONDS_PER_DAY, &year, &month, &day);
+
+    dst_cache.dst_begin = last_sunday_transition(year, 3);
+    dst_cache.dst_end = last_sunday_transition(year, 10);
+    dst_cache.year_end = days_from_civil(year + 1, 1, 1) * SECONDS_PER_DAY;
+    dst_cache.year_begin = days_from_civil(year, 1, 1) * SECONDS_PER_DAY;
+}
+
+int calendar_is_dst(calendar_epoch_t utc)
+{
+    if (utc < dst_cache.year_begin || utc >= dst_cache.year_end) {
+        dst_cache_fill(utc);
+    }
+
+    return (utc >= dst_cache.dst_begin && utc < dst_cache.dst_end) ? 1 : 0;
+}
+
+void calendar_utc_to_local(calendar_epoch_t utc, struct tm *local)
+{
+    const int dst = calendar_is_dst(utc);
+
+    calendar_from_epoch(utc + LOCAL_TIME_OFFSET + (dst ? DST_OFFSET : 0), local);
+    local->tm_isdst = dst;
+}
@@ -0,0 +1,55 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Integer calendar arithmetic, without mktime().
+ *
+ * Time is represented as seconds since 1970-01-01 00:00:00 UTC in an
+ * unsigned 32-bit integer, which is valid until 2106. All conversions run in
+ * constant time. The daylight saving time transitions (EU rules) are computed
+ * once per year and cached.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+typedef uint32_t calendar_epoch_t;
+
+// Convert a UTC struct tm (fields in their normal ranges, tm_year >= 70)
+// to seconds since the epoch. tm_wday, tm_yday and tm_isdst are ignored.
+calendar_epoch_t calendar_to_epoch(const struct tm *utc);
+
+// Fill all fields of a struct tm from seconds since the epoch.
+// tm_isdst is set to 0.
+void calendar_from_epoch(calendar_epoch_t epoch, struct tm *t);
+
+// Return 1 if the instant is in central european summer time, 0 otherwise.
+// DST runs from 01:00 UTC on the last Sunday in March to 01:00 UTC on the
+// last Sunday in October.
+int calendar_is_dst(calendar_epoch_t utc);
+
+// Convert a UTC instant to swiss local time (CET/CEST), tm_isdst is set
+// accordingly.
+void calendar_utc_to_local(calendar_epoch_t utc, struct tm *local);
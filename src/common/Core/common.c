@@ -24,212 +24,139 @@
 
 #include "Core/common.h"
 #include "GPIO/usart.h"
+#include "Core/log.h"
 #include "FreeRTOS.h"
-#include "timers.h"
+#include "task.h"
 #include "GPS/gps.h"
+#include "GPS/pps.h"
+#include "Core/calendar.h"
+#include "Core/rtc.h"
 #include <time.h>
 #include <math.h>
 
-static uint64_t common_timestamp = 0; // milliseconds since startup
-static TimerHandle_t common_timer;
-
 // The LFSR is used as random number generator
 static const uint16_t lfsr_start_state = 0x12ABu;
 static uint16_t lfsr;
 
-static void common_increase_timestamp(TimerHandle_t t);
-
-struct tm last_derived_time;
+// Last GPS time, and the timestamp_now_us() at the start of that second,
+// used to derive time between and after GPS messages. Several tasks read
+// the time, these are only accessed in critical sections.
+static calendar_epoch_t last_derived_epoch = 0;
 static uint64_t last_derived_time_timestamp = 0;
-int last_derived_time_valid = 0;
-int last_derived_time_delta_applied = 0;
-
-
-#ifdef SIMULATOR
-long timestamp_delta = 0;
-#endif
-
-int find_last_sunday(const struct tm* time) {
-    struct tm t = *time;
-
-    // the last sunday can never be before the 20th
-    t.tm_mday = 20;
-
-    int last_sunday = 1;
-
-    while (t.tm_mon == time->tm_mon) {
-        t.tm_mday++;
-        if (mktime(&t) == (time_t)-1) {
-            return -1;
-        }
-
-        const int sunday = 0;
-        if (t.tm_wday == sunday) {
-            last_sunday = t.tm_mday;
-        }
+static int last_derived_time_valid = 0;
+// Set once the derived time comes from the GPS instead of the RTC
+static int last_derived_time_from_gps = 0;
+
+// The RTC is set from GPS at the first fix, and then every hour. Only
+// accessed by local_time_sync_rtc().
+#define RTC_SYNC_INTERVAL_US (3600ull * 1000000ull)
+static uint64_t last_rtc_sync_timestamp = 0;
+static int rtc_synced = 0;
+
+// Return 0 if there is no derived time yet
+static int derived_epoch(calendar_epoch_t *utc, int *from_gps)
+{
+    taskENTER_CRITICAL();
+    const int valid = last_derived_time_valid;
+    const calendar_epoch_t epoch = last_derived_epoch;
+    const uint64_t timestamp = last_derived_time_timestamp;
+    if (from_gps) {
+        *from_gps = last_derived_time_from_gps;
     }
+    taskEXIT_CRITICAL();
 
-    return last_sunday;
-}
-
-/* Calculate if we are in daylight saving time.
- * return  0 if false
- *         1 if true
- *        -1 in case of error
- */
-static int is_dst(const struct tm *time) {
-    /* DST from 01:00 UTC on last Sunday in March
-     *     to   01:00 UTC on last Sunday in October
-     */
-    const int march = 2;
-    const int october = 9;
-    if (time->tm_mon < march) {
-        return 0;
-    }
-    else if (time->tm_mon == march) {
-        int last_sunday = find_last_sunday(time);
-        if (last_sunday == -1) return -1;
-
-        if (time->tm_mday < last_sunday) {
-            return 0;
-        }
-        else if (time->tm_mday == last_sunday) {
-            return (time->tm_hour < 1) ?  0 : 1;
-        }
-        else {
-            return 1;
-        }
-    }
-    else if (time->tm_mon > march && time->tm_mon < october) {
-        return 1;
-    }
-    else if (time->tm_mon == october) {
-        int last_sunday = find_last_sunday(time);
-        if (last_sunday == -1) return -1;
-
-        if (time->tm_mday < last_sunday) {
-            return 1;
-        }
-        else if (time->tm_mday == last_sunday) {
-            return (time->tm_hour < 1) ? 1 : 0;
-        }
-        else {
-            return 0;
-        }
-    }
-    else {
+    if (!valid) {
         return 0;
     }
+
+    const uint64_t elapsed_us =
+        pps_correct_interval_us(timestamp_now_us() - timestamp);
+
+    *utc = epoch + (calendar_epoch_t)(elapsed_us / 1000000ull);
+    return 1;
 }
 
 int local_time(struct tm *time) {
-    const int local_time_offset = 1; // hours
-
     int num_sv_used = 0;
-    int valid = gps_utctime(time, &num_sv_used);
+    uint64_t received_us = 0;
+    const int valid = gps_utctime_received(time, &num_sv_used, &received_us);
 
     if (valid) {
-        time->tm_hour += local_time_offset;
-
-        const int dst = is_dst(time);
-        if (dst == -1) {
-            usart_debug("mktime fail for dst %d-%d-%d %d:%d:%d "
-                    "dst %d wday %d yday %d\r\n",
-                    time->tm_year + 1900, time->tm_mon + 1, time->tm_mday,
-                    time->tm_hour, time->tm_min, time->tm_sec,
-                    time->tm_isdst, time->tm_wday, time->tm_yday);
-        }
-        else if (dst == 1) {
-            time->tm_hour++;
-            time->tm_isdst = 1;
-        }
-
-        // Let mktime fix the struct tm *time
-        if (mktime(time) == (time_t)-1) {
-            usart_debug("mktime fail for local_time %d-%d-%d %d:%d:%d "
-                    "dst %d wday %d yday %d\r\n",
-                    time->tm_year + 1900, time->tm_mon + 1, time->tm_mday,
-                    time->tm_hour, time->tm_min, time->tm_sec,
-                    time->tm_isdst, time->tm_wday, time->tm_yday);
-            valid = 0;
-        }
-
-        if (valid) {
-            last_derived_time = *time;
-            last_derived_time_timestamp = timestamp_now();
-            last_derived_time_valid = 1;
-            last_derived_time_delta_applied = 0;
-        }
-
+        // The GPS time refers to the PPS edge that precedes the message.
+        // Without PPS, the reception time is the best we have.
+        const uint64_t edge_us = pps_edge_before(received_us);
+        const calendar_epoch_t gps_epoch = calendar_to_epoch(time);
+
+        taskENTER_CRITICAL();
+        last_derived_epoch = gps_epoch;
+        last_derived_time_timestamp = edge_us ? edge_us : received_us;
+        last_derived_time_valid = 1;
+        last_derived_time_from_gps = 1;
+        taskEXIT_CRITICAL();
+
+        calendar_epoch_t utc = gps_epoch;
+        derived_epoch(&utc, NULL);
+        calendar_utc_to_local(utc, time);
     }
 
     return valid;
 }
 
 int local_derived_time(struct tm *time) {
-
-    if (last_derived_time_valid == 0) {
+    calendar_epoch_t utc;
+    if (!derived_epoch(&utc, NULL)) {
         return 0;
     }
 
-    // As there is a GPS timeout, local_time will think he has valid GPS data for GPS_MS_TIMEOUT. We need to remove it for better calculations.
-    if (last_derived_time_delta_applied == 0) {
-        last_derived_time_delta_applied = 1;
-        last_derived_time_timestamp -= GPS_MS_TIMEOUT;
-    }
+    calendar_utc_to_local(utc, time);
 
-    uint64_t new_timestamp = timestamp_now();
+    return 1;
+}
 
-    while (new_timestamp - last_derived_time_timestamp > 1000) {
-        last_derived_time.tm_sec += 1;
-        last_derived_time_timestamp += 1000;
+void local_time_sync_rtc(void)
+{
+    calendar_epoch_t utc;
+    int from_gps = 0;
+    if (!derived_epoch(&utc, &from_gps) || !from_gps) {
+        return;
     }
 
-    mktime(&last_derived_time);
-
-    *time = last_derived_time;
-
-    return 1;
-
+    const uint64_t now = timestamp_now_us();
+    if (!rtc_synced || now - last_rtc_sync_timestamp > RTC_SYNC_INTERVAL_US) {
+        rtc_set_utc(utc);
+        rtc_synced = 1;
+        last_rtc_sync_timestamp = now;
+    }
 }
 
 
 void common_init(void)
 {
-    common_timer = xTimerCreate("Timer",
-            pdMS_TO_TICKS(8),
-            pdTRUE, // Auto-reload
-            NULL,   // No unique id
-            common_increase_timestamp
-            );
-
-    xTimerStart(common_timer, 0);
-
     lfsr = lfsr_start_state;
-}
 
-static void common_increase_timestamp(TimerHandle_t __attribute__ ((unused))t)
-{
-
-#ifdef SIMULATOR
-    struct timespec ctime;
+    rtc_init();
 
-    clock_gettime(CLOCK_REALTIME, &ctime);
-    common_timestamp = ctime.tv_sec * 1000 + ctime.tv_nsec / 1.0e6 - timestamp_delta;
+    // Start with the RTC time until GPS is available
+    calendar_epoch_t utc;
+    if (rtc_get_utc(&utc)) {
+        last_derived_epoch = utc;
+        last_derived_time_timestamp = timestamp_now_us();
+        last_derived_time_valid = 1;
 
-    if (timestamp_delta == 0) {
-        timestamp_delta = common_timestamp;
-        common_timestamp = 0;
+        struct tm t;
+        calendar_from_epoch(utc, &t);
+        log_msg(CORE, LOG_INFO, "RTC %04d-%02d-%02d %02d:%02d:%02d UTC\r\n",
+                t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
+                t.tm_hour, t.tm_min, t.tm_sec);
+    }
+    else {
+        log_msg(CORE, LOG_WARNING, "RTC not set\r\n");
     }
-
-#else
-    common_timestamp += 8;
-#endif
 }
 
 uint64_t timestamp_now(void)
 {
-    return common_timestamp; // ms
+    return timestamp_now_us() / 1000; // ms
 }
 
 
@@ -250,6 +177,7 @@ static int faultsource = 0;
 void trigger_fault(int source)
 {
     usart_debug("Fatal: %d\r\n\r\n", source);
+    usart_debug_flush();
 
     __disable_irq();
 
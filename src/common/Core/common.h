@@ -35,10 +35,18 @@
 
 void common_init(void);
 
+// Start the hardware timer behind timestamp_now_us(), before the scheduler
+// starts. Implemented separately for the glutt-o-logique and the simulator.
+void timestamp_init(void);
+
 // Return the current timestamp in milliseconds. Timestamps are monotonic, and not
 // wall clock time.
 uint64_t timestamp_now(void);
 
+// Return the current timestamp in microseconds, same time base as timestamp_now().
+// Can be called from interrupts.
+uint64_t timestamp_now_us(void);
+
 // Calculate local time from GPS time, including daylight saving time
 // Return 1 on success, 0 on failure
 // A call to this function will invalidate the information inside 'time'
@@ -49,6 +57,10 @@ int local_time(struct tm *time);
 // Return 1 on success, 0 on failure
 int local_derived_time(struct tm *time);
 
+// Set the RTC from the GPS derived time, at the first fix and then every
+// hour. Must always be called from the same task, the GPS monitor.
+void local_time_sync_rtc(void);
+
 // Return either 0 or 1, somewhat randomly
 int random_bool(void);
 
@@ -66,12 +78,13 @@ int random_bool(void);
 #define FAULT_SOURCE_CW_QUEUE 11
 void trigger_fault(int source);
 
-int find_last_sunday(const struct tm*);
-
 #ifdef SIMULATOR
 void __disable_irq(void);
 #else
 void hard_fault_handler_c(uint32_t *);
+
+// Advance timestamp_now_us() by the time TIM2 was stopped in STOP mode
+void timestamp_compensate_stop(uint32_t stopped_us);
 #endif
 
 // Round a value to the nearest 0.5
@@ -0,0 +1,44 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Cyclic redundancy checks of the stored and transmitted data */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CRC32_INIT 0xFFFFFFFFul
+
+/* CRC-32 of IEEE 802.3, with a table of 16 entries. Start with CRC32_INIT,
+ * give the result of the previous call to continue, and invert the result
+ * at the end.
+ */
+uint32_t crc32_update(uint32_t crc, const void *data, size_t len);
+
+// Complete CRC-32 of a buffer
+uint32_t crc32(const void *data, size_t len);
+
+// CRC-16 of X.25, the frame check sequence of HDLC and AX.25
+uint16_t crc16_x25(const void *data, size_t len);
@@ -0,0 +1,220 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "Core/energy.h"
+#include "Core/store.h"
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+
+#define NOMINAL_VOLTAGE 12.5f
+
+/* Accumulated since energy_clear(). Change the version when the layout
+ * changes, older records are then ignored.
+ */
+#define ENERGY_STORE_VERSION 1
+struct energy_totals {
+    uint32_t version;
+    // Time in each state, by [qrp][tx_on]
+    uint32_t state_ms[_NUM_FSM_STATES][2][2];
+    // Capacity drop while not charging in mAh mV, and the estimate over the
+    // same intervals in mW ms
+    uint64_t measured_mah_mv;
+    uint64_t estimated_mw_ms;
+};
+
+static struct energy_totals totals;
+// Not on the stack of the calling task
+static struct energy_totals persistent;
+
+// State of the previous energy_account()
+static uint64_t last_ms = 0;
+static fsm_state_t last_state = FSM_OISIF;
+static int last_tx_on = 0;
+static int last_qrp = 0;
+
+// Estimate since the previous capacity, for the cross check
+static uint64_t pending_mw_ms = 0;
+static uint32_t last_capacity_mah = 0;
+static int last_charging = -1;
+
+static uint32_t power_mw(int qrp, int tx_on)
+{
+    if (!tx_on) {
+        return ENERGY_IDLE_MW;
+    }
+    return qrp ? ENERGY_TX_MW_QRP : ENERGY_TX_MW_QRO;
+}
+
+static enum energy_group group_of(fsm_state_t state)
+{
+    if (state >= FSM_BALISE_LONGUE && state <= FSM_BALISE_APRS) {
+        return ENERGY_BEACONS;
+    }
+    else if (state == FSM_OISIF) {
+        return ENERGY_IDLE;
+    }
+    return ENERGY_QSO;
+}
+
+// mW ms of a state, called in a critical section
+static uint64_t state_mw_ms(fsm_state_t state, int qrp)
+{
+    uint64_t total = 0;
+    for (int q = 0; q < 2; q++) {
+        if (qrp != -1 && qrp != q) {
+            continue;
+        }
+        for (int tx = 0; tx < 2; tx++) {
+            total += (uint64_t)totals.state_ms[state][q][tx] * power_mw(q, tx);
+        }
+    }
+    return total;
+}
+
+static uint32_t mw_ms_to_mwh(uint64_t mw_ms)
+{
+    return mw_ms / 3600000ull;
+}
+
+void energy_clear(void)
+{
+    taskENTER_CRITICAL();
+    memset(&totals, 0, sizeof(totals));
+    taskEXIT_CRITICAL();
+}
+
+void energy_account(uint64_t now_ms, fsm_state_t state, int tx_on, int qrp)
+{
+    taskENTER_CRITICAL();
+    if (last_ms != 0 && now_ms > last_ms) {
+        uint64_t interval = now_ms - last_ms;
+        if (interval > ENERGY_MAX_INTERVAL_MS) {
+            interval = ENERGY_MAX_INTERVAL_MS;
+        }
+
+        totals.state_ms[last_state][last_qrp][last_tx_on] += interval;
+        pending_mw_ms += interval * power_mw(last_qrp, last_tx_on);
+    }
+
+    last_ms = now_ms;
+    last_state = ((int)state >= 0 && state < _NUM_FSM_STATES) ? state : FSM_OISIF;
+    last_tx_on = tx_on ? 1 : 0;
+    last_qrp = qrp ? 1 : 0;
+    taskEXIT_CRITICAL();
+}
+
+void energy_capacity(uint32_t capacity_mah, int charging, float voltage)
+{
+    if (voltage <= 0.0f) {
+        voltage = NOMINAL_VOLTAGE;
+    }
+
+    taskENTER_CRITICAL();
+    if (capacity_mah == 0) {
+        // Restart the interval with the next capacity
+        last_capacity_mah = 0;
+        pending_mw_ms = 0;
+    }
+    else if (capacity_mah != last_capacity_mah) {
+        /* The capacity changes by steps: the interval goes from one change
+         * to the next, and only counts if the battery was not charged
+         * during the whole of it.
+         */
+        if (last_capacity_mah != 0 && last_charging == 0 && charging == 0 &&
+                capacity_mah < last_capacity_mah) {
+            totals.measured_mah_mv += (uint64_t)(last_capacity_mah - capacity_mah) *
+                (uint32_t)(1000.0f * voltage);
+            totals.estimated_mw_ms += pending_mw_ms;
+        }
+        last_capacity_mah = capacity_mah;
+        last_charging = charging;
+        pending_mw_ms = 0;
+    }
+    else if (charging != 0) {
+        last_charging = charging;
+    }
+    taskEXIT_CRITICAL();
+}
+
+uint32_t energy_state_mwh(fsm_state_t state, int qrp)
+{
+    if ((int)state < 0 || state >= _NUM_FSM_STATES) {
+        return 0;
+    }
+
+    taskENTER_CRITICAL();
+    const uint64_t mw_ms = state_mw_ms(state, qrp);
+    taskEXIT_CRITICAL();
+
+    return mw_ms_to_mwh(mw_ms);
+}
+
+uint32_t energy_group_mwh(enum energy_group group, int qrp)
+{
+    uint64_t mw_ms = 0;
+
+    taskENTER_CRITICAL();
+    for (int s = 0; s < _NUM_FSM_STATES; s++) {
+        if (group_of(s) == group) {
+            mw_ms += state_mw_ms(s, qrp);
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return mw_ms_to_mwh(mw_ms);
+}
+
+int energy_cross_check(uint32_t *measured_mwh, uint32_t *estimated_mwh)
+{
+    taskENTER_CRITICAL();
+    *measured_mwh = totals.measured_mah_mv / 1000;
+    *estimated_mwh = mw_ms_to_mwh(totals.estimated_mw_ms);
+    taskEXIT_CRITICAL();
+
+    return *measured_mwh != 0 || *estimated_mwh != 0;
+}
+
+int energy_save(void)
+{
+    taskENTER_CRITICAL();
+    persistent = totals;
+    taskEXIT_CRITICAL();
+
+    persistent.version = ENERGY_STORE_VERSION;
+    return store_write(STORE_KEY_ENERGY, &persistent, sizeof(persistent));
+}
+
+int energy_restore(void)
+{
+    if (store_read(STORE_KEY_ENERGY, &persistent, sizeof(persistent)) != sizeof(persistent) ||
+            persistent.version != ENERGY_STORE_VERSION) {
+        return 0;
+    }
+
+    taskENTER_CRITICAL();
+    totals = persistent;
+    taskEXIT_CRITICAL();
+    return 1;
+}
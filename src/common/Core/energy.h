@@ -0,0 +1,82 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Energy accounting of the relay behaviours.
+ *
+ * The time spent in each FSM state is integrated, with the TX on or off,
+ * in QRP or QRO. The energy of a state is estimated from the supply power
+ * figures below. The states are grouped into beacons, QSO and idle for the
+ * daily report.
+ *
+ * The estimate is checked against the coulomb counter: while the battery
+ * is not charged, its capacity drop is the consumption of the relay, which
+ * is compared with the estimate over the same intervals.
+ *
+ * The totals are cleared with the other statistics, once they are sent.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "Core/fsm.h"
+
+// Supply power with the TX on and off, in mW
+#define ENERGY_TX_MW_QRO 75000
+#define ENERGY_TX_MW_QRP 31000
+#define ENERGY_IDLE_MW 3000
+
+// Longest interval accounted at once, anything longer is a stall
+#define ENERGY_MAX_INTERVAL_MS 10000
+
+enum energy_group {
+    ENERGY_BEACONS,
+    ENERGY_QSO,
+    ENERGY_IDLE,
+    ENERGY_NUM_GROUPS,
+};
+
+void energy_clear(void);
+
+// Account the time since the previous call to the state given then, and
+// remember the state until the next call. Called at every FSM update.
+void energy_account(uint64_t now_ms, fsm_state_t state, int tx_on, int qrp);
+
+// Give the capacity of the coulomb counter, 0 if unknown, and whether the
+// battery is being charged: 1 yes, 0 no, -1 unknown. The voltage converts
+// the capacity into energy, 0.0f if not measured.
+void energy_capacity(uint32_t capacity_mah, int charging, float voltage);
+
+// Estimated energy of a state, or of a group, in mWh. qrp -1 for both QRP
+// and QRO.
+uint32_t energy_state_mwh(fsm_state_t state, int qrp);
+uint32_t energy_group_mwh(enum energy_group group, int qrp);
+
+// Give the measured and estimated consumption while not charging, in mWh.
+// Returns 0 if there was no such interval.
+int energy_cross_check(uint32_t *measured_mwh, uint32_t *estimated_mwh);
+
+// Keep the totals since energy_clear() in the store across resets, see
+// Core/store.h. Return 1 on success.
+int energy_save(void);
+int energy_restore(void);
@@ -0,0 +1,48 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Internal flash sectors reserved for the persistent store, see
+ * Core/store.h. The linker script keeps the program out of them.
+ *
+ * The sectors are 16kB, erasing one takes about 250ms, during which the
+ * processor cannot fetch from the flash. Programming is done per 32-bit
+ * word, and can only clear bits.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define FLASH_STORE_SECTORS 2
+#define FLASH_STORE_SECTOR_LEN (16 * 1024)
+#define FLASH_STORE_SECTOR_WORDS (FLASH_STORE_SECTOR_LEN / 4)
+
+// Erase one sector, all bits read 1 afterwards. Return 1 on success.
+int flash_store_erase(int sector);
+
+// Program num_words words at word offset of the sector. Return 1 on success.
+int flash_store_program(int sector, uint32_t offset, const uint32_t *words, uint32_t num_words);
+
+// Contents of a sector, for reading
+const uint32_t *flash_store_sector(int sector);
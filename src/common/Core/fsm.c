@@ -28,6 +28,12 @@
 #include "Core/common.h"
 #include "Core/fsm.h"
 #include "Core/stats.h"
+#include "Core/telemetry.h"
+#include "Core/aprs.h"
+#include "Core/beacon.h"
+#include "Core/energy.h"
+#include "Core/soc.h"
+#include "Audio/afsk.h"
 #include "GPIO/usart.h"
 #include "GPIO/temperature.h"
 #include "GPIO/batterycharge.h"
@@ -75,6 +81,31 @@ static void balise_message_clear(void)
 // Some time to ensure we don't cut off the last letter
 #define CW_POSTDELAY "  "
 
+/* PSK modes of the statistics, see enum psk_mode_e. The text is for the
+ * listeners, the telemetry frame is sent in QRP and decoded by software.
+ */
+#define STATS_TEXT_PSK_MODE PSK_BPSK125
+#define STATS_TELEMETRY_PSK_MODE PSK_BPSK250
+
+// Decided when the statistics are announced in CW
+static int stats_telemetry = 0;
+
+// Content and speed of the current 2-hour beacon, see Core/beacon.h
+static struct beacon_plan beacon = {
+    .content = BEACON_CONTENT_FULL,
+    .dit_duration = BEACON_DIT_QRO_MS,
+};
+// Start of the transmission of the current beacon, for its energy
+static uint64_t beacon_start_ms = 0;
+
+/* APRS packets sent after the 2-hour beacons: the telemetry report, and
+ * after the statistics the definitions of its values.
+ */
+static int aprs_packet = 0;
+static int aprs_num_packets = 0;
+static int aprs_sequence = 0;
+static uint8_t aprs_bits[256];
+
 // The counter (up to 20 minutes) for the short balise
 static int short_beacon_counter_s = 0;
 static uint64_t short_beacon_counter_last_update = 0;
@@ -104,6 +135,10 @@ void fsm_init() {
     qso_info.qso_start_time = timestamp_now();
 }
 
+int fsm_idle(void) {
+    return current_state == FSM_OISIF && sstv_state == SSTV_FSM_OFF;
+}
+
 // Calculate the time spent in the current state
 static uint64_t fsm_current_state_time_ms(void) {
     return timestamp_now() - timestamp_state[current_state];
@@ -137,6 +172,7 @@ static const char* state_name(fsm_state_t state) {
         case FSM_BALISE_SPECIALE_STATS3: return "FSM_BALISE_SPECIALE_STATS3";
         case FSM_BALISE_COURTE: return "FSM_BALISE_COURTE";
         case FSM_BALISE_COURTE_OPEN: return "FSM_BALISE_COURTE_OPEN";
+        case FSM_BALISE_APRS: return "FSM_BALISE_APRS";
         default: return "ERROR!";
     }
 }
@@ -209,6 +245,119 @@ static const char* fsm_select_letter(void) {
     return letter_all_ok;
 }
 
+static int is_beacon_state(fsm_state_t state) {
+    return state >= FSM_BALISE_LONGUE && state <= FSM_BALISE_APRS;
+}
+
+static void beacon_choose(int qrp, int stats) {
+    struct soc_estimate soc;
+    soc_get_estimate(&soc);
+
+    const struct beacon_input in = {
+        .qrp = qrp,
+        .stats = stats,
+        .soc_valid = soc.valid,
+        .usable_mah = soc.usable_mah,
+        .voltage = analog_measure_12v(),
+    };
+    beacon_plan(&in, &beacon);
+}
+
+// Write the 2-hour beacon with the content of the plan into balise_message
+static void beacon_build_message(const char *eol_info) {
+    const float supply_voltage = round_float_to_half_steps(analog_measure_12v());
+    const int supply_decivolts = supply_voltage * 10.0f;
+
+    size_t len = 0;
+    len += snprintf(balise_message + len, BALISE_MESSAGE_LEN-len-1,
+            CW_PREDELAY CALL "%s U %dV%01d ",
+            beacon.content == BEACON_CONTENT_FULL ? " JN36BK " : "",
+            supply_decivolts / 10,
+            supply_decivolts % 10);
+
+    if (beacon.content != BEACON_CONTENT_MINIMAL) {
+        const uint32_t capacity_bat_mah = batterycharge_retrieve_last_capacity();
+        const int capacity_bat_ah = capacity_bat_mah / 1000;
+
+        if (capacity_bat_ah != 0 && beacon.content == BEACON_CONTENT_FULL) {
+            // = means same battery capacity as previous
+            // + means higher
+            // - means lower
+            char supply_trend = '=';
+            if (last_battery_capacity_ah < capacity_bat_ah) {
+                supply_trend = '+';
+            }
+            else if (last_battery_capacity_ah > capacity_bat_ah) {
+                supply_trend = '-';
+            }
+            last_battery_capacity_ah = capacity_bat_ah;
+
+            len += snprintf(balise_message + len, BALISE_MESSAGE_LEN-len-1,
+                    " %d AH %c ", capacity_bat_ah, supply_trend);
+        }
+        else if (capacity_bat_ah != 0) {
+            len += snprintf(balise_message + len, BALISE_MESSAGE_LEN-len-1,
+                    " %d AH ", capacity_bat_ah);
+        }
+
+        float temp = 0;
+        if (temperature_get(&temp)) {
+            len += snprintf(balise_message + len, BALISE_MESSAGE_LEN-len-1,
+                    " T %d ",
+                    (int)(round_float_to_half_steps(temp)));
+        }
+    }
+
+    snprintf(balise_message + len, BALISE_MESSAGE_LEN-len-1,
+            "%s" CW_POSTDELAY,
+            eol_info);
+}
+
+static void beacon_account_energy(void) {
+    struct soc_estimate soc;
+    soc_get_estimate(&soc);
+
+    const uint32_t tx_ms = timestamp_now() - beacon_start_ms;
+    stats_beacon_energy(beacon_energy_mwh(tx_ms, fsm_in.qrp,
+                soc.valid ? soc.tx_rate_mah_h : 0, analog_measure_12v()));
+}
+
+// Start the APRS packets, with the definitions after the statistics
+static void aprs_begin(int with_definitions) {
+    aprs_packet = 0;
+    aprs_num_packets = 1 + (with_definitions ? APRS_NUM_DEFINITIONS : 0);
+}
+
+// Write the bits of the current APRS packet into aprs_bits, returns their number
+static size_t aprs_build_packet(void) {
+    char info[APRS_INFO_LEN];
+
+    if (aprs_packet == 0) {
+        struct batterycharge_telemetry charge;
+        batterycharge_telemetry(&charge);
+
+        struct aprs_telemetry t = {
+            .voltage = analog_measure_12v(),
+            .capacity_mah = batterycharge_retrieve_last_capacity(),
+            .charge_ma = charge.charge_updated ? charge.charge_ma : -1,
+            .discharge_ma = charge.discharge_updated ? charge.discharge_ma : -1,
+            .qrp = fsm_in.qrp,
+            .wind_disconnected = batterycharge_wind_disconnected() == 1,
+            .wind_folded = !fsm_in.wind_generator_ok,
+            .swr_high = fsm_in.swr_high,
+        };
+        t.temp_valid = temperature_get(&t.temp);
+
+        aprs_telemetry_info(info, sizeof(info), aprs_sequence, &t);
+        aprs_sequence = (aprs_sequence + 1) % 1000;
+    }
+    else {
+        aprs_definition_info(info, sizeof(info), aprs_packet - 1);
+    }
+
+    return aprs_packet_bits(info, aprs_bits, 8 * sizeof(aprs_bits));
+}
+
 
 void fsm_update() {
 
@@ -474,15 +623,15 @@ void fsm_update() {
         case FSM_BALISE_STATS1:
             fsm_out.tx_on = 1;
             fsm_out.msg_frequency   = 588;
-            fsm_out.cw_dit_duration = 110;
 
-            {
-                const float supply_voltage = round_float_to_half_steps(analog_measure_12v());
-                const int supply_decivolts = supply_voltage * 10.0f;
+            if (balise_message_empty()) {
+                const int stats = current_state == FSM_BALISE_STATS1;
 
                 const char *eol_info = "73";
-                if (current_state == FSM_BALISE_STATS1) {
-                    eol_info = "PSK125";
+                if (stats) {
+                    stats_telemetry = fsm_in.qrp;
+                    eol_info = psk_mode_name(stats_telemetry ?
+                            STATS_TELEMETRY_PSK_MODE : STATS_TEXT_PSK_MODE);
                 }
                 else if (batterycharge_wind_disconnected() == 1) {
                     eol_info = "EOL \\"; // backslash is <SK>
@@ -491,64 +640,25 @@ void fsm_update() {
                     eol_info = "\\"; // backslash is <SK>
                 }
 
-                if (balise_message_empty()) {
-                    const uint32_t capacity_bat_mah = batterycharge_retrieve_last_capacity();
-                    const int capacity_bat_ah = capacity_bat_mah / 1000;
-
-                    char supply_trend = '=';
-                    if (capacity_bat_ah) {
-                        // = means same battery capacity as previous
-                        // + means higher
-                        // - means lower
-                        if (last_battery_capacity_ah < capacity_bat_ah) {
-                            supply_trend = '+';
-                        }
-                        else if (last_battery_capacity_ah > capacity_bat_ah) {
-                            supply_trend = '-';
-                        }
-
-                        last_battery_capacity_ah = capacity_bat_ah;
-                    }
-
-                    size_t len = 0;
-
-                    len += snprintf(balise_message + len, BALISE_MESSAGE_LEN-len-1,
-                            CW_PREDELAY CALL " JN36BK  U %dV%01d ",
-                                supply_decivolts / 10,
-                                supply_decivolts % 10);
-
-                    if (capacity_bat_ah != 0) {
-                        len += snprintf(balise_message + len, BALISE_MESSAGE_LEN-len-1,
-                                " %d AH %c ", capacity_bat_ah, supply_trend);
-                    }
-
-                    float temp = 0;
-                    if (temperature_get(&temp)) {
-                        len += snprintf(balise_message + len, BALISE_MESSAGE_LEN-len-1,
-                                " T %d ",
-                                (int)(round_float_to_half_steps(temp)));
-                    }
-
-                    snprintf(balise_message + len, BALISE_MESSAGE_LEN-len-1,
-                            "%s" CW_POSTDELAY,
-                            eol_info);
-
-                    fsm_out.msg = balise_message;
-                    fsm_out.cw_psk_trigger = 1;
-                }
+                beacon_choose(0, stats);
+                beacon_build_message(eol_info);
+                fsm_out.msg = balise_message;
+                fsm_out.cw_psk_trigger = 1;
             }
+            fsm_out.cw_dit_duration = beacon.dit_duration;
 
             if (fsm_in.cw_psk_done) {
                 balise_message_clear();
                 // The exercise_fsm loop needs to see a 1 to 0 transition on cw_psk_trigger
                 // so that it considers the STATS2 message.
                 fsm_out.cw_psk_trigger = 0;
+                fsm_out.msg = NULL;
                 if (current_state == FSM_BALISE_STATS1) {
-                    fsm_out.msg = NULL;
                     next_state = FSM_BALISE_STATS2;
                 }
                 else {
-                    next_state = FSM_OISIF;
+                    aprs_begin(0);
+                    next_state = FSM_BALISE_APRS;
                 }
             }
             break;
@@ -557,16 +667,30 @@ void fsm_update() {
         case FSM_BALISE_SPECIALE_STATS2:
             fsm_out.tx_on = 1;
             fsm_out.msg_frequency   = 588;
-            fsm_out.cw_dit_duration = -3; // PSK125
+            fsm_out.cw_dit_duration = stats_telemetry ?
+                STATS_TELEMETRY_PSK_MODE : STATS_TEXT_PSK_MODE;
 
             // All predecessor states must NULL the fsm_out.msg field!
-            if (fsm_out.msg == NULL) {
-                fsm_out.msg = stats_build_text(batterycharge_wind_disconnected() == 1);
+            if (fsm_out.msg == NULL && fsm_out.msg_source == NULL &&
+                    fsm_out.msg_symbols == NULL) {
+                const int wind_disconnected = batterycharge_wind_disconnected() == 1;
+                if (stats_telemetry) {
+                    // The telemetry frame in PSK250 takes a tenth of the airtime
+                    fsm_out.msg_symbols = stats_telemetry_build(wind_disconnected);
+                    fsm_out.msg_num_symbols = TELEMETRY_SYMBOLS;
+                }
+                else {
+                    stats_report_begin(wind_disconnected);
+                    fsm_out.msg_source = stats_report_read;
+                }
             }
             fsm_out.cw_psk_trigger = 1;
 
             if (fsm_in.cw_psk_done) {
+                stats_report_sent();
                 fsm_out.cw_psk_trigger = 0;
+                fsm_out.msg_source = NULL;
+                fsm_out.msg_symbols = NULL;
                 next_state = (current_state == FSM_BALISE_STATS2) ?
                     FSM_BALISE_STATS3 :
                     FSM_BALISE_SPECIALE_STATS3;
@@ -576,14 +700,9 @@ void fsm_update() {
         case FSM_BALISE_STATS3:
         case FSM_BALISE_SPECIALE_STATS3:
             fsm_out.tx_on = 1;
-            if (current_state == FSM_BALISE_STATS3) {
-                fsm_out.msg_frequency   = 588;
-                fsm_out.cw_dit_duration = 110;
-            }
-            else {
-                fsm_out.msg_frequency   = 696;
-                fsm_out.cw_dit_duration = 70;
-            }
+            fsm_out.msg_frequency = (current_state == FSM_BALISE_STATS3) ? 588 : 696;
+            // Same speed as STATS1, the beacon announcing the statistics is in CW
+            fsm_out.cw_dit_duration = beacon.dit_duration;
 
             if (balise_message_empty()) {
                 const char *eol_info = "73";
@@ -602,9 +721,12 @@ void fsm_update() {
 
             if (fsm_in.cw_psk_done) {
                 stats_beacon_sent();
-                fsm_out.cw_psk_trigger = 1;
+                // FSM_BALISE_APRS needs a rising edge of cw_psk_trigger
+                fsm_out.cw_psk_trigger = 0;
+                fsm_out.msg = NULL;
                 balise_message_clear();
-                next_state = FSM_OISIF;
+                aprs_begin(1);
+                next_state = FSM_BALISE_APRS;
             }
             break;
 
@@ -612,15 +734,15 @@ void fsm_update() {
         case FSM_BALISE_SPECIALE_STATS1:
             fsm_out.tx_on = 1;
             fsm_out.msg_frequency   = 696;
-            fsm_out.cw_dit_duration = 70;
 
             if (balise_message_empty()) {
-                const float supply_voltage = round_float_to_half_steps(analog_measure_12v());
-                const int supply_decivolts = supply_voltage * 10.0f;
+                const int stats = current_state == FSM_BALISE_SPECIALE_STATS1;
 
                 const char *eol_info = "73";
-                if (current_state == FSM_BALISE_SPECIALE_STATS1) {
-                    eol_info = "PSK125";
+                if (stats) {
+                    stats_telemetry = fsm_in.qrp;
+                    eol_info = psk_mode_name(stats_telemetry ?
+                            STATS_TELEMETRY_PSK_MODE : STATS_TEXT_PSK_MODE);
                 }
                 else if (batterycharge_wind_disconnected() == 1) {
                     eol_info = "EOL \\"; // backslash is <SK>
@@ -629,34 +751,12 @@ void fsm_update() {
                     eol_info = "\\"; // backslash is <SK>
                 }
 
-                size_t len = 0;
-                len += snprintf(balise_message+len, BALISE_MESSAGE_LEN-len-1,
-                        CW_PREDELAY CALL " U %dV%01d ",
-                        supply_decivolts / 10,
-                        supply_decivolts % 10);
-
-                const uint32_t capacity_bat_mah = batterycharge_retrieve_last_capacity();
-                const int capacity_bat_ah = capacity_bat_mah / 1000;
-                if (capacity_bat_ah != 0) {
-                    len += snprintf(balise_message + len, BALISE_MESSAGE_LEN-len-1,
-                            " %d AH ", capacity_bat_ah);
-                }
-
-                float temp = 0;
-                if (temperature_get(&temp)) {
-                    len += snprintf(balise_message + len, BALISE_MESSAGE_LEN-len-1,
-                            " T %d ",
-                            (int)(round_float_to_half_steps(temp)));
-                }
-
-                len += snprintf(balise_message+len, BALISE_MESSAGE_LEN-len-1,
-                        "%s" CW_POSTDELAY,
-                        eol_info);
-
+                beacon_choose(1, stats);
+                beacon_build_message(eol_info);
                 fsm_out.msg = balise_message;
-
                 fsm_out.cw_psk_trigger = 1;
             }
+            fsm_out.cw_dit_duration = beacon.dit_duration;
 
             if (fsm_in.cw_psk_done) {
                 stats_beacon_sent();
@@ -664,13 +764,48 @@ void fsm_update() {
                 // The exercise_fsm loop needs to see a 1 to 0 transition on cw_psk_trigger
                 // so that it considers the STATS2 message.
                 fsm_out.cw_psk_trigger = 0;
+                fsm_out.msg = NULL;
                 if (current_state == FSM_BALISE_SPECIALE_STATS1) {
-                    fsm_out.msg = NULL;
                     next_state = FSM_BALISE_SPECIALE_STATS2;
                 }
                 else {
-                    next_state = FSM_OISIF;
+                    aprs_begin(0);
+                    next_state = FSM_BALISE_APRS;
+                }
+            }
+            break;
+
+        case FSM_BALISE_APRS:
+            fsm_out.tx_on = 1;
+            fsm_out.msg_frequency   = AFSK_MARK_HZ;
+            fsm_out.cw_dit_duration = AFSK_1200;
+
+            if (fsm_out.msg_symbols == NULL) {
+                fsm_out.msg_num_symbols = aprs_build_packet();
+                if (fsm_out.msg_num_symbols) {
+                    fsm_out.msg_symbols = aprs_bits;
                 }
+                else {
+                    // Does not fit, skip it
+                    aprs_packet++;
+                }
+            }
+
+            if (fsm_out.msg_symbols) {
+                fsm_out.cw_psk_trigger = 1;
+            }
+
+            if (fsm_in.cw_psk_done) {
+                // Next packet on the next rising edge of cw_psk_trigger
+                fsm_out.cw_psk_trigger = 0;
+                fsm_out.msg_symbols = NULL;
+                aprs_packet++;
+            }
+
+            if (aprs_packet >= aprs_num_packets) {
+                fsm_out.cw_psk_trigger = 0;
+                fsm_out.msg_symbols = NULL;
+                next_state = FSM_OISIF;
             }
             break;
 
@@ -735,11 +870,20 @@ void fsm_update() {
     if (next_state != current_state) {
         timestamp_state[next_state] = timestamp_now();
 
+        if (!is_beacon_state(current_state) && is_beacon_state(next_state)) {
+            beacon_start_ms = timestamp_now();
+        }
+        else if (is_beacon_state(current_state) && !is_beacon_state(next_state)) {
+            beacon_account_energy();
+        }
+
         short_beacon_counter_last_update = 0;
 
         fsm_state_switched(state_name(next_state));
     }
     current_state = next_state;
+
+    energy_account(timestamp_now(), current_state, fsm_out.tx_on, fsm_in.qrp);
 }
 
 void fsm_update_inputs(struct fsm_input_signals_t* inputs)
@@ -24,6 +24,7 @@
 
 #pragma once
 #include <stdint.h>
+#include "Audio/cw.h"
 
 // List of all states the FSM of the relay can be in
 enum fsm_state_e {
@@ -39,6 +40,7 @@ enum fsm_state_e {
     FSM_TEXTE_73,               // Transmit 73 after QSO
     FSM_TEXTE_HB9G,             // Transmit HB9G after QSO
     FSM_TEXTE_LONG,             // Transmit either HB9G JN36BK or HB9G 1628M after QSO
+    // The beacons, up to FSM_BALISE_APRS
     FSM_BALISE_LONGUE,          // Full-length 2-hour beacon
     FSM_BALISE_STATS1,          // Full-length 2-hour beacon at 22:00, 1st part in CW
     FSM_BALISE_STATS2,          // Full-length 2-hour beacon at 22:00, 2nd part in PSK
@@ -49,6 +51,7 @@ enum fsm_state_e {
     FSM_BALISE_SPECIALE_STATS3, // QRP 2-hour beacon at 22:00, 3nd part in CW
     FSM_BALISE_COURTE,          // Short intermittent beacon
     FSM_BALISE_COURTE_OPEN,     // Short intermittent beacon, need to switch to OPEN
+    FSM_BALISE_APRS,            // APRS telemetry packets after the 2-hour beacon
     _NUM_FSM_STATES             // Dummy state to count the number of states
 };
 
@@ -108,8 +111,11 @@ struct fsm_output_signals_t {
 
     /* Signals to the CW and PSK generator */
     const char* msg;       // The message to transmit
+    cw_psk_text_source_t msg_source; // Generates the message instead of msg if not NULL
+    const uint8_t* msg_symbols; // PSK or AFSK symbols to send instead of msg if not NULL
+    size_t msg_num_symbols;
     int msg_frequency;     // What audio frequency for the CW or PSK message
-    int cw_dit_duration;   // CW speed, dit duration in ms or PSK speed (see enum cw_psk_types_e)
+    int cw_dit_duration;   // CW speed, dit duration in ms or PSK speed (see enum psk_mode_e) or AFSK_1200
     int cw_psk_trigger;    // Set to true to trigger a CW or PSK transmission.
 
     /* Tone detector */
@@ -137,5 +143,8 @@ void fsm_update_inputs(struct fsm_input_signals_t* inputs);
 // Getter for outputs
 void fsm_get_outputs(struct fsm_output_signals_t* out);
 
+// Return 1 when the repeater is idle, and its inputs can be polled slowly
+int fsm_idle(void);
+
 // Announce a state change
 void fsm_state_switched(const char *new_state);
@@ -0,0 +1,97 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "Core/histogram.h"
+#include <string.h>
+
+#define SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+
+int histogram_bucket(uint32_t value)
+{
+    if (value < SUB_BUCKETS) {
+        return value;
+    }
+
+    const int msb = 31 - __builtin_clz(value);
+    const int shift = msb - HISTOGRAM_SUB_BITS;
+    // The bits below the most significant one select the sub-bucket
+    const int bucket = ((shift + 1) << HISTOGRAM_SUB_BITS) + ((value >> shift) & (SUB_BUCKETS - 1));
+
+    return bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1;
+}
+
+static uint32_t bucket_low(int bucket)
+{
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+
+    const int shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+    return (uint32_t)(SUB_BUCKETS + (bucket & (SUB_BUCKETS - 1))) << shift;
+}
+
+uint32_t histogram_bucket_middle(int bucket)
+{
+    const uint32_t low = bucket_low(bucket);
+    // The last bucket also reports its nominal range
+    const uint32_t high = bucket_low(bucket + 1) - 1;
+    return low + (high - low) / 2;
+}
+
+void histogram_clear(struct histogram *h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+void histogram_add(struct histogram *h, uint32_t value)
+{
+    h->counts[histogram_bucket(value)]++;
+    h->total++;
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+uint32_t histogram_percentile(const struct histogram *h, int percent)
+{
+    if (h->total == 0) {
+        return 0;
+    }
+    if (percent >= 100) {
+        return h->max;
+    }
+
+    // Smallest rank which has percent of the values at or below it
+    const uint64_t rank = ((uint64_t)h->total * percent + 99) / 100;
+
+    uint64_t seen = 0;
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        seen += h->counts[b];
+        if (seen >= rank && seen > 0) {
+            const uint32_t middle = histogram_bucket_middle(b);
+            return middle < h->max ? middle : h->max;
+        }
+    }
+    return h->max;
+}
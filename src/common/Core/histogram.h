@@ -0,0 +1,58 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Histograms of durations with logarithmic buckets.
+ *
+ * Every power of two is split in four buckets, so a percentile is known to
+ * within 12.5%. Adding a value takes constant time, and the memory does not
+ * depend on the number of values. Values up to 2^24, about four hours in
+ * milliseconds, have their own bucket, larger ones count in the last one.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define HISTOGRAM_SUB_BITS 2
+#define HISTOGRAM_MAX_BITS 24
+#define HISTOGRAM_BUCKETS (((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS) + 1) << HISTOGRAM_SUB_BITS)
+
+struct histogram {
+    uint32_t counts[HISTOGRAM_BUCKETS];
+    uint32_t total;
+    uint32_t max;
+};
+
+void histogram_clear(struct histogram *h);
+
+void histogram_add(struct histogram *h, uint32_t value);
+
+// Bucket of a value, and the middle of a bucket. A value known within 12.5%
+// can be sent as its bucket in one byte.
+int histogram_bucket(uint32_t value);
+uint32_t histogram_bucket_middle(int bucket);
+
+// Value below which percent of the values are, in the middle of its bucket.
+// percent 100 gives the exact maximum. Returns 0 if the histogram is empty.
+uint32_t histogram_percentile(const struct histogram *h, int percent);
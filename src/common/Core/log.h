@@ -0,0 +1,94 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Debug messages by module and level
+ *
+ * Each module has a level fixed at compile time, messages above it are
+ * removed by the compiler together with their formatting. The level of
+ * the simulator is LOG_DEBUG, the one of the board LOG_INFO. Override with
+ * e.g. -DLOG_LEVEL_GPS=LOG_DEBUG.
+ *
+ * A ceiling set at run time further filters the messages that remain.
+ *
+ * log_msg() formats on the target like usart_debug(), log_bin_msg() sends
+ * integer arguments in binary like log_bin().
+ */
+
+#pragma once
+
+#include "GPIO/usart.h"
+#include "Core/log_bin.h"
+
+#define LOG_ERROR   1
+#define LOG_WARNING 2
+#define LOG_INFO    3
+#define LOG_DEBUG   4
+
+#ifndef LOG_LEVEL_DEFAULT
+#  ifdef SIMULATOR
+#    define LOG_LEVEL_DEFAULT LOG_DEBUG
+#  else
+#    define LOG_LEVEL_DEFAULT LOG_INFO
+#  endif
+#endif
+
+// Start-up, time keeping and task monitoring
+#ifndef LOG_LEVEL_CORE
+#  define LOG_LEVEL_CORE LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_AUDIO
+#  define LOG_LEVEL_AUDIO LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_FSM
+#  define LOG_LEVEL_FSM LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_GPS
+#  define LOG_LEVEL_GPS LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_GPIO
+#  define LOG_LEVEL_GPIO LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_STATS
+#  define LOG_LEVEL_STATS LOG_LEVEL_DEFAULT
+#endif
+
+// Run time ceiling, LOG_DEBUG lets everything through
+extern int log_level;
+
+void log_set_level(int level);
+
+#define log_enabled(module, level) \
+    ((level) <= LOG_LEVEL_##module && (level) <= log_level)
+
+#define log_msg(module, level, ...) do { \
+        if (log_enabled(module, level)) { \
+            usart_debug(__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define log_bin_msg(module, level, ...) do { \
+        if (log_enabled(module, level)) { \
+            log_bin(__VA_ARGS__); \
+        } \
+    } while (0)
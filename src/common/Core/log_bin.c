@@ -0,0 +1,197 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "Core/log_bin.h"
+#include "Core/log_ring.h"
+#include "Core/common.h"
+
+// Start of the section, defined by the linker
+extern const char __start_log_fmt[];
+
+static inline void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint32_t zigzag(uint32_t v)
+{
+    return (v << 1) ^ (uint32_t)((int32_t)v >> 31);
+}
+
+static inline uint32_t varint_len(uint32_t z)
+{
+    uint32_t len = 1;
+    while (z >= 0x80) {
+        z >>= 7;
+        len++;
+    }
+    return len;
+}
+
+void log_bin_write(const char *fmt, uint32_t nargs, const uint32_t *args)
+{
+    uint32_t args_len = 0;
+    for (uint32_t i = 0; i < nargs; i++) {
+        args_len += varint_len(zigzag(args[i]));
+    }
+
+    const uint32_t len = LOG_BIN_HEADER_LEN + args_len + 1;
+
+    uint32_t token;
+    uint8_t *rec = (uint8_t*)log_ring_reserve(len, &token);
+    if (rec == NULL) {
+        return;
+    }
+
+    const uint32_t offset = (uintptr_t)fmt - (uintptr_t)__start_log_fmt;
+
+    rec[0] = LOG_BIN_SYNC;
+    rec[1] = args_len;
+    rec[2] = offset;
+    rec[3] = offset >> 8;
+    put_u32(rec + 4, timestamp_now());
+
+    uint8_t *p = rec + LOG_BIN_HEADER_LEN;
+    for (uint32_t i = 0; i < nargs; i++) {
+        uint32_t z = zigzag(args[i]);
+        while (z >= 0x80) {
+            *p++ = (z & 0x7F) | 0x80;
+            z >>= 7;
+        }
+        *p++ = z;
+    }
+
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < len - 1; i++) {
+        sum += rec[i];
+    }
+    rec[len - 1] = sum;
+
+    log_ring_commit(token);
+    usart_debug_kick();
+}
+
+// Decode the next argument, 0 when there is none left
+static uint32_t next_arg(const uint8_t **p, const uint8_t *end)
+{
+    uint32_t z = 0;
+    int shift = 0;
+    while (*p < end) {
+        const uint8_t b = *(*p)++;
+        if (shift < 32) {
+            z |= (uint32_t)(b & 0x7F) << shift;
+        }
+        shift += 7;
+        if ((b & 0x80) == 0) {
+            break;
+        }
+    }
+    return (z >> 1) ^ -(z & 1);
+}
+
+int log_bin_render(const uint8_t *rec, uint32_t len, char *out, uint32_t out_len)
+{
+    if (len < LOG_BIN_HEADER_LEN + 1 || rec[0] != LOG_BIN_SYNC ||
+            len != LOG_BIN_HEADER_LEN + rec[1] + 1 || out_len == 0) {
+        return -1;
+    }
+
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < len - 1; i++) {
+        sum += rec[i];
+    }
+    if (sum != rec[len - 1]) {
+        return -1;
+    }
+
+    const uint8_t *args = rec + LOG_BIN_HEADER_LEN;
+    const uint8_t *args_end = args + rec[1];
+    const char *fmt = __start_log_fmt + (rec[2] | (rec[3] << 8));
+
+    uint32_t n = snprintf(out, out_len, "[%u] ", (unsigned)get_u32(rec + 4));
+    if (n >= out_len) {
+        n = out_len - 1;
+    }
+
+    while (*fmt && n < out_len - 1) {
+        if (*fmt != '%') {
+            out[n++] = *fmt++;
+            continue;
+        }
+
+        // Copy the conversion without its length modifiers
+        char spec[16];
+        uint32_t spec_len = 0;
+        spec[spec_len++] = *fmt++;
+        while (*fmt && strchr("-+ #0123456789.hl", *fmt)) {
+            if (*fmt != 'h' && *fmt != 'l' && spec_len < sizeof(spec) - 2) {
+                spec[spec_len++] = *fmt;
+            }
+            fmt++;
+        }
+
+        const char conversion = *fmt ? *fmt++ : '%';
+        spec[spec_len++] = conversion;
+        spec[spec_len] = '\0';
+
+        int written;
+        switch (conversion) {
+            case 'd':
+            case 'i':
+            case 'c':
+                written = snprintf(out + n, out_len - n, spec, (int)next_arg(&args, args_end));
+                break;
+            case 'u':
+            case 'x':
+            case 'X':
+                written = snprintf(out + n, out_len - n, spec, (unsigned int)next_arg(&args, args_end));
+                break;
+            case '%':
+                written = snprintf(out + n, out_len - n, "%%");
+                break;
+            default:
+                next_arg(&args, args_end);
+                written = snprintf(out + n, out_len - n, "?");
+                break;
+        }
+
+        n += written;
+        if (n >= out_len) {
+            n = out_len - 1;
+        }
+    }
+
+    out[n] = '\0';
+    return n;
+}
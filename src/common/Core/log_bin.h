@@ -0,0 +1,81 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Binary debug messages with deferred formatting
+ *
+ * log_bin() takes a printf format with integer arguments only. It stores
+ * the offset of the format in the log_fmt section, the timestamp and the
+ * raw arguments in the log ring, instead of the text. No formatting happens
+ * on the target. The format strings are not loaded into the flash, the
+ * build extracts them into bin/log_fmt.bin, and decoder/logdecode.py renders
+ * the messages on the PC. The simulator renders them itself.
+ *
+ * Record, little endian:
+ *   LOG_BIN_SYNC, length of the arguments in bytes, format offset (16 bits),
+ *   timestamp in ms (32 bits), arguments, sum of the previous bytes (8 bits)
+ *
+ * Arguments are 32 bit words, wider ones fail to build. They are zigzag
+ * encoded so that small negative values stay small, in little endian groups
+ * of 7 bits. The high bit of a byte is set when more follow.
+ *
+ * Text messages never contain LOG_BIN_SYNC, which separates both on the
+ * debug port. Build with LOG_BIN_AS_TEXT to send text instead.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "GPIO/usart.h"
+
+#define LOG_BIN_SYNC 0x00
+#define LOG_BIN_HEADER_LEN 8
+
+// Checks up to 10 arguments, the missing ones are replaced by 0
+#define LOG_BIN_CHECK_WIDTH_(...) LOG_BIN_CHECK_WIDTH_N_(__VA_ARGS__, \
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+#define LOG_BIN_CHECK_WIDTH_N_(a0, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, ...) \
+    _Static_assert(sizeof(a1) <= 4 && sizeof(a2) <= 4 && sizeof(a3) <= 4 && \
+            sizeof(a4) <= 4 && sizeof(a5) <= 4 && sizeof(a6) <= 4 && \
+            sizeof(a7) <= 4 && sizeof(a8) <= 4 && sizeof(a9) <= 4 && \
+            sizeof(a10) <= 4, "log_bin() arguments must fit in 32 bits")
+
+#ifdef LOG_BIN_AS_TEXT
+#  define log_bin(fmt, ...) usart_debug(fmt, ##__VA_ARGS__)
+#else
+#  define log_bin(fmt, ...) do { \
+        LOG_BIN_CHECK_WIDTH_(0, ##__VA_ARGS__); \
+        static const char log_bin_fmt_[] __attribute__((section("log_fmt"), used)) = fmt; \
+        const uint32_t log_bin_args_[] = { 0, ##__VA_ARGS__ }; \
+        log_bin_write(log_bin_fmt_, \
+                sizeof(log_bin_args_) / sizeof(uint32_t) - 1, log_bin_args_ + 1); \
+    } while (0)
+#endif
+
+// Write a record into the log ring, use log_bin() instead
+void log_bin_write(const char *fmt, uint32_t nargs, const uint32_t *args);
+
+/* Render a record as text with its timestamp, like usart_debug() would.
+ * Return the length of the text, or -1 if the record is invalid.
+ */
+int log_bin_render(const uint8_t *record, uint32_t len, char *out, uint32_t out_len);
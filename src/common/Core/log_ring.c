@@ -0,0 +1,158 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include <string.h>
+#include "Core/log_ring.h"
+
+#define HDR_COMMITTED 0x80000000ul
+// Skip to the start of the ring, a message never wraps around
+#define HDR_PAD       0x40000000ul
+#define HDR_LEN_MASK  0x0000FFFFul
+
+/* Positions are counted in bytes since startup and wrap around at 2^32,
+ * which is a multiple of the ring length. Space that is not reserved is
+ * kept zeroed, so that the consumer sees an uncommitted header at the
+ * write position.
+ */
+static uint32_t ring[LOG_RING_LEN / 4];
+static uint32_t ring_head = 0;
+static uint32_t ring_tail = 0;
+
+static uint32_t dropped_messages = 0;
+static uint32_t dropped_bytes = 0;
+
+static inline uint32_t record_size(uint32_t len)
+{
+    return 4 + ((len + 3) & ~3ul);
+}
+
+static void drop(uint32_t len)
+{
+    __atomic_fetch_add(&dropped_messages, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&dropped_bytes, len, __ATOMIC_RELAXED);
+}
+
+char* log_ring_reserve(uint32_t len, uint32_t *token)
+{
+    if (len == 0) {
+        return NULL;
+    }
+    else if (len > LOG_RING_MAX_MSG) {
+        drop(len);
+        return NULL;
+    }
+
+    const uint32_t size = record_size(len);
+
+    uint32_t head = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+    uint32_t pad, next;
+    do {
+        const uint32_t offset = head % LOG_RING_LEN;
+        pad = offset + size > LOG_RING_LEN ? LOG_RING_LEN - offset : 0;
+        next = head + pad + size;
+
+        if (next - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE) > LOG_RING_LEN) {
+            drop(len);
+            return NULL;
+        }
+    } while (!__atomic_compare_exchange_n(&ring_head, &head, next, 1,
+                __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+    if (pad) {
+        __atomic_store_n(&ring[(head % LOG_RING_LEN) / 4],
+                HDR_COMMITTED | HDR_PAD | pad, __ATOMIC_RELEASE);
+    }
+
+    const uint32_t index = ((head + pad) % LOG_RING_LEN) / 4;
+    *token = index | (len << 16);
+    return (char*)&ring[index + 1];
+}
+
+void log_ring_commit(uint32_t token)
+{
+    __atomic_store_n(&ring[token & HDR_LEN_MASK],
+            HDR_COMMITTED | (token >> 16), __ATOMIC_RELEASE);
+}
+
+int log_ring_write(const char *msg, uint32_t len)
+{
+    uint32_t token;
+    char *dst = log_ring_reserve(len, &token);
+    if (dst == NULL) {
+        return 0;
+    }
+
+    memcpy(dst, msg, len);
+    log_ring_commit(token);
+    return 1;
+}
+
+const char* log_ring_peek(uint32_t *len)
+{
+    uint32_t tail = ring_tail;
+
+    while (tail != __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE)) {
+        uint32_t *hdr = &ring[(tail % LOG_RING_LEN) / 4];
+        const uint32_t h = __atomic_load_n(hdr, __ATOMIC_ACQUIRE);
+
+        if ((h & HDR_COMMITTED) == 0) {
+            // Reserved, but still being written
+            return NULL;
+        }
+        else if (h & HDR_PAD) {
+            const uint32_t pad = h & HDR_LEN_MASK;
+            memset(hdr, 0, pad);
+            tail += pad;
+            __atomic_store_n(&ring_tail, tail, __ATOMIC_RELEASE);
+        }
+        else {
+            *len = h & HDR_LEN_MASK;
+            return (const char*)(hdr + 1);
+        }
+    }
+
+    return NULL;
+}
+
+void log_ring_release(void)
+{
+    const uint32_t tail = ring_tail;
+    uint32_t *hdr = &ring[(tail % LOG_RING_LEN) / 4];
+    const uint32_t size = record_size(*hdr & HDR_LEN_MASK);
+
+    memset(hdr, 0, size);
+    __atomic_store_n(&ring_tail, tail + size, __ATOMIC_RELEASE);
+}
+
+int log_ring_empty(void)
+{
+    return __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE) ==
+        __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+}
+
+void log_ring_dropped(uint32_t *messages, uint32_t *bytes)
+{
+    *messages = __atomic_load_n(&dropped_messages, __ATOMIC_RELAXED);
+    *bytes = __atomic_load_n(&dropped_bytes, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,68 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Multi-producer ring of debug messages
+ *
+ * Any task or interrupt copies its message into the ring without locking:
+ * space is reserved with a compare-and-swap on the write position, filled,
+ * and committed. A single consumer, the DMA interrupt of the debug USART on
+ * the board, takes the committed messages in order. When the ring is full,
+ * the message is dropped and counted.
+ *
+ * Each message is stored contiguously after a header word, so that it can
+ * be sent by DMA in place.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Size of the ring in bytes, a power of two
+#define LOG_RING_LEN 4096
+// Longest message
+#define LOG_RING_MAX_MSG 1024
+
+/* Reserve space for a message of len bytes. Return a pointer where to copy
+ * it, and the token to commit it. Return NULL if the ring is full.
+ */
+char* log_ring_reserve(uint32_t len, uint32_t *token);
+
+// Make the reserved message available to the consumer
+void log_ring_commit(uint32_t token);
+
+// Copy a message into the ring. Return 0 if it was dropped.
+int log_ring_write(const char *msg, uint32_t len);
+
+/* Consumer side, from a single context. Return the oldest committed
+ * message, or NULL if there is none yet. It stays in place until
+ * log_ring_release() is called.
+ */
+const char* log_ring_peek(uint32_t *len);
+void log_ring_release(void);
+
+// Return 1 if all messages have been released
+int log_ring_empty(void);
+
+// Number of messages and bytes dropped because the ring was full
+void log_ring_dropped(uint32_t *messages, uint32_t *bytes);
@@ -42,9 +42,18 @@
 #include "GPIO/pio.h"
 #include "GPIO/i2c.h"
 #include "GPS/gps.h"
+#include "GPS/gps_power.h"
+#include "GPS/pps.h"
 #include "Core/fsm.h"
 #include "Core/stats.h"
 #include "Core/common.h"
+#include "Core/power.h"
+#include "Core/log_ring.h"
+#include "Core/log_bin.h"
+#include "Core/log.h"
+#include "Core/soc.h"
+#include "Core/energy.h"
+#include "Core/store.h"
 #include "GPIO/usart.h"
 #include "GPIO/batterycharge.h"
 #include "Core/delay.h"
@@ -58,6 +67,7 @@ extern int gui_in_tone_1750;
 #endif
 
 static void print_task_stats(void);
+static void log_channel_stats(int hour);
 
 static int tm_trigger_button = 0;
 
@@ -80,6 +90,12 @@ const int swr_refl_threshold = 10; // mV
 static int swr_error_counter = 0;
 static int swr_error_flag = 0;
 
+/* The statistics are saved to flash every 15 minutes, about 25kB per day.
+ * Each of the two 16kB sectors is then erased about 300 times per year,
+ * the flash is specified for 10000 cycles.
+ */
+#define STATS_SAVE_PERIOD_MS (15 * 60 * 1000)
+
 // Platform specific init function
 void init(void);
 
@@ -95,6 +111,8 @@ static void launcher_task(void *pvParameters);
 static void audio_callback(void* context, int select_buffer);
 // Debugging
 static uint64_t timestamp_last_audio_callback = 0;
+// Set when the playback was let to stop, cw_psk restarts it
+static volatile int audio_paused = 0;
 
 void vApplicationStackOverflowHook(TaskHandle_t, signed char *);
 
@@ -105,6 +123,7 @@ void vApplicationStackOverflowHook(TaskHandle_t __attribute__ ((unused)) xTask,
 
 int main(void) {
     init();
+    timestamp_init();
     delay_init();
     usart_init();
     usart_debug("\r\n******* glutt-o-matique version %s *******\r\n", vc_get_version());
@@ -143,31 +162,47 @@ int main(void) {
 // already running when calling the init functions.
 static void launcher_task(void __attribute__ ((unused))*pvParameters)
 {
-    usart_debug_puts("CW init\r\n");
+    log_msg(CORE, LOG_INFO, "CW init\r\n");
     cw_psk_init(16000);
 
-    usart_debug_puts("PIO init\r\n");
+    log_msg(CORE, LOG_INFO, "PIO init\r\n");
     pio_init();
 
-    usart_debug_puts("Analog init\r\n");
+    log_msg(CORE, LOG_INFO, "Analog init\r\n");
     analog_init();
 
-    usart_debug_puts("Batterycharge init\r\n");
+    log_msg(CORE, LOG_INFO, "Batterycharge init\r\n");
     batterycharge_init();
+    soc_init();
+
+    log_msg(CORE, LOG_INFO, "Store init\r\n");
+    if (store_init()) {
+        struct store_stats store;
+        store_get_stats(&store);
+        const int restored = stats_restore();
+        const int energy_restored = energy_restore();
+        log_msg(STATS, LOG_INFO, "Store generation %u, %u words used, %u corrupt records, stats %s, energy %s\r\n",
+                (unsigned)store.generation, (unsigned)store.used_words,
+                (unsigned)store.corrupt_records, restored ? "restored" : "not found",
+                energy_restored ? "restored" : "not found");
+    }
+    else {
+        log_msg(STATS, LOG_ERROR, "Store not usable\r\n");
+    }
 
-    usart_debug_puts("I2C init\r\n");
+    log_msg(CORE, LOG_INFO, "I2C init\r\n");
     i2c_init();
 
-    usart_debug_puts("common init\r\n");
+    log_msg(CORE, LOG_INFO, "common init\r\n");
     common_init();
 
-    usart_debug_puts("GPS init\r\n");
+    log_msg(CORE, LOG_INFO, "GPS init\r\n");
     gps_init();
 
-    usart_debug_puts("DS18B20 init\r\n");
+    log_msg(CORE, LOG_INFO, "DS18B20 init\r\n");
     temperature_init();
 
-    usart_debug_puts("TaskButton init\r\n");
+    log_msg(CORE, LOG_INFO, "TaskButton init\r\n");
 
     TaskHandle_t task_handle;
     xTaskCreate(
@@ -182,7 +217,7 @@ static void launcher_task(void __attribute__ ((unused))*pvParameters)
         trigger_fault(FAULT_SOURCE_MAIN);
     }
 
-    usart_debug_puts("TaskFSM init\r\n");
+    log_msg(CORE, LOG_INFO, "TaskFSM init\r\n");
 
     xTaskCreate(
             exercise_fsm,
@@ -196,7 +231,7 @@ static void launcher_task(void __attribute__ ((unused))*pvParameters)
         trigger_fault(FAULT_SOURCE_MAIN);
     }
 
-    usart_debug_puts("TaskGPS init\r\n");
+    log_msg(CORE, LOG_INFO, "TaskGPS init\r\n");
 
     xTaskCreate(
             gps_monit_task,
@@ -210,22 +245,22 @@ static void launcher_task(void __attribute__ ((unused))*pvParameters)
         trigger_fault(FAULT_SOURCE_MAIN);
     }
 
-    usart_debug_puts("Audio init\r\n");
+    log_msg(CORE, LOG_INFO, "Audio init\r\n");
     audio_initialize(Audio16000HzSettings);
 
-    usart_debug_puts("Audio set volume\r\n");
+    log_msg(CORE, LOG_INFO, "Audio set volume\r\n");
     audio_set_volume(210);
 
-    usart_debug_puts("Audio set callback\r\n");
+    log_msg(CORE, LOG_INFO, "Audio set callback\r\n");
     audio_play_with_callback(audio_callback, NULL);
 
-    usart_debug_puts("Tone init\r\n");
+    log_msg(CORE, LOG_INFO, "Tone init\r\n");
     tone_init();
 
-    usart_debug_puts("Audio in init\r\n");
+    log_msg(CORE, LOG_INFO, "Audio in init\r\n");
     audio_in_initialize();
 
-    usart_debug_puts("TaskNF init\r\n");
+    log_msg(CORE, LOG_INFO, "TaskNF init\r\n");
 
     xTaskCreate(
             nf_analyse,
@@ -239,7 +274,7 @@ static void launcher_task(void __attribute__ ((unused))*pvParameters)
         trigger_fault(FAULT_SOURCE_MAIN);
     }
 
-    usart_debug_puts("TaskCC init\r\n");
+    log_msg(CORE, LOG_INFO, "TaskCC init\r\n");
 
     xTaskCreate(
             read_in_coulomb_counter,
@@ -253,10 +288,11 @@ static void launcher_task(void __attribute__ ((unused))*pvParameters)
         trigger_fault(FAULT_SOURCE_MAIN);
     }
 
-    usart_debug_puts("Init done.\r\n");
+    log_msg(CORE, LOG_INFO, "Init done.\r\n");
 
     int last_qrp_from_supply = 0;
     int send_audio_callback_warning = 0;
+    uint64_t last_stats_save = timestamp_now();
 
     int i = 0;
 
@@ -279,11 +315,27 @@ static void launcher_task(void __attribute__ ((unused))*pvParameters)
 
         tone_detector_enable(fsm_out.require_tone_detector);
 
+        // Saving can erase a flash sector, which stalls the processor
+        if (!fsm_out.tx_on && last_stats_save + STATS_SAVE_PERIOD_MS < timestamp_now()) {
+            if (!stats_save() || !energy_save()) {
+                log_msg(STATS, LOG_WARNING, "Stats not saved\r\n");
+            }
+            last_stats_save = timestamp_now();
+        }
+
+        {
+            struct batterycharge_telemetry charge;
+            batterycharge_telemetry(&charge);
+            energy_capacity(charge.capacity_updated ? charge.capacity_mah : 0,
+                    charge.charge_updated ? (charge.charge_ma > 0) : -1,
+                    analog_measure_12v());
+        }
+
         if (fsm_out.tx_on) {
             int swr_fwd_mv, swr_refl_mv;
             if (analog_measure_swr(&swr_fwd_mv, &swr_refl_mv)) {
                 if (swr_refl_mv > swr_refl_threshold) {
-                    usart_debug("SWR meas %d mV\r\n", swr_refl_mv);
+                    log_bin_msg(GPIO, LOG_DEBUG, "SWR meas %d mV\r\n", swr_refl_mv);
                     swr_error_counter++;
                 }
                 else {
@@ -293,7 +345,7 @@ static void launcher_task(void __attribute__ ((unused))*pvParameters)
                 if (swr_error_counter > SWR_ERROR_COUNTER_MAX) {
                     swr_error_counter = SWR_ERROR_COUNTER_MAX;
                     if (!swr_error_flag) {
-                        usart_debug("Set SWR error\r\n");
+                        log_msg(GPIO, LOG_WARNING, "Set SWR error\r\n");
                     }
                     swr_error_flag = 1;
                     pio_set_qrp(1);
@@ -305,11 +357,25 @@ static void launcher_task(void __attribute__ ((unused))*pvParameters)
                 pio_set_qrp(1);
             }
             else {
-                const int charge_qrp = batterycharge_too_low();
+                struct batterycharge_telemetry telemetry;
+                batterycharge_telemetry(&telemetry);
+
+                struct soc_input soc_in;
+                soc_in.now_ms = timestamp_now();
+                soc_in.capacity_mah = telemetry.capacity_updated ? telemetry.capacity_mah : 0;
+                soc_in.breaker_open = telemetry.breaker_updated ? telemetry.breaker_open : -1;
+                soc_in.voltage = analog_measure_12v();
+                soc_in.temp_valid = temperature_get(&soc_in.temp);
+                soc_in.tx_on_ms = stats_tx_on_ms();
+
+                const int charge_qrp = soc_update(&soc_in);
 
                 if (charge_qrp != -1) {
                     if (charge_qrp != last_qrp_from_supply) {
-                        usart_debug("QRP CC = %d\r\n", charge_qrp);
+                        struct soc_estimate soc;
+                        soc_get_estimate(&soc);
+                        log_msg(GPIO, LOG_INFO, "QRP CC = %d, usable %d mAh, threshold in %d min\r\n",
+                                charge_qrp, (int)soc.usable_mah, (int)soc.minutes_to_qrp);
                         last_qrp_from_supply = charge_qrp;
 
                         pio_set_qrp(charge_qrp);
@@ -319,7 +385,7 @@ static void launcher_task(void __attribute__ ((unused))*pvParameters)
                     /* Read the voltage when battery capacity is not available */
                     const int qrp_from_supply = analog_supply_too_low();
                     if (qrp_from_supply != last_qrp_from_supply) {
-                        usart_debug("QRP U = %d\r\n", qrp_from_supply);
+                        log_msg(GPIO, LOG_INFO, "QRP U = %d\r\n", qrp_from_supply);
                         last_qrp_from_supply = qrp_from_supply;
 
                         pio_set_qrp(qrp_from_supply);
@@ -329,16 +395,16 @@ static void launcher_task(void __attribute__ ((unused))*pvParameters)
         }
 
         const int64_t delta = timestamp_now() - timestamp_last_audio_callback;
-        if (delta > 1000) {
+        if (delta > 1000 && !audio_paused) {
             if (send_audio_callback_warning == 0) {
                 send_audio_callback_warning = 1;
-                usart_debug("[HOHO] timestamp_last_audio_callback > 1000 : %d\r\n", delta);
+                log_msg(AUDIO, LOG_WARNING, "[HOHO] timestamp_last_audio_callback > 1000 : %d\r\n", delta);
             }
         }
         else {
             if (send_audio_callback_warning == 1) {
                 send_audio_callback_warning = 0;
-                usart_debug("[HOHO] Fix ? Now timestamp_last_audio_callback < 1000\r\n");
+                log_msg(AUDIO, LOG_WARNING, "[HOHO] Fix ? Now timestamp_last_audio_callback < 1000\r\n");
             }
         }
     }
@@ -362,12 +428,18 @@ static void detect_button_press(void __attribute__ ((unused))*pvParameters)
             }
         }
 
-        vTaskDelay(pdMS_TO_TICKS(10)); /* Debounce Delay */
+        if (pin_high_count == 0) {
+            // Released, a press is seen at most POWER_IDLE_POLL_MS late
+            power_idle_poll_delay();
+        }
+        else {
+            vTaskDelay(pdMS_TO_TICKS(10)); /* Debounce Delay */
+        }
 
         if (pin_high_count == pin_high_thresh &&
                 last_pin_high_count != pin_high_count) {
             tm_trigger_button = 1;
-            usart_debug_puts("Bouton bleu\r\n");
+            log_msg(GPIO, LOG_INFO, "Bouton bleu\r\n");
         }
         else if (pin_high_count == 0 &&
                 last_pin_high_count != pin_high_count) {
@@ -396,6 +468,14 @@ static void audio_callback(void __attribute__ ((unused))*context, int select_buf
 
     size_t samples_len = cw_psk_fill_buffer(samples, AUDIO_BUF_LEN);
 
+    if (samples_len == 0 && only_zero_in_audio_buffer && !cw_psk_busy()) {
+        // Let the DMA stop after the current buffer, and the audio
+        // hardware release STOP mode
+        audio_paused = 1;
+        return;
+    }
+    audio_paused = 0;
+
     if (samples_len == 0) {
         for (int i = 0; i < AUDIO_BUF_LEN; i++) {
             samples[i] = 0;
@@ -414,7 +494,7 @@ static void audio_callback(void __attribute__ ((unused))*context, int select_buf
     }
 
     if (!audio_provide_buffer_without_blocking(samples, samples_len)) {
-        usart_debug("[HOHO] audio_provide_buffer_without_blocking returned False.\r\n");
+        log_msg(AUDIO, LOG_WARNING, "[HOHO] audio_provide_buffer_without_blocking returned False.\r\n");
     }
 
     timestamp_last_audio_callback = timestamp_now();
@@ -424,9 +504,10 @@ static struct tm gps_time;
 static void gps_monit_task(void __attribute__ ((unused))*pvParameters) {
 
     /* There are two types of non GPS clocks: the DERIVED one which works if
-     * GPS time was known at some point, and the free-running that only depends
-     * on timestamp_now(). The free-running one is used to ensure 2h beacons are
-     * transmitted even if GPS never gave us time. The DERIVED kicks in when GPS
+     * GPS time was known at some point, or if the RTC was set before the last
+     * reset, and the free-running that only depends on timestamp_now(). The
+     * free-running one is used to ensure 2h beacons are transmitted even if
+     * neither GPS nor the RTC gave us time. The DERIVED kicks in when GPS
      * fails after having output time information and tries to keep accurate absolute
      * time.
      */
@@ -441,6 +522,8 @@ static void gps_monit_task(void __attribute__ ((unused))*pvParameters) {
     last_volt_and_temp_timestamp = last_hour_is_even_change_timestamp = timestamp_now();
 
     int last_even = -1;
+    int last_channel_stats_hour = -1;
+    int trend_export_latch = 0;
 
     while (1) {
         const uint64_t now = timestamp_now();
@@ -448,6 +531,7 @@ static void gps_monit_task(void __attribute__ ((unused))*pvParameters) {
         struct tm time = {0};
         int time_valid = local_time(&time);
         int derived_mode = 0;
+        local_time_sync_rtc();
 
         if (time_valid) {
             if (time.tm_sec % 2) {
@@ -480,14 +564,14 @@ static void gps_monit_task(void __attribute__ ((unused))*pvParameters) {
             if (last_even != hour_is_even) {
                 last_even = hour_is_even;
 
-                usart_debug("Even changed: %i %i %s\r\n", hour_is_even, time.tm_hour, derived_mode ? "DERIVED" : "GPS");
+                log_msg(CORE, LOG_INFO, "Even changed: %i %i %s\r\n", hour_is_even, time.tm_hour, derived_mode ? "DERIVED" : "GPS");
             }
         }
         else if (last_hour_is_even_change_timestamp + (2 * 3600 * 1000) < now) {
             hour_is_even = (hour_is_even + 1) % 2;
             last_even = hour_is_even;
 
-            usart_debug("Even changed: %i %i FREE-RUNNING\r\n", hour_is_even, time.tm_hour);
+            log_msg(CORE, LOG_INFO, "Even changed: %i %i FREE-RUNNING\r\n", hour_is_even, time.tm_hour);
             last_hour_is_even_change_timestamp = now;
         }
 
@@ -495,9 +579,10 @@ static void gps_monit_task(void __attribute__ ((unused))*pvParameters) {
             const float u_bat = analog_measure_12v();
             const uint32_t capacity_bat = batterycharge_retrieve_last_capacity();
 
-            usart_debug("ALIM %d mV\r\n", (int)roundf(1000.0f * u_bat));
+            log_msg(GPIO, LOG_DEBUG, "ALIM %d mV\r\n", (int)roundf(1000.0f * u_bat));
 
             stats_voltage(u_bat);
+            stats_capacity(capacity_bat);
             if (time_valid && time.tm_min == 0) {
                 stats_battery_at_full_hour(time.tm_hour, u_bat, capacity_bat);
             }
@@ -512,12 +597,29 @@ static void gps_monit_task(void __attribute__ ((unused))*pvParameters) {
                     temp = -temp;
                 }
 
-                usart_debug("TEMP %s%d.%02d\r\n", sign, (int)temp, (int)(temp * 100.0f - (int)(temp) * 100.0f));
+                log_msg(GPIO, LOG_DEBUG, "TEMP %s%d.%02d\r\n", sign, (int)temp, (int)(temp * 100.0f - (int)(temp) * 100.0f));
             }
             else {
-                usart_debug("TEMP invalid\r\n");
+                log_msg(GPIO, LOG_WARNING, "TEMP invalid\r\n");
             }
 
+            struct soc_estimate soc;
+            soc_get_estimate(&soc);
+            if (soc.valid) {
+                log_msg(STATS, LOG_DEBUG, "SOC %d mAh, rate %d + %d x %d%% mAh/h, temp %d cC/h, QRP in %d min\r\n",
+                        (int)soc.usable_mah, (int)soc.base_rate_mah_h, (int)soc.tx_rate_mah_h,
+                        (int)soc.duty_percent, (int)soc.temp_slope_cdeg_h, (int)soc.minutes_to_qrp);
+            }
+
+            uint32_t measured_mwh = 0, estimated_mwh = 0;
+            energy_cross_check(&measured_mwh, &estimated_mwh);
+            log_msg(STATS, LOG_DEBUG, "Energy beacons %d QSO %d idle %d mWh, QRP %d mWh, measured %d estimated %d mWh\r\n",
+                    (int)energy_group_mwh(ENERGY_BEACONS, -1), (int)energy_group_mwh(ENERGY_QSO, -1),
+                    (int)energy_group_mwh(ENERGY_IDLE, -1),
+                    (int)(energy_group_mwh(ENERGY_BEACONS, 1) + energy_group_mwh(ENERGY_QSO, 1) +
+                        energy_group_mwh(ENERGY_IDLE, 1)),
+                    (int)measured_mwh, (int)estimated_mwh);
+
             last_volt_and_temp_timestamp = now;
         }
 
@@ -525,7 +627,7 @@ static void gps_monit_task(void __attribute__ ((unused))*pvParameters) {
         gps_utctime(&gps_time, &num_sv_used);
 
         if (time.tm_sec % 30 == 0 && t_gps_print_latch == 0) {
-            usart_debug("T_GPS %04d-%02d-%02d %02d:%02d:%02d %d SV tracked\r\n",
+            log_msg(GPS, LOG_INFO, "T_GPS %04d-%02d-%02d %02d:%02d:%02d %d SV tracked\r\n",
                 gps_time.tm_year + 1900, gps_time.tm_mon + 1, gps_time.tm_mday,
                 gps_time.tm_hour, gps_time.tm_min, gps_time.tm_sec,
                 num_sv_used);
@@ -541,12 +643,53 @@ static void gps_monit_task(void __attribute__ ((unused))*pvParameters) {
                 mode = "GPS";
             }
 
-            usart_debug("TIME  %04d-%02d-%02d %02d:%02d:%02d [%s]\r\n",
+            log_msg(CORE, LOG_INFO, "TIME  %04d-%02d-%02d %02d:%02d:%02d [%s]\r\n",
                 time.tm_year + 1900,
                 time.tm_mon + 1, time.tm_mday,
                 time.tm_hour, time.tm_min, time.tm_sec,
                 mode);
 
+            log_msg(GPS, LOG_INFO, "PPS %s freq %d ppb, uncertainty %u us\r\n",
+                    pps_locked() ? "locked" : "holdover",
+                    (int)pps_frequency_error_ppb(),
+                    (unsigned int)pps_holdover_uncertainty_us(timestamp_now_us()));
+
+            const uint32_t accuracy = gps_time_accuracy_ns();
+            if (accuracy != UINT32_MAX) {
+                log_msg(GPS, LOG_INFO, "GPS time accuracy %u ns\r\n", (unsigned int)accuracy);
+            }
+
+            int sleep_permille, stop_permille;
+            power_residency(&sleep_permille, &stop_permille);
+            log_msg(CORE, LOG_INFO, "IDLE sleep %d.%d%% stop %d.%d%%\r\n",
+                    sleep_permille / 10, sleep_permille % 10,
+                    stop_permille / 10, stop_permille % 10);
+
+            const uint32_t gps_dropped = usart_gps_rx_dropped();
+            if (gps_dropped) {
+                log_msg(GPS, LOG_WARNING, "GPS RX dropped %u bytes\r\n", (unsigned int)gps_dropped);
+            }
+
+            uint32_t log_dropped_messages, log_dropped_bytes;
+            log_ring_dropped(&log_dropped_messages, &log_dropped_bytes);
+            if (log_dropped_messages) {
+                log_msg(CORE, LOG_WARNING, "DEBUG dropped %u messages %u bytes\r\n",
+                        (unsigned int)log_dropped_messages,
+                        (unsigned int)log_dropped_bytes);
+            }
+
+            struct gps_power_stats gps_power;
+            gps_power_get_stats(&gps_power);
+            const uint64_t gps_total_us = gps_power.on_us + gps_power.off_us;
+            const int gps_off_permille = gps_total_us ?
+                (int)(gps_power.off_us * 1000 / gps_total_us) : 0;
+            log_msg(GPS, LOG_INFO, "GPS off %d.%d%% TTFF %us max %us wakeups %u saved %u mWh/day\r\n",
+                    gps_off_permille / 10, gps_off_permille % 10,
+                    (unsigned int)gps_power.last_ttff_s,
+                    (unsigned int)gps_power.max_ttff_s,
+                    (unsigned int)gps_power.wakeups,
+                    (unsigned int)gps_power_saved_mwh_per_day());
+
             t_gps_print_latch = 1;
         }
 
@@ -556,10 +699,10 @@ static void gps_monit_task(void __attribute__ ((unused))*pvParameters) {
 
         if (time_valid && derived_mode == 0 && gps_time.tm_sec == 0 && gps_time.tm_min == 0 && t_gps_hours_handeled == 0) {
             if (last_hour_timestamp == 0) {
-                usart_debug("DERIV INIT TS=%lld\r\n", now);
+                log_msg(GPS, LOG_DEBUG, "DERIV INIT TS=%lld\r\n", now);
             }
             else {
-                usart_debug("DERIV TS=%lld Excepted=%lld Delta=%lld\r\n",
+                log_msg(GPS, LOG_DEBUG, "DERIV TS=%lld Excepted=%lld Delta=%lld\r\n",
                     now,
                     last_hour_timestamp + 3600000,
                     last_hour_timestamp + 3600000 - now
@@ -575,7 +718,31 @@ static void gps_monit_task(void __attribute__ ((unused))*pvParameters) {
             t_gps_hours_handeled = 0;
         }
 
-        vTaskDelay(pdMS_TO_TICKS(100));
+        // Once a day, one line per iteration to leave room in the debug output
+        if (time_valid && time.tm_hour == 23 && time.tm_min == 0) {
+            if (trend_export_latch == 0) {
+                stats_trend_export_start();
+                trend_export_latch = 1;
+            }
+        }
+        else {
+            trend_export_latch = 0;
+        }
+
+        const char *trend_line = stats_trend_export_line();
+        if (trend_line) {
+            log_msg(STATS, LOG_INFO, "%s", trend_line);
+        }
+
+        if (time_valid && time.tm_hour != last_channel_stats_hour) {
+            if (last_channel_stats_hour != -1) {
+                log_channel_stats(last_channel_stats_hour);
+            }
+            last_channel_stats_hour = time.tm_hour;
+        }
+
+        // On the same ticks as the other polling tasks, see Core/power.h
+        power_idle_poll_delay();
 
         // Reload watchdog
 #ifndef SIMULATOR
@@ -584,6 +751,37 @@ static void gps_monit_task(void __attribute__ ((unused))*pvParameters) {
     }
 }
 
+// Distribution of the channel activity since the last statistics text
+static void log_channel_stats(int hour)
+{
+    static const struct {
+        enum stats_histogram hist;
+        const char *name;
+    } hists[] = {
+        {STATS_HIST_QSO, "QSO ms"},
+        {STATS_HIST_SQ_OPEN, "SQ open ms"},
+        {STATS_HIST_SQ_GAP, "SQ gap ms"},
+        {STATS_HIST_1750_LATENCY, "1750 latency ms"},
+        {STATS_HIST_OCCUPANCY, "Occupancy permille"},
+    };
+
+    log_msg(STATS, LOG_INFO, "CHANNEL occupancy %dh %d permille\r\n",
+            hour, stats_occupancy_hourly(hour));
+
+    for (size_t i = 0; i < sizeof(hists)/sizeof(hists[0]); i++) {
+        if (stats_percentile(hists[i].hist, 50) == -1) {
+            continue;
+        }
+
+        log_msg(STATS, LOG_INFO, "CHANNEL %s p50 %d p90 %d p99 %d max %d\r\n",
+                hists[i].name,
+                (int)stats_percentile(hists[i].hist, 50),
+                (int)stats_percentile(hists[i].hist, 90),
+                (int)stats_percentile(hists[i].hist, 99),
+                (int)stats_percentile(hists[i].hist, 100));
+    }
+}
+
 static void exercise_fsm(void __attribute__ ((unused))*pvParameters)
 {
     fsm_init();
@@ -608,8 +806,15 @@ static void exercise_fsm(void __attribute__ ((unused))*pvParameters)
     fsm_input.send_stats = 0;
     fsm_input.bonne_annee = 0;
 
+    int idle = 0;
+
     while (1) {
-        vTaskDelay(pdMS_TO_TICKS(10));
+        if (idle) {
+            power_idle_poll_delay();
+        }
+        else {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
 
         pio_set_fsm_signals(&fsm_input);
 
@@ -623,24 +828,24 @@ static void exercise_fsm(void __attribute__ ((unused))*pvParameters)
 
         if (last_sq != fsm_input.sq) {
             last_sq = fsm_input.sq;
-            usart_debug("In SQ %d\r\n", last_sq);
+            log_bin_msg(FSM, LOG_INFO, "In SQ %d\r\n", last_sq);
         }
         if (last_qrp != fsm_input.qrp) {
             last_qrp = fsm_input.qrp;
-            usart_debug("In QRP %d\r\n", last_qrp);
+            log_bin_msg(FSM, LOG_INFO, "In QRP %d\r\n", last_qrp);
         }
         if (last_discrim_d != fsm_input.discrim_d) {
             last_discrim_d = fsm_input.discrim_d;
-            usart_debug("In D %d\r\n", last_discrim_d);
+            log_bin_msg(FSM, LOG_INFO, "In D %d\r\n", last_discrim_d);
         }
         if (last_discrim_u != fsm_input.discrim_u) {
             last_discrim_u = fsm_input.discrim_u;
-            usart_debug("In U %d\r\n", last_discrim_u);
+            log_bin_msg(FSM, LOG_INFO, "In U %d\r\n", last_discrim_u);
         }
         if (last_wind_generator_ok != fsm_input.wind_generator_ok) {
             last_wind_generator_ok = fsm_input.wind_generator_ok;
             stats_wind_generator_moved();
-            usart_debug("In eolienne %s\r\n", last_wind_generator_ok ? "vent" : "replie");
+            log_msg(FSM, LOG_INFO, "In eolienne %s\r\n", last_wind_generator_ok ? "vent" : "replie");
         }
 
         const int cw_psk_done = !cw_psk_busy();
@@ -648,7 +853,7 @@ static void exercise_fsm(void __attribute__ ((unused))*pvParameters)
 
         // Set the done flag to 1 only once, when cw_done switches from 0 to 1
         if (last_cw_done != cw_done) {
-            usart_debug("In cw_done change %d %d\r\n", cw_done, only_zero_in_audio_buffer);
+            log_bin_msg(FSM, LOG_DEBUG, "In cw_done change %d %d\r\n", cw_done, only_zero_in_audio_buffer);
 
             if (cw_done) {
                 fsm_input.cw_psk_done = cw_done;
@@ -684,6 +889,9 @@ static void exercise_fsm(void __attribute__ ((unused))*pvParameters)
             time_valid = local_derived_time(&time);
         }
 
+        stats_channel_sample(fsm_input.sq, fsm_input.det_1750,
+                time_valid ? time.tm_hour : -1);
+
         if (time_valid) {
             fsm_input.send_stats = (time.tm_hour == 22) ? 1 : 0;
             fsm_input.bonne_annee = (gps_time.tm_mon == 0 && gps_time.tm_mday <= 5);
@@ -711,21 +919,34 @@ static void exercise_fsm(void __attribute__ ((unused))*pvParameters)
 
         pio_set_tx(fsm_out.tx_on);
         if (fsm_out.tx_on != last_tx_on) {
+            power_inhibit_stop(POWER_INHIBIT_TX, fsm_out.tx_on);
             stats_tx_switched(fsm_out.tx_on);
             last_tx_on = fsm_out.tx_on;
         }
         pio_set_mod_off(!fsm_out.modulation);
 
         // Add message to CW generator only on rising edge of trigger
-        if (fsm_out.cw_psk_trigger && !cw_last_trigger && fsm_out.msg != NULL) {
-            const int success = cw_psk_push_message(fsm_out.msg, fsm_out.cw_dit_duration, fsm_out.msg_frequency);
+        if (fsm_out.cw_psk_trigger && !cw_last_trigger &&
+                (fsm_out.msg != NULL || fsm_out.msg_source != NULL ||
+                 fsm_out.msg_symbols != NULL)) {
+            const int success = fsm_out.msg_symbols ?
+                cw_psk_push_symbols(fsm_out.msg_symbols, fsm_out.msg_num_symbols,
+                        fsm_out.cw_dit_duration, fsm_out.msg_frequency) :
+                fsm_out.msg_source ?
+                cw_psk_push_source(fsm_out.msg_source, fsm_out.cw_dit_duration, fsm_out.msg_frequency) :
+                cw_psk_push_message(fsm_out.msg, fsm_out.cw_dit_duration, fsm_out.msg_frequency);
             if (!success) {
-                usart_debug_puts("cw_psk_push_message failed");
+                log_msg(AUDIO, LOG_ERROR, "cw_psk_push_message failed\r\n");
             }
 
             leds_turn_on(LED_ORANGE);
         }
         cw_last_trigger = fsm_out.cw_psk_trigger;
+
+        // Every 10ms, the idle periods would be too short for STOP mode. The
+        // squelch opening is seen at most POWER_IDLE_POLL_MS late.
+        idle = fsm_idle() && !fsm_out.tx_on && !fsm_input.sq &&
+            cw_done && !tm_trigger_button;
     }
 }
 
@@ -756,7 +977,11 @@ static void read_in_coulomb_counter(void __attribute__ ((unused))*pvParameters)
 {
     while (1) {
         int ok = usart_get_ccounter_msg(ccounter_msg); // times out after 2s
-        if (ok) {
+        if (!ok) {
+            // Woken up from STOP by the counter, which is silent again
+            power_inhibit_stop(POWER_INHIBIT_CCOUNTER, 0);
+        }
+        else {
             size_t len = strlen(ccounter_msg);
             /* Ignore if \n follows \r or not, as that should never happen, and in any case
              * we don't want to send the \r or whatever could come after.
@@ -766,30 +991,19 @@ static void read_in_coulomb_counter(void __attribute__ ((unused))*pvParameters)
             }
 
             batterycharge_push_message(ccounter_msg);
-            usart_debug_puts_header("CC: ", ccounter_msg);
+            log_msg(STATS, LOG_INFO, "CC: %s\r\n", ccounter_msg);
         }
     }
 }
 
 #if configGENERATE_RUN_TIME_STATS
-#include "stm32f4xx_conf.h"
-#include "stm32f4xx_tim.h"
-
 void vConfigureTimerForRunTimeStats()
 {
-    TIM_TimeBaseInitTypeDef SetupTimer;
-    /* Enable timer 2, using the Reset and Clock Control register */
-    RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2, ENABLE);
-    SetupTimer.TIM_Prescaler = 0x0000;
-    SetupTimer.TIM_CounterMode = TIM_CounterMode_Up;
-    SetupTimer.TIM_Period = 0xFFFFFFFF;
-    SetupTimer.TIM_ClockDivision = TIM_CKD_DIV1;
-    TIM_TimeBaseInit(TIM2, &SetupTimer);
-    TIM_Cmd(TIM2, ENABLE); /* start counting by enabling CEN in CR1 */
+    // TIM2 is already running, see timestamp_init()
 }
 
 unsigned long vGetTimerForRunTimeStats( void ) {
-    return TIM_GetCounter(TIM2);
+    return timestamp_now_us();
 }
 
 static TaskStatus_t taskstats[12];
@@ -813,7 +1027,7 @@ static void print_task_stats(void) {
             task_time_percent = taskstats[t].ulRunTimeCounter / total_time;
         }
 
-        usart_debug("TASK %d %s %c [%d] %d\r\n",
+        log_msg(CORE, LOG_DEBUG, "TASK %d %s %c [%d] %d\r\n",
                 taskstats[t].xTaskNumber,
                 taskstats[t].pcTaskName,
                 status_indicator,
@@ -0,0 +1,94 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "Core/power.h"
+#include "Core/common.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+static volatile uint32_t inhibitors = 0;
+
+// Only modified by the idle task with interrupts disabled
+static uint64_t total_sleep_us = 0;
+static uint64_t total_stop_us = 0;
+
+void power_inhibit_stop(uint32_t inhibitor, int inhibit)
+{
+    taskENTER_CRITICAL();
+    if (inhibit) {
+        inhibitors |= inhibitor;
+    }
+    else {
+        inhibitors &= ~inhibitor;
+    }
+    taskEXIT_CRITICAL();
+}
+
+void power_inhibit_stop_from_isr(uint32_t inhibitor, int inhibit)
+{
+    const UBaseType_t saved = taskENTER_CRITICAL_FROM_ISR();
+    if (inhibit) {
+        inhibitors |= inhibitor;
+    }
+    else {
+        inhibitors &= ~inhibitor;
+    }
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+}
+
+void power_idle_poll_delay(void)
+{
+    const TickType_t period = pdMS_TO_TICKS(POWER_IDLE_POLL_MS);
+    vTaskDelay(period - xTaskGetTickCount() % period);
+}
+
+int power_stop_allowed(void)
+{
+    return inhibitors == 0;
+}
+
+void power_account_idle(uint32_t sleep_us, uint32_t stop_us)
+{
+    total_sleep_us += sleep_us;
+    total_stop_us += stop_us;
+}
+
+void power_residency(int *sleep_permille, int *stop_permille)
+{
+    taskENTER_CRITICAL();
+    const uint64_t sleep_us = total_sleep_us;
+    const uint64_t stop_us = total_stop_us;
+    taskEXIT_CRITICAL();
+
+    const uint64_t uptime_us = timestamp_now_us();
+
+    if (uptime_us == 0) {
+        *sleep_permille = 0;
+        *stop_permille = 0;
+    }
+    else {
+        *sleep_permille = sleep_us * 1000 / uptime_us;
+        *stop_permille = stop_us * 1000 / uptime_us;
+    }
+}
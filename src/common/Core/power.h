@@ -0,0 +1,70 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Low-power management
+ *
+ * FreeRTOS suppresses the tick when all tasks are blocked (tickless idle),
+ * and the MCU sleeps until the next task wakes up or an interrupt arrives.
+ * When no module needs the system clocks, it enters STOP mode instead, which
+ * also stops the peripherals. Modules that need them hold an inhibitor.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Audio output over I2S and DMA, while the DMA plays buffers
+#define POWER_INHIBIT_AUDIO    (1ul << 0)
+// ADC2 sampling for the tone detector
+#define POWER_INHIBIT_TONE     (1ul << 1)
+// Transmitter on
+#define POWER_INHIBIT_TX       (1ul << 2)
+// USART3 does not receive from the GPS in STOP mode
+#define POWER_INHIBIT_GPS      (1ul << 3)
+// USART2 does not receive from the coulomb counter in STOP mode. Its RX
+// line wakes up the MCU, which then stays awake until the counter is silent.
+#define POWER_INHIBIT_CCOUNTER (1ul << 4)
+
+// Period of the tasks that poll their inputs while the repeater is idle.
+// They wake up on the same ticks, which leaves idle periods long enough for
+// STOP mode.
+#define POWER_IDLE_POLL_MS 100
+
+// Set or clear an inhibitor
+void power_inhibit_stop(uint32_t inhibitor, int inhibit);
+void power_inhibit_stop_from_isr(uint32_t inhibitor, int inhibit);
+
+// Block until the next multiple of POWER_IDLE_POLL_MS
+void power_idle_poll_delay(void);
+
+// Return 1 if no inhibitor is set
+int power_stop_allowed(void);
+
+// Account time spent in sleep and in STOP mode. Called by the platform
+// after waking up.
+void power_account_idle(uint32_t sleep_us, uint32_t stop_us);
+
+// Fraction of the time since startup spent in sleep and in STOP mode,
+// in tenths of percent.
+void power_residency(int *sleep_permille, int *stop_permille);
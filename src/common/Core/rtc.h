@@ -0,0 +1,48 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Real-time clock that keeps the calendar across resets.
+ *
+ * It is set from the GPS time and read at startup, so that the local time is
+ * known immediately after a reset, without waiting for a GPS fix.
+ * Implemented with the STM32 RTC for the glutt-o-logique, and with a file
+ * for the simulator.
+ */
+
+#pragma once
+
+#include "Core/calendar.h"
+
+// Start the RTC. May block for up to two seconds on the first start.
+void rtc_init(void);
+
+// Return 1 if the RTC is running
+int rtc_available(void);
+
+// Return 1 and write the UTC time into utc if the RTC was set since it was
+// powered up, 0 otherwise.
+int rtc_get_utc(calendar_epoch_t *utc);
+
+// Set the RTC to the given UTC time
+void rtc_set_utc(calendar_epoch_t utc);
@@ -0,0 +1,268 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "Core/soc.h"
+#include "GPIO/batterycharge.h"
+#include "GPIO/analog.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+// Forgetting factor of the fit per step, about five hours of memory
+#define SOC_FORGETTING 0.97f
+// Initial and largest covariance, bounds the wind-up while the duty cycle
+// does not change
+#define SOC_COVARIANCE_INIT 1e6f
+#define SOC_COVARIANCE_MAX 1e8f
+// Weight of a new value in the averages of the duty cycle, the temperature
+// slope and the voltage
+#define SOC_DUTY_WEIGHT 0.1f
+#define SOC_TEMP_SLOPE_WEIGHT 0.25f
+#define SOC_VOLTAGE_WEIGHT 0.1f
+// Resolution of the forecast
+#define SOC_FORECAST_STEP_S 600
+
+#define MS_PER_HOUR 3600000.0f
+
+// Start of the current estimation step
+static int step_valid;
+static uint64_t step_start_ms;
+static uint32_t step_start_capacity;
+static uint32_t step_start_tx_on_ms;
+static int step_start_temp_valid;
+static float step_start_temp;
+
+// Fit of the rate: theta[0] + duty * theta[1], in mAh per hour
+static float theta[2];
+static float covariance[2][2];
+
+static float duty_avg;
+static int temp_valid;
+static float temp;
+static float temp_slope;
+static float voltage_avg;
+static uint32_t last_tx_on_ms;
+static int voltage_qrp;
+static int qrp;
+
+static struct soc_estimate estimate;
+
+static void fit(float duty, float rate)
+{
+    const float x[2] = { 1.0f, duty };
+
+    float px[2];
+    for (int i = 0; i < 2; i++) {
+        px[i] = covariance[i][0] * x[0] + covariance[i][1] * x[1];
+    }
+
+    const float denominator = SOC_FORGETTING + x[0] * px[0] + x[1] * px[1];
+    const float error = rate - (theta[0] * x[0] + theta[1] * x[1]);
+
+    float gain[2];
+    for (int i = 0; i < 2; i++) {
+        gain[i] = px[i] / denominator;
+        theta[i] += gain[i] * error;
+    }
+
+    // The covariance is symmetric, P x is also x' P
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 2; j++) {
+            covariance[i][j] = (covariance[i][j] - gain[i] * px[j]) / SOC_FORGETTING;
+        }
+        if (covariance[i][i] > SOC_COVARIANCE_MAX) {
+            covariance[i][i] = SOC_COVARIANCE_MAX;
+        }
+    }
+}
+
+static int32_t derating_mah(float t)
+{
+    if (t >= SOC_DERATE_BELOW_C) {
+        return 0;
+    }
+    return (int32_t)((SOC_DERATE_BELOW_C - t) * SOC_DERATE_MAH_PER_C);
+}
+
+// Usable capacity in hours from now, the temperature follows its trend
+// downwards only, warming is not counted on
+static int32_t forecast_mah(uint32_t capacity, float rate, float hours)
+{
+    float t_derating = SOC_DERATE_BELOW_C;
+    if (temp_valid) {
+        float drop = temp_slope < 0.0f ? -temp_slope * hours : 0.0f;
+        if (drop > SOC_MAX_TEMP_DROP_C) {
+            drop = SOC_MAX_TEMP_DROP_C;
+        }
+        t_derating = temp - drop;
+    }
+
+    return (int32_t)capacity + (int32_t)(rate * hours) - derating_mah(t_derating);
+}
+
+static int32_t minutes_to_qrp(uint32_t capacity, float rate)
+{
+    for (int s = 0; s <= SOC_HORIZON_S; s += SOC_FORECAST_STEP_S) {
+        if (forecast_mah(capacity, rate, s / 3600.0f) < CHARGE_QRP) {
+            return s / 60;
+        }
+    }
+    return -1;
+}
+
+static void start_step(const struct soc_input *in)
+{
+    step_valid = 1;
+    step_start_ms = in->now_ms;
+    step_start_capacity = in->capacity_mah;
+    step_start_tx_on_ms = in->tx_on_ms;
+    step_start_temp_valid = in->temp_valid;
+    step_start_temp = in->temp;
+}
+
+static void end_step(const struct soc_input *in)
+{
+    const float hours = (in->now_ms - step_start_ms) / MS_PER_HOUR;
+    const float rate = ((float)in->capacity_mah - (float)step_start_capacity) / hours;
+
+    float duty = (in->tx_on_ms - step_start_tx_on_ms) / (hours * MS_PER_HOUR);
+    if (duty > 1.0f) {
+        duty = 1.0f;
+    }
+
+    fit(duty, rate);
+    duty_avg += SOC_DUTY_WEIGHT * (duty - duty_avg);
+
+    if (in->temp_valid && step_start_temp_valid) {
+        const float slope = (in->temp - step_start_temp) / hours;
+        temp_slope += SOC_TEMP_SLOPE_WEIGHT * (slope - temp_slope);
+    }
+}
+
+void soc_init(void)
+{
+    step_valid = 0;
+    theta[0] = 0.0f;
+    theta[1] = 0.0f;
+    covariance[0][0] = SOC_COVARIANCE_INIT;
+    covariance[0][1] = 0.0f;
+    covariance[1][0] = 0.0f;
+    covariance[1][1] = SOC_COVARIANCE_INIT;
+    duty_avg = 0.0f;
+    temp_valid = 0;
+    temp = 0.0f;
+    temp_slope = 0.0f;
+    voltage_avg = 0.0f;
+    last_tx_on_ms = 0;
+    voltage_qrp = 0;
+    qrp = -1;
+
+    estimate.valid = 0;
+    estimate.qrp = -1;
+}
+
+int soc_update(const struct soc_input *in)
+{
+    // The voltage sags under the TX load
+    const int tx_was_on = in->tx_on_ms != last_tx_on_ms;
+    last_tx_on_ms = in->tx_on_ms;
+
+    if (in->voltage > 0.0f && !tx_was_on) {
+        if (voltage_avg == 0.0f) {
+            voltage_avg = in->voltage;
+        }
+        voltage_avg += SOC_VOLTAGE_WEIGHT * (in->voltage - voltage_avg);
+
+        if (voltage_avg < SUPPLY_QRP) {
+            voltage_qrp = 1;
+        }
+        else if (voltage_avg > SUPPLY_QRO) {
+            voltage_qrp = 0;
+        }
+    }
+
+    temp_valid = in->temp_valid;
+    if (in->temp_valid) {
+        temp = in->temp;
+    }
+
+    struct soc_estimate e = estimate;
+
+    if (in->capacity_mah == 0) {
+        // Keep the fit, it is still valid when the counter comes back
+        step_valid = 0;
+        qrp = in->breaker_open == 1 ? 1 : -1;
+        e.valid = 0;
+    }
+    else {
+        if (!step_valid) {
+            start_step(in);
+        }
+        else if (in->now_ms - step_start_ms >= SOC_STEP_S * 1000ull) {
+            end_step(in);
+            start_step(in);
+        }
+
+        const float rate = theta[0] + theta[1] * duty_avg;
+        const int32_t usable = forecast_mah(in->capacity_mah, rate, 0.0f);
+        const int32_t minutes = minutes_to_qrp(in->capacity_mah, rate);
+
+        if (in->breaker_open == 1) {
+            // Disconnected wind generator implies QRP always
+            qrp = 1;
+        }
+        else if (qrp != 1) {
+            qrp = (minutes >= 0 && minutes * 60 <= SOC_LEAD_S) ? 1 : 0;
+        }
+        else if (usable >= CHARGE_QRO && (minutes < 0 || minutes * 60 > 2 * SOC_LEAD_S)) {
+            qrp = 0;
+        }
+
+        e.valid = 1;
+        e.capacity_mah = in->capacity_mah;
+        e.usable_mah = usable;
+        e.base_rate_mah_h = theta[0];
+        e.tx_rate_mah_h = theta[1];
+        e.rate_mah_h = rate;
+        e.duty_percent = 100.0f * duty_avg;
+        e.temp_slope_cdeg_h = 100.0f * temp_slope;
+        e.minutes_to_qrp = minutes;
+    }
+
+    const int decision = (qrp == 0 && voltage_qrp) ? 1 : qrp;
+    e.qrp = decision;
+
+    // The estimate is read from another task
+    taskENTER_CRITICAL();
+    estimate = e;
+    taskEXIT_CRITICAL();
+
+    return decision;
+}
+
+void soc_get_estimate(struct soc_estimate *e)
+{
+    taskENTER_CRITICAL();
+    *e = estimate;
+    taskEXIT_CRITICAL();
+}
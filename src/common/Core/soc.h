@@ -0,0 +1,102 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* State of charge estimator, to decide QRP ahead of time.
+ *
+ * The capacity from the coulomb counter is the state of charge. Every
+ * SOC_STEP_S, a recursive least squares fit with forgetting relates its rate
+ * of change to the TX duty cycle of the same interval: the rate is
+ * base + duty * tx. The temperature trend and the average duty cycle
+ * extrapolate the usable capacity, which is reduced in the cold, up to
+ * SOC_HORIZON_S ahead.
+ *
+ * QRP is chosen when the usable capacity is below CHARGE_QRP, or is forecast
+ * to fall below it within SOC_LEAD_S. QRO needs CHARGE_QRO and a forecast
+ * that stays above CHARGE_QRP for twice that time. The supply voltage,
+ * measured while the TX is off, forces QRP below SUPPLY_QRP, in case the
+ * coulomb counter drifted.
+ *
+ * The estimator only decides, the main task sets QRP. It uses constant
+ * memory and does not depend on the operating system, see host-tests.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Interval of the rate estimation
+#define SOC_STEP_S 600
+// How far ahead the forecast goes
+#define SOC_HORIZON_S (12 * 3600)
+// Go QRP when the threshold is forecast to be reached within this time
+#define SOC_LEAD_S (2 * 3600)
+// Usable capacity lost per degree below SOC_DERATE_BELOW_C
+#define SOC_DERATE_BELOW_C 10
+#define SOC_DERATE_MAH_PER_C 2000
+// Largest temperature drop extrapolated from the trend
+#define SOC_MAX_TEMP_DROP_C 15
+
+struct soc_input {
+    uint64_t now_ms;
+    // 0 if the coulomb counter is not valid
+    uint32_t capacity_mah;
+    // 1 if the wind generator breaker is open, 0 if closed, -1 if unknown
+    int breaker_open;
+    // 0.0f if not measured
+    float voltage;
+    int temp_valid;
+    float temp;
+    // Total time the TX was on, see stats_tx_on_ms()
+    uint32_t tx_on_ms;
+};
+
+struct soc_estimate {
+    // 0 until the first step with a valid capacity
+    int valid;
+    uint32_t capacity_mah;
+    // Capacity minus the temperature derating
+    int32_t usable_mah;
+    // Fitted rates in mAh per hour, and the resulting rate at the average duty
+    int32_t base_rate_mah_h;
+    int32_t tx_rate_mah_h;
+    int32_t rate_mah_h;
+    // Average TX duty cycle in percent
+    int32_t duty_percent;
+    // Temperature trend in hundredths of a degree per hour
+    int32_t temp_slope_cdeg_h;
+    // Time until the usable capacity reaches CHARGE_QRP, -1 if beyond the
+    // horizon, 0 if below already
+    int32_t minutes_to_qrp;
+    // 1 QRP, 0 QRO, -1 unknown
+    int qrp;
+};
+
+void soc_init(void);
+
+// Give new measurements, every few seconds. Return 1 if QRP is needed, 0 if
+// QRO is possible, -1 if the capacity is not known and the decision is left
+// to the supply voltage.
+int soc_update(const struct soc_input *in);
+
+void soc_get_estimate(struct soc_estimate *estimate);
@@ -28,10 +28,19 @@
 #include <math.h>
 #include "Core/stats.h"
 #include "Core/common.h"
+#include "Core/store.h"
+#include "Core/histogram.h"
+#include "Core/timeseries.h"
+#include "Core/telemetry.h"
+#include "Core/energy.h"
+#include "Core/calendar.h"
 #include "vc.h"
 
 static int values_valid = 0;
 static int num_beacons_sent = 0;
+static int num_beacons_energy = 0;
+static uint32_t beacons_energy_mwh = 0;
+static uint32_t beacon_energy_max_mwh = 0;
 static int num_wind_generator_movements = 0;
 static int num_tx_switch = 0;
 static int num_antibavard = 0;
@@ -50,18 +59,89 @@ static int last_tx_on_valid = 0;
 static uint64_t last_tx_on = 0;
 static uint64_t max_qso_duration = 0;
 
+/* Distribution of the channel activity, fed from the FSM task. Too large for
+ * the store, they restart empty after a reset.
+ */
+static struct histogram histograms[STATS_HIST_NUM];
+// Time the squelch was open during each hour of the day, in per mille
+static int16_t occupancy_hourly[24];
+
+// State of the channel, not cleared with the statistics
+static int sq_open = 0;
+static uint64_t sq_open_since = 0;
+static uint64_t sq_closed_since = 0;
+static int sq_closed_valid = 0;
+static int waiting_for_1750 = 0;
+static int occupancy_hour = -1;
+static int occupancy_hour_complete = 0;
+static uint64_t occupancy_ms = 0;
+static uint64_t occupancy_since = 0;
+
+/* Trends of the measurements over the last days, fed and exported from the
+ * GPS monitoring task. Not cleared with the daily statistics.
+ */
+static struct timeseries trends[STATS_TREND_NUM];
+static int trends_initialised = 0;
+static const struct {
+    const char *name;
+    const char *unit;
+} trend_names[STATS_TREND_NUM] = {
+    {"U", "10mV"},
+    {"CAPA", "100mAh"},
+    {"TEMP", "0.1C"},
+};
+
+// As long as a debug message, see MAX_MSG_LEN in usart.c
+#define EXPORT_LINE_LEN 80
+static char export_line[EXPORT_LINE_LEN];
+static int export_trend = STATS_TREND_NUM;
+static int export_tier = 0;
+static int export_index = -1;
+static struct timeseries_iter export_iter;
+
+// Not cleared with the other statistics, read from other tasks
+static volatile uint32_t tx_on_total_ms = 0;
+static volatile uint32_t tx_on_since_ms = 0;
+static volatile int tx_is_on = 0;
+
 /* Ideas
  *
  * Max SWR ratio
  */
 
-#define STATS_LEN 1024 // also check MAX_MESSAGE_LEN in cw.c
-static char stats_text[STATS_LEN];
-static int32_t stats_end_ix = 0;
+/* Statistics kept in the store across resets. Change the version when the
+ * layout changes, older records are then ignored.
+ */
+#define STATS_STORE_VERSION 2
+struct stats_persistent {
+    uint32_t version;
+    int32_t values_valid;
+    int32_t num_beacons_sent;
+    int32_t num_beacons_energy;
+    uint32_t beacons_energy_mwh;
+    uint32_t beacon_energy_max_mwh;
+    int32_t num_wind_generator_movements;
+    int32_t num_tx_switch;
+    int32_t num_antibavard;
+    int32_t num_qro;
+    int32_t num_qrp;
+    float battery_volt_min;
+    float battery_volt_max;
+    float battery_volt_hourly[24];
+    uint32_t battery_charge_hourly[24];
+    float temp_min;
+    float temp_max;
+    uint32_t max_qso_duration;
+};
+// Not on the stack of the calling task
+static struct stats_persistent persistent;
 
 static void clear_stats()
 {
     num_beacons_sent = 0;
+    num_beacons_energy = 0;
+    beacons_energy_mwh = 0;
+    beacon_energy_max_mwh = 0;
     num_wind_generator_movements = 0;
     num_tx_switch = 0;
     num_antibavard = 0;
@@ -79,6 +159,12 @@ static void clear_stats()
     for (int i = 0; i < 24; i++) {
         battery_charge_hourly[i] = 0;
     }
+    for (int i = 0; i < 24; i++) {
+        occupancy_hourly[i] = -1;
+    }
+    for (int i = 0; i < STATS_HIST_NUM; i++) {
+        histogram_clear(&histograms[i]);
+    }
     values_valid = 1;
 }
 
@@ -94,6 +180,18 @@ void stats_battery_at_full_hour(int hour, float u_bat, uint32_t capacity_mAh)
     }
 }
 
+static void trend_add(enum stats_trend trend, int16_t value)
+{
+    if (!trends_initialised) {
+        for (int i = 0; i < STATS_TREND_NUM; i++) {
+            timeseries_init(&trends[i]);
+        }
+        trends_initialised = 1;
+    }
+
+    timeseries_add(&trends[trend], timestamp_now(), value);
+}
+
 void stats_voltage(float u_bat)
 {
     if (values_valid == 0) {
@@ -107,6 +205,18 @@ void stats_voltage(float u_bat)
     if (u_bat > battery_volt_max || battery_volt_max == -1.0f) {
         battery_volt_max = u_bat;
     }
+
+    trend_add(STATS_TREND_VOLTAGE, roundf(100.0f * u_bat));
+}
+
+void stats_capacity(uint32_t capacity_mAh)
+{
+    if (capacity_mAh == 0 || capacity_mAh / 100 > INT16_MAX) {
+        trend_add(STATS_TREND_CAPACITY, TIMESERIES_MISSING);
+    }
+    else {
+        trend_add(STATS_TREND_CAPACITY, (capacity_mAh + 50) / 100);
+    }
 }
 
 
@@ -123,6 +233,74 @@ void stats_temp(float temp)
     if (temp > temp_max || temp_max == TEMP_INVALID) {
         temp_max = temp;
     }
+
+    trend_add(STATS_TREND_TEMP, roundf(10.0f * temp));
+}
+
+int stats_trend_count(enum stats_trend trend, int tier)
+{
+    if (!trends_initialised || (int)trend < 0 || trend >= STATS_TREND_NUM) {
+        return 0;
+    }
+    return timeseries_count(&trends[trend], tier);
+}
+
+void stats_trend_export_start()
+{
+    if (!trends_initialised) {
+        return;
+    }
+
+    export_trend = 0;
+    export_tier = 0;
+    export_index = -1;
+}
+
+const char* stats_trend_export_line()
+{
+    while (export_trend < STATS_TREND_NUM) {
+        const struct timeseries *ts = &trends[export_trend];
+        const unsigned int period = timeseries_period_s(export_tier);
+
+        if (export_index == -1) {
+            timeseries_iter_init(&export_iter, ts, export_tier);
+            export_index = 0;
+            snprintf(export_line, EXPORT_LINE_LEN, "TREND %s %us %d points of %s, oldest first\r\n",
+                    trend_names[export_trend].name, period,
+                    timeseries_count(ts, export_tier), trend_names[export_trend].unit);
+            return export_line;
+        }
+
+        int len = snprintf(export_line, EXPORT_LINE_LEN, "TREND %s %us %d:",
+                trend_names[export_trend].name, period, export_index);
+
+        int16_t value;
+        int n = 0;
+        // Room for one more value of up to seven characters and the line end
+        while (len < EXPORT_LINE_LEN - 11 && timeseries_iter_next(&export_iter, &value)) {
+            if (value == TIMESERIES_MISSING) {
+                len += snprintf(export_line + len, EXPORT_LINE_LEN - len, " ?");
+            }
+            else {
+                len += snprintf(export_line + len, EXPORT_LINE_LEN - len, " %d", value);
+            }
+            n++;
+        }
+        export_index += n;
+
+        if (n > 0) {
+            snprintf(export_line + len, EXPORT_LINE_LEN - len, "\r\n");
+            return export_line;
+        }
+
+        export_index = -1;
+        if (++export_tier == TIMESERIES_TIERS) {
+            export_tier = 0;
+            export_trend++;
+        }
+    }
+
+    return NULL;
 }
 
 void stats_qrp(int is_qrp)
@@ -157,6 +335,19 @@ void stats_beacon_sent()
     num_beacons_sent++;
 }
 
+void stats_beacon_energy(uint32_t energy_mwh)
+{
+    if (values_valid == 0) {
+        clear_stats();
+    }
+
+    num_beacons_energy++;
+    beacons_energy_mwh += energy_mwh;
+    if (energy_mwh > beacon_energy_max_mwh) {
+        beacon_energy_max_mwh = energy_mwh;
+    }
+}
+
 void stats_tx_switched(int tx_on)
 {
     if (values_valid == 0) {
@@ -165,6 +356,16 @@ void stats_tx_switched(int tx_on)
 
     num_tx_switch++;
 
+    const uint32_t now_ms = timestamp_now();
+    if (tx_on && !tx_is_on) {
+        tx_on_since_ms = now_ms;
+        tx_is_on = 1;
+    }
+    else if (!tx_on && tx_is_on) {
+        tx_is_on = 0;
+        tx_on_total_ms += now_ms - tx_on_since_ms;
+    }
+
     if (tx_on) {
         last_tx_on = timestamp_now();
         last_tx_on_valid = 1;
@@ -174,7 +375,94 @@ void stats_tx_switched(int tx_on)
         if (qso_duration > max_qso_duration) {
             max_qso_duration = qso_duration;
         }
+        histogram_add(&histograms[STATS_HIST_QSO], qso_duration);
+    }
+}
+
+static void occupancy_hour_end(uint64_t now)
+{
+    if (sq_open) {
+        occupancy_ms += now - occupancy_since;
+        occupancy_since = now;
     }
+
+    // The hour during which we booted is incomplete
+    if (occupancy_hour_complete) {
+        const int per_mille = occupancy_ms / 3600;
+        occupancy_hourly[occupancy_hour] = per_mille > 1000 ? 1000 : per_mille;
+        histogram_add(&histograms[STATS_HIST_OCCUPANCY], occupancy_hourly[occupancy_hour]);
+    }
+    occupancy_ms = 0;
+}
+
+void stats_channel_sample(int sq, int det_1750, int hour)
+{
+    if (values_valid == 0) {
+        clear_stats();
+    }
+
+    const uint64_t now = timestamp_now();
+
+    if (sq && !sq_open) {
+        sq_open = 1;
+        sq_open_since = now;
+        occupancy_since = now;
+        waiting_for_1750 = 1;
+        if (sq_closed_valid) {
+            histogram_add(&histograms[STATS_HIST_SQ_GAP], now - sq_closed_since);
+        }
+    }
+    else if (!sq && sq_open) {
+        sq_open = 0;
+        sq_closed_since = now;
+        sq_closed_valid = 1;
+        waiting_for_1750 = 0;
+        occupancy_ms += now - occupancy_since;
+        histogram_add(&histograms[STATS_HIST_SQ_OPEN], now - sq_open_since);
+    }
+
+    // Only the first detection of each opening counts
+    if (det_1750 && waiting_for_1750) {
+        waiting_for_1750 = 0;
+        histogram_add(&histograms[STATS_HIST_1750_LATENCY], now - sq_open_since);
+    }
+
+    if (hour >= 0 && hour < 24 && hour != occupancy_hour) {
+        if (occupancy_hour != -1) {
+            occupancy_hour_end(now);
+            occupancy_hour_complete = 1;
+        }
+        occupancy_hour = hour;
+    }
+}
+
+int32_t stats_percentile(enum stats_histogram hist, int percent)
+{
+    if ((int)hist < 0 || hist >= STATS_HIST_NUM || histograms[hist].total == 0) {
+        return -1;
+    }
+
+    return histogram_percentile(&histograms[hist], percent);
+}
+
+int stats_occupancy_hourly(int hour)
+{
+    if (hour < 0 || hour >= 24 || values_valid == 0) {
+        return -1;
+    }
+    return occupancy_hourly[hour];
+}
+
+uint32_t stats_tx_on_ms()
+{
+    /* A switch between the reads only moves the current transmission from
+     * one call to the next.
+     */
+    uint32_t total = tx_on_total_ms;
+    if (tx_is_on) {
+        total += (uint32_t)timestamp_now() - tx_on_since_ms;
+    }
+    return total;
 }
 
 void stats_anti_bavard_triggered()
@@ -195,126 +483,541 @@ void stats_num_gnss_sv(int num_sv)
     num_sv_used = num_sv;
 }
 
-const char* stats_build_text(int wind_disconnected)
+static void stats_copy(struct stats_persistent *p)
 {
-    struct tm time = {0};
-    int time_valid = local_time(&time);
+    memset(p, 0, sizeof(*p));
+
+    p->version = STATS_STORE_VERSION;
+    p->values_valid = values_valid;
+    p->num_beacons_sent = num_beacons_sent;
+    p->num_beacons_energy = num_beacons_energy;
+    p->beacons_energy_mwh = beacons_energy_mwh;
+    p->beacon_energy_max_mwh = beacon_energy_max_mwh;
+    p->num_wind_generator_movements = num_wind_generator_movements;
+    p->num_tx_switch = num_tx_switch;
+    p->num_antibavard = num_antibavard;
+    p->num_qro = num_qro;
+    p->num_qrp = num_qrp;
+    p->battery_volt_min = battery_volt_min;
+    p->battery_volt_max = battery_volt_max;
+    memcpy(p->battery_volt_hourly, battery_volt_hourly, sizeof(p->battery_volt_hourly));
+    memcpy(p->battery_charge_hourly, battery_charge_hourly, sizeof(p->battery_charge_hourly));
+    p->temp_min = temp_min;
+    p->temp_max = temp_max;
+    p->max_qso_duration = max_qso_duration;
+}
 
-    stats_end_ix = snprintf(stats_text + stats_end_ix, STATS_LEN - 1 - stats_end_ix,
-            "HB9G www.glutte.ch HB9G www.glutte.ch\n");
+int stats_save()
+{
+    struct stats_persistent *p = &persistent;
+    stats_copy(p);
+    return store_write(STORE_KEY_STATS, p, sizeof(*p));
+}
 
-    if (time_valid) {
-        stats_end_ix += snprintf(stats_text + stats_end_ix, STATS_LEN - 1 - stats_end_ix,
-                "Statistiques du %04d-%02d-%02d\n",
-                time.tm_year + 1900, time.tm_mon + 1, time.tm_mday);
+int stats_restore()
+{
+    struct stats_persistent *p = &persistent;
+    if (store_read(STORE_KEY_STATS, p, sizeof(*p)) != sizeof(*p) ||
+            p->version != STATS_STORE_VERSION) {
+        return 0;
+    }
+
+    values_valid = p->values_valid;
+    num_beacons_sent = p->num_beacons_sent;
+    num_beacons_energy = p->num_beacons_energy;
+    beacons_energy_mwh = p->beacons_energy_mwh;
+    beacon_energy_max_mwh = p->beacon_energy_max_mwh;
+    num_wind_generator_movements = p->num_wind_generator_movements;
+    num_tx_switch = p->num_tx_switch;
+    num_antibavard = p->num_antibavard;
+    num_qro = p->num_qro;
+    num_qrp = p->num_qrp;
+    battery_volt_min = p->battery_volt_min;
+    battery_volt_max = p->battery_volt_max;
+    memcpy(battery_volt_hourly, p->battery_volt_hourly, sizeof(battery_volt_hourly));
+    memcpy(battery_charge_hourly, p->battery_charge_hourly, sizeof(battery_charge_hourly));
+    temp_min = p->temp_min;
+    temp_max = p->temp_max;
+    max_qso_duration = p->max_qso_duration;
+    return 1;
+}
+
+/* The date of the statistics, from the GPS or, without a fix, derived from
+ * the last fix like the FSM does.
+ */
+static int stats_date(struct tm *time)
+{
+    return local_time(time) || local_derived_time(time);
+}
+
+/* The report is formatted one piece at a time, into the scratch buffer or
+ * pointing to a constant string, while the PSK generator pulls characters.
+ */
+enum report_step {
+    REPORT_HEADER,
+    REPORT_DATE,
+    REPORT_VERSION_LABEL,
+    REPORT_VERSION,
+    REPORT_UPTIME,
+    REPORT_VOLTAGE,
+    REPORT_QRP,
+    REPORT_VOLTAGE_HOURLY_LABEL,
+    REPORT_VOLTAGE_HOURLY,
+    REPORT_CAPACITY_HOURLY_LABEL,
+    REPORT_CAPACITY_HOURLY,
+    REPORT_WIND_GENERATOR,
+    REPORT_TEMP,
+    REPORT_BEACONS,
+    REPORT_BEACON_ENERGY,
+    REPORT_ENERGY,
+    REPORT_ENERGY_QRP,
+    REPORT_ENERGY_CHECK,
+    REPORT_TX_SWITCH,
+    REPORT_ANTIBAVARD,
+    REPORT_QSO_MAX,
+    REPORT_SATELLITES,
+    REPORT_HISTOGRAMS,
+    REPORT_OCCUPANCY,
+    REPORT_BREAKER,
+    REPORT_END,
+};
+
+static const struct {
+    enum stats_histogram hist;
+    const char *label;
+    uint32_t divisor;
+    const char *unit;
+} report_histograms[] = {
+    {STATS_HIST_QSO, "QSO p50,p90= ", 1000, "s"},
+    {STATS_HIST_SQ_OPEN, "SQ ouvert p50,p90= ", 1000, "s"},
+    {STATS_HIST_SQ_GAP, "SQ pause p50,p90= ", 1000, "s"},
+    {STATS_HIST_1750_LATENCY, "Latence 1750 p50,p90= ", 1, "ms"},
+};
+#define NUM_REPORT_HISTOGRAMS (sizeof(report_histograms)/sizeof(report_histograms[0]))
+
+#define REPORT_SCRATCH_LEN 64
+static struct {
+    enum report_step step;
+    // Hour or histogram of the steps that repeat
+    int index;
+    const char *piece;
+    size_t piece_len;
+    char scratch[REPORT_SCRATCH_LEN];
+    size_t scratch_len;
+
+    /* What the report says, taken by stats_report_begin() in the FSM task.
+     * The PSK task that formats the text reads nothing else.
+     */
+    struct stats_persistent values;
+    int wind_disconnected;
+    int date_valid;
+    struct tm date;
+    uint32_t uptime_m;
+    int num_sv_used;
+    uint32_t energy_mwh[ENERGY_NUM_GROUPS];
+    uint32_t energy_qrp_mwh;
+    int energy_checked;
+    uint32_t measured_mwh;
+    uint32_t estimated_mwh;
+    int32_t percentiles[NUM_REPORT_HISTOGRAMS][2];
+    int32_t occupancy[2];
+} report = { .step = REPORT_END };
+
+static void put_str(const char *str)
+{
+    while (*str && report.scratch_len < REPORT_SCRATCH_LEN) {
+        report.scratch[report.scratch_len++] = *str++;
+    }
+}
+
+// Decimal with at least width digits, zero padded
+static void put_uint(uint32_t value, int width)
+{
+    char digits[10];
+    int n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+
+    while (width-- > n && report.scratch_len < REPORT_SCRATCH_LEN) {
+        report.scratch[report.scratch_len++] = '0';
+    }
+    while (n && report.scratch_len < REPORT_SCRATCH_LEN) {
+        report.scratch[report.scratch_len++] = digits[--n];
+    }
+}
+
+static void put_int(int32_t value)
+{
+    if (value < 0) {
+        put_str("-");
+        put_uint(-(int64_t)value, 1);
     }
     else {
-        stats_end_ix += snprintf(stats_text + stats_end_ix, STATS_LEN - 1 - stats_end_ix,
-                "Statistiques de la journee\n");
+        put_uint(value, 1);
+    }
+}
+
+// Tenths with the unit as decimal separator, like 12V5
+static void put_tenths(int32_t tenths, const char *unit)
+{
+    if (tenths < 0) {
+        put_str("-");
+        tenths = -tenths;
+    }
+    put_uint(tenths / 10, 1);
+    put_str(unit);
+    put_uint(tenths % 10, 1);
+}
+
+static void put_duration_hms(uint64_t ms)
+{
+    const uint32_t s = ms / 1000;
+    put_uint(s / 3600, 1);
+    put_str("h");
+    put_uint(s / 60 % 60, 1);
+    put_str("m");
+    put_uint(s % 60, 1);
+    put_str("s");
+}
+
+// Format the piece of the current step, which can be empty
+static void report_format_step(void)
+{
+    const struct stats_persistent *v = &report.values;
+
+    switch (report.step) {
+        case REPORT_HEADER:
+            report.piece = "HB9G www.glutte.ch HB9G www.glutte.ch\n";
+            break;
+        case REPORT_DATE:
+            if (report.date_valid) {
+                put_str("Statistiques du ");
+                put_uint(report.date.tm_year + 1900, 4);
+                put_str("-");
+                put_uint(report.date.tm_mon + 1, 2);
+                put_str("-");
+                put_uint(report.date.tm_mday, 2);
+                put_str("\n");
+            }
+            else {
+                report.piece = "Statistiques de la journee\n";
+            }
+            break;
+        case REPORT_VERSION_LABEL:
+            report.piece = "Version= ";
+            break;
+        case REPORT_VERSION:
+            report.piece = vc_get_version();
+            break;
+        case REPORT_UPTIME:
+            put_str("\nUptime= ");
+            put_uint(report.uptime_m / (24 * 60), 1);
+            put_str("j");
+            put_uint(report.uptime_m / 60 % 24, 1);
+            put_str("h");
+            put_uint(report.uptime_m % 60, 1);
+            put_str("m\n");
+            break;
+        case REPORT_VOLTAGE:
+            put_str("U min,max= ");
+            put_tenths(10.0f * v->battery_volt_min, "V");
+            put_str(",");
+            put_tenths(10.0f * v->battery_volt_max, "V");
+            put_str("\n");
+            break;
+        case REPORT_QRP:
+            put_str("Temps QRP= ");
+            if (v->num_qrp + v->num_qro) {
+                put_uint(100 * v->num_qrp / (v->num_qrp + v->num_qro), 1);
+                put_str("%\n");
+            }
+            else {
+                put_str("?\n");
+            }
+            break;
+        case REPORT_VOLTAGE_HOURLY_LABEL:
+            report.piece = "U heures pleines= ";
+            break;
+        case REPORT_VOLTAGE_HOURLY:
+            if (v->battery_volt_hourly[report.index] == -1.0f) {
+                put_str(" ?");
+            }
+            else {
+                put_str(" ");
+                put_tenths(10.0f * v->battery_volt_hourly[report.index], "V");
+            }
+            break;
+        case REPORT_CAPACITY_HOURLY_LABEL:
+            report.piece = "\nCapa heures pleines= ";
+            break;
+        case REPORT_CAPACITY_HOURLY:
+            if (v->battery_charge_hourly[report.index] == 0) {
+                put_str(" ?");
+            }
+            else {
+                put_str(" ");
+                put_uint(v->battery_charge_hourly[report.index] / 1000, 1);
+            }
+            break;
+        case REPORT_WIND_GENERATOR:
+            put_str("\nNbre de commutations eolienne= ");
+            put_int(v->num_wind_generator_movements);
+            put_str("\n");
+            break;
+        case REPORT_TEMP:
+            if (v->temp_min != TEMP_INVALID && v->temp_max != TEMP_INVALID) {
+                put_str("Temp min,max= ");
+                put_tenths(10.0f * v->temp_min, "C");
+                put_str(",");
+                put_tenths(10.0f * v->temp_max, "C");
+                put_str("\n");
+            }
+            break;
+        case REPORT_BEACONS:
+            put_str("Nbre de balises= ");
+            put_int(v->num_beacons_sent);
+            put_str("\n");
+            break;
+        case REPORT_BEACON_ENERGY:
+            if (v->num_beacons_energy) {
+                // The total is in the breakdown of REPORT_ENERGY
+                put_str("Energie par balise moy,max= ");
+                put_uint(v->beacons_energy_mwh / v->num_beacons_energy, 1);
+                put_str(",");
+                put_uint(v->beacon_energy_max_mwh, 1);
+                put_str("mWh\n");
+            }
+            break;
+        case REPORT_ENERGY:
+            put_str("Energie balises,QSO,repos= ");
+            put_uint(report.energy_mwh[ENERGY_BEACONS] / 1000, 1);
+            put_str(",");
+            put_uint(report.energy_mwh[ENERGY_QSO] / 1000, 1);
+            put_str(",");
+            put_uint(report.energy_mwh[ENERGY_IDLE] / 1000, 1);
+            put_str("Wh\n");
+            break;
+        case REPORT_ENERGY_QRP:
+            if (report.energy_qrp_mwh) {
+                put_str("Energie en QRP= ");
+                put_uint(report.energy_qrp_mwh / 1000, 1);
+                put_str("Wh\n");
+            }
+            break;
+        case REPORT_ENERGY_CHECK:
+            // Consumption while the battery was not charged
+            if (report.energy_checked) {
+                put_str("Energie mesuree,estimee= ");
+                put_uint(report.measured_mwh / 1000, 1);
+                put_str(",");
+                put_uint(report.estimated_mwh / 1000, 1);
+                put_str("Wh\n");
+            }
+            break;
+        case REPORT_TX_SWITCH:
+            put_str("Nbre de TX ON/OFF= ");
+            put_int(v->num_tx_switch);
+            put_str("\n");
+            break;
+        case REPORT_ANTIBAVARD:
+            put_str("Nbre anti-bavard= ");
+            put_int(v->num_antibavard);
+            put_str("\n");
+            break;
+        case REPORT_QSO_MAX:
+            put_str("QSO le plus long= ");
+            put_duration_hms(v->max_qso_duration);
+            put_str("\n");
+            break;
+        case REPORT_SATELLITES:
+            put_str("Sat GPS= ");
+            put_int(report.num_sv_used);
+            put_str("\n");
+            break;
+        case REPORT_HISTOGRAMS:
+            {
+                const int32_t *p = report.percentiles[report.index];
+                if (p[0] != -1) {
+                    const uint32_t divisor = report_histograms[report.index].divisor;
+                    const char *unit = report_histograms[report.index].unit;
+                    put_str(report_histograms[report.index].label);
+                    put_uint(p[0] / divisor, 1);
+                    put_str(unit);
+                    put_str(",");
+                    put_uint(p[1] / divisor, 1);
+                    put_str(unit);
+                    put_str("\n");
+                }
+            }
+            break;
+        case REPORT_OCCUPANCY:
+            if (report.occupancy[0] != -1) {
+                put_str("Occupation horaire p50,max= ");
+                put_tenths(report.occupancy[0], "%");
+                put_str(",");
+                put_tenths(report.occupancy[1], "%");
+                put_str("\n");
+            }
+            break;
+        case REPORT_BREAKER:
+            report.piece = report.wind_disconnected ?
+                "Disjoncteur eolienne= Off\n" : "Disjoncteur eolienne= On\n";
+            break;
+        case REPORT_END:
+            break;
     }
+}
 
-    uint64_t uptime = timestamp_now();
-    uint64_t uptime_j = uptime / (24 * 3600 * 1000);
-    uptime -= uptime_j * (24 * 3600 * 1000);
-    uint64_t uptime_h = uptime / (3600 * 1000);
-    uptime -= uptime_h * (3600 * 1000);
-    uint64_t uptime_m = uptime / (60 * 1000);
+static enum report_step report_following_step(void)
+{
+    switch (report.step) {
+        case REPORT_UPTIME:
+            // Without values, the report only says we are alive
+            return report.values.values_valid ? REPORT_VOLTAGE : REPORT_END;
+        case REPORT_VOLTAGE_HOURLY:
+        case REPORT_CAPACITY_HOURLY:
+            if (++report.index < 24) {
+                return report.step;
+            }
+            break;
+        case REPORT_HISTOGRAMS:
+            if (++report.index < (int)NUM_REPORT_HISTOGRAMS) {
+                return report.step;
+            }
+            break;
+        case REPORT_END:
+            return REPORT_END;
+        default:
+            break;
+    }
 
-    stats_end_ix += snprintf(stats_text + stats_end_ix, STATS_LEN - 1 - stats_end_ix,
-            "Version= %s\n"
-            "Uptime= %dj%dh%dm\n",
-            vc_get_version(),
-            (int)uptime_j, (int)uptime_h, (int)uptime_m);
+    report.index = 0;
+    return report.step + 1;
+}
 
-    if (values_valid == 0) {
-        return stats_text;
+static void report_load_step(void)
+{
+    report.scratch_len = 0;
+    report.piece = NULL;
+    report_format_step();
+
+    if (report.piece) {
+        report.piece_len = strlen(report.piece);
     }
+    else {
+        report.piece = report.scratch;
+        report.piece_len = report.scratch_len;
+    }
+}
 
-    const int battery_min_decivolt = 10.0f * battery_volt_min;
-    const int battery_max_decivolt = 10.0f * battery_volt_max;
+void stats_report_begin(int wind_disconnected)
+{
+    stats_copy(&report.values);
+    report.wind_disconnected = wind_disconnected;
+    report.date_valid = stats_date(&report.date);
+    report.uptime_m = timestamp_now() / (60 * 1000);
+    report.num_sv_used = num_sv_used;
+
+    report.energy_qrp_mwh = 0;
+    for (int group = 0; group < ENERGY_NUM_GROUPS; group++) {
+        report.energy_mwh[group] = energy_group_mwh(group, -1);
+        report.energy_qrp_mwh += energy_group_mwh(group, 1);
+    }
+    report.energy_checked = energy_cross_check(&report.measured_mwh, &report.estimated_mwh);
 
-    stats_end_ix += snprintf(stats_text + stats_end_ix, STATS_LEN - 1 - stats_end_ix,
-            "U min,max= %dV%01d,%dV%01d\n"
-            "Temps QRP= %d%%\n",
-            battery_min_decivolt / 10, battery_min_decivolt % 10,
-            battery_max_decivolt / 10, battery_max_decivolt % 10,
-            100 * num_qrp / (num_qrp + num_qro));
+    for (size_t h = 0; h < NUM_REPORT_HISTOGRAMS; h++) {
+        report.percentiles[h][0] = stats_percentile(report_histograms[h].hist, 50);
+        report.percentiles[h][1] = stats_percentile(report_histograms[h].hist, 90);
+    }
+    report.occupancy[0] = stats_percentile(STATS_HIST_OCCUPANCY, 50);
+    report.occupancy[1] = stats_percentile(STATS_HIST_OCCUPANCY, 100);
 
-    stats_end_ix += snprintf(stats_text + stats_end_ix, STATS_LEN - 1 - stats_end_ix,
-            "U heures pleines= ");
+    report.step = REPORT_HEADER;
+    report.index = 0;
+    report_load_step();
+}
 
-    for (int h = 0; h < 24; h++) {
-        if (battery_volt_hourly[h] == -1.0f) {
-            stats_end_ix += snprintf(stats_text + stats_end_ix,
-                    STATS_LEN - 1 - stats_end_ix, " ?");
-        }
-        else {
-            const int battery_decivolts = 10.0f * battery_volt_hourly[h];
-            stats_end_ix += snprintf(
-                    stats_text + stats_end_ix, STATS_LEN - 1 - stats_end_ix, " %dV%01d",
-                    battery_decivolts / 10, battery_decivolts % 10);
+void stats_report_sent()
+{
+    values_valid = 0;
+    energy_clear();
+}
+
+size_t stats_report_read(char *buf, size_t len)
+{
+    size_t n = 0;
+
+    while (n < len && report.step != REPORT_END) {
+        if (report.piece_len == 0) {
+            report.step = report_following_step();
+            report_load_step();
+            continue;
         }
+
+        const size_t count = (len - n < report.piece_len) ? len - n : report.piece_len;
+        memcpy(buf + n, report.piece, count);
+        report.piece += count;
+        report.piece_len -= count;
+        n += count;
     }
 
-    stats_end_ix += snprintf(stats_text + stats_end_ix, STATS_LEN - 1 - stats_end_ix,
-            "\nCapa heures pleines= ");
+    return n;
+}
 
-    for (int h = 0; h < 24; h++) {
-        if (battery_charge_hourly[h] == 0) {
-            stats_end_ix += snprintf(stats_text + stats_end_ix,
-                    STATS_LEN - 1 - stats_end_ix, " ?");
-        }
-        else {
-            stats_end_ix += snprintf(
-                    stats_text + stats_end_ix, STATS_LEN - 1 - stats_end_ix, " %ld",
-                    battery_charge_hourly[h] / 1000);
-        }
+// Days between 1970-01-01 and 2000-01-01
+#define TELEMETRY_EPOCH_DAYS 10957
+
+static struct telemetry_report telemetry_report;
+static uint8_t telemetry_frame[TELEMETRY_FRAME_LEN];
+static uint8_t telemetry_symbols[TELEMETRY_SYMBOLS_LEN];
+
+const uint8_t* stats_telemetry_build(int wind_disconnected)
+{
+    struct telemetry_report *r = &telemetry_report;
+    memset(r, 0, sizeof(*r));
+
+    struct tm time = {0};
+    r->date = stats_date(&time) ?
+        calendar_to_epoch(&time) / 86400 - TELEMETRY_EPOCH_DAYS :
+        TELEMETRY_DATE_UNKNOWN;
+    r->uptime_s = timestamp_now() / 1000;
+    r->values_valid = values_valid;
+    r->wind_disconnected = wind_disconnected;
+
+    r->voltage_min = battery_volt_min < 0.0f ? -1 : roundf(10.0f * battery_volt_min);
+    r->voltage_max = battery_volt_max < 0.0f ? -1 : roundf(10.0f * battery_volt_max);
+    for (int hour = 0; hour < 24; hour++) {
+        r->voltage_hourly[hour] = battery_volt_hourly[hour] < 0.0f ?
+            -1 : roundf(10.0f * battery_volt_hourly[hour]);
+        r->capacity_hourly[hour] = battery_charge_hourly[hour] / 1000;
     }
 
-    stats_end_ix += snprintf(stats_text + stats_end_ix, STATS_LEN - 1 - stats_end_ix,
-            "\n"
-            "Nbre de commutations eolienne= %d\n",
-            num_wind_generator_movements);
-
-    if (temp_min != TEMP_INVALID && temp_max != TEMP_INVALID) {
-        const int temp_min_positive = (temp_min > 0);
-        const int temp_max_positive = (temp_max > 0);
-
-        const int temp_min_decidegree = 10.0f * fabsf(temp_min);
-        const int temp_max_decidegree = 10.0f * fabsf(temp_max);
-        stats_end_ix += snprintf(stats_text + stats_end_ix, STATS_LEN - 1 - stats_end_ix,
-                "Temp min,max= %s%dC%01d,%s%dC%01d\n",
-                temp_min_positive ? "" : "-",
-                temp_min_decidegree / 10, temp_min_decidegree % 10,
-                temp_max_positive ? "" : "-",
-                temp_max_decidegree / 10, temp_max_decidegree % 10);
-    }
-
-    uint64_t qso_duration = max_qso_duration;
-    int qso_duration_h = qso_duration / (3600 * 1000);
-    qso_duration -= qso_duration_h * ( 3600 * 1000);
-    int qso_duration_m = qso_duration / (60 * 1000);
-    qso_duration -= qso_duration_m * (60 * 1000);
-    int qso_duration_s = qso_duration / (1000);
-
-    stats_end_ix += snprintf(stats_text + stats_end_ix, STATS_LEN - 1 - stats_end_ix,
-            "Nbre de balises= %d\n"
-            "Nbre de TX ON/OFF= %d\n"
-            "Nbre anti-bavard= %d\n"
-            "QSO le plus long= %dh%dm%ds\n"
-            "Sat GPS= %d\n",
-            num_beacons_sent,
-            num_tx_switch,
-            num_antibavard,
-            qso_duration_h, qso_duration_m, qso_duration_s,
-            num_sv_used
-            );
-
-    stats_end_ix += snprintf(stats_text + stats_end_ix, STATS_LEN - 1 - stats_end_ix,
-            "Disjoncteur eolienne= %s\n",
-            wind_disconnected ? "Off" : "On");
+    r->temp_valid = temp_min != TEMP_INVALID && temp_max != TEMP_INVALID;
+    if (r->temp_valid) {
+        r->temp_min = roundf(10.0f * temp_min);
+        r->temp_max = roundf(10.0f * temp_max);
+    }
 
-    values_valid = 0;
+    r->qrp_percent = (num_qrp + num_qro) ? 100 * num_qrp / (num_qrp + num_qro) : -1;
+    r->wind_generator_movements = num_wind_generator_movements;
+    r->beacons = num_beacons_sent;
+    r->tx_switch = num_tx_switch;
+    r->antibavard = num_antibavard;
+    r->sv_used = num_sv_used;
+    r->max_qso_s = max_qso_duration / 1000;
+
+    int i = 0;
+    for (size_t h = 0; h < NUM_REPORT_HISTOGRAMS; h++) {
+        r->percentiles[i++] = stats_percentile(report_histograms[h].hist, 50);
+        r->percentiles[i++] = stats_percentile(report_histograms[h].hist, 90);
+    }
+    r->percentiles[i++] = stats_percentile(STATS_HIST_OCCUPANCY, 50);
+    r->percentiles[i++] = stats_percentile(STATS_HIST_OCCUPANCY, 100);
+
+    telemetry_pack(r, telemetry_frame);
+    telemetry_encode(telemetry_frame, telemetry_symbols);
 
-    return stats_text;
+    return telemetry_symbols;
 }
@@ -24,18 +24,86 @@
 
 #pragma once
 #include <stdint.h>
+#include <stddef.h>
 
 void stats_battery_at_full_hour(int hour, float u_bat, uint32_t capacity_mAh);
 void stats_voltage(float u_bat);
+// Capacity from the coulomb counter, 0 if unknown
+void stats_capacity(uint32_t capacity_mAh);
 
 void stats_temp(float temp);
 void stats_wind_generator_moved(void);
 void stats_beacon_sent(void);
+// Energy taken by the transmission of a beacon, in mWh
+void stats_beacon_energy(uint32_t energy_mwh);
 void stats_tx_switched(int tx_on);
+// Total time the TX was on since boot, wraps after 49 days
+uint32_t stats_tx_on_ms(void);
 void stats_anti_bavard_triggered(void);
 void stats_num_gnss_sv(int num_sv);
 
+// Called at every sample of the squelch and the 1750 detector, with the
+// local hour or -1 if the time is not known.
+void stats_channel_sample(int sq, int det_1750, int hour);
+
+enum stats_histogram {
+    STATS_HIST_QSO,             // TX on duration, ms
+    STATS_HIST_SQ_OPEN,         // Squelch open duration, ms
+    STATS_HIST_SQ_GAP,          // Time between squelch openings, ms
+    STATS_HIST_1750_LATENCY,    // Squelch opening to 1750 detection, ms
+    STATS_HIST_OCCUPANCY,       // Squelch open time per hour, per mille
+    STATS_HIST_NUM,
+};
+
+// Percentile of the values since the last statistics text, within 12.5%.
+// percent 100 gives the maximum. Returns -1 if there are no values.
+int32_t stats_percentile(enum stats_histogram hist, int percent);
+
+// Channel occupancy during the given hour, in per mille, or -1 if unknown
+int stats_occupancy_hourly(int hour);
+
+/* Time series of the voltage, capacity and temperature, see
+ * Core/timeseries.h. Tier 0 has one point per minute for 6 hours, tier 1
+ * one per 10 minutes for 3 days, tier 2 one per hour for 30 days.
+ */
+enum stats_trend {
+    STATS_TREND_VOLTAGE,    // 10 mV
+    STATS_TREND_CAPACITY,   // 100 mAh
+    STATS_TREND_TEMP,       // 0.1 degree
+    STATS_TREND_NUM,
+};
+
+// Number of points of a trend in the given tier
+int stats_trend_count(enum stats_trend trend, int tier);
+
+// Export all points of the trends as text, one line per call to
+// stats_trend_export_line(), which returns NULL at the end. Both must be
+// called from the task that calls stats_voltage() and stats_temp().
+void stats_trend_export_start(void);
+const char* stats_trend_export_line(void);
+
 // Must be called in regular intervals
 void stats_qrp(int is_qrp);
 
-const char* stats_build_text(int wind_disconnected);
+// Write the statistics to the store, see Core/store.h. Return 1 on success.
+int stats_save(void);
+// Read them back after a reset. Return 1 if there were any.
+int stats_restore(void);
+
+/* The statistics report is generated while it is sent, see
+ * cw_psk_push_source(). stats_report_begin() starts a new report with the
+ * current values, stats_report_read() writes its next characters into buf,
+ * at most len, and returns how many. It returns 0 at the end of the report.
+ * Only stats_report_read() may be called from the PSK task.
+ */
+void stats_report_begin(int wind_disconnected);
+size_t stats_report_read(char *buf, size_t len);
+
+// Once the report or the telemetry frame is sent, the next values start a new day
+void stats_report_sent(void);
+
+/* Instead of the text report, the statistics can be sent as a telemetry
+ * frame, see Core/telemetry.h. Returns the TELEMETRY_SYMBOLS symbols of the
+ * frame, valid until the next call.
+ */
+const uint8_t* stats_telemetry_build(int wind_disconnected);
@@ -0,0 +1,256 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "Core/store.h"
+#include "Core/flash.h"
+#include "Core/crc.h"
+#include <string.h>
+
+#define STORE_MAGIC 0x47535431ul // GST1
+#define STORE_BLANK 0xFFFFFFFFul
+
+// Sector header: magic, generation, erase count, CRC of the three
+#define HEADER_WORDS 4
+
+// Record: header word, payload, CRC of header and payload
+#define RECORD_TAG 0xA5ul
+#define RECORD_HEADER(key, len) ((RECORD_TAG << 24) | ((uint32_t)(key) << 16) | (len))
+#define RECORD_TAG_OF(h) ((h) >> 24)
+#define RECORD_KEY_OF(h) (((h) >> 16) & 0xFF)
+#define RECORD_LEN_OF(h) ((h) & 0xFFFF)
+#define PAYLOAD_WORDS(len) (((len) + 3) / 4)
+#define RECORD_WORDS(len) (PAYLOAD_WORDS(len) + 2)
+
+static int usable = 0;
+static int active;
+static uint32_t write_pos;
+// Word offset of the latest record of each key, 0 if none
+static uint32_t record_index[STORE_MAX_KEYS];
+static struct store_stats stats;
+
+static uint32_t record_crc(const uint32_t *record, uint32_t len)
+{
+    return crc32(record, 4 + len);
+}
+
+static int header_valid(const uint32_t *sector)
+{
+    return sector[0] == STORE_MAGIC && sector[3] == crc32(sector, 12);
+}
+
+// Find the records of the active sector
+static void scan(void)
+{
+    const uint32_t *sector = flash_store_sector(active);
+
+    memset(record_index, 0, sizeof(record_index));
+    stats.corrupt_records = 0;
+
+    uint32_t pos = HEADER_WORDS;
+    while (pos < FLASH_STORE_SECTOR_WORDS) {
+        const uint32_t h = sector[pos];
+        if (h == STORE_BLANK) {
+            break;
+        }
+
+        const uint32_t len = RECORD_LEN_OF(h);
+        if (RECORD_TAG_OF(h) != RECORD_TAG || len > STORE_MAX_RECORD ||
+                RECORD_KEY_OF(h) >= STORE_MAX_KEYS ||
+                pos + RECORD_WORDS(len) > FLASH_STORE_SECTOR_WORDS) {
+            // The length cannot be trusted, nothing more is written here
+            pos = FLASH_STORE_SECTOR_WORDS;
+            stats.corrupt_records++;
+            break;
+        }
+
+        if (sector[pos + 1 + PAYLOAD_WORDS(len)] == record_crc(sector + pos, len)) {
+            record_index[RECORD_KEY_OF(h)] = pos;
+        }
+        else {
+            stats.corrupt_records++;
+        }
+        pos += RECORD_WORDS(len);
+    }
+
+    write_pos = pos;
+    stats.used_words = pos;
+}
+
+static int write_header(int sector, uint32_t generation, uint32_t erase_count)
+{
+    uint32_t header[HEADER_WORDS] = { STORE_MAGIC, generation, erase_count, 0 };
+    header[3] = crc32(header, 12);
+    return flash_store_program(sector, 0, header, HEADER_WORDS);
+}
+
+// Copy the latest records to the other sector, and make it active
+static int compact(void)
+{
+    const int other = !active;
+    const uint32_t *from = flash_store_sector(active);
+    const uint32_t *to = flash_store_sector(other);
+
+    uint32_t erase_count = stats.erase_count[active];
+    if (header_valid(to)) {
+        erase_count = to[2];
+    }
+    erase_count++;
+
+    if (!flash_store_erase(other)) {
+        return 0;
+    }
+
+    uint32_t new_index[STORE_MAX_KEYS] = {0};
+    uint32_t pos = HEADER_WORDS;
+    for (int key = 0; key < STORE_MAX_KEYS; key++) {
+        if (record_index[key]) {
+            const uint32_t words = RECORD_WORDS(RECORD_LEN_OF(from[record_index[key]]));
+            if (!flash_store_program(other, pos, from + record_index[key], words)) {
+                return 0;
+            }
+            new_index[key] = pos;
+            pos += words;
+        }
+    }
+
+    // The header is written last, an interrupted compaction leaves the
+    // active sector as it was
+    if (!write_header(other, stats.generation + 1, erase_count)) {
+        return 0;
+    }
+
+    active = other;
+    write_pos = pos;
+    memcpy(record_index, new_index, sizeof(record_index));
+    stats.generation++;
+    stats.erase_count[other] = erase_count;
+    stats.active_sector = other;
+    stats.used_words = pos;
+    stats.compactions++;
+    return 1;
+}
+
+int store_init(void)
+{
+    memset(&stats, 0, sizeof(stats));
+    usable = 0;
+    active = -1;
+
+    for (int s = 0; s < FLASH_STORE_SECTORS; s++) {
+        const uint32_t *sector = flash_store_sector(s);
+        if (header_valid(sector)) {
+            stats.erase_count[s] = sector[2];
+            if (active == -1 || sector[1] > stats.generation) {
+                active = s;
+                stats.generation = sector[1];
+            }
+        }
+    }
+
+    if (active == -1) {
+        // First use, or both headers lost
+        memset(record_index, 0, sizeof(record_index));
+        if (!flash_store_erase(0) || !write_header(0, 1, 1)) {
+            return 0;
+        }
+        active = 0;
+        stats.generation = 1;
+        stats.erase_count[0] = 1;
+    }
+
+    stats.active_sector = active;
+    scan();
+    usable = 1;
+    return 1;
+}
+
+// Program a record through a small buffer, the calling task has little stack
+static int program_record(uint32_t pos, uint32_t header, const uint8_t *data, uint32_t len)
+{
+    if (!flash_store_program(active, pos, &header, 1)) {
+        return 0;
+    }
+    pos++;
+
+    uint32_t chunk[8];
+    for (uint32_t done = 0; done < len; done += sizeof(chunk)) {
+        const uint32_t n = len - done < sizeof(chunk) ? len - done : sizeof(chunk);
+        const uint32_t words = PAYLOAD_WORDS(n);
+        chunk[words - 1] = 0;
+        memcpy(chunk, data + done, n);
+        if (!flash_store_program(active, pos, chunk, words)) {
+            return 0;
+        }
+        pos += words;
+    }
+
+    uint32_t crc = crc32_update(CRC32_INIT, &header, 4);
+    crc = ~crc32_update(crc, data, len);
+    return flash_store_program(active, pos, &crc, 1);
+}
+
+int store_write(uint8_t key, const void *data, uint32_t len)
+{
+    if (!usable || key >= STORE_MAX_KEYS || len > STORE_MAX_RECORD) {
+        return 0;
+    }
+
+    const uint32_t words = RECORD_WORDS(len);
+
+    if (write_pos + words > FLASH_STORE_SECTOR_WORDS) {
+        if (!compact() || write_pos + words > FLASH_STORE_SECTOR_WORDS) {
+            return 0;
+        }
+    }
+
+    const uint32_t pos = write_pos;
+    // Whatever happens, this space is used
+    write_pos += words;
+    stats.used_words = write_pos;
+
+    if (!program_record(pos, RECORD_HEADER(key, len), data, len)) {
+        return 0;
+    }
+
+    record_index[key] = pos;
+    return 1;
+}
+
+int store_read(uint8_t key, void *data, uint32_t len)
+{
+    if (!usable || key >= STORE_MAX_KEYS || record_index[key] == 0) {
+        return -1;
+    }
+
+    const uint32_t *record = flash_store_sector(active) + record_index[key];
+    const uint32_t record_len = RECORD_LEN_OF(record[0]);
+
+    memcpy(data, record + 1, len < record_len ? len : record_len);
+    return record_len;
+}
+
+void store_get_stats(struct store_stats *s)
+{
+    *s = stats;
+}
@@ -0,0 +1,76 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Log-structured store of small records in the internal flash.
+ *
+ * Records are appended to the active sector with a CRC each, and reading a
+ * key gives its latest record. When the active sector is full, the latest
+ * record of every key is copied to the other sector, which becomes active
+ * once its header is written. The two sectors therefore wear equally, and
+ * every record is written at most once more per compaction.
+ *
+ * At boot, the valid header with the highest generation designates the
+ * active sector, and one pass over it finds the latest records. A record
+ * cut by a reset fails its CRC and is skipped, an unreadable record header
+ * ends the sector early.
+ *
+ * Only one task may use the store. Compaction erases a sector, see
+ * Core/flash.h, which should not happen during a transmission.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Keys of the records
+#define STORE_KEY_STATS 1
+#define STORE_KEY_ENERGY 2
+#define STORE_MAX_KEYS 8
+
+// Largest record payload in bytes
+#define STORE_MAX_RECORD 512
+
+struct store_stats {
+    uint32_t generation;
+    uint32_t erase_count[2];
+    int active_sector;
+    // Words in use in the active sector
+    uint32_t used_words;
+    // Records with a bad CRC found at boot
+    uint32_t corrupt_records;
+    uint32_t compactions;
+};
+
+// Find the latest records, and prepare an empty store if none is valid.
+// Return 1 if the store is usable.
+int store_init(void);
+
+// Append a record. Return 1 on success.
+int store_write(uint8_t key, const void *data, uint32_t len);
+
+// Copy up to len bytes of the latest record of the key. Return the length
+// of the record, or -1 if there is none.
+int store_read(uint8_t key, void *data, uint32_t len);
+
+void store_get_stats(struct store_stats *stats);
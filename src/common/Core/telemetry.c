@@ -0,0 +1,183 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "Core/telemetry.h"
+#include "Core/histogram.h"
+#include "Core/crc.h"
+#include <string.h>
+
+// 4-bit delta of a missing hourly value
+#define NIBBLE_MISSING -8
+#define NIBBLE_MAX 7
+
+static uint32_t saturate(uint32_t value, uint32_t max)
+{
+    return value < max ? value : max;
+}
+
+static void put_u16(uint8_t *p, uint32_t value)
+{
+    value = saturate(value, 0xFFFF);
+    p[0] = value >> 8;
+    p[1] = value;
+}
+
+// 0.1 degree to 0.5 degree in an int8, -128 if unknown
+static uint8_t temp_half_degrees(int valid, int16_t tenths)
+{
+    if (!valid) {
+        return (uint8_t)INT8_MIN;
+    }
+
+    int half = (tenths >= 0 ? tenths + 2 : tenths - 2) / 5;
+    if (half < INT8_MIN + 1) {
+        half = INT8_MIN + 1;
+    }
+    else if (half > INT8_MAX) {
+        half = INT8_MAX;
+    }
+    return (uint8_t)(int8_t)half;
+}
+
+/* The first known value, then 24 deltas of 4 bits, high nibble first. The
+ * deltas saturate and the following ones correct the error. Unknown values
+ * are given as a negative number.
+ */
+static void put_hourly(uint8_t *nibbles, const int32_t *values, int32_t *reference)
+{
+    *reference = 0;
+    for (int hour = 0; hour < 24; hour++) {
+        if (values[hour] >= 0) {
+            *reference = values[hour];
+            break;
+        }
+    }
+
+    int32_t previous = *reference;
+    for (int hour = 0; hour < 24; hour++) {
+        int delta = NIBBLE_MISSING;
+        if (values[hour] >= 0) {
+            const int32_t d = values[hour] - previous;
+            delta = d > NIBBLE_MAX ? NIBBLE_MAX : d < -NIBBLE_MAX ? -NIBBLE_MAX : d;
+            previous += delta;
+        }
+
+        if (hour % 2 == 0) {
+            nibbles[hour / 2] = (delta & 0x0F) << 4;
+        }
+        else {
+            nibbles[hour / 2] |= delta & 0x0F;
+        }
+    }
+}
+
+void telemetry_pack(const struct telemetry_report *r, uint8_t *frame)
+{
+    memset(frame, 0, TELEMETRY_FRAME_LEN);
+
+    frame[0] = (TELEMETRY_VERSION << 4) |
+        (r->values_valid ? 0x01 : 0) |
+        (r->wind_disconnected ? 0x02 : 0) |
+        (r->temp_valid ? 0x04 : 0);
+    put_u16(frame + 1, r->date);
+    put_u16(frame + 3, r->uptime_s / 3600);
+
+    if (r->values_valid) {
+        frame[5] = r->voltage_min < 0 ? 0 : saturate(r->voltage_min, 0xFF);
+        frame[6] = r->voltage_max < 0 ? 0 : saturate(r->voltage_max, 0xFF);
+        frame[7] = temp_half_degrees(r->temp_valid, r->temp_min);
+        frame[8] = temp_half_degrees(r->temp_valid, r->temp_max);
+        frame[9] = r->qrp_percent < 0 ? 0xFF : saturate(r->qrp_percent, 100);
+        frame[10] = saturate(r->wind_generator_movements, 0xFF);
+        frame[11] = saturate(r->beacons, 0xFF);
+        put_u16(frame + 12, r->tx_switch);
+        frame[14] = saturate(r->antibavard, 0xFF);
+        frame[15] = saturate(r->sv_used, 0xFF);
+        put_u16(frame + 16, r->max_qso_s);
+
+        int32_t values[24];
+        int32_t reference;
+
+        for (int hour = 0; hour < 24; hour++) {
+            values[hour] = r->voltage_hourly[hour] > 0xFF ? 0xFF : r->voltage_hourly[hour];
+        }
+        put_hourly(frame + 19, values, &reference);
+        frame[18] = reference;
+
+        for (int hour = 0; hour < 24; hour++) {
+            values[hour] = r->capacity_hourly[hour] ? r->capacity_hourly[hour] : -1;
+        }
+        put_hourly(frame + 33, values, &reference);
+        put_u16(frame + 31, reference);
+
+        for (int i = 0; i < TELEMETRY_PERCENTILES; i++) {
+            frame[45 + i] = r->percentiles[i] < 0 ? 0xFF :
+                histogram_bucket(r->percentiles[i]);
+        }
+    }
+
+    const uint32_t crc = crc32(frame, TELEMETRY_PAYLOAD_LEN);
+    frame[TELEMETRY_PAYLOAD_LEN] = crc >> 24;
+    frame[TELEMETRY_PAYLOAD_LEN + 1] = crc >> 16;
+    frame[TELEMETRY_PAYLOAD_LEN + 2] = crc >> 8;
+    frame[TELEMETRY_PAYLOAD_LEN + 3] = crc;
+}
+
+static void put_symbol(uint8_t *symbols, int index, int bit)
+{
+    if (bit) {
+        symbols[index / 8] |= 0x80 >> (index % 8);
+    }
+}
+
+void telemetry_encode(const uint8_t *frame, uint8_t *symbols)
+{
+    memset(symbols, 0, TELEMETRY_SYMBOLS_LEN);
+
+    for (int i = 0; i < TELEMETRY_SYNC_BITS; i++) {
+        put_symbol(symbols, i, (TELEMETRY_SYNC >> (TELEMETRY_SYNC_BITS - 1 - i)) & 1);
+    }
+
+    /* Coded bit n goes to row n / COLUMNS and column n % COLUMNS, and is sent
+     * at position column * ROWS + row. The padding at the end of the last
+     * row stays 0.
+     */
+    uint32_t state = 0;
+    int n = 0;
+    for (int i = 0; i < 8 * TELEMETRY_FRAME_LEN + TELEMETRY_CONSTRAINT - 1; i++) {
+        const int bit = (i < 8 * TELEMETRY_FRAME_LEN) ?
+            (frame[i / 8] >> (7 - i % 8)) & 1 : 0;
+        state = ((state << 1) | bit) & ((1 << TELEMETRY_CONSTRAINT) - 1);
+
+        for (int k = 0; k < 2; k++, n++) {
+            const uint32_t poly = k ? TELEMETRY_POLY_B : TELEMETRY_POLY_A;
+            const int coded = __builtin_parity(state & poly);
+            const int row = n / TELEMETRY_INTERLEAVER_COLUMNS;
+            const int column = n % TELEMETRY_INTERLEAVER_COLUMNS;
+            put_symbol(symbols,
+                    TELEMETRY_SYNC_BITS + column * TELEMETRY_INTERLEAVER_ROWS + row,
+                    coded);
+        }
+    }
+}
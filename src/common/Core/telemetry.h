@@ -0,0 +1,112 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Binary telemetry frame with the daily statistics, a compact alternative
+ * to the text report of Core/stats.c. See decoder/telemdecode.py.
+ *
+ * The report is packed into TELEMETRY_PAYLOAD_LEN bytes of fixed-point
+ * fields, with the hourly series as a reference value followed by 4-bit
+ * deltas, and protected by a CRC-32. The frame is encoded with the K=7 rate
+ * 1/2 convolutional code (polynomials 171 and 133 octal), interleaved over
+ * TELEMETRY_INTERLEAVER_ROWS rows, and preceded by the TELEMETRY_SYNC word.
+ * The resulting bits are sent as PSK symbols, a 0 being a phase change.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TELEMETRY_VERSION 1
+
+#define TELEMETRY_PAYLOAD_LEN 55
+#define TELEMETRY_FRAME_LEN (TELEMETRY_PAYLOAD_LEN + 4)
+
+#define TELEMETRY_SYNC 0x1ACFFC1Dul
+#define TELEMETRY_SYNC_BITS 32
+
+#define TELEMETRY_CONSTRAINT 7
+#define TELEMETRY_POLY_A 0171
+#define TELEMETRY_POLY_B 0133
+// The encoder is flushed with zeros at the end of the frame
+#define TELEMETRY_CODED_BITS (2 * (8 * TELEMETRY_FRAME_LEN + TELEMETRY_CONSTRAINT - 1))
+
+// Coded bits are written by rows and sent by columns. A burst of errors
+// shorter than the number of rows touches every row at most once.
+#define TELEMETRY_INTERLEAVER_ROWS 16
+#define TELEMETRY_INTERLEAVER_COLUMNS \
+    ((TELEMETRY_CODED_BITS + TELEMETRY_INTERLEAVER_ROWS - 1) / TELEMETRY_INTERLEAVER_ROWS)
+
+#define TELEMETRY_SYMBOLS (TELEMETRY_SYNC_BITS + \
+        TELEMETRY_INTERLEAVER_ROWS * TELEMETRY_INTERLEAVER_COLUMNS)
+#define TELEMETRY_SYMBOLS_LEN ((TELEMETRY_SYMBOLS + 7) / 8)
+
+#define TELEMETRY_DATE_UNKNOWN 0xFFFF
+
+// p50 and p90 of the QSO, squelch open, squelch gap and 1750 latency
+// histograms, then p50 and maximum of the hourly occupancy
+#define TELEMETRY_PERCENTILES 10
+
+struct telemetry_report {
+    // Days since 2000-01-01 in local time, or TELEMETRY_DATE_UNKNOWN
+    uint16_t date;
+    uint32_t uptime_s;
+    // 0 if only the date and uptime are known
+    int values_valid;
+    int wind_disconnected;
+
+    // Voltages in 0.1 V, -1 if unknown
+    int16_t voltage_min;
+    int16_t voltage_max;
+    int16_t voltage_hourly[24];
+    // Capacity in Ah, 0 if unknown
+    uint16_t capacity_hourly[24];
+
+    // Temperatures in 0.1 degree
+    int temp_valid;
+    int16_t temp_min;
+    int16_t temp_max;
+
+    // Percentage of the time in QRP, -1 if unknown
+    int qrp_percent;
+
+    uint32_t wind_generator_movements;
+    uint32_t beacons;
+    uint32_t tx_switch;
+    uint32_t antibavard;
+    uint32_t sv_used;
+    uint32_t max_qso_s;
+
+    // Values of the histograms of Core/stats.h, -1 if empty. They are sent
+    // as their histogram bucket, within 12.5%.
+    int32_t percentiles[TELEMETRY_PERCENTILES];
+};
+
+// Pack the report into frame, which must hold TELEMETRY_FRAME_LEN bytes,
+// CRC included.
+void telemetry_pack(const struct telemetry_report *report, uint8_t *frame);
+
+// Encode the frame into TELEMETRY_SYMBOLS symbols, sync word included,
+// packed most significant bit first into TELEMETRY_SYMBOLS_LEN bytes.
+void telemetry_encode(const uint8_t *frame, uint8_t *symbols);
@@ -0,0 +1,246 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "Core/timeseries.h"
+#include <string.h>
+
+#define DELTA_MISSING INT8_MIN
+// The rest of the block is unused
+#define DELTA_END (INT8_MIN + 1)
+// The value follows in the next two slots, most significant byte first
+#define DELTA_ESCAPE (INT8_MIN + 2)
+#define ESCAPE_LEN 3
+#define DELTA_MAX (INT8_MAX - 2)
+
+// Finer points per point, one minute of samples for the first tier
+static const uint16_t tier_inputs[TIMESERIES_TIERS] = {0, 10, 6};
+static const uint32_t tier_period_s[TIMESERIES_TIERS] = {60, 600, 3600};
+static const uint16_t tier_blocks[TIMESERIES_TIERS] = {
+    TIMESERIES_TIER0_BLOCKS, TIMESERIES_TIER1_BLOCKS, TIMESERIES_TIER2_BLOCKS};
+
+// Longest gap filled with missing points, the hourly tier is then empty
+#define MAX_GAP_MINUTES (31ul * 24 * 60)
+
+void timeseries_init(struct timeseries *ts)
+{
+    memset(ts, 0, sizeof(*ts));
+
+    uint16_t first = 0;
+    for (int t = 0; t < TIMESERIES_TIERS; t++) {
+        ts->tiers[t].first_block = first;
+        ts->tiers[t].num_blocks = tier_blocks[t];
+        first += tier_blocks[t];
+    }
+}
+
+static int16_t average(int32_t sum, uint16_t count)
+{
+    if (count == 0) {
+        return TIMESERIES_MISSING;
+    }
+    // Round to nearest
+    return sum >= 0 ? (sum + count / 2) / count : (sum - count / 2) / count;
+}
+
+static int block_points(const struct timeseries_block *block)
+{
+    int points = 0;
+    int slot = 0;
+    while (slot < TIMESERIES_BLOCK_LEN && block->delta[slot] != DELTA_END) {
+        slot += (block->delta[slot] == DELTA_ESCAPE) ? ESCAPE_LEN : 1;
+        points++;
+    }
+    return points;
+}
+
+static struct timeseries_block* next_block(struct timeseries *ts, struct timeseries_tier *tier)
+{
+    tier->head = (tier->head + 1) % tier->num_blocks;
+    tier->fill = 0;
+
+    struct timeseries_block *block = &ts->blocks[tier->first_block + tier->head];
+    if (tier->full_blocks < tier->num_blocks - 1) {
+        tier->full_blocks++;
+    }
+    else {
+        // Overwrite the oldest block
+        tier->points -= block_points(block);
+    }
+    block->reference = tier->last;
+    return block;
+}
+
+static void push(struct timeseries *ts, int t, int16_t value)
+{
+    struct timeseries_tier *tier = &ts->tiers[t];
+
+    struct timeseries_block *block = &ts->blocks[tier->first_block + tier->head];
+    if (tier->fill == TIMESERIES_BLOCK_LEN) {
+        block = next_block(ts, tier);
+    }
+    else if (tier->fill == 0) {
+        block->reference = tier->last;
+    }
+
+    int8_t delta = DELTA_MISSING;
+    if (value != TIMESERIES_MISSING) {
+        if (!tier->last_valid) {
+            // Only missing points before in this block
+            block->reference = value;
+            tier->last = value;
+            tier->last_valid = 1;
+        }
+
+        const int32_t d = (int32_t)value - tier->last;
+        tier->last = value;
+        if (d <= DELTA_MAX && d >= -DELTA_MAX) {
+            delta = d;
+        }
+        else if (tier->fill + ESCAPE_LEN <= TIMESERIES_BLOCK_LEN) {
+            block->delta[tier->fill++] = DELTA_ESCAPE;
+            block->delta[tier->fill++] = (uint16_t)value >> 8;
+            delta = (uint16_t)value & 0xFF;
+        }
+        else {
+            while (tier->fill < TIMESERIES_BLOCK_LEN) {
+                block->delta[tier->fill++] = DELTA_END;
+            }
+            block = next_block(ts, tier);
+            delta = 0;
+        }
+    }
+    block->delta[tier->fill++] = delta;
+    tier->points++;
+
+    if (t + 1 < TIMESERIES_TIERS) {
+        if (value != TIMESERIES_MISSING) {
+            tier->sum += value;
+            tier->count++;
+        }
+        if (++tier->inputs == tier_inputs[t + 1]) {
+            const int16_t avg = average(tier->sum, tier->count);
+            tier->sum = 0;
+            tier->count = 0;
+            tier->inputs = 0;
+            push(ts, t + 1, avg);
+        }
+    }
+}
+
+void timeseries_add(struct timeseries *ts, uint64_t now_ms, int16_t value)
+{
+    const uint32_t minute = now_ms / 60000;
+
+    if (!ts->started) {
+        ts->started = 1;
+        ts->minute = minute;
+    }
+
+    if (minute != ts->minute) {
+        push(ts, 0, average(ts->sum, ts->count));
+        ts->sum = 0;
+        ts->count = 0;
+
+        uint32_t gap = minute - ts->minute - 1;
+        if (gap > MAX_GAP_MINUTES) {
+            gap = MAX_GAP_MINUTES;
+        }
+        for (uint32_t i = 0; i < gap; i++) {
+            push(ts, 0, TIMESERIES_MISSING);
+        }
+        ts->minute = minute;
+    }
+
+    if (value != TIMESERIES_MISSING) {
+        ts->sum += value;
+        ts->count++;
+    }
+}
+
+uint32_t timeseries_period_s(int tier)
+{
+    return (tier >= 0 && tier < TIMESERIES_TIERS) ? tier_period_s[tier] : 0;
+}
+
+int timeseries_count(const struct timeseries *ts, int tier)
+{
+    if (tier < 0 || tier >= TIMESERIES_TIERS) {
+        return 0;
+    }
+    return ts->tiers[tier].points;
+}
+
+void timeseries_iter_init(struct timeseries_iter *it, const struct timeseries *ts, int tier)
+{
+    it->ts = ts;
+    it->tier = tier;
+    it->point = 0;
+    it->remaining = timeseries_count(ts, tier);
+    if (it->remaining) {
+        const struct timeseries_tier *t = &ts->tiers[tier];
+        it->block = (t->head + t->num_blocks - t->full_blocks) % t->num_blocks;
+    }
+}
+
+int timeseries_iter_next(struct timeseries_iter *it, int16_t *value)
+{
+    if (it->remaining == 0) {
+        return 0;
+    }
+
+    const struct timeseries_tier *t = &it->ts->tiers[it->tier];
+    const struct timeseries_block *block = &it->ts->blocks[t->first_block + it->block];
+
+    if (block->delta[it->point] == DELTA_END) {
+        it->point = 0;
+        it->block = (it->block + 1) % t->num_blocks;
+        block = &it->ts->blocks[t->first_block + it->block];
+    }
+
+    if (it->point == 0) {
+        it->value = block->reference;
+    }
+
+    const int8_t delta = block->delta[it->point];
+    if (delta == DELTA_MISSING) {
+        *value = TIMESERIES_MISSING;
+    }
+    else if (delta == DELTA_ESCAPE) {
+        it->value = (uint16_t)((uint8_t)block->delta[it->point + 1] << 8 |
+                (uint8_t)block->delta[it->point + 2]);
+        it->point += ESCAPE_LEN - 1;
+        *value = it->value;
+    }
+    else {
+        it->value += delta;
+        *value = it->value;
+    }
+
+    if (++it->point == TIMESERIES_BLOCK_LEN) {
+        it->point = 0;
+        it->block = (it->block + 1) % t->num_blocks;
+    }
+    it->remaining--;
+    return 1;
+}
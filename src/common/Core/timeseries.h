@@ -0,0 +1,110 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Round-robin time series of a slowly varying measurement, in three
+ * resolutions: one point per minute for 6 hours, per 10 minutes for 3 days
+ * and per hour for 30 days. Each point is the average of the finer points,
+ * or of the samples for the first tier.
+ *
+ * The points are kept in blocks of 16, with a 16-bit reference value and an
+ * 8-bit difference per point. A difference too large for 8 bits is replaced
+ * by an escape code and the value, which take three slots. The oldest block
+ * of a tier is dropped when the tier is full.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define TIMESERIES_TIERS 3
+#define TIMESERIES_BLOCK_LEN 16
+// A point without any valid sample
+#define TIMESERIES_MISSING INT16_MIN
+
+/* Three blocks more than needed, the oldest is dropped sixteen points at a time
+ * and large steps take more room.
+ */
+#define TIMESERIES_TIER0_BLOCKS (6 * 60 / TIMESERIES_BLOCK_LEN + 3)
+#define TIMESERIES_TIER1_BLOCKS (3 * 24 * 6 / TIMESERIES_BLOCK_LEN + 3)
+#define TIMESERIES_TIER2_BLOCKS (30 * 24 / TIMESERIES_BLOCK_LEN + 3)
+#define TIMESERIES_BLOCKS (TIMESERIES_TIER0_BLOCKS + TIMESERIES_TIER1_BLOCKS + TIMESERIES_TIER2_BLOCKS)
+
+struct timeseries_block {
+    int16_t reference;
+    int8_t delta[TIMESERIES_BLOCK_LEN];
+};
+
+struct timeseries_tier {
+    uint16_t first_block;
+    uint16_t num_blocks;
+    // Block being written, slots used in it and complete blocks before it
+    uint16_t head;
+    uint16_t fill;
+    uint16_t full_blocks;
+    uint16_t points;
+    // Value the decoder will have after the last point
+    int16_t last;
+    int last_valid;
+    // Average of the finer points, for the next tier
+    int32_t sum;
+    uint16_t count;
+    uint16_t inputs;
+};
+
+struct timeseries {
+    struct timeseries_tier tiers[TIMESERIES_TIERS];
+    struct timeseries_block blocks[TIMESERIES_BLOCKS];
+    uint32_t minute;
+    int started;
+    int32_t sum;
+    uint16_t count;
+};
+
+struct timeseries_iter {
+    const struct timeseries *ts;
+    int tier;
+    int block;
+    int point;
+    int remaining;
+    int16_t value;
+};
+
+void timeseries_init(struct timeseries *ts);
+
+// Add a sample taken at timestamp_now() now_ms. The value is in the units of
+// the series, or TIMESERIES_MISSING.
+void timeseries_add(struct timeseries *ts, uint64_t now_ms, int16_t value);
+
+// Seconds per point of a tier
+uint32_t timeseries_period_s(int tier);
+
+// Number of points of a tier
+int timeseries_count(const struct timeseries *ts, int tier);
+
+// Walk through the points of a tier, oldest first
+void timeseries_iter_init(struct timeseries_iter *it, const struct timeseries *ts, int tier);
+
+// Give the next point, which can be TIMESERIES_MISSING. Returns 0 when there
+// are no more points.
+int timeseries_iter_next(struct timeseries_iter *it, int16_t *value);
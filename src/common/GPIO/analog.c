@@ -26,15 +26,34 @@
 
 #define SUPPLY_HISTORY_LEN 10
 
-// Hysteresis:
-#define SUPPLY_QRP 12.1f
-#define SUPPLY_QRO 12.5f
-
 static float supply_history[SUPPLY_HISTORY_LEN];
 static int supply_history_ix = 0;
 static int supply_history_ready = 0;
 static int last_qrp = 0;
 
+float analog_measure_12v(void)
+{
+    struct analog_snapshot snapshot;
+    if (!analog_get_snapshot(&snapshot)) {
+        return 0.0f;
+    }
+
+    return snapshot.supply;
+}
+
+int analog_measure_swr(int *forward_mv, int* reflected_mv)
+{
+    struct analog_snapshot snapshot;
+    if (!analog_get_snapshot(&snapshot)) {
+        return 0;
+    }
+
+    *forward_mv = snapshot.swr_forward_mv;
+    *reflected_mv = snapshot.swr_reflected_mv;
+
+    return 1;
+}
+
 // Return 1 if analog supply is too low
 int analog_supply_too_low(void)
 {
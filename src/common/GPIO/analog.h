@@ -25,8 +25,29 @@
 #pragma once
 #include <stdint.h>
 
+// QRP hysteresis on the supply voltage, in V
+#define SUPPLY_QRP 12.1f
+#define SUPPLY_QRO 12.5f
+
+struct analog_snapshot {
+    // Supply voltage in V
+    float supply;
+    // SWR detector voltages in mV
+    int swr_forward_mv;
+    int swr_reflected_mv;
+};
+
+/* Start the continuous measurement of the supply and SWR inputs */
 void analog_init(void);
 
+/* Give the average of the latest samples of all inputs. Takes constant
+ * time and does not suspend the scheduler.
+ * Returns 0 if no samples are available yet, 1 otherwise.
+ *
+ * Warning, do not run from interrupt context!
+ */
+int analog_get_snapshot(struct analog_snapshot *snapshot);
+
 /* Measure the 12V supply voltage, in 0.5V increments.
  * Returns 0.0f in case of error
  *
@@ -24,43 +24,54 @@
 
 #include "Core/common.h"
 #include "GPIO/batterycharge.h"
-#include "FreeRTOS.h"
-#include "task.h"
+#include "GPIO/usart.h"
 #include <string.h>
-#include <stdlib.h>
-#include <stdio.h>
-#include <errno.h>
-
-// Hysteresis:
-#define CHARGE_QRP 1300000
-#define CHARGE_QRO 1350000
 
 // If last message older than that, consider the coulomb-counter broken
 #define MAX_MESSAGE_AGE 60 // seconds
 
-static uint64_t timestamp_last_message;
+/* Same publication as the GPS time in GPS/gps.c: the coulomb counter task
+ * writes the other buffer and increments the sequence, the readers retry if
+ * the sequence changed while they copied.
+ */
+static struct batterycharge_telemetry telemetry_writer;
+static struct batterycharge_telemetry telemetry_published[2];
+static volatile uint32_t telemetry_seq = 0;
 
-static int breaker_valid;
-static int breaker_is_open;
-static int charge_valid;
-static uint32_t last_charge;
 static int charge_qrp;
 
-static void reset(void)
+static void telemetry_publish(void)
 {
-    breaker_valid = 0;
-    breaker_is_open = -1;
-    charge_valid = 0;
-    last_charge = 0;
-    charge_qrp = 0;
+    const uint32_t next = telemetry_seq + 1;
+    telemetry_published[next & 1] = telemetry_writer;
+    __sync_synchronize();
+    telemetry_seq = next;
 }
 
-static void check_timestamp(void)
+static void telemetry_read(struct batterycharge_telemetry *t)
 {
-    const uint64_t now = timestamp_now();
-    if (timestamp_last_message + MAX_MESSAGE_AGE * 1000 < now) {
-        reset();
-    }
+    uint32_t seq;
+    do {
+        seq = telemetry_seq;
+        __sync_synchronize();
+        *t = telemetry_published[seq & 1];
+        __sync_synchronize();
+    } while (seq != telemetry_seq);
+}
+
+static int is_silent(const struct batterycharge_telemetry *t, uint64_t now)
+{
+    return t->last_message == 0 || t->last_message + MAX_MESSAGE_AGE * 1000 < now;
+}
+
+static void invalidate(struct batterycharge_telemetry *t)
+{
+    t->capacity_updated = 0;
+    t->breaker_updated = 0;
+    t->charge_updated = 0;
+    t->discharge_updated = 0;
+    t->cells_updated = 0;
+    t->error_updated = 0;
 }
 
 void batterycharge_init()
@@ -68,99 +79,102 @@ void batterycharge_init()
     /* No need to protect the variables, this is called at init before the
      * tasks get created.
      */
-    timestamp_last_message = 0;
-    reset();
+    memset(&telemetry_writer, 0, sizeof(telemetry_writer));
+    charge_qrp = 0;
+    telemetry_publish();
 }
 
 void batterycharge_push_message(const char *ccounter_msg)
 {
     const uint64_t ts = timestamp_now();
+    struct batterycharge_telemetry *t = &telemetry_writer;
 
-    const int is_capa = strncmp(ccounter_msg, "CAPA", 4) == 0;
-    const int is_eol = strncmp(ccounter_msg, "DISJEOL", 7) == 0;
-
-    /* We ignore TEXT, ERROR, VBAT+ and VBAT- for the moment, and only parse CAPA.
-     * The \r\n has been trimmed off the message already, therefore the value
-     * should extend until the end of string.
+    /* The \r\n has been trimmed off the message already, therefore the
+     * values extend until the end of string.
      */
-    if (is_capa || is_eol) {
-        size_t ix_value = 0;
-        int second_found = 0;
-
-        for (size_t ix = 0; ccounter_msg[ix] != '\0'; ix++) {
-            if (ccounter_msg[ix] == ',') {
-                if (! second_found) {
-                    second_found = 1;
-                }
-                else {
-                    ix_value = ix + 1;
-                }
-            }
-        }
-
-        const char *valuestr = ccounter_msg + ix_value;
-        if (is_capa) {
-            /* Field is the capacity in mAh */
-            char *endptr;
-            errno = 0;
-            const uint32_t value = strtol(valuestr, &endptr, 10);
-            if (errno == 0 && endptr != valuestr) {
-                taskDISABLE_INTERRUPTS();
-                last_charge = value;
-                charge_valid = 1;
-                timestamp_last_message = ts;
-                taskENABLE_INTERRUPTS();
+    const char *nul = memchr(ccounter_msg, '\0', MAX_CCOUNTER_SENTENCE_LEN);
+    const size_t len = nul ? (size_t)(nul - ccounter_msg) : MAX_CCOUNTER_SENTENCE_LEN;
+
+    struct ccounter_msg msg;
+    const enum ccounter_type type = ccounter_parse(ccounter_msg, len, &msg);
+
+    if (type == CCOUNTER_NONE) {
+        t->num_malformed++;
+        telemetry_publish();
+        return;
+    }
+
+    // Values from before a silence are not mixed with the new ones
+    if (is_silent(t, ts)) {
+        invalidate(t);
+    }
+    t->last_message = ts;
+
+    switch (type) {
+        case CCOUNTER_CAPA:
+            t->capacity_mah = msg.value;
+            t->capacity_updated = ts;
+            break;
+        case CCOUNTER_DISJEOL:
+            // On means the wind generator is connected
+            t->breaker_open = !msg.value;
+            t->breaker_updated = ts;
+            break;
+        case CCOUNTER_VBAT_IN:
+        case CCOUNTER_VBAT_OUT:
+            if (type == CCOUNTER_VBAT_IN) {
+                t->charge_ma = msg.value;
+                t->charge_updated = ts;
             }
-        }
-        else if (is_eol) {
-            /* Field is either `On` or `Off` */
-            const int is_on = strncmp(valuestr, "On", 2) == 0;
-            const int is_off = strncmp(valuestr, "Off", 2) == 0;
-
-            taskDISABLE_INTERRUPTS();
-            if (is_on) {
-                breaker_valid = 1;
-                breaker_is_open = 0;
-                timestamp_last_message = ts;
+            else {
+                t->discharge_ma = msg.value;
+                t->discharge_updated = ts;
             }
-            else if (is_off) {
-                breaker_valid = 1;
-                breaker_is_open = 1;
-                timestamp_last_message = ts;
+            if (msg.num_cells > 0) {
+                t->num_cells = msg.num_cells;
+                memcpy(t->cell_mv, msg.cell_mv, sizeof(t->cell_mv));
+                t->cells_updated = ts;
             }
-            taskENABLE_INTERRUPTS();
-        }
+            break;
+        case CCOUNTER_ERROR:
+            t->error_code = msg.value;
+            t->error_updated = ts;
+            t->num_errors++;
+            break;
+        case CCOUNTER_TEXT:
+            t->num_texts++;
+            break;
+        default:
+            break;
     }
+
+    telemetry_publish();
 }
 
-uint32_t batterycharge_retrieve_last_capacity()
+void batterycharge_telemetry(struct batterycharge_telemetry *t)
 {
-    uint32_t ret = 0;
-    taskDISABLE_INTERRUPTS();
-    check_timestamp();
+    telemetry_read(t);
 
-    if (charge_valid) {
-        ret = last_charge;
+    if (is_silent(t, timestamp_now())) {
+        invalidate(t);
     }
-    taskENABLE_INTERRUPTS();
-    return ret;
 }
 
-int batterycharge_too_low()
+uint32_t batterycharge_retrieve_last_capacity()
 {
-    uint32_t c = 0;
-    int b = -1;
-    taskDISABLE_INTERRUPTS();
-    check_timestamp();
+    struct batterycharge_telemetry t;
+    batterycharge_telemetry(&t);
 
-    if (charge_valid) {
-        c = last_charge;
-    }
+    return t.capacity_updated ? t.capacity_mah : 0;
+}
 
-    if (breaker_valid) {
-        b = breaker_is_open;
-    }
-    taskENABLE_INTERRUPTS();
+int batterycharge_too_low()
+{
+    struct batterycharge_telemetry t;
+    batterycharge_telemetry(&t);
+
+    const uint32_t c = t.capacity_updated ? t.capacity_mah : 0;
+    const int b = t.breaker_updated ? t.breaker_open : -1;
 
     /* Disconnected wind generator implies QRP always */
     if (b == 1) {
@@ -181,14 +195,8 @@ int batterycharge_too_low()
 
 int batterycharge_wind_disconnected()
 {
-    int b = -1;
-    taskDISABLE_INTERRUPTS();
-    check_timestamp();
-
-    if (breaker_valid) {
-        b = breaker_is_open;
-    }
-    taskENABLE_INTERRUPTS();
+    struct batterycharge_telemetry t;
+    batterycharge_telemetry(&t);
 
-    return b;
+    return t.breaker_updated ? t.breaker_open : -1;
 }
@@ -22,15 +22,60 @@
  * SOFTWARE.
 */
 
+/* Telemetry from the Glutte-batteries coulomb counter.
+ *
+ * The coulomb counter task parses the messages, see GPIO/ccounter.h, into a
+ * snapshot that the other tasks read without locking. All values become
+ * invalid when the counter stays silent for more than a minute.
+ */
+
 #pragma once
 #include <stdint.h>
+#include "GPIO/ccounter.h"
+
+// QRP hysteresis on the capacity, in mAh
+#define CHARGE_QRP 1300000
+#define CHARGE_QRO 1350000
+
+struct batterycharge_telemetry {
+    // timestamp_now() of the last message, 0 if there was none
+    uint64_t last_message;
+
+    // Each group is valid if its timestamp_now() is not 0
+    uint64_t capacity_updated;
+    uint32_t capacity_mah;
+
+    uint64_t breaker_updated;
+    int breaker_open;
+
+    uint64_t charge_updated;
+    int32_t charge_ma;
+    uint64_t discharge_updated;
+    int32_t discharge_ma;
+
+    uint64_t cells_updated;
+    int num_cells;
+    int32_t cell_mv[CCOUNTER_MAX_CELLS];
+
+    uint64_t error_updated;
+    int32_t error_code;
+
+    // Since boot
+    uint32_t num_errors;
+    uint32_t num_texts;
+    uint32_t num_malformed;
+};
 
 void batterycharge_init(void);
 
 // Parse a message received from the glutte coulomb counter and update
-// internal state accordingly
+// internal state accordingly. Only called from the coulomb counter task.
 void batterycharge_push_message(const char *ccounter_msg);
 
+// Copy the current telemetry, with the groups invalidated if the counter
+// is silent
+void batterycharge_telemetry(struct batterycharge_telemetry *t);
+
 // Get the last received battery capacity in mAh, or 0 if not valid
 uint32_t batterycharge_retrieve_last_capacity(void);
 
@@ -0,0 +1,192 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "GPIO/ccounter.h"
+#include <string.h>
+
+struct cursor {
+    const char *pos;
+    const char *end;
+    // Set after the last field was returned
+    int done;
+};
+
+// Return the next field and advance past its comma, NULL after the last one
+static const char *next_field(struct cursor *c, size_t *len)
+{
+    if (c->done) {
+        return NULL;
+    }
+
+    const char *field = c->pos;
+    const char *comma = memchr(field, ',', c->end - field);
+    if (comma) {
+        *len = comma - field;
+        c->pos = comma + 1;
+    }
+    else {
+        *len = c->end - field;
+        c->pos = c->end;
+        c->done = 1;
+    }
+    return field;
+}
+
+static int field_is(const char *field, size_t len, const char *name)
+{
+    const size_t name_len = strlen(name);
+    return len == name_len && memcmp(field, name, len) == 0;
+}
+
+// Convert a decimal number with optional sign, the whole field must be used
+static int field_to_int(const char *field, size_t len, int32_t *value)
+{
+    size_t i = 0;
+    int negative = 0;
+
+    if (len > 0 && (field[0] == '-' || field[0] == '+')) {
+        negative = field[0] == '-';
+        i++;
+    }
+
+    if (i == len) {
+        return 0;
+    }
+
+    uint32_t v = 0;
+    for (; i < len; i++) {
+        const unsigned digit = (unsigned)(field[i] - '0');
+        if (digit > 9 || v > (INT32_MAX - digit) / 10) {
+            return 0;
+        }
+        v = v * 10 + digit;
+    }
+
+    *value = negative ? -(int32_t)v : (int32_t)v;
+    return 1;
+}
+
+static enum ccounter_type parse_type(const char *field, size_t len)
+{
+    if (field_is(field, len, "CAPA")) return CCOUNTER_CAPA;
+    if (field_is(field, len, "DISJEOL")) return CCOUNTER_DISJEOL;
+    if (field_is(field, len, "VBAT+")) return CCOUNTER_VBAT_IN;
+    if (field_is(field, len, "VBAT-")) return CCOUNTER_VBAT_OUT;
+    if (field_is(field, len, "TEXT")) return CCOUNTER_TEXT;
+    if (field_is(field, len, "ERROR")) return CCOUNTER_ERROR;
+    return CCOUNTER_NONE;
+}
+
+enum ccounter_type ccounter_parse(const char *line, size_t len, struct ccounter_msg *msg)
+{
+    struct cursor c = { line, line + len, 0 };
+    size_t field_len;
+    const char *field;
+    int32_t v;
+
+    msg->type = CCOUNTER_NONE;
+    msg->num_cells = 0;
+    msg->text = NULL;
+    msg->text_len = 0;
+
+    field = next_field(&c, &field_len);
+    const enum ccounter_type type = parse_type(field, field_len);
+    if (type == CCOUNTER_NONE) {
+        return CCOUNTER_NONE;
+    }
+
+    field = next_field(&c, &field_len);
+    if (field == NULL || !field_to_int(field, field_len, &v) || v < 0) {
+        return CCOUNTER_NONE;
+    }
+    msg->seconds = v;
+
+    if (type == CCOUNTER_TEXT) {
+        // The remainder of the line, commas included
+        if (c.done) {
+            return CCOUNTER_NONE;
+        }
+        msg->text = c.pos;
+        msg->text_len = c.end - c.pos;
+        msg->type = type;
+        return type;
+    }
+
+    field = next_field(&c, &field_len);
+    if (field == NULL) {
+        return CCOUNTER_NONE;
+    }
+
+    switch (type) {
+        case CCOUNTER_DISJEOL:
+            if (field_is(field, field_len, "On")) {
+                msg->value = 1;
+            }
+            else if (field_is(field, field_len, "Off")) {
+                msg->value = 0;
+            }
+            else {
+                return CCOUNTER_NONE;
+            }
+            break;
+        case CCOUNTER_CAPA:
+            if (!field_to_int(field, field_len, &msg->value) || msg->value < 0) {
+                return CCOUNTER_NONE;
+            }
+            break;
+        case CCOUNTER_VBAT_IN:
+        case CCOUNTER_VBAT_OUT:
+            if (!field_to_int(field, field_len, &msg->value)) {
+                return CCOUNTER_NONE;
+            }
+            while ((field = next_field(&c, &field_len)) != NULL) {
+                if (msg->num_cells == CCOUNTER_MAX_CELLS ||
+                        !field_to_int(field, field_len, &msg->cell_mv[msg->num_cells])) {
+                    return CCOUNTER_NONE;
+                }
+                msg->num_cells++;
+            }
+            break;
+        case CCOUNTER_ERROR:
+            if (!field_to_int(field, field_len, &msg->value)) {
+                return CCOUNTER_NONE;
+            }
+            if (!c.done) {
+                msg->text = c.pos;
+                msg->text_len = c.end - c.pos;
+            }
+            break;
+        default:
+            return CCOUNTER_NONE;
+    }
+
+    if (type == CCOUNTER_CAPA || type == CCOUNTER_DISJEOL) {
+        if (next_field(&c, &field_len) != NULL) {
+            return CCOUNTER_NONE;
+        }
+    }
+
+    msg->type = type;
+    return type;
+}
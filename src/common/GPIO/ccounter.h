@@ -0,0 +1,76 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Tokenizer for the lines of the Glutte-batteries coulomb counter.
+ *
+ * Every line is TYPE,<seconds>,<values...> without the \r\n:
+ *   CAPA,<s>,<mAh>                 remaining capacity
+ *   DISJEOL,<s>,On|Off             wind generator breaker
+ *   VBAT+,<s>,<mA>[,<mV>...]       charge current, then the cell voltages
+ *   VBAT-,<s>,<mA>[,<mV>...]       discharge current, then the cell voltages
+ *   TEXT,<s>,<text>                free text, may contain commas
+ *   ERROR,<s>,<code>[,<text>]      error code and optional description
+ *
+ * The line is not modified nor copied, texts point into it. Numbers are
+ * converted without the C library, so that a malformed line cannot set errno
+ * or read past the given length.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+enum ccounter_type {
+    CCOUNTER_NONE = 0,
+    CCOUNTER_CAPA,
+    CCOUNTER_DISJEOL,
+    CCOUNTER_VBAT_IN,
+    CCOUNTER_VBAT_OUT,
+    CCOUNTER_TEXT,
+    CCOUNTER_ERROR,
+};
+
+#define CCOUNTER_MAX_CELLS 4
+
+struct ccounter_msg {
+    enum ccounter_type type;
+    // Clock of the coulomb counter, in seconds
+    uint32_t seconds;
+
+    // CAPA: mAh. DISJEOL: 1 when On, 0 when Off. VBAT: mA. ERROR: code.
+    int32_t value;
+
+    // VBAT: cell voltages in mV
+    int num_cells;
+    int32_t cell_mv[CCOUNTER_MAX_CELLS];
+
+    // TEXT and ERROR: text inside the line, not terminated
+    const char *text;
+    size_t text_len;
+};
+
+// Tokenize one line of len characters. Return its type and fill msg, or
+// CCOUNTER_NONE if the line is malformed.
+enum ccounter_type ccounter_parse(const char *line, size_t len, struct ccounter_msg *msg);
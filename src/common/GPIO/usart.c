@@ -29,27 +29,34 @@
 #include "Core/common.h"
 #include "GPIO/usart.h"
 #include "GPIO/analog.h"
+#include "Core/log_ring.h"
 #include "FreeRTOS.h"
 #include "task.h"
 #include "queue.h"
+#include "semphr.h"
 
-// The ISRs write into these buffer, for NMEA input and Coulomb counter
-static char nmea_sentence[MAX_NMEA_SENTENCE_LEN];
-static int  nmea_sentence_last_written = 0;
+// The ISR writes into this buffer for the Coulomb counter
 static char ccounter_msg[MAX_CCOUNTER_SENTENCE_LEN];
 static int  ccounter_msg_last_written = 0;
 
-// Once a completed NMEA sentence is received in the ISR,
-// it is appended to this queue
-static QueueHandle_t usart_nmea_queue;
+/* GPS reception: the platform writes into the ring and reports its write
+ * position. Positions are counted in bytes since startup, and wrap around
+ * at 2^32, which is a multiple of the ring length.
+ */
+char usart_gps_rx_ring[GPS_RX_RING_LEN];
+static uint32_t gps_rx_last_pos = 0;
+static volatile uint32_t gps_rx_written = 0;
+static uint32_t gps_rx_read = 0;
+static uint32_t gps_rx_dropped = 0;
+static SemaphoreHandle_t gps_rx_semaphore;
 
 // Once a full line (ending in \r\n) is received on USART2,
 // it is appended to this queue
 static QueueHandle_t usart_ccounter_queue;
 
 void usart_gps_init() {
-    usart_nmea_queue = xQueueCreate(15, MAX_NMEA_SENTENCE_LEN);
-    if (usart_nmea_queue == 0) {
+    gps_rx_semaphore = xSemaphoreCreateBinary();
+    if (gps_rx_semaphore == 0) {
         while(1); /* fatal error */
     }
 
@@ -67,67 +74,140 @@ void usart_gps_puts(const char* str) {
     xTaskResumeAll();
 }
 
+void usart_gps_write(const uint8_t *data, uint32_t len) {
+    vTaskSuspendAll();
+    usart_write(USART3, data, len);
+    xTaskResumeAll();
+}
+
 #define MAX_MSG_LEN 80
-static char usart_debug_message[MAX_MSG_LEN];
 
-void usart_debug_timestamp() {
+/* Debug messages are copied into the log ring with a timestamp, and sent by
+ * the platform in the background. This costs a few microseconds, does not
+ * suspend the scheduler, and can be called from interrupts.
+ */
+static uint32_t usart_debug_timestamp(char *ts_str)
+{
     // Don't call printf here, to reduce stack usage
     uint64_t now = timestamp_now();
-    if (now == 0) {
-        usart_puts(USART2, "[0] ");
+    char digits[20];
+    int n = 0;
+
+    do {
+        digits[n++] = '0' + (now % 10);
+        now /= 10;
+    } while (now > 0);
+
+    uint32_t len = 0;
+    ts_str[len++] = '[';
+    while (n > 0) {
+        ts_str[len++] = digits[--n];
     }
-    else {
-        char ts_str[64];
-        int i = 63;
-
-        ts_str[i--] = '\0';
-        ts_str[i--] = ' ';
-        ts_str[i--] = ']';
+    ts_str[len++] = ']';
+    ts_str[len++] = ' ';
+    return len;
+}
 
-        while (now > 0 && i >= 0) {
-            ts_str[i--] = '0' + (now % 10);
-            now /= 10;
-        }
-        ts_str[i] = '[';
+static void usart_debug_send(const char *hdr, const char *str, const char *end)
+{
+    char ts_str[24];
+    const uint32_t ts_len = usart_debug_timestamp(ts_str);
+    const uint32_t hdr_len = strlen(hdr);
+    uint32_t str_len = strlen(str);
+    const uint32_t end_len = strlen(end);
+
+    if (ts_len + hdr_len + str_len + end_len > LOG_RING_MAX_MSG) {
+        str_len = LOG_RING_MAX_MSG - ts_len - hdr_len - end_len;
+    }
 
-        usart_puts(USART2, &ts_str[i]);
+    uint32_t token;
+    char *dst = log_ring_reserve(ts_len + hdr_len + str_len + end_len, &token);
+    if (dst == NULL) {
+        return;
     }
+
+    memcpy(dst, ts_str, ts_len);
+    dst += ts_len;
+    memcpy(dst, hdr, hdr_len);
+    dst += hdr_len;
+    memcpy(dst, str, str_len);
+    dst += str_len;
+    memcpy(dst, end, end_len);
+    log_ring_commit(token);
+
+    usart_debug_kick();
 }
 
 void usart_debug(const char *format, ...) {
+    char message[MAX_MSG_LEN];
+
     va_list list;
     va_start(list, format);
-    vsnprintf(usart_debug_message, MAX_MSG_LEN-1, format, list);
-
-    vTaskSuspendAll();
-    usart_debug_timestamp();
-    usart_puts(USART2, usart_debug_message);
-    xTaskResumeAll();
-
+    vsnprintf(message, MAX_MSG_LEN-1, format, list);
     va_end(list);
+
+    usart_debug_send("", message, "");
 }
 
 void usart_debug_puts(const char* str) {
 #ifdef SIMULATOR
     fprintf(stderr, "DEBUG: %s", str);
 #endif
-    vTaskSuspendAll();
-    usart_debug_timestamp();
-    usart_puts(USART2, str);
-    xTaskResumeAll();
+    usart_debug_send("", str, "");
 }
 
 void usart_debug_puts_header(const char* hdr, const char* str) {
-    vTaskSuspendAll();
-    usart_debug_timestamp();
-    usart_puts(USART2, hdr);
-    usart_puts(USART2, str);
-    usart_puts(USART2, "\r\n");
-    xTaskResumeAll();
+    usart_debug_send(hdr, str, "\r\n");
+}
+
+void usart_gps_rx_advance(uint32_t pos)
+{
+// Warning: running in interrupt context
+    BaseType_t require_context_switch = pdFALSE;
+
+    gps_rx_written += (pos + GPS_RX_RING_LEN - gps_rx_last_pos) % GPS_RX_RING_LEN;
+    gps_rx_last_pos = pos % GPS_RX_RING_LEN;
+
+    xSemaphoreGiveFromISR(gps_rx_semaphore, &require_context_switch);
+    portYIELD_FROM_ISR(require_context_switch);
 }
 
-int usart_get_nmea_sentence(char *nmea) {
-    return xQueueReceive(usart_nmea_queue, nmea, portMAX_DELAY);
+uint32_t usart_gps_rx_dropped(void)
+{
+    return gps_rx_dropped;
+}
+
+const char* usart_gps_rx_wait(uint32_t *len, uint32_t timeout) {
+    while (1) {
+        const uint32_t written = gps_rx_written;
+
+        /* The platform may already have written up to half a ring beyond
+         * what it reported. Anything older than that is unreliable.
+         */
+        if (written - gps_rx_read > GPS_RX_RING_LEN / 2) {
+            gps_rx_dropped += written - gps_rx_read;
+            gps_rx_read = written;
+        }
+
+        if (written != gps_rx_read) {
+            const uint32_t offset = gps_rx_read % GPS_RX_RING_LEN;
+            uint32_t available = written - gps_rx_read;
+
+            // Until the end of the ring, the rest comes with the next call
+            if (offset + available > GPS_RX_RING_LEN) {
+                available = GPS_RX_RING_LEN - offset;
+            }
+
+            gps_rx_read += available;
+            *len = available;
+            return &usart_gps_rx_ring[offset];
+        }
+
+        if (xSemaphoreTake(gps_rx_semaphore, timeout) == pdFALSE) {
+            *len = 0;
+            return usart_gps_rx_ring;
+        }
+    }
 }
 
 int usart_get_ccounter_msg(char *msg) {
@@ -169,47 +249,3 @@ void usart_process_char(char c) {
 
     portYIELD_FROM_ISR(require_context_switch);
 }
-
-static void usart_clear_nmea_buffer(void) {
-    for (int i = 0; i < MAX_NMEA_SENTENCE_LEN; i++) {
-        nmea_sentence[i] = '\0';
-    }
-    nmea_sentence_last_written = 0;
-}
-
-void usart_gps_process_char(char c)
-{
-// Warning: running in interrupt context
-    BaseType_t require_context_switch = pdFALSE;
-
-    if (nmea_sentence_last_written == 0) {
-        if (c == '$') {
-            // Likely new start of sentence
-            nmea_sentence[nmea_sentence_last_written] = c;
-            nmea_sentence_last_written++;
-        }
-    }
-    else if (nmea_sentence_last_written < MAX_NMEA_SENTENCE_LEN) {
-        nmea_sentence[nmea_sentence_last_written] = c;
-        nmea_sentence_last_written++;
-
-        if (c == '\n') {
-            int success = xQueueSendToBackFromISR(
-                    usart_nmea_queue,
-                    nmea_sentence,
-                    &require_context_switch);
-
-            if (success == pdFALSE) {
-                trigger_fault(FAULT_SOURCE_USART);
-            }
-
-            usart_clear_nmea_buffer();
-        }
-    }
-    else {
-        // Buffer overrun without a meaningful NMEA message.
-        usart_clear_nmea_buffer();
-    }
-
-    portYIELD_FROM_ISR(require_context_switch);
-}
@@ -22,11 +22,14 @@
  * SOFTWARE.
 */
 
-/* This handles the USART 3 to the GPS receiver, and fills a queue of
- * NMEA messages.
+/* This handles the USART 3 to the GPS receiver. The received bytes are
+ * written into a ring buffer, by DMA on the board, and are read from there
+ * in place.
  *
  * It also handles the debug USART 2 to send messages to the PC and
- * receiv measurements from the Glutte-batteries coulomb counter.
+ * receiv measurements from the Glutte-batteries coulomb counter. The
+ * messages go through the log ring, see Core/log_ring.h, and the platform
+ * sends them in the background.
  */
 
 #ifndef __USART_H_
@@ -40,7 +43,11 @@
 #  define USART3 ((USART_TypeDef*)3)
 #endif
 
-#define MAX_NMEA_SENTENCE_LEN 256
+#include <stdint.h>
+
+// Receive ring of the GPS USART. At 9600 baud, half the ring holds one
+// second of data, which is how late the reader may be.
+#define GPS_RX_RING_LEN 2048
 
 #define MAX_CCOUNTER_SENTENCE_LEN 64
 
@@ -54,28 +61,56 @@ void usart_gps_init(void);
 // Take GPS out of RESET
 void usart_gps_remove_reset(void);
 
+// Put GPS into RESET
+void usart_gps_hold_reset(void);
+
 // Send the str to the GPS receiver
 void usart_gps_puts(const char* str);
 
-// a printf to send data to the PC
+// Send binary data to the GPS receiver
+void usart_gps_write(const uint8_t *data, uint32_t len);
+
+// a printf to send data to the PC, from any context
 void usart_debug(const char *format, ...);
 
 // Send a string to the PC
 void usart_debug_puts(const char* str);
 void usart_debug_puts_header(const char* hdr, const char* str);
 
-// Get a MAX_NMEA_SENTENCE_LEN sized NMEA sentence
-// Return 1 on success
-int usart_get_nmea_sentence(char* nmea);
+// Send the pending messages before a reset or a halt, also from a fault
+// handler or with interrupts disabled
+void usart_debug_flush(void);
+
+// Return 1 when all messages are sent, and the USART is not transmitting.
+// USART2 stops in STOP mode.
+int usart_debug_idle(void);
 
-void usart_debug_timestamp(void);
+// Wait up to timeout ticks for bytes from the GPS, and return a pointer to
+// them in the ring. len is set to their number, 0 on timeout. They stay
+// valid until the next call.
+const char* usart_gps_rx_wait(uint32_t *len, uint32_t timeout);
+
+// Number of received GPS bytes that were overwritten before they could be
+// read
+uint32_t usart_gps_rx_dropped(void);
 
 void usart_gps_specific_init(void);
 
 void usart_process_char(char);
-void usart_gps_process_char(char);
+
+// Written by the platform
+extern char usart_gps_rx_ring[GPS_RX_RING_LEN];
+
+// Called by the platform when the ring has been written up to pos.
+// Must be called at least once per half ring. Runs in interrupt context.
+void usart_gps_rx_advance(uint32_t pos);
+
+// Called when messages were added to the log ring. The platform must send
+// them with log_ring_peek() and log_ring_release(). Any context.
+void usart_debug_kick(void);
 
 void usart_puts(USART_TypeDef*, const char*);
+void usart_write(USART_TypeDef*, const uint8_t*, uint32_t);
 
 // Get a MAX_CCOUNTER_SENTENCE_LEN sized message from Coulomb counter
 // Return 1 on success
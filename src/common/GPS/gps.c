@@ -22,133 +22,389 @@
  * SOFTWARE.
 */
 
+#include <string.h>
 #include "FreeRTOS.h"
 #include "FreeRTOSConfig.h"
 #include "task.h"
-#include "semphr.h"
 #include "Core/common.h"
+#include "Core/power.h"
 #include "GPS/gps.h"
-#include "GPS/minmea.h"
+#include "GPS/gps_power.h"
+#include "GPS/nmea.h"
+#include "GPS/pps.h"
+#include "GPS/ubx.h"
 #include "GPIO/usart.h"
+#include "Core/log.h"
 
 
-TickType_t gps_timeutc_last_updated = 0;
-static struct tm gps_timeutc;
-static int gps_num_sv_used;
-static int gps_timeutc_valid; // Validity flag for both gps_timeutc and gps_num_sv_used
+struct gps_time {
+    struct tm timeutc;
+    int num_sv_used;
+    int valid; // Validity flag for both timeutc and num_sv_used
+    uint32_t accuracy_ns;
+    TickType_t last_updated;
+    uint64_t received_us;
+};
+
+/* The GPS task updates its own copy, and publishes it into the buffer not
+ * designated by gps_time_seq, before incrementing gps_time_seq. Readers copy
+ * the designated buffer and retry if gps_time_seq changed meanwhile, which
+ * needs two publications during the copy.
+ *
+ * Readers never block, and a GPS task preempted while publishing does not
+ * hold them back.
+ */
+static struct gps_time gps_time_writer;
+static struct gps_time gps_time_published[2];
+static volatile uint32_t gps_time_seq = 0;
 
 const TickType_t gps_data_validity_timeout = GPS_MS_TIMEOUT / portTICK_PERIOD_MS;
 
 static void gps_task(void *pvParameters);
 
-SemaphoreHandle_t timeutc_semaphore;
+static void gps_time_publish(void)
+{
+    const uint32_t next = gps_time_seq + 1;
+    gps_time_published[next & 1] = gps_time_writer;
+    __sync_synchronize();
+    gps_time_seq = next;
+}
+
+static void gps_time_read(struct gps_time *t)
+{
+    uint32_t seq;
+    do {
+        seq = gps_time_seq;
+        __sync_synchronize();
+        *t = gps_time_published[seq & 1];
+        __sync_synchronize();
+    } while (seq != gps_time_seq);
+}
 
 // Get current time from GPS
 int gps_utctime(struct tm *timeutc, int *num_sv_used)
+{
+    uint64_t received_us;
+    return gps_utctime_received(timeutc, num_sv_used, &received_us);
+}
+
+int gps_utctime_received(struct tm *timeutc, int *num_sv_used, uint64_t *received_us)
 {
     int valid = 0;
 
-    xSemaphoreTake(timeutc_semaphore, portMAX_DELAY);
-    if (xTaskGetTickCount() - gps_timeutc_last_updated < gps_data_validity_timeout) {
-        timeutc->tm_year  = gps_timeutc.tm_year;
-        timeutc->tm_mon   = gps_timeutc.tm_mon;
-        timeutc->tm_mday  = gps_timeutc.tm_mday;
-        timeutc->tm_hour  = gps_timeutc.tm_hour;
-        timeutc->tm_min   = gps_timeutc.tm_min;
-        timeutc->tm_sec   = gps_timeutc.tm_sec;
+    struct gps_time t;
+    gps_time_read(&t);
+
+    if (xTaskGetTickCount() - t.last_updated < gps_data_validity_timeout) {
+        timeutc->tm_year  = t.timeutc.tm_year;
+        timeutc->tm_mon   = t.timeutc.tm_mon;
+        timeutc->tm_mday  = t.timeutc.tm_mday;
+        timeutc->tm_hour  = t.timeutc.tm_hour;
+        timeutc->tm_min   = t.timeutc.tm_min;
+        timeutc->tm_sec   = t.timeutc.tm_sec;
         timeutc->tm_isdst = 0;
-        *num_sv_used      = gps_num_sv_used;
-        valid             = gps_timeutc_valid;
+        *num_sv_used      = t.num_sv_used;
+        *received_us      = t.received_us;
+        valid             = t.valid;
     }
 
-    xSemaphoreGive(timeutc_semaphore);
-
     return valid;
 }
 
-#define RXBUF_LEN MAX_NMEA_SENTENCE_LEN
-static char rxbuf[RXBUF_LEN];
+uint32_t gps_time_accuracy_ns()
+{
+    struct gps_time t;
+    gps_time_read(&t);
+    return t.accuracy_ns;
+}
+
+static struct nmea_parser nmea;
+static struct ubx_parser ubx;
+
+/* UBX configuration: the receiver sends NAV-TIMEUTC every second and
+ * NAV-PVT for the number of satellites, instead of the NMEA sentences. TXT
+ * stays enabled for the messages of the receiver.
+ *
+ * One CFG-MSG is sent at a time, waiting for its acknowledgement. A receiver
+ * that does not answer or refuses NAV-TIMEUTC keeps sending NMEA.
+ */
+
+// NAV-PVT every 10 navigation epochs, the satellite count changes slowly
+#define GPS_UBX_PVT_RATE 10
+#define GPS_CONFIG_TIMEOUT pdMS_TO_TICKS(1000)
+
+struct gps_config_msg {
+    uint8_t msg_class;
+    uint8_t msg_id;
+    uint8_t rate;
+};
+
+static const struct gps_config_msg gps_config[] = {
+    { UBX_CLASS_NAV, UBX_NAV_TIMEUTC, 1 },
+    { UBX_CLASS_NAV, UBX_NAV_PVT, GPS_UBX_PVT_RATE },
+    { UBX_CLASS_NMEA, UBX_NMEA_RMC, 0 },
+    // Kept if NAV-PVT is refused
+    { UBX_CLASS_NMEA, UBX_NMEA_GGA, 0 },
+    { UBX_CLASS_NMEA, UBX_NMEA_GLL, 0 },
+    { UBX_CLASS_NMEA, UBX_NMEA_GSA, 0 },
+    { UBX_CLASS_NMEA, UBX_NMEA_GSV, 0 },
+    { UBX_CLASS_NMEA, UBX_NMEA_VTG, 0 },
+};
+#define GPS_CONFIG_LEN ((int)(sizeof(gps_config)/sizeof(gps_config[0])))
+
+// -1 until the receiver talks, GPS_CONFIG_LEN when done
+static int gps_config_step = -1;
+static TickType_t gps_config_sent;
+static int gps_pvt_enabled = 0;
+// The receiver accepted the configuration and understands UBX
+static int gps_ubx_active = 0;
+
+static void gps_config_send(void)
+{
+    if (gps_config_step < GPS_CONFIG_LEN &&
+            gps_config[gps_config_step].msg_class == UBX_CLASS_NMEA &&
+            gps_config[gps_config_step].msg_id == UBX_NMEA_GGA &&
+            !gps_pvt_enabled) {
+        gps_config_step++;
+    }
+
+    if (gps_config_step >= GPS_CONFIG_LEN) {
+        log_msg(GPS, LOG_INFO, "GPS configured for UBX\r\n");
+        gps_ubx_active = 1;
+        return;
+    }
+
+    const struct gps_config_msg *msg = &gps_config[gps_config_step];
+    const uint8_t payload[3] = { msg->msg_class, msg->msg_id, msg->rate };
+
+    uint8_t frame[sizeof(payload) + UBX_FRAME_OVERHEAD];
+    const uint32_t len = ubx_frame(frame, UBX_CLASS_CFG, UBX_CFG_MSG, payload, sizeof(payload));
+    usart_gps_write(frame, len);
+    gps_config_sent = xTaskGetTickCount();
+}
+
+static void gps_config_answer(int ack)
+{
+    const struct gps_config_msg *msg = &gps_config[gps_config_step];
+
+    if (msg->msg_class == UBX_CLASS_NAV && msg->msg_id == UBX_NAV_TIMEUTC && !ack) {
+        log_msg(GPS, LOG_WARNING, "GPS refused NAV-TIMEUTC, staying with NMEA\r\n");
+        gps_config_step = GPS_CONFIG_LEN;
+        return;
+    }
+    else if (msg->msg_class == UBX_CLASS_NAV && msg->msg_id == UBX_NAV_PVT) {
+        gps_pvt_enabled = ack;
+    }
+
+    gps_config_step++;
+    gps_config_send();
+}
+
+static void gps_config_update(void)
+{
+    if (gps_config_step == -1) {
+        // The receiver is up
+        gps_config_step = 0;
+        gps_config_send();
+    }
+    else if (gps_config_step < GPS_CONFIG_LEN &&
+            xTaskGetTickCount() - gps_config_sent > GPS_CONFIG_TIMEOUT) {
+        log_msg(GPS, LOG_WARNING, "GPS does not answer UBX, staying with NMEA\r\n");
+        gps_config_step = GPS_CONFIG_LEN;
+    }
+}
+
+static void gps_handle_ubx(enum ubx_message msg)
+{
+    switch (msg) {
+        case UBX_MSG_NAV_TIMEUTC:
+            gps_time_writer.timeutc.tm_year  = ubx.year - 1900;
+            gps_time_writer.timeutc.tm_mon   = ubx.month - 1;
+            gps_time_writer.timeutc.tm_mday  = ubx.day;
+            gps_time_writer.timeutc.tm_hour  = ubx.hours;
+            gps_time_writer.timeutc.tm_min   = ubx.minutes;
+            gps_time_writer.timeutc.tm_sec   = ubx.seconds;
+            gps_time_writer.timeutc.tm_isdst = 0;
+            gps_time_writer.valid            = ubx.utc_valid;
+            gps_time_writer.accuracy_ns      = ubx.time_accuracy_ns;
+            gps_time_writer.last_updated     = xTaskGetTickCount();
+            gps_time_writer.received_us      = timestamp_now_us();
+            gps_time_publish();
+            break;
+        case UBX_MSG_NAV_PVT:
+            gps_time_writer.num_sv_used = ubx.satellites;
+            gps_time_publish();
+            break;
+        case UBX_MSG_ACK:
+        case UBX_MSG_NAK:
+            if (gps_config_step >= 0 && gps_config_step < GPS_CONFIG_LEN &&
+                    ubx.ack_class == UBX_CLASS_CFG && ubx.ack_id == UBX_CFG_MSG) {
+                gps_config_answer(msg == UBX_MSG_ACK);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void gps_handle_sentence(enum nmea_sentence sentence)
+{
+    switch (sentence) {
+        case NMEA_RMC:
+            // tm_year is saved as Year - 1900 in struct tm
+            gps_time_writer.timeutc.tm_year  = 2000 + nmea.year - 1900;
+            // struct tm months are zero-indexed
+            gps_time_writer.timeutc.tm_mon   = nmea.month - 1;
+            gps_time_writer.timeutc.tm_mday  = nmea.day;
+            gps_time_writer.timeutc.tm_hour  = nmea.hours;
+            gps_time_writer.timeutc.tm_min   = nmea.minutes;
+            gps_time_writer.timeutc.tm_sec   = nmea.seconds;
+            gps_time_writer.timeutc.tm_isdst = 0;
+            // Without fix, the receiver can leave time and date empty
+            gps_time_writer.valid            = nmea.valid && nmea.year != -1 && nmea.hours != -1;
+            gps_time_writer.accuracy_ns      = UINT32_MAX;
+            gps_time_writer.last_updated     = xTaskGetTickCount();
+            gps_time_writer.received_us      = timestamp_now_us();
+            gps_time_publish();
+            break;
+        case NMEA_TXT:
+            switch (nmea.txt_type) {
+                case NMEA_TXT_ERROR:
+                    log_msg(GPS, LOG_ERROR, "GPS ERROR %s\r\n", nmea.txt);
+                    break;
+                case NMEA_TXT_WARNING:
+                    log_msg(GPS, LOG_WARNING, "GPS WARNING %s\r\n", nmea.txt);
+                    break;
+                default:
+                    log_msg(GPS, LOG_INFO, "GPS Message %s\r\n", nmea.txt);
+                    break;
+            }
+            break;
+        case NMEA_GGA:
+            gps_time_writer.num_sv_used = nmea.satellites;
+            gps_time_publish();
+            break;
+        default:
+            break;
+    }
+}
+
+/* Switching off uses the backup mode of the receiver when it understands
+ * UBX, which keeps the ephemeris for a hot start. Otherwise it is held in
+ * reset. In both cases, a reset pulse switches it on again, and the
+ * configuration is sent again when it starts talking.
+ */
+#define GPS_RESET_PULSE pdMS_TO_TICKS(10)
+#define GPS_POWER_PERIOD pdMS_TO_TICKS(1000)
+
+static int gps_receiver_on = 1;
+
+static void gps_receiver_power(int on)
+{
+    if (on == gps_receiver_on) {
+        return;
+    }
+    gps_receiver_on = on;
+
+    if (on) {
+        power_inhibit_stop(POWER_INHIBIT_GPS, 1);
+
+        usart_gps_hold_reset();
+        vTaskDelay(GPS_RESET_PULSE);
+        usart_gps_remove_reset();
+
+        gps_config_step = -1;
+        gps_pvt_enabled = 0;
+        gps_ubx_active = 0;
+        nmea_init(&nmea);
+        ubx_init(&ubx);
+        log_msg(GPS, LOG_INFO, "GPS on\r\n");
+    }
+    else {
+        if (gps_ubx_active) {
+            // RXM-PMREQ: backup for an unlimited duration
+            const uint8_t payload[UBX_RXM_PMREQ_LEN] = { 0, 0, 0, 0, 0x02, 0, 0, 0 };
+            uint8_t frame[sizeof(payload) + UBX_FRAME_OVERHEAD];
+            const uint32_t len = ubx_frame(frame, UBX_CLASS_RXM, UBX_RXM_PMREQ, payload, sizeof(payload));
+            usart_gps_write(frame, len);
+        }
+        else {
+            usart_gps_hold_reset();
+        }
+
+        // Nothing to receive until it is switched on again
+        power_inhibit_stop(POWER_INHIBIT_GPS, 0);
+        log_msg(GPS, LOG_INFO, "GPS off\r\n");
+    }
+}
 
 static void gps_task(void __attribute__ ((unused))*pvParameters) {
 
     // The initialisation placed the GPS into reset
     usart_gps_remove_reset();
 
+    nmea_init(&nmea);
+    ubx_init(&ubx);
+
+    gps_power_init(timestamp_now_us());
+    TickType_t power_updated = xTaskGetTickCount();
+
     while (1) {
-        taskYIELD();
-
-        int success = usart_get_nmea_sentence(rxbuf);
-
-        if (success) {
-            const int strict = 1;
-            switch (minmea_sentence_id(rxbuf, strict)) {
-                case MINMEA_SENTENCE_RMC:
-                    {
-                        struct minmea_sentence_rmc frame;
-                        if (minmea_parse_rmc(&frame, rxbuf)) {
-                            xSemaphoreTake(timeutc_semaphore, portMAX_DELAY);
-                            // tm_year is saved as Year - 1900 in struct tm
-                            gps_timeutc.tm_year  = 2000 + frame.date.year - 1900;
-                            // struct tm months are zero-indexed
-                            gps_timeutc.tm_mon   = frame.date.month - 1;
-                            gps_timeutc.tm_mday  = frame.date.day;
-                            gps_timeutc.tm_hour  = frame.time.hours;
-                            gps_timeutc.tm_min   = frame.time.minutes;
-                            gps_timeutc.tm_sec   = frame.time.seconds;
-                            gps_timeutc.tm_isdst = 0;
-                            gps_timeutc_valid    = frame.valid;
-                            gps_timeutc_last_updated = xTaskGetTickCount();
-                            xSemaphoreGive(timeutc_semaphore);
-                        }
-                    } break;
-                case MINMEA_SENTENCE_TXT:
-                    {
-                        struct minmea_sentence_txt frame;
-                        if (minmea_parse_txt(&frame, rxbuf)) {
-                            rxbuf[MINMEA_TXT_START_IX + frame.text_len] = '\0';
-
-                            switch (frame.msgtype) {
-                                case MINMEA_GPTXT_ERROR:
-                                    usart_debug_puts_header("GPS ERROR ", frame.text);
-                                    break;
-                                case MINMEA_GPTXT_WARNING:
-                                    usart_debug_puts_header("GPS WARNING ", frame.text);
-                                    break;
-                                default:
-                                    usart_debug_puts_header("GPS Message ", frame.text);
-                                    break;
-                            }
-                        }
-                    } break;
-                case MINMEA_SENTENCE_GGA:
-                    {
-                        struct minmea_sentence_gga frame;
-                        if (minmea_parse_gga(&frame, rxbuf)) {
-                            xSemaphoreTake(timeutc_semaphore, portMAX_DELAY);
-                            gps_num_sv_used = frame.satellites_tracked;
-                            xSemaphoreGive(timeutc_semaphore);
-                        }
-                    } break;
-                default:
-                    break;
+        uint32_t len = 0;
+        const char *rx = usart_gps_rx_wait(&len, GPS_POWER_PERIOD);
+
+        if (xTaskGetTickCount() - power_updated >= GPS_POWER_PERIOD) {
+            power_updated = xTaskGetTickCount();
+
+            const uint64_t now_us = timestamp_now_us();
+            gps_receiver_power(gps_power_update(now_us,
+                        gps_locked(), pps_locked(), pps_holdover_uncertainty_us(now_us)));
+        }
+
+        if (len == 0) {
+            continue;
+        }
+
+        if (gps_receiver_on) {
+            gps_config_update();
+        }
+
+        // UBX frames and NMEA sentences are interleaved
+        while (len > 0) {
+            uint32_t consumed = 0;
+
+            if (ubx_receiving(&ubx) || (uint8_t)rx[0] == UBX_SYNC_1) {
+                const enum ubx_message msg = ubx_parse(&ubx, (const uint8_t*)rx, len, &consumed);
+                if (msg != UBX_NONE) {
+                    gps_handle_ubx(msg);
+                }
             }
+            else {
+                const char *sync = memchr(rx, UBX_SYNC_1, len);
+                const uint32_t nmea_len = sync ? (uint32_t)(sync - rx) : len;
+
+                const enum nmea_sentence sentence = nmea_parse(&nmea, rx, nmea_len, &consumed);
+                if (sentence != NMEA_NONE) {
+                    gps_handle_sentence(sentence);
+                }
+            }
+
+            rx += consumed;
+            len -= consumed;
         }
     }
 }
 
 void gps_init() {
-    gps_timeutc_valid = 0;
+    gps_time_writer.valid = 0;
+    gps_time_writer.accuracy_ns = UINT32_MAX;
+    gps_time_publish();
 
+    // The messages of the receiver must not be lost while it is on, see
+    // gps_receiver_power()
+    power_inhibit_stop(POWER_INHIBIT_GPS, 1);
     usart_gps_init();
 
-    timeutc_semaphore = xSemaphoreCreateBinary();
-
-    if (timeutc_semaphore == NULL) {
-        trigger_fault(FAULT_SOURCE_GPS);
-    } else {
-        xSemaphoreGive(timeutc_semaphore);
-    }
-
     xTaskCreate(
             gps_task,
             "TaskGPS",
@@ -160,8 +416,11 @@ void gps_init() {
 
 // Return 1 of the GPS is receiving time
 int gps_locked() {
-    if (xTaskGetTickCount() - gps_timeutc_last_updated < gps_data_validity_timeout) {
-        return gps_timeutc_valid;
+    struct gps_time t;
+    gps_time_read(&t);
+
+    if (xTaskGetTickCount() - t.last_updated < gps_data_validity_timeout) {
+        return t.valid;
     } else {
         return 0;
     }
@@ -44,3 +44,10 @@ int gps_locked(void);
 // used for fix.
 // Returns 1 if data is valid, 0 otherwise
 int gps_utctime(struct tm *timeutc, int *num_sv_used);
+
+// Time accuracy estimate of the receiver in ns, UINT32_MAX if unknown
+uint32_t gps_time_accuracy_ns(void);
+
+// Same as gps_utctime, and also return the timestamp_now_us() at which
+// the time was received.
+int gps_utctime_received(struct tm *timeutc, int *num_sv_used, uint64_t *received_us);
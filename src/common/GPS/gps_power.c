@@ -0,0 +1,139 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "GPS/gps_power.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+#define US_PER_S 1000000ull
+
+static enum gps_power_state state = GPS_POWER_ACQUIRE;
+// Start of the current state
+static uint64_t state_since_us = 0;
+static uint64_t last_update_us = 0;
+static uint64_t last_fix_us = 0;
+static int first_track = 1;
+
+static struct gps_power_stats stats;
+
+static void enter(enum gps_power_state s, uint64_t now_us)
+{
+    state = s;
+    state_since_us = now_us;
+    stats.state = s;
+}
+
+void gps_power_init(uint64_t now_us)
+{
+    state = GPS_POWER_ACQUIRE;
+    state_since_us = now_us;
+    last_update_us = now_us;
+    last_fix_us = 0;
+    first_track = 1;
+
+    stats.state = state;
+    stats.wakeups = 0;
+    stats.last_ttff_s = 0;
+    stats.max_ttff_s = 0;
+    stats.on_us = 0;
+    stats.off_us = 0;
+}
+
+int gps_power_update(uint64_t now_us, int fix_valid, int pps_locked,
+        uint32_t uncertainty_us)
+{
+    // The statistics are read from another task
+    taskENTER_CRITICAL();
+
+    if (state == GPS_POWER_OFF) {
+        stats.off_us += now_us - last_update_us;
+    }
+    else {
+        stats.on_us += now_us - last_update_us;
+    }
+    last_update_us = now_us;
+
+    if (fix_valid) {
+        last_fix_us = now_us;
+    }
+
+    const uint64_t in_state_s = (now_us - state_since_us) / US_PER_S;
+
+    switch (state) {
+        case GPS_POWER_ACQUIRE:
+            if (fix_valid) {
+                stats.last_ttff_s = in_state_s;
+                if (stats.last_ttff_s > stats.max_ttff_s) {
+                    stats.max_ttff_s = stats.last_ttff_s;
+                }
+                enter(GPS_POWER_TRACK, now_us);
+            }
+            break;
+        case GPS_POWER_TRACK:
+            {
+                const uint32_t track_s = first_track ? GPS_POWER_FIRST_TRACK_S : GPS_POWER_TRACK_S;
+
+                if ((now_us - last_fix_us) / US_PER_S > GPS_POWER_FIX_LOST_S) {
+                    enter(GPS_POWER_ACQUIRE, now_us);
+                }
+                else if (in_state_s >= track_s && pps_locked &&
+                        uncertainty_us < GPS_POWER_MAX_UNCERTAINTY_US) {
+                    first_track = 0;
+                    enter(GPS_POWER_OFF, now_us);
+                }
+            } break;
+        case GPS_POWER_OFF:
+            if (in_state_s >= GPS_POWER_MAX_OFF_S ||
+                    uncertainty_us >= GPS_POWER_MAX_UNCERTAINTY_US) {
+                stats.wakeups++;
+                enter(GPS_POWER_ACQUIRE, now_us);
+            }
+            break;
+    }
+
+    const int on = state != GPS_POWER_OFF;
+    taskEXIT_CRITICAL();
+
+    return on;
+}
+
+void gps_power_get_stats(struct gps_power_stats *s)
+{
+    taskENTER_CRITICAL();
+    *s = stats;
+    taskEXIT_CRITICAL();
+}
+
+uint32_t gps_power_saved_mwh_per_day(void)
+{
+    struct gps_power_stats s;
+    gps_power_get_stats(&s);
+
+    const uint64_t total_us = s.on_us + s.off_us;
+    if (total_us == 0) {
+        return 0;
+    }
+
+    return GPS_POWER_RECEIVER_MW * 24ull * s.off_us / total_us;
+}
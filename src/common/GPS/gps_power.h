@@ -0,0 +1,77 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Power policy of the GPS receiver
+ *
+ * Once the PPS has disciplined the clock, the receiver is switched off and
+ * the time is kept in holdover. It is switched on again periodically, or
+ * earlier when the holdover uncertainty exceeds a bound, to resynchronise.
+ * Without PPS lock, the receiver stays on.
+ *
+ * The policy only decides, the GPS task switches the receiver.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Stay on after the first fix, for the PPS loop to settle on the frequency
+#define GPS_POWER_FIRST_TRACK_S 900
+// Stay on after the following fixes
+#define GPS_POWER_TRACK_S 120
+// Fix lost for longer than this while tracking: acquire again
+#define GPS_POWER_FIX_LOST_S 10
+// Longest off time, for the ephemeris to stay usable for a hot start
+#define GPS_POWER_MAX_OFF_S (4 * 3600)
+// Switch on when the holdover uncertainty reaches this
+#define GPS_POWER_MAX_UNCERTAINTY_US 1000
+// Consumption of the running receiver
+#define GPS_POWER_RECEIVER_MW 120
+
+enum gps_power_state {
+    GPS_POWER_ACQUIRE = 0,
+    GPS_POWER_TRACK,
+    GPS_POWER_OFF,
+};
+
+struct gps_power_stats {
+    enum gps_power_state state;
+    uint32_t wakeups;
+    // Time to fix of the last and the slowest acquisition, in seconds
+    uint32_t last_ttff_s;
+    uint32_t max_ttff_s;
+    uint64_t on_us;
+    uint64_t off_us;
+};
+
+void gps_power_init(uint64_t now_us);
+
+// Called about once per second. Return 1 if the receiver must be on.
+int gps_power_update(uint64_t now_us, int fix_valid, int pps_locked,
+        uint32_t uncertainty_us);
+
+void gps_power_get_stats(struct gps_power_stats *stats);
+
+// Energy not used by the receiver, extrapolated to one day, in mWh
+uint32_t gps_power_saved_mwh_per_day(void);
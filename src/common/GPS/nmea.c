@@ -0,0 +1,310 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include <string.h>
+#include "GPS/nmea.h"
+
+enum {
+    STATE_IDLE = 0,
+    STATE_BODY,
+    STATE_CHECKSUM_HIGH,
+    STATE_CHECKSUM_LOW,
+};
+
+// Field numbers, the sentence identifier being field 0
+#define RMC_FIELD_TIME 1
+#define RMC_FIELD_STATUS 2
+#define RMC_FIELD_DATE 9
+#define GGA_FIELD_SATELLITES 7
+#define TXT_FIELD_TYPE 3
+#define TXT_FIELD_TEXT 4
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+static void start_sentence(struct nmea_parser *p)
+{
+    p->state = STATE_BODY;
+    p->type = NMEA_NONE;
+    p->len = 0;
+    p->field = 0;
+    p->field_pos = 0;
+    p->convert_field = 1;
+    p->checksum = 0;
+
+    p->hours = p->minutes = p->seconds = -1;
+    p->day = p->month = p->year = -1;
+    p->valid = 0;
+    p->satellites = 0;
+    p->txt_type = 0;
+    p->txt_len = 0;
+    p->txt[0] = '\0';
+}
+
+/* Six digits hhmmss or ddmmyy, into three values. Anything after the six
+ * digits, like fractional seconds, is ignored.
+ */
+static int parse_triple(int pos, char c, int *a, int *b, int *d)
+{
+    if (pos >= 6) {
+        return 1;
+    }
+
+    if (c < '0' || c > '9') {
+        return 0;
+    }
+
+    int *v = pos < 2 ? a : (pos < 4 ? b : d);
+    if (pos % 2 == 0) {
+        *v = (c - '0') * 10;
+    }
+    else {
+        *v += c - '0';
+    }
+    return 1;
+}
+
+// Return 0 if the sentence must be dropped
+static int field_char(struct nmea_parser *p, char c)
+{
+    const int pos = p->field_pos;
+
+    switch (p->type) {
+        case NMEA_NONE:
+            if (pos >= 5) {
+                return 0;
+            }
+            p->id[pos] = c;
+            return 1;
+        case NMEA_RMC:
+            if (p->field == RMC_FIELD_TIME) {
+                return parse_triple(pos, c, &p->hours, &p->minutes, &p->seconds);
+            }
+            else if (p->field == RMC_FIELD_STATUS && pos == 0) {
+                p->valid = (c == 'A');
+            }
+            else if (p->field == RMC_FIELD_DATE) {
+                return parse_triple(pos, c, &p->day, &p->month, &p->year);
+            }
+            return 1;
+        case NMEA_GGA:
+            if (p->field == GGA_FIELD_SATELLITES) {
+                if (c < '0' || c > '9' || p->satellites > 1000) {
+                    return 0;
+                }
+                p->satellites = p->satellites * 10 + (c - '0');
+            }
+            return 1;
+        case NMEA_TXT:
+            if (p->field == TXT_FIELD_TYPE) {
+                if (c < '0' || c > '9' || p->txt_type > 1000) {
+                    return 0;
+                }
+                p->txt_type = p->txt_type * 10 + (c - '0');
+            }
+            else if (p->field >= TXT_FIELD_TEXT && p->txt_len < NMEA_TXT_MAX_LEN) {
+                p->txt[p->txt_len++] = c;
+                p->txt[p->txt_len] = '\0';
+            }
+            return 1;
+    }
+    return 0;
+}
+
+// Return 0 if the sentence must be dropped
+static int field_end(struct nmea_parser *p)
+{
+    const int pos = p->field_pos;
+
+    switch (p->type) {
+        case NMEA_NONE:
+            if (p->field != 0 || pos != 5) {
+                return 0;
+            }
+
+            // Any talker
+            if (p->id[2] == 'R' && p->id[3] == 'M' && p->id[4] == 'C') {
+                p->type = NMEA_RMC;
+            }
+            else if (p->id[2] == 'G' && p->id[3] == 'G' && p->id[4] == 'A') {
+                p->type = NMEA_GGA;
+            }
+            else if (p->id[2] == 'T' && p->id[3] == 'X' && p->id[4] == 'T') {
+                p->type = NMEA_TXT;
+            }
+            else {
+                // Not interesting, skip until the next sentence
+                return 0;
+            }
+            return 1;
+        case NMEA_RMC:
+            if (p->field == RMC_FIELD_TIME || p->field == RMC_FIELD_DATE) {
+                // Empty, or at least six digits
+                return pos == 0 || pos >= 6;
+            }
+            return 1;
+        default:
+            return 1;
+    }
+}
+
+// Return 1 if the current field is one we convert
+static int field_needed(const struct nmea_parser *p)
+{
+    switch (p->type) {
+        case NMEA_RMC:
+            return p->field == RMC_FIELD_TIME || p->field == RMC_FIELD_STATUS ||
+                p->field == RMC_FIELD_DATE;
+        case NMEA_GGA:
+            return p->field == GGA_FIELD_SATELLITES;
+        case NMEA_TXT:
+            return p->field >= TXT_FIELD_TYPE;
+        default:
+            return 1;
+    }
+}
+
+// Fields that must be present
+static int fields_complete(const struct nmea_parser *p)
+{
+    switch (p->type) {
+        case NMEA_RMC:
+            return p->field >= RMC_FIELD_DATE;
+        case NMEA_GGA:
+            return p->field >= GGA_FIELD_SATELLITES;
+        case NMEA_TXT:
+            return p->field >= TXT_FIELD_TEXT;
+        default:
+            return 0;
+    }
+}
+
+void nmea_init(struct nmea_parser *parser)
+{
+    parser->state = STATE_IDLE;
+}
+
+static inline enum nmea_sentence push(struct nmea_parser *p, char c)
+{
+    if (c == '$') {
+        start_sentence(p);
+        return NMEA_NONE;
+    }
+
+    switch (p->state) {
+        case STATE_BODY:
+            if (c == '*') {
+                p->state = field_end(p) ? STATE_CHECKSUM_HIGH : STATE_IDLE;
+            }
+            else if (c < ' ' || c > '~' || ++p->len > NMEA_MAX_LEN) {
+                p->state = STATE_IDLE;
+            }
+            else {
+                p->checksum ^= c;
+
+                // The text of TXT can contain commas
+                if (c == ',' && !(p->type == NMEA_TXT && p->field >= TXT_FIELD_TEXT)) {
+                    if (field_end(p)) {
+                        p->field++;
+                        p->field_pos = 0;
+                        p->convert_field = field_needed(p);
+                    }
+                    else {
+                        p->state = STATE_IDLE;
+                    }
+                }
+                else if (!p->convert_field || field_char(p, c)) {
+                    p->field_pos++;
+                }
+                else {
+                    p->state = STATE_IDLE;
+                }
+            }
+            break;
+        case STATE_CHECKSUM_HIGH:
+            {
+                const int v = hex_value(c);
+                if (v < 0) {
+                    p->state = STATE_IDLE;
+                }
+                else {
+                    p->expected_checksum = v << 4;
+                    p->state = STATE_CHECKSUM_LOW;
+                }
+            } break;
+        case STATE_CHECKSUM_LOW:
+            {
+                p->state = STATE_IDLE;
+
+                const int v = hex_value(c);
+                if (v >= 0 && (p->expected_checksum | v) == p->checksum &&
+                        fields_complete(p)) {
+                    return p->type;
+                }
+            } break;
+        default:
+            break;
+    }
+
+    return NMEA_NONE;
+}
+
+enum nmea_sentence nmea_push(struct nmea_parser *parser, char c)
+{
+    return push(parser, c);
+}
+
+enum nmea_sentence nmea_parse(struct nmea_parser *parser,
+        const char *buf, uint32_t len, uint32_t *consumed)
+{
+    uint32_t i = 0;
+
+    while (i < len) {
+        if (parser->state == STATE_IDLE) {
+            // Skip to the next sentence
+            const char *start = memchr(buf + i, '$', len - i);
+            if (start == NULL) {
+                break;
+            }
+            i = start - buf;
+        }
+
+        const enum nmea_sentence sentence = push(parser, buf[i++]);
+        if (sentence != NMEA_NONE) {
+            *consumed = i;
+            return sentence;
+        }
+    }
+
+    *consumed = len;
+    return NMEA_NONE;
+}
@@ -0,0 +1,93 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Streaming NMEA parser for the sentences the repeater uses.
+ *
+ * The bytes from the GPS are given one at a time. The checksum is computed
+ * while receiving, and only the fields we need are converted: time, date and
+ * validity from RMC, the number of satellites from GGA, and the messages of
+ * the receiver in TXT. Everything else is skipped without being stored.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+enum nmea_sentence {
+    NMEA_NONE = 0,
+    NMEA_RMC,
+    NMEA_GGA,
+    NMEA_TXT,
+};
+
+// Longest sentence accepted, from $ to the checksum
+#define NMEA_MAX_LEN 120
+
+#define NMEA_TXT_MAX_LEN 64
+
+enum nmea_txt_type {
+    NMEA_TXT_ERROR = 0,
+    NMEA_TXT_WARNING = 1,
+    NMEA_TXT_NOTICE = 2,
+};
+
+struct nmea_parser {
+    // Parser state
+    int state;
+    enum nmea_sentence type;
+    int len;
+    int field;
+    int field_pos;
+    int convert_field;
+    uint8_t checksum;
+    uint8_t expected_checksum;
+    char id[5];
+
+    /* Values of the last sentence, valid after nmea_push() returned its type
+     * and until the next byte is given. Time and date are -1 when empty, the
+     * year has two digits.
+     */
+    int hours;
+    int minutes;
+    int seconds;
+    int day;
+    int month;
+    int year;
+    int valid;
+    int satellites;
+    int txt_type;
+    int txt_len;
+    char txt[NMEA_TXT_MAX_LEN + 1];
+};
+
+void nmea_init(struct nmea_parser *parser);
+
+// Give one received byte. Return the type of the sentence it completed, if
+// its checksum is correct, NMEA_NONE otherwise.
+enum nmea_sentence nmea_push(struct nmea_parser *parser, char c);
+
+// Give len received bytes, and stop after the first sentence completed.
+// Return its type like nmea_push(), and the number of bytes used in consumed.
+enum nmea_sentence nmea_parse(struct nmea_parser *parser,
+        const char *buf, uint32_t len, uint32_t *consumed);
@@ -0,0 +1,248 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "GPS/pps.h"
+#include "Core/common.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+#define PPS_NOMINAL_NS 1000000000ll
+
+// Reject edges further away from the prediction once locked
+#define PPS_OUTLIER_NS 100000ll
+// Reacquire the phase after this many consecutive rejected edges
+#define PPS_MAX_OUTLIERS 4
+// Reacquire the phase after a gap longer than this, in seconds
+#define PPS_MAX_GAP 16
+// Good edges before switching to the narrow loop bandwidth
+#define PPS_EDGES_TO_LOCK 64
+// The crystal is much better than this, anything beyond is not a PPS. In
+// parts per trillion.
+#define PPS_MAX_FREQ_ERROR_PPT 200000000ll
+
+/* Loop gains, as divisors: the phase is corrected by error/KP, the frequency
+ * by error/KI per second. The wide bandwidth settles in about 20 seconds, the
+ * narrow one averages the 1us capture resolution over a few minutes.
+ */
+#define PPS_KP_ACQUIRE 4
+#define PPS_KI_ACQUIRE 16
+#define PPS_KP_TRACK 16
+#define PPS_KI_TRACK 256
+
+// Holdover uncertainty model
+#define PPS_CAPTURE_RESOLUTION_NS 1000
+#define PPS_FREQ_UNCERTAINTY_MIN_PPB 20
+// Frequency wander of the crystal due to temperature changes
+#define PPS_WANDER_PPB_PER_HOUR 100
+
+#define PPS_NUM_EDGES 4
+static uint64_t pps_edges[PPS_NUM_EDGES];
+static int pps_edges_ix = 0;
+
+// Phase of the last edge according to the loop, in local nanoseconds
+static int64_t model_edge_ns = 0;
+// Frequency error of the local clock, in parts per trillion
+static int64_t freq_error_ppt = 0;
+static int freq_valid = 0;
+static int good_edges = 0;
+static int outliers = 0;
+static int locked = 0;
+static uint64_t last_edge_us = 0;
+// Average of the absolute phase error per second, in ns
+static int64_t avg_abs_error_ns = 0;
+
+static inline int64_t abs64(int64_t v)
+{
+    return v < 0 ? -v : v;
+}
+
+static void record_edge(uint64_t edge_us)
+{
+    pps_edges_ix = (pps_edges_ix + 1) % PPS_NUM_EDGES;
+    pps_edges[pps_edges_ix] = edge_us;
+    last_edge_us = edge_us;
+}
+
+static void reacquire(int64_t edge_ns)
+{
+    model_edge_ns = edge_ns;
+    good_edges = 0;
+    outliers = 0;
+    locked = 0;
+}
+
+void pps_push_edge(uint64_t edge_us)
+{
+    const int64_t edge_ns = (int64_t)edge_us * 1000;
+
+    if (last_edge_us == 0) {
+        reacquire(edge_ns);
+        record_edge(edge_us);
+        return;
+    }
+
+    const int64_t period_ns = PPS_NOMINAL_NS + freq_error_ppt / 1000;
+    const int64_t n = (edge_ns - model_edge_ns + period_ns / 2) / period_ns;
+
+    if (n < 1) {
+        // Glitch, less than half a second after the previous edge
+        return;
+    }
+
+    if (n > PPS_MAX_GAP) {
+        reacquire(edge_ns);
+        record_edge(edge_us);
+        return;
+    }
+
+    if (!freq_valid) {
+        // Initial estimate from the first interval
+        const int64_t freq = (edge_ns - model_edge_ns - n * PPS_NOMINAL_NS) * 1000 / n;
+        if (abs64(freq) < PPS_MAX_FREQ_ERROR_PPT) {
+            freq_error_ppt = freq;
+            freq_valid = 1;
+        }
+        reacquire(edge_ns);
+        record_edge(edge_us);
+        return;
+    }
+
+    const int64_t predicted_ns = model_edge_ns + n * period_ns;
+    const int64_t error_ns = edge_ns - predicted_ns;
+
+    if (locked && abs64(error_ns) > n * PPS_OUTLIER_NS) {
+        outliers++;
+        if (outliers >= PPS_MAX_OUTLIERS) {
+            reacquire(edge_ns);
+            record_edge(edge_us);
+        }
+        return;
+    }
+    outliers = 0;
+    record_edge(edge_us);
+
+    const int kp = locked ? PPS_KP_TRACK : PPS_KP_ACQUIRE;
+    const int ki = locked ? PPS_KI_TRACK : PPS_KI_ACQUIRE;
+
+    model_edge_ns = predicted_ns + error_ns / kp;
+    // error_ns over n seconds is error_ns/n ppb
+    freq_error_ppt += error_ns * 1000 / (n * ki);
+
+    if (freq_error_ppt > PPS_MAX_FREQ_ERROR_PPT) {
+        freq_error_ppt = PPS_MAX_FREQ_ERROR_PPT;
+    }
+    else if (freq_error_ppt < -PPS_MAX_FREQ_ERROR_PPT) {
+        freq_error_ppt = -PPS_MAX_FREQ_ERROR_PPT;
+    }
+
+    avg_abs_error_ns += (abs64(error_ns) / n - avg_abs_error_ns) / 16;
+
+    if (good_edges < PPS_EDGES_TO_LOCK) {
+        good_edges++;
+    }
+    else {
+        locked = 1;
+    }
+}
+
+int pps_locked(void)
+{
+    taskENTER_CRITICAL();
+    const uint64_t last = last_edge_us;
+    const int l = locked;
+    taskEXIT_CRITICAL();
+
+    return l && (timestamp_now_us() - last < 2000000ull);
+}
+
+uint64_t pps_edge_before(uint64_t timestamp_us)
+{
+    uint64_t edge = 0;
+
+    taskENTER_CRITICAL();
+    for (int i = 0; i < PPS_NUM_EDGES; i++) {
+        const uint64_t e = pps_edges[i];
+        if (e != 0 && e <= timestamp_us && timestamp_us - e < 1000000ull && e > edge) {
+            edge = e;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return edge;
+}
+
+uint64_t pps_correct_interval_us(uint64_t interval_us)
+{
+    taskENTER_CRITICAL();
+    const int64_t freq = freq_error_ppt;
+    const int valid = freq_valid;
+    taskEXIT_CRITICAL();
+
+    if (!valid) {
+        return interval_us;
+    }
+
+    // Split to avoid overflowing for intervals of several days
+    const int64_t correction =
+        (int64_t)(interval_us / 1000000ull) * freq / 1000000ll +
+        (int64_t)(interval_us % 1000000ull) * freq / 1000000000000ll;
+
+    return interval_us - correction;
+}
+
+int32_t pps_frequency_error_ppb(void)
+{
+    taskENTER_CRITICAL();
+    const int64_t freq = freq_error_ppt;
+    taskEXIT_CRITICAL();
+
+    return freq / 1000;
+}
+
+uint32_t pps_holdover_uncertainty_us(uint64_t now_us)
+{
+    taskENTER_CRITICAL();
+    const int valid = freq_valid;
+    const uint64_t last = last_edge_us;
+    const int64_t avg_error = avg_abs_error_ns;
+    taskEXIT_CRITICAL();
+
+    if (!valid) {
+        return UINT32_MAX;
+    }
+
+    const uint64_t since_s = now_us > last ? (now_us - last) / 1000000ull : 0;
+
+    uint64_t freq_uncertainty_ppb = avg_error;
+    if (freq_uncertainty_ppb < PPS_FREQ_UNCERTAINTY_MIN_PPB) {
+        freq_uncertainty_ppb = PPS_FREQ_UNCERTAINTY_MIN_PPB;
+    }
+
+    const uint64_t uncertainty_ns = PPS_CAPTURE_RESOLUTION_NS + avg_error +
+        freq_uncertainty_ppb * since_s +
+        PPS_WANDER_PPB_PER_HOUR * since_s * since_s / (2 * 3600);
+
+    const uint64_t uncertainty_us = uncertainty_ns / 1000;
+    return uncertainty_us > UINT32_MAX ? UINT32_MAX : uncertainty_us;
+}
@@ -0,0 +1,58 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Discipline the derived clock with the GPS pulse per second.
+ *
+ * The rising edges of the PPS are timestamped with timestamp_now_us(). A PI
+ * loop tracks the phase of the edges and estimates the frequency error of
+ * the local oscillator. The estimate corrects the intervals measured with
+ * timestamp_now_us() while the GPS is not available (holdover).
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Give the timestamp_now_us() of a PPS rising edge. Called from the timer
+// capture interrupt, or from the simulator.
+void pps_push_edge(uint64_t edge_us);
+
+// Return 1 if the loop is locked and receiving edges
+int pps_locked(void);
+
+// Return the latest PPS edge at or before timestamp_us, if it is less than
+// one second older. Return 0 otherwise.
+uint64_t pps_edge_before(uint64_t timestamp_us);
+
+// Convert an interval measured with timestamp_now_us() to true microseconds
+uint64_t pps_correct_interval_us(uint64_t interval_us);
+
+// Estimated frequency error of the local clock in parts per billion,
+// positive when timestamp_now_us() runs fast.
+int32_t pps_frequency_error_ppb(void);
+
+// Estimated uncertainty of the disciplined clock in microseconds at the
+// given timestamp, growing with the time since the last edge.
+// Returns UINT32_MAX if the frequency was never estimated.
+uint32_t pps_holdover_uncertainty_us(uint64_t now_us);
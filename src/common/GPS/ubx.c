@@ -0,0 +1,212 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "GPS/ubx.h"
+
+enum {
+    STATE_SYNC_1 = 0,
+    STATE_SYNC_2,
+    STATE_CLASS,
+    STATE_ID,
+    STATE_LEN_LOW,
+    STATE_LEN_HIGH,
+    STATE_PAYLOAD,
+    STATE_CK_A,
+    STATE_CK_B,
+};
+
+// Little endian fields of the payload
+static inline uint16_t u2(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t u4(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void ubx_init(struct ubx_parser *parser)
+{
+    parser->state = STATE_SYNC_1;
+}
+
+int ubx_receiving(const struct ubx_parser *parser)
+{
+    return parser->state != STATE_SYNC_1;
+}
+
+static enum ubx_message decode(struct ubx_parser *p)
+{
+    const uint8_t *pl = p->payload;
+
+    if (p->msg_class == UBX_CLASS_NAV && p->msg_id == UBX_NAV_TIMEUTC &&
+            p->len == UBX_NAV_TIMEUTC_LEN) {
+        p->time_accuracy_ns = u4(pl + 4);
+        p->nano = (int32_t)u4(pl + 8);
+        p->year = u2(pl + 12);
+        p->month = pl[14];
+        p->day = pl[15];
+        p->hours = pl[16];
+        p->minutes = pl[17];
+        p->seconds = pl[18];
+        // validUTC
+        p->utc_valid = (pl[19] & 0x04) ? 1 : 0;
+        return UBX_MSG_NAV_TIMEUTC;
+    }
+    else if (p->msg_class == UBX_CLASS_NAV && p->msg_id == UBX_NAV_PVT &&
+            p->len >= UBX_NAV_PVT_MIN_LEN) {
+        p->year = u2(pl + 4);
+        p->month = pl[6];
+        p->day = pl[7];
+        p->hours = pl[8];
+        p->minutes = pl[9];
+        p->seconds = pl[10];
+        // validDate and validTime
+        p->utc_valid = (pl[11] & 0x03) == 0x03;
+        p->time_accuracy_ns = u4(pl + 12);
+        p->nano = (int32_t)u4(pl + 16);
+        // gnssFixOK
+        p->fix_ok = pl[21] & 0x01;
+        p->satellites = pl[23];
+        return UBX_MSG_NAV_PVT;
+    }
+    else if (p->msg_class == UBX_CLASS_ACK && p->len == 2) {
+        p->ack_class = pl[0];
+        p->ack_id = pl[1];
+        return p->msg_id == UBX_ACK_ACK ? UBX_MSG_ACK : UBX_MSG_NAK;
+    }
+
+    return UBX_NONE;
+}
+
+static inline void checksum(struct ubx_parser *p, uint8_t b)
+{
+    p->ck_a += b;
+    p->ck_b += p->ck_a;
+}
+
+enum ubx_message ubx_parse(struct ubx_parser *p,
+        const uint8_t *buf, uint32_t len, uint32_t *consumed)
+{
+    uint32_t i = 0;
+
+    // One frame at most, the bytes after it can be NMEA
+    while (i < len && (i == 0 || p->state != STATE_SYNC_1)) {
+        const uint8_t b = buf[i++];
+
+        switch (p->state) {
+            case STATE_SYNC_1:
+                if (b == UBX_SYNC_1) {
+                    p->state = STATE_SYNC_2;
+                }
+                break;
+            case STATE_SYNC_2:
+                if (b == UBX_SYNC_2) {
+                    p->state = STATE_CLASS;
+                }
+                else if (b != UBX_SYNC_1) {
+                    p->state = STATE_SYNC_1;
+                }
+                p->ck_a = 0;
+                p->ck_b = 0;
+                break;
+            case STATE_CLASS:
+                p->msg_class = b;
+                checksum(p, b);
+                p->state = STATE_ID;
+                break;
+            case STATE_ID:
+                p->msg_id = b;
+                checksum(p, b);
+                p->state = STATE_LEN_LOW;
+                break;
+            case STATE_LEN_LOW:
+                p->len = b;
+                checksum(p, b);
+                p->state = STATE_LEN_HIGH;
+                break;
+            case STATE_LEN_HIGH:
+                p->len |= b << 8;
+                checksum(p, b);
+                p->pos = 0;
+                if (p->len > UBX_MAX_PAYLOAD) {
+                    // Corrupted, or a frame we do not decode. Waiting for
+                    // up to 64KiB would drop the NMEA sentences meanwhile.
+                    p->state = STATE_SYNC_1;
+                }
+                else {
+                    p->state = p->len ? STATE_PAYLOAD : STATE_CK_A;
+                }
+                break;
+            case STATE_PAYLOAD:
+                p->payload[p->pos] = b;
+                checksum(p, b);
+                if (++p->pos == p->len) {
+                    p->state = STATE_CK_A;
+                }
+                break;
+            case STATE_CK_A:
+                p->state = (b == p->ck_a) ? STATE_CK_B : STATE_SYNC_1;
+                break;
+            case STATE_CK_B:
+                p->state = STATE_SYNC_1;
+                if (b == p->ck_b) {
+                    const enum ubx_message msg = decode(p);
+                    if (msg != UBX_NONE) {
+                        *consumed = i;
+                        return msg;
+                    }
+                }
+                break;
+        }
+    }
+
+    *consumed = i;
+    return UBX_NONE;
+}
+
+uint32_t ubx_frame(uint8_t *out, uint8_t msg_class, uint8_t msg_id,
+        const uint8_t *payload, uint16_t len)
+{
+    out[0] = UBX_SYNC_1;
+    out[1] = UBX_SYNC_2;
+    out[2] = msg_class;
+    out[3] = msg_id;
+    out[4] = len & 0xFF;
+    out[5] = len >> 8;
+    for (uint16_t i = 0; i < len; i++) {
+        out[6 + i] = payload[i];
+    }
+
+    uint8_t ck_a = 0, ck_b = 0;
+    for (uint32_t i = 2; i < 6u + len; i++) {
+        ck_a += out[i];
+        ck_b += ck_a;
+    }
+    out[6 + len] = ck_a;
+    out[7 + len] = ck_b;
+
+    return len + UBX_FRAME_OVERHEAD;
+}
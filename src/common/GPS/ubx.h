@@ -0,0 +1,128 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* u-blox UBX binary protocol
+ *
+ * Frames to configure the receiver, and a streaming parser for the
+ * navigation messages we use:
+ *  NAV-TIMEUTC for the time and its accuracy estimate,
+ *  NAV-PVT for the fix status and the number of satellites.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define UBX_SYNC_1 0xB5
+#define UBX_SYNC_2 0x62
+
+// Header and checksum around the payload
+#define UBX_FRAME_OVERHEAD 8
+
+// Longer payloads are checked but not stored
+#define UBX_MAX_PAYLOAD 100
+
+#define UBX_CLASS_NAV  0x01
+#define UBX_CLASS_RXM  0x02
+#define UBX_CLASS_ACK  0x05
+#define UBX_CLASS_CFG  0x06
+#define UBX_CLASS_NMEA 0xF0
+
+#define UBX_NAV_PVT     0x07
+#define UBX_NAV_TIMEUTC 0x21
+#define UBX_ACK_NAK     0x00
+#define UBX_ACK_ACK     0x01
+#define UBX_CFG_MSG     0x01
+#define UBX_RXM_PMREQ   0x41
+
+// Message ids of the NMEA sentences, for CFG-MSG
+#define UBX_NMEA_GGA 0x00
+#define UBX_NMEA_GLL 0x01
+#define UBX_NMEA_GSA 0x02
+#define UBX_NMEA_GSV 0x03
+#define UBX_NMEA_RMC 0x04
+#define UBX_NMEA_VTG 0x05
+
+// Payload lengths. NAV-PVT is 84 bytes on u-blox 7, 92 bytes later.
+#define UBX_NAV_TIMEUTC_LEN 20
+#define UBX_NAV_PVT_MIN_LEN 84
+#define UBX_NAV_PVT_LEN 92
+#define UBX_RXM_PMREQ_LEN 8
+
+enum ubx_message {
+    UBX_NONE = 0,
+    UBX_MSG_NAV_TIMEUTC,
+    UBX_MSG_NAV_PVT,
+    UBX_MSG_ACK,
+    UBX_MSG_NAK,
+};
+
+struct ubx_parser {
+    // Parser state
+    int state;
+    uint8_t msg_class;
+    uint8_t msg_id;
+    uint16_t len;
+    uint16_t pos;
+    uint8_t ck_a;
+    uint8_t ck_b;
+    uint8_t payload[UBX_MAX_PAYLOAD];
+
+    /* Values of the last message, valid after ubx_parse() returned it.
+     * Time is UTC, with the year on four digits.
+     */
+    int year;
+    int month;
+    int day;
+    int hours;
+    int minutes;
+    int seconds;
+    int32_t nano;
+    // Time accuracy estimate in ns
+    uint32_t time_accuracy_ns;
+    int utc_valid;
+
+    int fix_ok;
+    int satellites;
+
+    // Class and id of the acknowledged configuration message
+    uint8_t ack_class;
+    uint8_t ack_id;
+};
+
+void ubx_init(struct ubx_parser *parser);
+
+// Return 1 while a frame is being received
+int ubx_receiving(const struct ubx_parser *parser);
+
+// Give len received bytes, and stop at the end of the first frame, or when
+// the bytes are not a frame. Return the message type if it is one we use,
+// and the number of bytes used in consumed.
+enum ubx_message ubx_parse(struct ubx_parser *parser,
+        const uint8_t *buf, uint32_t len, uint32_t *consumed);
+
+// Write a frame with the payload into out, which must hold
+// len + UBX_FRAME_OVERHEAD bytes. Return the frame length.
+uint32_t ubx_frame(uint8_t *out, uint8_t msg_class, uint8_t msg_id,
+        const uint8_t *payload, uint16_t len);
@@ -11,3 +11,10 @@
 #define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()    vConfigureTimerForRunTimeStats()
 #define portGET_RUN_TIME_COUNTER_VALUE()            vGetTimerForRunTimeStats()
 #endif
+
+/* The tickless idle enters STOP mode when possible, see power.c */
+#include <stdint.h>
+uint32_t power_pre_sleep(uint32_t expected_idle_ticks);
+void power_post_sleep(uint32_t expected_idle_ticks);
+#define configPRE_SLEEP_PROCESSING(x) do { (x) = power_pre_sleep(x); } while (0)
+#define configPOST_SLEEP_PROCESSING(x) power_post_sleep(x)
@@ -26,19 +26,12 @@
 
 #include "FreeRTOS.h"
 #include "task.h"
-#include "timers.h"
 
-#include "Core/delay.h"
 #include "Core/common.h"
 #include "stm32f4xx_conf.h"
 #include "stm32f4xx_adc.h"
+#include "stm32f4xx_dma.h"
 #include "stm32f4xx_gpio.h"
-#include <math.h>
-#include "GPIO/usart.h"
-
-#define PIN_SUPPLY GPIO_Pin_5
-#define PIN_SWR_FWD GPIO_Pin_6
-#define PIN_SWR_REFL GPIO_Pin_7
 
 // see doc/pio.txt for allocation
 #define PINS_ADC1 /* PA pins */ (GPIO_Pin_5 | GPIO_Pin_6 | GPIO_Pin_7)
@@ -47,13 +40,74 @@
 #define ADC1_CHANNEL_SWR_FWD ADC_Channel_6
 #define ADC1_CHANNEL_SWR_REFL ADC_Channel_7
 
+// ADC1 is on DMA2 stream 0 channel 0
+#define ADC1_DMA_STREAM DMA2_Stream0
+#define ADC1_DMA_CHANNEL DMA_Channel_0
+#define ADC1_DMA_FLAG_TC DMA_FLAG_TCIF0
+
+/* ADC1 converts the three inputs in scan mode, continuously, and the DMA
+ * writes them in a circular buffer of ADC1_OVERSAMPLING scans. A measurement
+ * is the average of the buffer, which always holds the latest samples.
+ *
+ * The ADC clock is APB2/8 = 10.5MHz, a conversion takes 480+12 cycles or
+ * 47us, so the buffer is refreshed every 2.25ms. In STOP mode the scan
+ * pauses with the clocks and resumes at wakeup.
+ */
+#define ADC1_NUM_CHANNELS 3
+#define ADC1_OVERSAMPLING 16
+
+// Index of each input in a scan, the rank minus one
+#define RANK_SUPPLY 0
+#define RANK_SWR_FWD 1
+#define RANK_SWR_REFL 2
+
+static volatile uint16_t adc1_samples[ADC1_OVERSAMPLING][ADC1_NUM_CHANNELS];
+
+// Set once the DMA has filled the buffer
+static int adc1_ready = 0;
+
 // Measured on the board itself
 const float v_ref = 2.965f;
 
+static void adc1_start_scan(void)
+{
+    DMA_Cmd(ADC1_DMA_STREAM, DISABLE);
+    while (DMA_GetCmdStatus(ADC1_DMA_STREAM) == ENABLE) {
+    }
+
+    DMA_DeInit(ADC1_DMA_STREAM);
+    DMA_InitTypeDef DMA_InitStruct;
+    DMA_StructInit(&DMA_InitStruct);
+    DMA_InitStruct.DMA_Channel = ADC1_DMA_CHANNEL;
+    DMA_InitStruct.DMA_PeripheralBaseAddr = (uint32_t)&ADC1->DR;
+    DMA_InitStruct.DMA_Memory0BaseAddr = (uint32_t)adc1_samples;
+    DMA_InitStruct.DMA_DIR = DMA_DIR_PeripheralToMemory;
+    DMA_InitStruct.DMA_BufferSize = ADC1_OVERSAMPLING * ADC1_NUM_CHANNELS;
+    DMA_InitStruct.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStruct.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStruct.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+    DMA_InitStruct.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+    DMA_InitStruct.DMA_Mode = DMA_Mode_Circular;
+    DMA_InitStruct.DMA_Priority = DMA_Priority_Low;
+    DMA_InitStruct.DMA_FIFOMode = DMA_FIFOMode_Disable;
+    DMA_Init(ADC1_DMA_STREAM, &DMA_InitStruct);
+    DMA_Cmd(ADC1_DMA_STREAM, ENABLE);
+
+    /* After an overrun, the DMA requests only restart when the DMA bit
+     * is toggled. The new scan starts at rank 1 and at the beginning of the
+     * buffer, which keeps the samples of each input in place.
+     */
+    ADC_ClearFlag(ADC1, ADC_FLAG_OVR);
+    ADC_DMACmd(ADC1, DISABLE);
+    ADC_DMACmd(ADC1, ENABLE);
+    ADC_SoftwareStartConv(ADC1);
+}
+
 void analog_init(void)
 {
-    // Enable ADC and GPIOA clocks
+    // Enable ADC, DMA and GPIOA clocks
     RCC_APB2PeriphClockCmd(RCC_APB2Periph_ADC1, ENABLE);
+    RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA2, ENABLE);
     RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_GPIOA, ENABLE);
 
     // Set analog input pins mode
@@ -65,7 +119,7 @@ void analog_init(void)
     GPIO_InitStructure.GPIO_OType = GPIO_OType_PP;
     GPIO_Init(GPIOA, &GPIO_InitStructure);
 
-    // Init ADC1 for supply measurement
+    // Init ADC1 for supply and SWR measurement
     ADC_CommonInitTypeDef ADC_CommonInitStruct;
 
     ADC_CommonInitStruct.ADC_Mode = ADC_Mode_Independent;
@@ -76,82 +130,70 @@ void analog_init(void)
 
     ADC_InitTypeDef ADC_InitStruct;
     ADC_InitStruct.ADC_Resolution = ADC_Resolution_12b;
-    ADC_InitStruct.ADC_ScanConvMode = DISABLE;
-    ADC_InitStruct.ADC_ContinuousConvMode = DISABLE;
+    ADC_InitStruct.ADC_ScanConvMode = ENABLE;
+    ADC_InitStruct.ADC_ContinuousConvMode = ENABLE;
     ADC_InitStruct.ADC_ExternalTrigConvEdge = ADC_ExternalTrigConvEdge_None;
     ADC_InitStruct.ADC_ExternalTrigConv = ADC_ExternalTrigConv_T1_CC1;
     ADC_InitStruct.ADC_DataAlign = ADC_DataAlign_Right;
-    ADC_InitStruct.ADC_NbrOfConversion = 3;
+    ADC_InitStruct.ADC_NbrOfConversion = ADC1_NUM_CHANNELS;
     ADC_Init(ADC1, &ADC_InitStruct);
 
+    ADC_RegularChannelConfig(ADC1, ADC1_CHANNEL_SUPPLY,
+            RANK_SUPPLY + 1, ADC_SampleTime_480Cycles);
+    ADC_RegularChannelConfig(ADC1, ADC1_CHANNEL_SWR_FWD,
+            RANK_SWR_FWD + 1, ADC_SampleTime_480Cycles);
+    ADC_RegularChannelConfig(ADC1, ADC1_CHANNEL_SWR_REFL,
+            RANK_SWR_REFL + 1, ADC_SampleTime_480Cycles);
+
+    ADC_DMARequestAfterLastTransferCmd(ADC1, ENABLE);
+
     // Enable ADC
     ADC_Cmd(ADC1, ENABLE);
+
+    adc1_start_scan();
 }
 
-static uint16_t adc1_read(uint8_t channel)
+int analog_get_snapshot(struct analog_snapshot *snapshot)
 {
-    ADC_RegularChannelConfig(ADC1,
-            channel,
-            1,
-            ADC_SampleTime_480Cycles);
-
-    ADC_SoftwareStartConv(ADC1);
-
-    /* Timeout:
-     * System clock is at 168MHz, ADC is on APB2 which has a prescaler of 2.
-     * 480 cycles at 84Mhz is about 6us.
-     *
-     * If we have no result after 1000ms it is a real problem. Keep in mind
-     * we could get preempted.
-     */
-
-    int ready = 0;
+    taskENTER_CRITICAL();
+    if (ADC_GetFlagStatus(ADC1, ADC_FLAG_OVR) == SET) {
+        // The buffer keeps the samples from before the overrun
+        adc1_start_scan();
+    }
 
-    vTaskSuspendAll();
-    for (int i = 0; i < 10000; i++) {
-        if (ADC_GetFlagStatus(ADC1, ADC_FLAG_EOC) == SET) {
-            ready = 1;
-            break;
-        }
-        delay_us(100);
+    if (!adc1_ready &&
+            DMA_GetFlagStatus(ADC1_DMA_STREAM, ADC1_DMA_FLAG_TC) == SET) {
+        adc1_ready = 1;
     }
-    xTaskResumeAll();
+    const int ready = adc1_ready;
+    taskEXIT_CRITICAL();
 
     if (!ready) {
-        trigger_fault(FAULT_SOURCE_ADC1);
+        return 0;
     }
 
-    return ADC_GetConversionValue(ADC1);
-}
-
-float analog_measure_12v(void)
-{
-    const uint16_t raw_value = adc1_read(ADC1_CHANNEL_SUPPLY);
-
-    const float adc_max_value = (1 << 12);
-
-    // Convert ADC measurement to voltage
-    float voltage = ((float)raw_value*v_ref/adc_max_value);
-
-    // Compensate resistor divider on board (see schematic)
-    return voltage * 202.0f / 22.0f;
-}
-
+    /* The DMA keeps writing while the sums are made, each sample is read
+     * atomically and belongs to the right input.
+     */
+    uint32_t sums[ADC1_NUM_CHANNELS] = {0};
+    for (int i = 0; i < ADC1_OVERSAMPLING; i++) {
+        for (int c = 0; c < ADC1_NUM_CHANNELS; c++) {
+            sums[c] += adc1_samples[i][c];
+        }
+    }
 
-int analog_measure_swr(int *forward_mv, int* reflected_mv)
-{
-    const uint16_t raw_swr_fwd_value = adc1_read(ADC1_CHANNEL_SWR_FWD);
-    const uint16_t raw_swr_refl_value = adc1_read(ADC1_CHANNEL_SWR_REFL);
+    const float adc_max_value = (1 << 12) * ADC1_OVERSAMPLING;
 
-    const float adc_max_value = (1 << 12);
+    // Convert ADC measurement to voltage, and compensate resistor divider
+    // on board (see schematic)
+    snapshot->supply = (float)sums[RANK_SUPPLY] * v_ref / adc_max_value *
+        202.0f / 22.0f;
 
     // Convert ADC measurement to mV (includes times 100 amplifier)
-    const int swr_fwd = ((float)raw_swr_fwd_value*10.0f*v_ref/adc_max_value);
-    const int swr_refl = ((float)raw_swr_refl_value*10.0f*v_ref/adc_max_value);
-
-    *forward_mv = swr_fwd;
-    *reflected_mv = swr_refl;
+    snapshot->swr_forward_mv =
+        (float)sums[RANK_SWR_FWD] * 10.0f * v_ref / adc_max_value;
+    snapshot->swr_reflected_mv =
+        (float)sums[RANK_SWR_REFL] * 10.0f * v_ref / adc_max_value;
 
     return 1;
 }
-
@@ -24,6 +24,7 @@
 
 #include "GPIO/i2c.h"
 #include "Audio/audio.h"
+#include "Core/power.h"
 #include "stm32f4xx_conf.h"
 #include "stm32f4xx.h"
 
@@ -167,6 +168,12 @@ bool audio_provide_buffer_without_blocking(void *samples, int numsamples) {
 }
 
 void audio_start_dma_and_request_buffers() {
+    if (!dma_running) {
+        // I2S needs the PLL. Only from a task, in the DMA interrupt the
+        // playback is already running.
+        power_inhibit_stop(POWER_INHIBIT_AUDIO, 1);
+    }
+
     // Configure DMA stream.
     DMA1_Stream7 ->CR = (0 * DMA_SxCR_CHSEL_0 ) | // Channel 0
         (1 * DMA_SxCR_PL_0 ) | // Priority 1
@@ -197,6 +204,20 @@ void audio_stop_dma() {
         ; // Wait for DMA stream to stop.
 
     dma_running = false;
+    power_inhibit_stop(POWER_INHIBIT_AUDIO, 0);
+}
+
+void audio_resume(void) {
+    NVIC_DisableIRQ(DMA1_Stream7_IRQn);
+
+    if (callback_function && !next_buffer_samples) {
+        if (!dma_running) {
+            buffer_number = 0;
+        }
+        callback_function(callback_context, buffer_number);
+    }
+
+    NVIC_EnableIRQ(DMA1_Stream7_IRQn);
 }
 
 void DMA1_Stream7_IRQHandler() {
@@ -206,6 +227,7 @@ void DMA1_Stream7_IRQHandler() {
         audio_start_dma_and_request_buffers();
     } else {
         dma_running = false;
+        power_inhibit_stop_from_isr(POWER_INHIBIT_AUDIO, 0);
     }
 }
 
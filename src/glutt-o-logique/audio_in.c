@@ -28,6 +28,7 @@
 #include "stm32f4xx_dac.h"
 
 #include "GPIO/usart.h"
+#include "Core/log.h"
 #include "Core/common.h"
 #include "Audio/audio_in.h"
 #include "Audio/tone.h"
@@ -49,7 +50,7 @@ void TIM6_DAC_IRQHandler()
         TIM_ClearITPendingBit(TIM6, TIM_IT_Update);
     }
     else {
-        usart_debug("Spurious TIM6 IRQ: SR=%x, DAC SR=%x\r\n",
+        log_msg(AUDIO, LOG_WARNING, "Spurious TIM6 IRQ: SR=%x, DAC SR=%x\r\n",
                 TIM6->SR, DAC->SR);
         trigger_fault(FAULT_SOURCE_TIM6_ISR);
     }
@@ -71,7 +72,7 @@ void ADC_IRQHandler()
         // This sometimes happens...
     }
     else {
-        usart_debug("Spurious ADC2 IRQ: SR=%x\r\n", ADC2->SR);
+        log_msg(AUDIO, LOG_WARNING, "Spurious ADC2 IRQ: SR=%x\r\n", ADC2->SR);
         trigger_fault(FAULT_SOURCE_ADC2_IRQ);
     }
 
@@ -23,9 +23,136 @@
 */
 
 #include <stm32f4xx.h>
+#include "stm32f4xx_conf.h"
+#include "stm32f4xx_tim.h"
+#include "stm32f4xx_gpio.h"
 #include "GPIO/usart.h"
+#include "GPS/pps.h"
 #include "Core/common.h"
 
+// APB1 prescaler = 4, see bsp/system_stm32f4xx.c. The timers on APB1
+// run at twice the bus frequency.
+#define APB1_TIMER_FREQ (2 * 168000000ul / 4)
+
+// see doc/pio.txt for allocation
+#define PIN_PPS /* PB11 on TIM2 CH4 */ GPIO_Pin_11
+
+/* TIM2 is a free-running 32-bit counter at 1MHz. It wraps every 71 minutes,
+ * the wraps are counted in the update interrupt to extend it to 64 bits.
+ * Channel 4 captures the GPS PPS.
+ */
+static volatile uint32_t tim2_overflows = 0;
+
+// Time during which TIM2 was stopped in STOP mode. Only modified by the idle
+// task with interrupts disabled.
+static volatile uint64_t tim2_stopped_us = 0;
+
+static uint64_t tim2_now(void);
+
+void TIM2_IRQHandler(void);
+void TIM2_IRQHandler()
+{
+    if (TIM_GetITStatus(TIM2, TIM_IT_Update)) {
+        TIM_ClearITPendingBit(TIM2, TIM_IT_Update);
+        tim2_overflows++;
+    }
+
+    if (TIM_GetITStatus(TIM2, TIM_IT_CC4)) {
+        // Reading the capture register clears the flag
+        const uint32_t capture = TIM_GetCapture4(TIM2);
+
+        // The edge is in the past, extend it to 64 bits from the current time
+        const uint64_t now = tim2_now();
+        pps_push_edge(now - (uint32_t)((uint32_t)now - capture) + tim2_stopped_us);
+    }
+}
+
+static void setup_pps_capture(void)
+{
+    RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_GPIOB, ENABLE);
+
+    GPIO_InitTypeDef GPIO_InitStructure;
+    GPIO_InitStructure.GPIO_Mode  = GPIO_Mode_AF;
+    GPIO_InitStructure.GPIO_Pin   = PIN_PPS;
+    GPIO_InitStructure.GPIO_PuPd  = GPIO_PuPd_DOWN;
+    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+    GPIO_InitStructure.GPIO_OType = GPIO_OType_PP;
+    GPIO_Init(GPIOB, &GPIO_InitStructure);
+    GPIO_PinAFConfig(GPIOB, GPIO_PinSource11, GPIO_AF_TIM2);
+
+    TIM_ICInitTypeDef TIM_ICInitStructure;
+    TIM_ICStructInit(&TIM_ICInitStructure);
+    TIM_ICInitStructure.TIM_Channel = TIM_Channel_4;
+    TIM_ICInitStructure.TIM_ICPolarity = TIM_ICPolarity_Rising;
+    TIM_ICInitStructure.TIM_ICSelection = TIM_ICSelection_DirectTI;
+    TIM_ICInitStructure.TIM_ICPrescaler = TIM_ICPSC_DIV1;
+    TIM_ICInitStructure.TIM_ICFilter = 0x3;
+    TIM_ICInit(TIM2, &TIM_ICInitStructure);
+
+    TIM_ClearITPendingBit(TIM2, TIM_IT_CC4);
+    TIM_ITConfig(TIM2, TIM_IT_CC4, ENABLE);
+}
+
+void timestamp_init(void)
+{
+    RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2, ENABLE);
+
+    TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+    TIM_TimeBaseStructInit(&TIM_TimeBaseStructure);
+    TIM_TimeBaseStructure.TIM_Period = 0xFFFFFFFF;
+    TIM_TimeBaseStructure.TIM_Prescaler = APB1_TIMER_FREQ / 1000000ul - 1;
+    TIM_TimeBaseStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+    TIM_TimeBaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+    TIM_TimeBaseInit(TIM2, &TIM_TimeBaseStructure);
+
+    // TIM_TimeBaseInit generates an update event to load the prescaler
+    TIM_ClearITPendingBit(TIM2, TIM_IT_Update);
+
+    NVIC_InitTypeDef NVIC_InitStructure;
+    NVIC_InitStructure.NVIC_IRQChannel = TIM2_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 5;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+    NVIC_SetPriority(TIM2_IRQn, 5);
+
+    TIM_ITConfig(TIM2, TIM_IT_Update, ENABLE);
+    setup_pps_capture();
+    TIM_Cmd(TIM2, ENABLE);
+}
+
+// The TIM2 counter extended to 64 bits
+static uint64_t tim2_now(void)
+{
+    uint32_t overflows;
+    uint32_t high;
+    uint32_t low;
+
+    do {
+        overflows = tim2_overflows;
+        low = TIM2->CNT;
+        high = overflows;
+
+        // The counter wrapped but the interrupt was not serviced yet,
+        // because it is masked or of lower priority than the caller.
+        if ((TIM2->SR & TIM_SR_UIF) && low < 0x80000000ul) {
+            high++;
+        }
+    } while (overflows != tim2_overflows);
+
+    return ((uint64_t)high << 32) | low;
+}
+
+uint64_t timestamp_now_us(void)
+{
+    return tim2_now() + tim2_stopped_us;
+}
+
+void timestamp_compensate_stop(uint32_t stopped_us)
+{
+    tim2_stopped_us += stopped_us;
+}
+
 void hard_fault_handler_c(uint32_t *hardfault_args)
 {
     uint32_t stacked_r0;
@@ -62,6 +189,7 @@ void hard_fault_handler_c(uint32_t *hardfault_args)
     usart_debug("DFSR = %x\n", (*((volatile unsigned long *)(0xE000ED30))));
     usart_debug("AFSR = %x\n", (*((volatile unsigned long *)(0xE000ED3C))));
     usart_debug("SCB_SHCSR = %x\n", SCB->SHCSR);
+    usart_debug_flush();
 
     while (1);
 }
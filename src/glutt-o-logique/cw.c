@@ -23,10 +23,11 @@
 */
 
 #include "GPIO/usart.h"
+#include "Core/log.h"
 #include "Audio/cw.h"
 
 // Function to display message in GUI, unused on STM32 firmware
 void cw_message_sent(const char* str) {
-    usart_debug_puts_header("CW: ", str);
+    log_msg(AUDIO, LOG_INFO, "CW: %s\r\n", str);
 }
 
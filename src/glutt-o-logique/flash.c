@@ -0,0 +1,80 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "Core/flash.h"
+#include "stm32f4xx_conf.h"
+#include "stm32f4xx.h"
+
+/* Sectors 1 and 2, 16kB each. The linker script places the interrupt
+ * vectors alone in sector 0, and the program after sector 2.
+ */
+extern uint32_t _store_start[];
+
+static const uint32_t sector_ids[FLASH_STORE_SECTORS] = {
+    FLASH_Sector_1,
+    FLASH_Sector_2,
+};
+
+#define FLASH_ERROR_FLAGS (FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | \
+        FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR)
+
+int flash_store_erase(int sector)
+{
+    FLASH_Unlock();
+    FLASH_ClearFlag(FLASH_ERROR_FLAGS);
+    const FLASH_Status status = FLASH_EraseSector(sector_ids[sector], VoltageRange_3);
+    FLASH_Lock();
+
+    // The data cache can hold the previous contents
+    FLASH_DataCacheCmd(DISABLE);
+    FLASH_DataCacheReset();
+    FLASH_DataCacheCmd(ENABLE);
+
+    return status == FLASH_COMPLETE;
+}
+
+int flash_store_program(int sector, uint32_t offset, const uint32_t *words, uint32_t num_words)
+{
+    if (offset + num_words > FLASH_STORE_SECTOR_WORDS) {
+        return 0;
+    }
+
+    const uint32_t address = (uint32_t)flash_store_sector(sector) + offset * 4;
+
+    FLASH_Unlock();
+    FLASH_ClearFlag(FLASH_ERROR_FLAGS);
+
+    FLASH_Status status = FLASH_COMPLETE;
+    for (uint32_t i = 0; i < num_words && status == FLASH_COMPLETE; i++) {
+        status = FLASH_ProgramWord(address + i * 4, words[i]);
+    }
+    FLASH_Lock();
+
+    return status == FLASH_COMPLETE;
+}
+
+const uint32_t *flash_store_sector(int sector)
+{
+    return _store_start + sector * FLASH_STORE_SECTOR_WORDS;
+}
@@ -24,7 +24,8 @@
 
 #include "Core/fsm.h"
 #include "GPIO/usart.h"
+#include "Core/log.h"
 
 void fsm_state_switched(const char *new_state) {
-    usart_debug_puts_header("FSM: ", new_state);
+    log_msg(FSM, LOG_INFO, "FSM: %s\r\n", new_state);
 }
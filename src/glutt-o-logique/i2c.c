@@ -34,6 +34,7 @@
 #include "task.h"
 #include "semphr.h"
 #include "GPIO/usart.h"
+#include "Core/log.h"
 
 /* I2C 1 on PB9 and PB6
  * See pio.txt for PIO allocation details */
@@ -68,7 +69,7 @@ static void i2c_device_init(void);
 static int i2c_recover_count;
 static void i2c_recover_from_lockup(void)
 {
-    usart_debug_puts("ERROR: I2C lockup\r\n");
+    log_msg(GPIO, LOG_ERROR, "ERROR: I2C lockup\r\n");
 
     i2c_recover_count++;
     if (i2c_recover_count > 3) {
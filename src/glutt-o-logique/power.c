@@ -0,0 +1,252 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "stm32f4xx_conf.h"
+#include "stm32f4xx_rcc.h"
+#include "stm32f4xx_pwr.h"
+#include "stm32f4xx_rtc.h"
+#include "stm32f4xx_exti.h"
+#include "stm32f4xx_syscfg.h"
+#include "stm32f4xx_usart.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "Core/common.h"
+#include "Core/power.h"
+#include "Core/rtc.h"
+#include "GPIO/usart.h"
+
+/* STOP mode for the tickless idle.
+ *
+ * The default vPortSuppressTicksAndSleep() of the port sleeps with WFI, which
+ * keeps all clocks running. When no module inhibits it, the pre-sleep hook
+ * enters STOP mode instead, and the RTC wakeup timer ends it before the next
+ * task must run. Any EXTI line also wakes the MCU.
+ *
+ * The coulomb counter sends on USART2 RX, PA3, which cannot receive in STOP.
+ * Its falling edges wake up the MCU through EXTI3, and the counter inhibitor
+ * keeps it awake for the rest of the burst. The bytes that arrive before the
+ * clocks are restored are lost, the first line is then rejected by the
+ * parser.
+ *
+ * SysTick and TIM2 are stopped in STOP mode. The time spent in STOP is
+ * measured with the RTC subsecond counter, and is added to the kernel tick
+ * count and to timestamp_now_us().
+ */
+
+// Below this, the clock restart after STOP is not worth it
+#define POWER_STOP_MIN_TICKS 5
+
+// The IWDG keeps running in STOP mode. Wake up early enough for the task
+// that reloads it.
+#define POWER_STOP_MAX_MS 1000
+
+#define TICK_US (1000ul * portTICK_PERIOD_MS)
+
+// Wakeup timer clock is LSE / 16
+#define RTC_WAKEUP_FREQ (32768ul / 16)
+
+static uint64_t sleep_start_us = 0;
+static int stopped = 0;
+// Fraction of a tick spent in STOP, not yet given to the kernel
+static uint32_t stop_tick_remainder_us = 0;
+
+void RTC_WKUP_IRQHandler(void);
+void RTC_WKUP_IRQHandler()
+{
+    if (RTC_GetITStatus(RTC_IT_WUT) != RESET) {
+        RTC_ClearITPendingBit(RTC_IT_WUT);
+    }
+    EXTI_ClearITPendingBit(EXTI_Line22);
+}
+
+void EXTI3_IRQHandler(void);
+void EXTI3_IRQHandler()
+{
+    EXTI_ClearITPendingBit(EXTI_Line3);
+}
+
+// Only enabled during STOP, the line toggles with every received byte
+static void ccounter_wakeup_enable(int enable)
+{
+    EXTI_InitTypeDef EXTI_InitStructure;
+    EXTI_InitStructure.EXTI_Line = EXTI_Line3;
+    EXTI_InitStructure.EXTI_Mode = EXTI_Mode_Interrupt;
+    EXTI_InitStructure.EXTI_Trigger = EXTI_Trigger_Falling;
+    EXTI_InitStructure.EXTI_LineCmd = enable ? ENABLE : DISABLE;
+    EXTI_Init(&EXTI_InitStructure);
+}
+
+static void setup_wakeup_timer(uint32_t ms)
+{
+    RTC_WakeUpCmd(DISABLE);
+    RTC_WakeUpClockConfig(RTC_WakeUpClock_RTCCLK_Div16);
+    RTC_SetWakeUpCounter(ms * RTC_WAKEUP_FREQ / 1000 - 1);
+
+    RTC_ClearITPendingBit(RTC_IT_WUT);
+    EXTI_ClearITPendingBit(EXTI_Line22);
+
+    RTC_ITConfig(RTC_IT_WUT, ENABLE);
+    RTC_WakeUpCmd(ENABLE);
+}
+
+static void power_init(void)
+{
+    EXTI_InitTypeDef EXTI_InitStructure;
+    EXTI_InitStructure.EXTI_Line = EXTI_Line22;
+    EXTI_InitStructure.EXTI_Mode = EXTI_Mode_Interrupt;
+    EXTI_InitStructure.EXTI_Trigger = EXTI_Trigger_Rising;
+    EXTI_InitStructure.EXTI_LineCmd = ENABLE;
+    EXTI_Init(&EXTI_InitStructure);
+
+    NVIC_InitTypeDef NVIC_InitStructure;
+    NVIC_InitStructure.NVIC_IRQChannel = RTC_WKUP_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 6;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+    NVIC_SetPriority(RTC_WKUP_IRQn, 6);
+
+    // USART2 RX on PA3 stays in alternate function mode, EXTI still sees it
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_SYSCFG, ENABLE);
+    SYSCFG_EXTILineConfig(EXTI_PortSourceGPIOA, EXTI_PinSource3);
+
+    NVIC_InitStructure.NVIC_IRQChannel = EXTI3_IRQn;
+    NVIC_Init(&NVIC_InitStructure);
+    NVIC_SetPriority(EXTI3_IRQn, 6);
+}
+
+// Time of day of the RTC, in subsecond units
+static uint32_t rtc_read_subseconds(uint32_t prediv_s)
+{
+    // Reading SSR locks TR and DR until DR is read
+    const uint32_t ssr = RTC->SSR;
+    const uint32_t tr = RTC->TR;
+    (void)RTC->DR;
+
+    const uint32_t hours = ((tr >> 20) & 0x3) * 10 + ((tr >> 16) & 0xF);
+    const uint32_t minutes = ((tr >> 12) & 0x7) * 10 + ((tr >> 8) & 0xF);
+    const uint32_t seconds = ((tr >> 4) & 0x7) * 10 + (tr & 0xF);
+
+    return (hours * 3600 + minutes * 60 + seconds) * (prediv_s + 1) + (prediv_s - ssr);
+}
+
+// After STOP, the system runs from the HSI. Restart HSE and PLL, and the
+// I2S PLL if the audio had left it on.
+static void restore_clocks(int plli2s_on)
+{
+    RCC_HSEConfig(RCC_HSE_ON);
+    while (RCC_GetFlagStatus(RCC_FLAG_HSERDY) == RESET) {}
+
+    RCC_PLLCmd(ENABLE);
+    while (RCC_GetFlagStatus(RCC_FLAG_PLLRDY) == RESET) {}
+
+    RCC_SYSCLKConfig(RCC_SYSCLKSource_PLLCLK);
+    while (RCC_GetSYSCLKSource() != 0x08) {}
+
+    if (plli2s_on) {
+        RCC_PLLI2SCmd(ENABLE);
+        while (RCC_GetFlagStatus(RCC_FLAG_PLLI2SRDY) == RESET) {}
+    }
+}
+
+// Called with interrupts disabled from vPortSuppressTicksAndSleep()
+uint32_t power_pre_sleep(uint32_t expected_idle_ticks)
+{
+    static int initialised = 0;
+
+    sleep_start_us = timestamp_now_us();
+    stopped = 0;
+
+    if (expected_idle_ticks < POWER_STOP_MIN_TICKS ||
+            !power_stop_allowed() || !rtc_available() ||
+            !usart_debug_idle()) {
+        return expected_idle_ticks;
+    }
+
+    if (!initialised) {
+        power_init();
+        initialised = 1;
+    }
+
+    // Wake up one tick early, the kernel expects to be in time
+    uint32_t stop_ms = (expected_idle_ticks - 1) * portTICK_PERIOD_MS;
+    if (stop_ms > POWER_STOP_MAX_MS) {
+        stop_ms = POWER_STOP_MAX_MS;
+    }
+
+    const uint32_t prediv_s = RTC->PRER & RTC_PRER_PREDIV_S;
+
+    setup_wakeup_timer(stop_ms);
+    EXTI_ClearITPendingBit(EXTI_Line3);
+    ccounter_wakeup_enable(1);
+
+    const int plli2s_on = (RCC->CR & RCC_CR_PLLI2SON) != 0;
+
+    const uint32_t rtc_before = rtc_read_subseconds(prediv_s);
+    PWR_EnterSTOPMode(PWR_Regulator_LowPower, PWR_STOPEntry_WFI);
+    restore_clocks(plli2s_on);
+
+    RTC_WakeUpCmd(DISABLE);
+
+    if (EXTI_GetITStatus(EXTI_Line3) != RESET) {
+        EXTI_ClearITPendingBit(EXTI_Line3);
+        // Released by the coulomb counter task when the counter is silent
+        power_inhibit_stop(POWER_INHIBIT_CCOUNTER, 1);
+    }
+    ccounter_wakeup_enable(0);
+
+    // The calendar shadow registers are not updated in STOP mode
+    RTC_WaitForSynchro();
+    const uint32_t rtc_after = rtc_read_subseconds(prediv_s);
+
+    const uint32_t ticks_per_day = 86400ul * (prediv_s + 1);
+    const uint32_t elapsed = (rtc_after + ticks_per_day - rtc_before) % ticks_per_day;
+    const uint32_t stopped_us = (uint64_t)elapsed * 1000000ull / (prediv_s + 1);
+
+    timestamp_compensate_stop(stopped_us);
+
+    stop_tick_remainder_us += stopped_us;
+    uint32_t ticks = stop_tick_remainder_us / TICK_US;
+    if (ticks > expected_idle_ticks - 1) {
+        ticks = expected_idle_ticks - 1;
+        stop_tick_remainder_us = 0;
+    }
+    else {
+        stop_tick_remainder_us -= ticks * TICK_US;
+    }
+    vTaskStepTick(ticks);
+
+    power_account_idle(0, stopped_us);
+    stopped = 1;
+
+    // The port must not execute WFI
+    return 0;
+}
+
+void power_post_sleep(uint32_t __attribute__ ((unused)) expected_idle_ticks)
+{
+    if (!stopped) {
+        power_account_idle(timestamp_now_us() - sleep_start_us, 0);
+    }
+}
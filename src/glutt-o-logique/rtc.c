@@ -0,0 +1,155 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "stm32f4xx_conf.h"
+#include "stm32f4xx_rcc.h"
+#include "stm32f4xx_pwr.h"
+#include "stm32f4xx_rtc.h"
+#include "stm32f4xx_iwdg.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "Core/rtc.h"
+#include "GPIO/usart.h"
+#include "Core/log.h"
+
+/* The RTC runs from the 32.768kHz LSE crystal. Its backup domain is not
+ * affected by a system reset, e.g. by the watchdog. It survives power loss
+ * only if VBAT is connected to a battery instead of VDD.
+ *
+ * The backup register DR0 holds a magic value once the RTC was set.
+ */
+#define RTC_MAGIC 0x47505331ul // "GPS1"
+
+// LSE / (1 + 1) / (16383 + 1) = 1Hz. The fast subsecond counter is used to
+// measure the time spent in STOP mode.
+#define RTC_ASYNCH_PREDIV 1
+#define RTC_SYNCH_PREDIV 16383
+
+static int rtc_running = 0;
+
+void rtc_init(void)
+{
+    RCC_APB1PeriphClockCmd(RCC_APB1Periph_PWR, ENABLE);
+    PWR_BackupAccessCmd(ENABLE);
+
+    if (RTC_ReadBackupRegister(RTC_BKP_DR0) == RTC_MAGIC &&
+            RCC_GetFlagStatus(RCC_FLAG_LSERDY) == SET) {
+        RTC_WaitForSynchro();
+        rtc_running = 1;
+        return;
+    }
+
+    RCC_LSEConfig(RCC_LSE_ON);
+
+    // The LSE needs up to two seconds to start, longer than the watchdog
+    for (int i = 0; i < 300 && RCC_GetFlagStatus(RCC_FLAG_LSERDY) == RESET; i++) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+        IWDG_ReloadCounter();
+    }
+
+    if (RCC_GetFlagStatus(RCC_FLAG_LSERDY) == RESET) {
+        log_msg(CORE, LOG_ERROR, "RTC: LSE does not start\r\n");
+        RCC_LSEConfig(RCC_LSE_OFF);
+        return;
+    }
+
+    RCC_RTCCLKConfig(RCC_RTCCLKSource_LSE);
+    RCC_RTCCLKCmd(ENABLE);
+    RTC_WaitForSynchro();
+
+    RTC_InitTypeDef RTC_InitStructure;
+    RTC_StructInit(&RTC_InitStructure);
+    RTC_InitStructure.RTC_HourFormat = RTC_HourFormat_24;
+    RTC_InitStructure.RTC_AsynchPrediv = RTC_ASYNCH_PREDIV;
+    RTC_InitStructure.RTC_SynchPrediv = RTC_SYNCH_PREDIV;
+
+    if (RTC_Init(&RTC_InitStructure) == ERROR) {
+        log_msg(CORE, LOG_ERROR, "RTC: init failed\r\n");
+        return;
+    }
+
+    rtc_running = 1;
+}
+
+int rtc_available(void)
+{
+    return rtc_running;
+}
+
+int rtc_get_utc(calendar_epoch_t *utc)
+{
+    if (!rtc_running || RTC_ReadBackupRegister(RTC_BKP_DR0) != RTC_MAGIC) {
+        return 0;
+    }
+
+    RTC_TimeTypeDef rtc_time;
+    RTC_DateTypeDef rtc_date;
+
+    // Reading the time locks the date shadow register until it is read
+    RTC_GetTime(RTC_Format_BIN, &rtc_time);
+    RTC_GetDate(RTC_Format_BIN, &rtc_date);
+
+    struct tm t = {0};
+    t.tm_year = 100 + rtc_date.RTC_Year;
+    t.tm_mon  = rtc_date.RTC_Month - 1;
+    t.tm_mday = rtc_date.RTC_Date;
+    t.tm_hour = rtc_time.RTC_Hours;
+    t.tm_min  = rtc_time.RTC_Minutes;
+    t.tm_sec  = rtc_time.RTC_Seconds;
+
+    *utc = calendar_to_epoch(&t);
+    return 1;
+}
+
+void rtc_set_utc(calendar_epoch_t utc)
+{
+    if (!rtc_running) {
+        return;
+    }
+
+    struct tm t;
+    calendar_from_epoch(utc, &t);
+
+    RTC_TimeTypeDef rtc_time;
+    RTC_TimeStructInit(&rtc_time);
+    rtc_time.RTC_Hours   = t.tm_hour;
+    rtc_time.RTC_Minutes = t.tm_min;
+    rtc_time.RTC_Seconds = t.tm_sec;
+
+    RTC_DateTypeDef rtc_date;
+    RTC_DateStructInit(&rtc_date);
+    // RTC weekdays are 1 (Monday) to 7 (Sunday)
+    rtc_date.RTC_WeekDay = t.tm_wday == 0 ? RTC_Weekday_Sunday : t.tm_wday;
+    rtc_date.RTC_Month   = t.tm_mon + 1;
+    rtc_date.RTC_Date    = t.tm_mday;
+    rtc_date.RTC_Year    = t.tm_year - 100;
+
+    if (RTC_SetTime(RTC_Format_BIN, &rtc_time) == ERROR ||
+            RTC_SetDate(RTC_Format_BIN, &rtc_date) == ERROR) {
+        log_msg(CORE, LOG_ERROR, "RTC: set failed\r\n");
+        return;
+    }
+
+    RTC_WriteBackupRegister(RTC_BKP_DR0, RTC_MAGIC);
+}
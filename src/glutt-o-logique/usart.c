@@ -23,8 +23,10 @@
 */
 
 
+#include <stddef.h>
 #include <stm32f4xx.h>
 #include <stm32f4xx_usart.h>
+#include <stm32f4xx_iwdg.h>
 #include <stm32f4xx_conf.h>
 
 /* USART 3 on PD8 and PD9
@@ -38,11 +40,27 @@ const uint16_t GPIOA_PIN_USART2_RX = GPIO_Pin_3;
 const uint16_t GPIOA_PIN_USART2_TX = GPIO_Pin_2;
 
 #include "GPIO/usart.h"
+#include "Core/common.h"
+#include "Core/log_ring.h"
 
 #define USART2_RECEIVE_ENABLE 1
 
+// USART3_RX is on DMA1 stream 1, channel 4
+#define GPS_RX_DMA_STREAM DMA1_Stream1
+// USART2_TX is on DMA1 stream 6, channel 4
+#define DEBUG_TX_DMA_STREAM DMA1_Stream6
+
+#define DEBUG_BAUDRATE 9600
+/* Time to send the whole log ring at 10 bits per byte, with margin. Longer
+ * than the watchdog period, the flush reloads the watchdog while it waits.
+ */
+#define DEBUG_FLUSH_TIMEOUT_US \
+    ((uint32_t)(2ull * LOG_RING_LEN * 10 * 1000000 / DEBUG_BAUDRATE))
+
 void USART2_IRQHandler(void);
 void USART3_IRQHandler(void);
+void DMA1_Stream1_IRQHandler(void);
+void DMA1_Stream6_IRQHandler(void);
 
 
 void usart_init() {
@@ -63,7 +81,7 @@ void usart_init() {
 
     // Setup USART2 for 9600,8,N,1
     USART_InitTypeDef USART_InitStruct;
-    USART_InitStruct.USART_BaudRate = 9600;
+    USART_InitStruct.USART_BaudRate = DEBUG_BAUDRATE;
     USART_InitStruct.USART_WordLength = USART_WordLength_8b;
     USART_InitStruct.USART_StopBits = USART_StopBits_1;
     USART_InitStruct.USART_Parity = USART_Parity_No;
@@ -85,6 +103,40 @@ void usart_init() {
     NVIC_SetPriority(USART2_IRQn, 6);
 #endif
 
+    /* The messages of the log ring are sent by DMA, one at a time. The
+     * stream interrupt starts the next one, it is also triggered by software
+     * when a message is added.
+     */
+    RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA1, ENABLE);
+
+    DMA_DeInit(DEBUG_TX_DMA_STREAM);
+    DMA_InitTypeDef DMA_InitStruct;
+    DMA_StructInit(&DMA_InitStruct);
+    DMA_InitStruct.DMA_Channel = DMA_Channel_4;
+    DMA_InitStruct.DMA_PeripheralBaseAddr = (uint32_t)&USART2->DR;
+    DMA_InitStruct.DMA_DIR = DMA_DIR_MemoryToPeripheral;
+    DMA_InitStruct.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStruct.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStruct.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+    DMA_InitStruct.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    DMA_InitStruct.DMA_Mode = DMA_Mode_Normal;
+    DMA_InitStruct.DMA_Priority = DMA_Priority_Low;
+    DMA_InitStruct.DMA_FIFOMode = DMA_FIFOMode_Disable;
+    DMA_Init(DEBUG_TX_DMA_STREAM, &DMA_InitStruct);
+
+    DMA_ITConfig(DEBUG_TX_DMA_STREAM, DMA_IT_TC, ENABLE);
+
+    NVIC_InitTypeDef NVIC_TxInitStructure;
+    NVIC_TxInitStructure.NVIC_IRQChannel = DMA1_Stream6_IRQn;
+    NVIC_TxInitStructure.NVIC_IRQChannelPreemptionPriority = 6;
+    NVIC_TxInitStructure.NVIC_IRQChannelSubPriority = 2;
+    NVIC_TxInitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_TxInitStructure);
+
+    NVIC_SetPriority(DMA1_Stream6_IRQn, 6);
+
+    USART_DMACmd(USART2, USART_DMAReq_Tx, ENABLE);
+
     // finally this enables the complete USART2 peripheral
     USART_Cmd(USART2, ENABLE);
 }
@@ -127,11 +179,46 @@ void usart_gps_specific_init() {
     USART_InitStruct.USART_Mode = USART_Mode_Tx | USART_Mode_Rx;
     USART_Init(USART3, &USART_InitStruct);
 
-
-    // enable the USART3 receive interrupt
-    USART_ITConfig(USART3, USART_IT_RXNE, ENABLE);
+    /* The DMA writes the received bytes into the ring. The reader is woken
+     * up at the end of each burst of NMEA sentences by the idle line
+     * interrupt, and at the half and full ring interrupts of the DMA.
+     */
+    RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA1, ENABLE);
+
+    DMA_DeInit(GPS_RX_DMA_STREAM);
+    DMA_InitTypeDef DMA_InitStruct;
+    DMA_StructInit(&DMA_InitStruct);
+    DMA_InitStruct.DMA_Channel = DMA_Channel_4;
+    DMA_InitStruct.DMA_PeripheralBaseAddr = (uint32_t)&USART3->DR;
+    DMA_InitStruct.DMA_Memory0BaseAddr = (uint32_t)usart_gps_rx_ring;
+    DMA_InitStruct.DMA_DIR = DMA_DIR_PeripheralToMemory;
+    DMA_InitStruct.DMA_BufferSize = GPS_RX_RING_LEN;
+    DMA_InitStruct.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStruct.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStruct.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+    DMA_InitStruct.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    DMA_InitStruct.DMA_Mode = DMA_Mode_Circular;
+    DMA_InitStruct.DMA_Priority = DMA_Priority_Low;
+    DMA_InitStruct.DMA_FIFOMode = DMA_FIFOMode_Disable;
+    DMA_Init(GPS_RX_DMA_STREAM, &DMA_InitStruct);
+
+    DMA_ITConfig(GPS_RX_DMA_STREAM, DMA_IT_HT | DMA_IT_TC, ENABLE);
 
     NVIC_InitTypeDef NVIC_InitStructure;
+    NVIC_InitStructure.NVIC_IRQChannel = DMA1_Stream1_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 6;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+
+    NVIC_SetPriority(DMA1_Stream1_IRQn, 6);
+
+    DMA_Cmd(GPS_RX_DMA_STREAM, ENABLE);
+    USART_DMACmd(USART3, USART_DMAReq_Rx, ENABLE);
+
+    // enable the USART3 idle line interrupt
+    USART_ITConfig(USART3, USART_IT_IDLE, ENABLE);
+
     NVIC_InitStructure.NVIC_IRQChannel = USART3_IRQn;
     NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 6;
     NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
@@ -149,6 +236,11 @@ void usart_gps_remove_reset(void)
     GPIO_SetBits(GPIOD, GPIOD_PIN_GPS_RESET_N);
 }
 
+void usart_gps_hold_reset(void)
+{
+    GPIO_ResetBits(GPIOD, GPIOD_PIN_GPS_RESET_N);
+}
+
 // Make sure Tasks are suspended when this is called!
 void usart_puts(USART_TypeDef* USART, const char* str) {
     while(*str) {
@@ -159,13 +251,122 @@ void usart_puts(USART_TypeDef* USART, const char* str) {
     }
 }
 
+// Make sure Tasks are suspended when this is called!
+void usart_write(USART_TypeDef* USART, const uint8_t *data, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        USART_SendData(USART, data[i]);
+        while(USART_GetFlagStatus(USART, USART_FLAG_TXE) == RESET) ;
+    }
+}
+
+static inline uint32_t usart_gps_rx_pos(void)
+{
+    return GPS_RX_RING_LEN - DMA_GetCurrDataCounter(GPS_RX_DMA_STREAM);
+}
+
 void USART3_IRQHandler(void) {
-    if (USART_GetITStatus(USART3, USART_IT_RXNE)) {
-        char t = USART3->DR;
-        usart_gps_process_char(t);
+    if (USART_GetITStatus(USART3, USART_IT_IDLE)) {
+        // Cleared by reading SR then DR
+        (void)USART3->SR;
+        (void)USART3->DR;
+        usart_gps_rx_advance(usart_gps_rx_pos());
     }
 }
 
+void DMA1_Stream1_IRQHandler(void) {
+    if (DMA_GetITStatus(GPS_RX_DMA_STREAM, DMA_IT_HTIF1)) {
+        DMA_ClearITPendingBit(GPS_RX_DMA_STREAM, DMA_IT_HTIF1);
+    }
+    if (DMA_GetITStatus(GPS_RX_DMA_STREAM, DMA_IT_TCIF1)) {
+        DMA_ClearITPendingBit(GPS_RX_DMA_STREAM, DMA_IT_TCIF1);
+    }
+    usart_gps_rx_advance(usart_gps_rx_pos());
+}
+
+void usart_debug_kick(void)
+{
+    NVIC_SetPendingIRQ(DMA1_Stream6_IRQn);
+}
+
+// Only accessed from the DMA interrupt
+static int debug_tx_busy = 0;
+
+void DMA1_Stream6_IRQHandler(void) {
+    if (DMA_GetITStatus(DEBUG_TX_DMA_STREAM, DMA_IT_TCIF6)) {
+        DMA_ClearITPendingBit(DEBUG_TX_DMA_STREAM, DMA_IT_TCIF6);
+        log_ring_release();
+        debug_tx_busy = 0;
+    }
+
+    if (!debug_tx_busy) {
+        uint32_t len;
+        const char *msg = log_ring_peek(&len);
+        if (msg) {
+            DMA_ClearFlag(DEBUG_TX_DMA_STREAM, DMA_FLAG_TCIF6 | DMA_FLAG_HTIF6 |
+                    DMA_FLAG_TEIF6 | DMA_FLAG_DMEIF6 | DMA_FLAG_FEIF6);
+            DMA_MemoryTargetConfig(DEBUG_TX_DMA_STREAM, (uint32_t)msg, DMA_Memory_0);
+            DMA_SetCurrDataCounter(DEBUG_TX_DMA_STREAM, len);
+            // Set again when the last byte has left, see usart_debug_idle()
+            USART_ClearFlag(USART2, USART_FLAG_TC);
+            DMA_Cmd(DEBUG_TX_DMA_STREAM, ENABLE);
+            debug_tx_busy = 1;
+        }
+    }
+}
+
+int usart_debug_idle(void)
+{
+    return log_ring_empty() &&
+        DMA_GetCmdStatus(DEBUG_TX_DMA_STREAM) == DISABLE &&
+        USART_GetFlagStatus(USART2, USART_FLAG_TC) == SET;
+}
+
+void usart_debug_flush(void)
+{
+    // Only the low bits, TIM2 overflows are not counted with interrupts
+    // masked
+    const uint32_t start = timestamp_now_us();
+
+    // The DMA interrupt cannot run in a handler, with interrupts disabled,
+    // or in a critical section
+    const int masked = __get_IPSR() != 0 || __get_PRIMASK() != 0 ||
+        __get_BASEPRI() != 0;
+
+    if (!masked) {
+        // Bounded, the messages may not be committed
+        while (!log_ring_empty() &&
+                (uint32_t)timestamp_now_us() - start < DEBUG_FLUSH_TIMEOUT_US) {
+            IWDG_ReloadCounter();
+        }
+        return;
+    }
+
+    // Finish the transfer and send the rest by polling, without the DMA
+    // interrupt
+    NVIC_DisableIRQ(DMA1_Stream6_IRQn);
+
+    if (debug_tx_busy) {
+        while (DMA_GetFlagStatus(DEBUG_TX_DMA_STREAM, DMA_FLAG_TCIF6) == RESET &&
+                (uint32_t)timestamp_now_us() - start < DEBUG_FLUSH_TIMEOUT_US) {
+            IWDG_ReloadCounter();
+        }
+        DMA_ClearFlag(DEBUG_TX_DMA_STREAM, DMA_FLAG_TCIF6);
+        log_ring_release();
+        debug_tx_busy = 0;
+    }
+
+    uint32_t len;
+    const char *msg;
+    while ((msg = log_ring_peek(&len)) != NULL) {
+        // Up to LOG_RING_MAX_MSG bytes, about 1s, within the watchdog period
+        IWDG_ReloadCounter();
+        usart_write(USART2, (const uint8_t*)msg, len);
+        log_ring_release();
+    }
+
+    NVIC_EnableIRQ(DMA1_Stream6_IRQn);
+}
+
 void USART2_IRQHandler(void) {
     if (USART_GetITStatus(USART2, USART_IT_RXNE)) {
         char t = USART2->DR;
@@ -0,0 +1,279 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Compare the integer calendar against the previous mktime() based
+ * local time calculation, both for correctness and speed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "Core/calendar.h"
+#include "check.h"
+
+/* Previous implementation, as it was in Core/common.c. newlib's mktime()
+ * runs in UTC, timegm() does the same on the host regardless of TZ.
+ */
+static int ref_find_last_sunday(const struct tm* time) {
+    struct tm t = *time;
+
+    // the last sunday can never be before the 20th
+    t.tm_mday = 20;
+
+    int last_sunday = 1;
+
+    while (t.tm_mon == time->tm_mon) {
+        t.tm_mday++;
+        if (timegm(&t) == (time_t)-1) {
+            return -1;
+        }
+
+        const int sunday = 0;
+        if (t.tm_wday == sunday) {
+            last_sunday = t.tm_mday;
+        }
+    }
+
+    return last_sunday;
+}
+
+static int ref_is_dst(const struct tm *time) {
+    const int march = 2;
+    const int october = 9;
+    if (time->tm_mon < march) {
+        return 0;
+    }
+    else if (time->tm_mon == march) {
+        int last_sunday = ref_find_last_sunday(time);
+        if (last_sunday == -1) return -1;
+
+        if (time->tm_mday < last_sunday) {
+            return 0;
+        }
+        else if (time->tm_mday == last_sunday) {
+            return (time->tm_hour < 1) ?  0 : 1;
+        }
+        else {
+            return 1;
+        }
+    }
+    else if (time->tm_mon > march && time->tm_mon < october) {
+        return 1;
+    }
+    else if (time->tm_mon == october) {
+        int last_sunday = ref_find_last_sunday(time);
+        if (last_sunday == -1) return -1;
+
+        if (time->tm_mday < last_sunday) {
+            return 1;
+        }
+        else if (time->tm_mday == last_sunday) {
+            return (time->tm_hour < 1) ? 1 : 0;
+        }
+        else {
+            return 0;
+        }
+    }
+    else {
+        return 0;
+    }
+}
+
+static int ref_local_time(struct tm *time) {
+    time->tm_hour += 1;
+
+    const int dst = ref_is_dst(time);
+    if (dst == 1) {
+        time->tm_hour++;
+    }
+
+    const int ok = timegm(time) != (time_t)-1;
+    time->tm_isdst = (dst == 1);
+    return ok;
+}
+
+// The old derived time advanced one second per iteration
+static void ref_derived_time(struct tm *last, uint64_t *last_ts, uint64_t now)
+{
+    while (now - *last_ts > 1000) {
+        last->tm_sec += 1;
+        *last_ts += 1000;
+    }
+    timegm(last);
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void check_conversions(void)
+{
+    // 2000-01-01 to 2099-12-31, every 37 minutes to hit all hours and minutes
+    const calendar_epoch_t begin = 946684800ul;
+    const calendar_epoch_t end = 4102444800ul;
+
+    long checked = 0;
+    long old_wrong = 0;
+    for (calendar_epoch_t utc = begin; utc < end; utc += 37 * 60) {
+        const time_t t = utc;
+        struct tm ref_utc;
+        gmtime_r(&t, &ref_utc);
+
+        struct tm new_utc;
+        calendar_from_epoch(utc, &new_utc);
+        if (calendar_to_epoch(&ref_utc) != utc ||
+                new_utc.tm_year != ref_utc.tm_year ||
+                new_utc.tm_mon != ref_utc.tm_mon ||
+                new_utc.tm_mday != ref_utc.tm_mday ||
+                new_utc.tm_hour != ref_utc.tm_hour ||
+                new_utc.tm_min != ref_utc.tm_min ||
+                new_utc.tm_sec != ref_utc.tm_sec ||
+                new_utc.tm_wday != ref_utc.tm_wday ||
+                new_utc.tm_yday != ref_utc.tm_yday) {
+            printf("FAIL utc conversion at %u\n", (unsigned)utc);
+            failures++;
+        }
+
+        // Swiss local time from the system time zone database is the reference
+        struct tm tz_local;
+        localtime_r(&t, &tz_local);
+
+        struct tm new_local;
+        calendar_utc_to_local(utc, &new_local);
+
+        if (new_local.tm_year != tz_local.tm_year ||
+                new_local.tm_yday != tz_local.tm_yday ||
+                new_local.tm_hour != tz_local.tm_hour ||
+                new_local.tm_min != tz_local.tm_min ||
+                new_local.tm_isdst != tz_local.tm_isdst) {
+            printf("FAIL local time at %04d-%02d-%02d %02d:%02dZ tz %02d:%02d new %02d:%02d\n",
+                    ref_utc.tm_year + 1900, ref_utc.tm_mon + 1, ref_utc.tm_mday,
+                    ref_utc.tm_hour, ref_utc.tm_min,
+                    tz_local.tm_hour, tz_local.tm_min,
+                    new_local.tm_hour, new_local.tm_min);
+            failures++;
+        }
+
+        struct tm old_local = ref_utc;
+        ref_local_time(&old_local);
+        if (old_local.tm_hour != tz_local.tm_hour) {
+            old_wrong++;
+        }
+
+        checked++;
+    }
+
+    // Known transitions
+    struct { const char *desc; calendar_epoch_t utc; int dst; } cases[] = {
+        {"2020-03-29 00:59:59Z", 1585443599ul, 0},
+        {"2020-03-29 01:00:00Z", 1585443600ul, 1},
+        {"2020-10-25 00:59:59Z", 1603587599ul, 1},
+        {"2020-10-25 01:00:00Z", 1603587600ul, 0},
+        {"2021-03-28 01:00:00Z", 1616893200ul, 1},
+        {"2024-02-29 12:00:00Z", 1709208000ul, 0},
+    };
+    for (size_t i = 0; i < sizeof(cases)/sizeof(cases[0]); i++) {
+        if (calendar_is_dst(cases[i].utc) != cases[i].dst) {
+            printf("FAIL DST at %s\n", cases[i].desc);
+            failures++;
+        }
+    }
+
+    printf("Checked %ld instants, %d failures\n", checked, failures);
+    // The old find_last_sunday() returned 1 when the first day of the
+    // following month was a Sunday, and switched one hour too early.
+    printf("Previous implementation wrong for %ld instants\n", old_wrong);
+}
+
+static void benchmark(void)
+{
+    const int iterations = 200000;
+    const calendar_epoch_t base = 1590000000ul; // May 2020
+    volatile int sink = 0;
+
+    double t0 = now_s();
+    for (int i = 0; i < iterations; i++) {
+        const time_t t = base + i * 13;
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        // October exercises find_last_sunday
+        tm.tm_mon = 9;
+        ref_local_time(&tm);
+        sink += tm.tm_hour;
+    }
+    double t1 = now_s();
+    for (int i = 0; i < iterations; i++) {
+        const time_t t = base + i * 13;
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        tm.tm_mon = 9;
+        struct tm local;
+        calendar_utc_to_local(calendar_to_epoch(&tm), &local);
+        sink += local.tm_hour;
+    }
+    double t2 = now_s();
+
+    printf("local_time   mktime: %8.1f ns/call  calendar: %8.1f ns/call\n",
+            (t1 - t0) * 1e9 / iterations, (t2 - t1) * 1e9 / iterations);
+
+    // Derived time after a one day GPS outage
+    const int derived_iterations = 20;
+    const uint64_t outage_ms = 24ull * 3600 * 1000;
+
+    t0 = now_s();
+    for (int i = 0; i < derived_iterations; i++) {
+        const time_t t = base;
+        struct tm last;
+        gmtime_r(&t, &last);
+        uint64_t last_ts = 0;
+        ref_derived_time(&last, &last_ts, outage_ms);
+        sink += last.tm_hour;
+    }
+    t1 = now_s();
+    for (int i = 0; i < derived_iterations; i++) {
+        struct tm local;
+        calendar_utc_to_local(base + (calendar_epoch_t)(outage_ms / 1000), &local);
+        sink += local.tm_hour;
+    }
+    t2 = now_s();
+
+    printf("derived 24h  mktime: %8.1f us/call  calendar: %8.3f us/call\n",
+            (t1 - t0) * 1e6 / derived_iterations, (t2 - t1) * 1e6 / derived_iterations);
+    (void)sink;
+}
+
+int main(void)
+{
+    setenv("TZ", "Europe/Zurich", 1);
+    tzset();
+
+    check_conversions();
+    benchmark();
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,463 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Compare the streaming NMEA parser against minmea, on a corpus of NMEA
+ * output and on random mutations of it, and measure their throughput.
+ *
+ * Without argument, the corpus imitates one hour of the u-blox receiver
+ * output, starting without fix. A recorded log can be given instead:
+ *   bench_nmea gps.log
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "GPS/nmea.h"
+#include "GPS/minmea.h"
+#include "check.h"
+
+static char *corpus;
+static size_t corpus_len;
+static size_t corpus_size;
+
+static void corpus_add(const char *body)
+{
+    uint8_t checksum = 0;
+    for (const char *c = body; *c; c++) {
+        checksum ^= *c;
+    }
+
+    char line[128];
+    const int len = snprintf(line, sizeof(line), "$%s*%02X\r\n", body, checksum);
+
+    if (corpus_len + len + 1 > corpus_size) {
+        corpus_size = corpus_size ? corpus_size * 2 : 65536;
+        corpus = realloc(corpus, corpus_size);
+    }
+    memcpy(corpus + corpus_len, line, len + 1);
+    corpus_len += len;
+}
+
+static void generate_corpus(void)
+{
+    corpus_add("GPTXT,01,01,02,u-blox ag - www.u-blox.com");
+    corpus_add("GPTXT,01,01,02,HW  UBX-G60xx  00040007 FF7FFFFFp");
+    corpus_add("GPTXT,01,01,02,ROM CORE 7.03 (45969) Mar 17 2011 16:18:34");
+    corpus_add("GPTXT,01,01,02,ANTSUPERV=AC SD PDoS SR");
+    corpus_add("GPTXT,01,01,02,ANTSTATUS=OK");
+
+    const time_t start = 1590000000; // May 2020
+    char body[160];
+
+    for (int i = 0; i < 3600; i++) {
+        const time_t t = start + i;
+        struct tm tm;
+        gmtime_r(&t, &tm);
+
+        char hms[32], dmy[32];
+        snprintf(hms, sizeof(hms), "%02d%02d%02d.00", tm.tm_hour, tm.tm_min, tm.tm_sec);
+        snprintf(dmy, sizeof(dmy), "%02d%02d%02d", tm.tm_mday, tm.tm_mon + 1, tm.tm_year % 100);
+
+        if (i < 40) {
+            // Cold start: no time at first, then time without fix
+            if (i < 20) {
+                corpus_add("GPRMC,,V,,,,,,,,,,N");
+                corpus_add("GPVTG,,,,,,,,,N");
+                corpus_add("GPGGA,,,,,,0,00,99.99,,,,,,");
+                corpus_add("GPGSA,A,1,,,,,,,,,,,,,99.99,99.99,99.99");
+                corpus_add("GPGSV,1,1,00*79");
+                corpus_add("GPGLL,,,,,,V,N");
+                continue;
+            }
+            snprintf(body, sizeof(body), "GPRMC,%s,V,,,,,,,%s,,,N", hms, dmy);
+            corpus_add(body);
+            snprintf(body, sizeof(body), "GPGGA,%s,,,,,0,03,4.12,,,,,,", hms);
+            corpus_add(body);
+            continue;
+        }
+
+        snprintf(body, sizeof(body), "GPRMC,%s,A,4629.81421,N,00638.25913,E,0.031,,%s,,,A", hms, dmy);
+        corpus_add(body);
+        corpus_add("GPVTG,,T,,M,0.031,N,0.058,K,A");
+        snprintf(body, sizeof(body), "GPGGA,%s,4629.81421,N,00638.25913,E,1,%02d,1.02,511.3,M,48.0,M,,", hms, 5 + (i / 300) % 7);
+        corpus_add(body);
+        corpus_add("GPGSA,A,3,10,16,18,20,21,26,27,29,,,,,1.92,1.02,1.62");
+        corpus_add("GPGSV,3,1,11,05,07,037,,10,47,302,38,13,03,185,,15,14,213,24");
+        corpus_add("GPGSV,3,2,11,16,45,061,41,18,41,257,36,20,35,199,33,21,73,144,42");
+        corpus_add("GPGSV,3,3,11,26,34,098,30,27,19,047,28,29,19,269,29");
+        snprintf(body, sizeof(body), "GPGLL,4629.81421,N,00638.25913,E,%s,A,A", hms);
+        corpus_add(body);
+
+        if (i % 900 == 0) {
+            corpus_add("GPTXT,01,01,01,ANTSTATUS=SHORT");
+        }
+    }
+}
+
+static int load_corpus(const char *filename)
+{
+    FILE *fd = fopen(filename, "rb");
+    if (fd == NULL) {
+        perror(filename);
+        return 0;
+    }
+
+    corpus_size = 1 << 20;
+    corpus = malloc(corpus_size);
+    size_t r;
+    while ((r = fread(corpus + corpus_len, 1, corpus_size - corpus_len - 1, fd)) > 0) {
+        corpus_len += r;
+        if (corpus_len + 1 == corpus_size) {
+            corpus_size *= 2;
+            corpus = realloc(corpus, corpus_size);
+        }
+    }
+    corpus[corpus_len] = '\0';
+    fclose(fd);
+    return 1;
+}
+
+// The results of both parsers for one line
+struct result {
+    enum nmea_sentence type;
+    int hours, minutes, seconds;
+    int day, month, year;
+    int valid;
+    int satellites;
+};
+
+// As the previous gps_task did
+static struct result parse_minmea(const char *line)
+{
+    struct result r = { .type = NMEA_NONE };
+
+    switch (minmea_sentence_id(line, 1)) {
+        case MINMEA_SENTENCE_RMC:
+            {
+                struct minmea_sentence_rmc frame;
+                if (minmea_parse_rmc(&frame, line)) {
+                    r.type = NMEA_RMC;
+                    r.hours = frame.time.hours;
+                    r.minutes = frame.time.minutes;
+                    r.seconds = frame.time.seconds;
+                    r.day = frame.date.day;
+                    r.month = frame.date.month;
+                    r.year = frame.date.year;
+                    r.valid = frame.valid;
+                }
+            } break;
+        case MINMEA_SENTENCE_GGA:
+            {
+                struct minmea_sentence_gga frame;
+                if (minmea_parse_gga(&frame, line)) {
+                    r.type = NMEA_GGA;
+                    r.satellites = frame.satellites_tracked;
+                }
+            } break;
+        default:
+            break;
+    }
+
+    return r;
+}
+
+static struct result result_from_parser(const struct nmea_parser *p, enum nmea_sentence type)
+{
+    struct result r = { .type = type };
+    if (type == NMEA_RMC) {
+        r.hours = p->hours;
+        r.minutes = p->minutes;
+        r.seconds = p->seconds;
+        r.day = p->day;
+        r.month = p->month;
+        r.year = p->year;
+        r.valid = p->valid;
+    }
+    else if (type == NMEA_GGA) {
+        r.satellites = p->satellites;
+    }
+    return r;
+}
+
+static int results_equal(const struct result *a, const struct result *b)
+{
+    return a->type == b->type &&
+        a->hours == b->hours && a->minutes == b->minutes && a->seconds == b->seconds &&
+        a->day == b->day && a->month == b->month && a->year == b->year &&
+        a->valid == b->valid && a->satellites == b->satellites;
+}
+
+// Independent check of the sentence between the last $ and end
+static int checksum_correct(const char *line, size_t end)
+{
+    size_t start = end;
+    while (start > 0 && line[start] != '$') {
+        start--;
+    }
+    if (line[start] != '$' || end < start + 3 || line[end - 2] != '*') {
+        return 0;
+    }
+
+    uint8_t checksum = 0;
+    for (size_t i = start + 1; i < end - 2; i++) {
+        if (line[i] < ' ' || line[i] > '~') {
+            return 0;
+        }
+        checksum ^= line[i];
+    }
+
+    char hex[3] = { line[end - 1], line[end], '\0' };
+    char *endptr;
+    const long expected = strtol(hex, &endptr, 16);
+    return *endptr == '\0' && expected == checksum;
+}
+
+struct compare_stats {
+    long lines;
+    long accepted_both;
+    long stricter;
+    long more_lenient;
+};
+
+/* Give a line to both parsers. The streaming parser must find every
+ * RMC and GGA minmea finds, with the same values. It may accept sentences
+ * minmea refuses because of fields it does not convert, but only with a
+ * correct checksum.
+ */
+static void compare_line(struct nmea_parser *parser, const char *line, size_t len,
+        struct compare_stats *stats)
+{
+    const struct result expected = parse_minmea(line);
+
+    // Lines are independent
+    nmea_init(parser);
+
+    struct result found = { .type = NMEA_NONE };
+    for (size_t i = 0; i < len; i++) {
+        const enum nmea_sentence type = nmea_push(parser, line[i]);
+        if (type == NMEA_RMC || type == NMEA_GGA) {
+            CHECK(checksum_correct(line, i), "accepted bad checksum: %s", line);
+            found = result_from_parser(parser, type);
+        }
+    }
+
+    stats->lines++;
+    if (expected.type != NMEA_NONE && found.type != NMEA_NONE) {
+        stats->accepted_both++;
+        CHECK(results_equal(&expected, &found), "different values: %s", line);
+    }
+    else if (expected.type != NMEA_NONE) {
+        stats->stricter++;
+    }
+    else if (found.type != NMEA_NONE) {
+        stats->more_lenient++;
+    }
+}
+
+static void check_corpus(void)
+{
+    struct nmea_parser parser;
+    nmea_init(&parser);
+    struct compare_stats stats = {0};
+
+    char line[256];
+    const char *p = corpus;
+    while (*p) {
+        const char *eol = strchr(p, '\n');
+        const size_t len = eol ? (size_t)(eol - p + 1) : strlen(p);
+        if (len < sizeof(line)) {
+            memcpy(line, p, len);
+            line[len] = '\0';
+            compare_line(&parser, line, len, &stats);
+        }
+        p += len;
+    }
+
+    printf("corpus: %ld lines, %ld RMC/GGA found by both, %ld only by minmea, %ld only streaming\n",
+            stats.lines, stats.accepted_both, stats.stricter, stats.more_lenient);
+    CHECK(stats.stricter == 0, "sentences of the corpus missed");
+}
+
+static void check_txt(void)
+{
+    struct nmea_parser parser;
+    nmea_init(&parser);
+
+    const char *txt = "$GPTXT,01,01,01,ANTSTATUS=SHORT, check antenna*5B\r\n";
+    enum nmea_sentence type = NMEA_NONE;
+    for (const char *c = txt; *c; c++) {
+        const enum nmea_sentence t = nmea_push(&parser, *c);
+        if (t != NMEA_NONE) {
+            type = t;
+        }
+    }
+
+    CHECK(type == NMEA_TXT, "TXT not recognised");
+    CHECK(parser.txt_type == NMEA_TXT_WARNING, "TXT type %d", parser.txt_type);
+    CHECK(strcmp(parser.txt, "ANTSTATUS=SHORT, check antenna") == 0, "TXT text '%s'", parser.txt);
+}
+
+static void fuzz(void)
+{
+    srand(1750);
+
+    struct nmea_parser parser;
+    nmea_init(&parser);
+    struct compare_stats stats = {0};
+
+    // Printable characters that matter to both parsers
+    const char special[] = "$*,.0123456789ABCDEFAV\r\n";
+
+    char line[256];
+    for (int iteration = 0; iteration < 1000000; iteration++) {
+        // A random line of the corpus
+        const char *p = corpus + rand() % corpus_len;
+        while (p > corpus && p[-1] != '\n') {
+            p--;
+        }
+        const char *eol = strchr(p, '\n');
+        size_t len = eol ? (size_t)(eol - p + 1) : strlen(p);
+        if (len >= sizeof(line) - 8) {
+            continue;
+        }
+        memcpy(line, p, len);
+
+        const int mutations = 1 + rand() % 3;
+        for (int m = 0; m < mutations && len > 1; m++) {
+            const size_t pos = rand() % len;
+            const int r = rand() % 100;
+            const char c = r < 60 ? special[rand() % (sizeof(special) - 1)] : (char)(rand() % 256);
+
+            switch (rand() % 4) {
+                case 0: // Replace
+                    line[pos] = c;
+                    break;
+                case 1: // Insert
+                    memmove(line + pos + 1, line + pos, len - pos);
+                    line[pos] = c;
+                    len++;
+                    break;
+                case 2: // Delete
+                    memmove(line + pos, line + pos + 1, len - pos - 1);
+                    len--;
+                    break;
+                case 3: // Truncate
+                    len = pos + 1;
+                    break;
+            }
+        }
+        line[len] = '\0';
+
+        // strlen() for minmea
+        if (memchr(line, '\0', len)) {
+            len = strlen(line);
+        }
+
+        compare_line(&parser, line, len, &stats);
+    }
+
+    // minmea also accepts a sentence identifier followed by garbage,
+    // like $GPRMC1, which the streaming parser refuses
+    printf("fuzz: %ld lines, %ld RMC/GGA found by both, %ld only by minmea, %ld only streaming\n",
+            stats.lines, stats.accepted_both, stats.stricter, stats.more_lenient);
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void benchmark(void)
+{
+    const int rounds = 20;
+    volatile int sink = 0;
+    long sentences = 0;
+
+    // The previous gps_task copied each sentence from the queue
+    double t0 = now_s();
+    for (int round = 0; round < rounds; round++) {
+        char line[256];
+        size_t ix = 0;
+        for (size_t i = 0; i < corpus_len; i++) {
+            const char c = corpus[i];
+            if (ix == 0 && c != '$') {
+                continue;
+            }
+            if (ix < sizeof(line) - 1) {
+                line[ix++] = c;
+            }
+            if (c == '\n') {
+                line[ix] = '\0';
+                const struct result r = parse_minmea(line);
+                sink += r.hours + r.satellites;
+                sentences++;
+                ix = 0;
+            }
+        }
+    }
+    double t1 = now_s();
+    for (int round = 0; round < rounds; round++) {
+        struct nmea_parser parser;
+        nmea_init(&parser);
+        const char *rx = corpus;
+        uint32_t len = corpus_len;
+        while (len > 0) {
+            uint32_t consumed = 0;
+            const enum nmea_sentence type = nmea_parse(&parser, rx, len, &consumed);
+            if (type != NMEA_NONE) {
+                sink += parser.hours + parser.satellites;
+            }
+            rx += consumed;
+            len -= consumed;
+        }
+    }
+    double t2 = now_s();
+
+    const double mb = (double)corpus_len * rounds / 1e6;
+    printf("minmea:    %7.1f MB/s %7.1f ns/sentence\n", mb / (t1 - t0), (t1 - t0) * 1e9 / sentences);
+    printf("streaming: %7.1f MB/s %7.1f ns/sentence\n", mb / (t2 - t1), (t2 - t1) * 1e9 / sentences);
+    (void)sink;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) {
+        if (!load_corpus(argv[1])) {
+            return 1;
+        }
+    }
+    else {
+        generate_corpus();
+    }
+
+    check_corpus();
+    check_txt();
+    fuzz();
+    benchmark();
+
+    return check_exit();
+}
@@ -0,0 +1,17 @@
+/* Failure counting shared by the host tests */
+#pragma once
+
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { printf("FAIL: " __VA_ARGS__); printf("\n"); failures++; } \
+} while (0)
+
+// Print the number of failures, and return the exit status of the test
+static inline int check_exit(void)
+{
+    printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,12 @@
+/* Minimal stand-in for FreeRTOS.h, for host programs that run the common
+ * modules in a single thread.
+ */
+#pragma once
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
@@ -0,0 +1,5 @@
+/* Minimal stand-in for task.h, there is no concurrency on the host */
+#pragma once
+
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
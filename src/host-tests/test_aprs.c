@@ -0,0 +1,354 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Check the APRS packets: the X.25 CRC, the telemetry and definition
+ * messages, the AX.25 addresses, and a loopback of the AFSK1200 audio
+ * through a software demodulator, with noise.
+ *
+ * With a file name as argument, the packets are written there as 16 kHz WAV
+ * audio, which multimon-ng -a AFSK1200 or direwolf decode.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "Core/aprs.h"
+#include "Core/crc.h"
+#include "Audio/ax25.h"
+#include "Audio/afsk.h"
+#include "Core/common.h"
+#include "check.h"
+
+#define SAMPLERATE 16000
+#define NUM_PACKETS (1 + APRS_NUM_DEFINITIONS)
+// Silence between the packets, in samples
+#define GAP 4000
+#define MAX_SAMPLES (NUM_PACKETS * (2048 * 14 + GAP))
+
+static const struct aprs_telemetry telemetry = {
+    .voltage = 12.34f,
+    .capacity_mah = 1234000,
+    .temp_valid = 1,
+    .temp = 21.3f,
+    .charge_ma = 3000,
+    .discharge_ma = -1,
+    .qrp = 1,
+    .wind_disconnected = 0,
+    .wind_folded = 1,
+    .swr_high = 0,
+};
+
+static char infos[NUM_PACKETS][APRS_INFO_LEN];
+static uint8_t packet_bits[NUM_PACKETS][256];
+static size_t packet_num_bits[NUM_PACKETS];
+
+static float audio[MAX_SAMPLES];
+static size_t num_samples = 0;
+
+static void check_info(void)
+{
+    CHECK(crc16_x25("123456789", 9) == 0x906E, "CRC check value 0x%04X",
+            crc16_x25("123456789", 9));
+
+    aprs_telemetry_info(infos[0], APRS_INFO_LEN, 1234, &telemetry);
+    CHECK(strcmp(infos[0], "T#234,123,123,143,015,000,10100000") == 0,
+            "telemetry %s", infos[0]);
+
+    for (int i = 0; i < APRS_NUM_DEFINITIONS; i++) {
+        const size_t len = aprs_definition_info(infos[1 + i], APRS_INFO_LEN, i);
+        CHECK(len > 11 && strncmp(infos[1 + i], ":HB9G     :", 11) == 0,
+                "definition %s", infos[1 + i]);
+    }
+    CHECK(strncmp(infos[1], ":HB9G     :PARM.", 16) == 0, "PARM %s", infos[1]);
+    CHECK(strncmp(infos[3], ":HB9G     :EQNS.", 16) == 0, "EQNS %s", infos[3]);
+
+    char small[8];
+    CHECK(aprs_telemetry_info(small, sizeof(small), 0, &telemetry) == 0, "truncated telemetry");
+    CHECK(aprs_definition_info(small, sizeof(small), APRS_NUM_DEFINITIONS) == 0, "definition index");
+}
+
+static void check_addresses(void)
+{
+    uint8_t frame[AX25_MAX_FRAME_LEN];
+    const size_t len = ax25_ui_frame(frame, sizeof(frame),
+            APRS_DESTINATION, APRS_CALL, APRS_PATH, "!");
+
+    CHECK(len == 3 * AX25_ADDRESS_LEN + 2 + 1 + 2, "frame length %d", (int)len);
+    CHECK(memcmp(frame, "\x82\xA0\xB4\x8E\x98\xA8\xE0", 7) == 0, "destination");
+    CHECK(memcmp(frame + 7, "\x90\x84\x72\x8E\x40\x40\x60", 7) == 0, "source");
+    CHECK(memcmp(frame + 14, "\xAE\x92\x88\x8A\x64\x40\x63", 7) == 0, "path");
+    CHECK(frame[21] == AX25_CONTROL_UI && frame[22] == AX25_PID_NO_LAYER3, "control, PID");
+
+    const uint16_t fcs = crc16_x25(frame, len - 2);
+    CHECK(frame[len - 2] == (fcs & 0xFF) && frame[len - 1] == (fcs >> 8), "FCS");
+
+    CHECK(ax25_ui_frame(frame, sizeof(frame), "TOOLONGCALL", APRS_CALL, NULL, "!") == 0,
+            "invalid destination");
+    CHECK(ax25_ui_frame(frame, sizeof(frame), APRS_DESTINATION, "HB9G-16", NULL, "!") == 0,
+            "invalid SSID");
+    CHECK(ax25_ui_frame(frame, 20, APRS_DESTINATION, APRS_CALL, APRS_PATH, "!") == 0,
+            "frame overflow");
+}
+
+static void modulate(void)
+{
+    struct afsk_modulator m;
+    afsk_init(&m, SAMPLERATE);
+
+    for (int p = 0; p < NUM_PACKETS; p++) {
+        packet_num_bits[p] = aprs_packet_bits(infos[p], packet_bits[p], 8 * sizeof(packet_bits[p]));
+        CHECK(packet_num_bits[p] > 0, "packet %d does not fit", p);
+
+        const float airtime_s = packet_num_bits[p] / (float)AFSK_BAUD;
+        printf("packet %d: %d bits, %.2f s: %s\n", p, (int)packet_num_bits[p], airtime_s, infos[p]);
+        CHECK(airtime_s < 1.0f, "packet %d takes %.2f s", p, airtime_s);
+
+        for (size_t i = 0; i < packet_num_bits[p]; i++) {
+            const uint8_t tone = (packet_bits[p][i / 8] >> (7 - i % 8)) & 1;
+            const int samples = afsk_bit_samples(&m);
+            for (int t = 0; t < samples; t++) {
+                audio[num_samples++] = afsk_sample(&m, tone);
+            }
+        }
+        for (int t = 0; t < GAP; t++) {
+            audio[num_samples++] = 0;
+        }
+    }
+}
+
+static void add_noise(float amplitude)
+{
+    for (size_t i = 0; i < num_samples; i++) {
+        // Sum of uniforms, roughly gaussian
+        float n = 0;
+        for (int k = 0; k < 4; k++) {
+            n += 2.0f * rand() / RAND_MAX - 1.0f;
+        }
+        audio[i] += amplitude * n;
+    }
+}
+
+/* Software demodulator: mark and space correlators over one bit, a digital
+ * PLL on the transitions, NRZI and HDLC decoding. Calls found() with every
+ * frame whose FCS is correct.
+ */
+struct hdlc_decoder {
+    uint8_t frame[AX25_MAX_FRAME_LEN];
+    size_t len;
+    uint8_t byte;
+    int num_bits;
+    int ones;
+    int in_frame;
+};
+
+static uint8_t frames[NUM_PACKETS + 1][AX25_MAX_FRAME_LEN];
+static size_t frame_lens[NUM_PACKETS + 1];
+static int num_frames = 0;
+
+static void found(const uint8_t *frame, size_t len)
+{
+    if (num_frames <= NUM_PACKETS) {
+        memcpy(frames[num_frames], frame, len);
+        frame_lens[num_frames] = len;
+    }
+    num_frames++;
+}
+
+static void hdlc_push(struct hdlc_decoder *d, int bit)
+{
+    if (bit) {
+        d->ones++;
+        if (d->ones > 6) {
+            // Abort
+            d->in_frame = 0;
+            return;
+        }
+    }
+    else {
+        const int ones = d->ones;
+        d->ones = 0;
+
+        if (ones == 6) {
+            // Flag: end of a frame, and start of the next one
+            if (d->in_frame && d->num_bits == 7 && d->len > AX25_ADDRESS_LEN * 2 + 2) {
+                const uint16_t fcs = crc16_x25(d->frame, d->len - 2);
+                if (d->frame[d->len - 2] == (fcs & 0xFF) && d->frame[d->len - 1] == (fcs >> 8)) {
+                    found(d->frame, d->len);
+                }
+            }
+            d->in_frame = 1;
+            d->len = 0;
+            d->num_bits = 0;
+            return;
+        }
+        if (ones == 5) {
+            // Stuffed bit
+            return;
+        }
+    }
+
+    if (!d->in_frame) {
+        return;
+    }
+
+    // Least significant bit first
+    d->byte = (d->byte >> 1) | (bit ? 0x80 : 0);
+    if (++d->num_bits == 8) {
+        if (d->len == sizeof(d->frame)) {
+            d->in_frame = 0;
+            return;
+        }
+        d->frame[d->len++] = d->byte;
+        d->num_bits = 0;
+    }
+}
+
+static void demodulate(const float *samples, size_t len)
+{
+    const int window = SAMPLERATE / AFSK_BAUD;
+    const float mark = 2.0f * FLOAT_PI * AFSK_MARK_HZ / SAMPLERATE;
+    const float space = 2.0f * FLOAT_PI * AFSK_SPACE_HZ / SAMPLERATE;
+
+    struct hdlc_decoder d;
+    memset(&d, 0, sizeof(d));
+
+    float pll = 0;
+    int last_tone = 0;
+    int last_decision = 0;
+
+    for (size_t n = window; n < len; n++) {
+        float mi = 0, mq = 0, si = 0, sq = 0;
+        for (int k = 0; k < window; k++) {
+            const float x = samples[n - k];
+            mi += x * cosf(mark * k);
+            mq += x * sinf(mark * k);
+            si += x * cosf(space * k);
+            sq += x * sinf(space * k);
+        }
+        const int decision = (mi * mi + mq * mq) > (si * si + sq * sq);
+
+        // Transitions are expected at the phase 0 of the bit clock
+        if (decision != last_decision) {
+            pll -= 0.3f * (pll < 0.5f ? pll : pll - 1.0f);
+        }
+        last_decision = decision;
+
+        const float previous = pll;
+        pll += (float)AFSK_BAUD / SAMPLERATE;
+        if (previous < 0.5f && pll >= 0.5f) {
+            // Middle of the bit. NRZI: no change of tone is a 1
+            hdlc_push(&d, decision == last_tone);
+            last_tone = decision;
+        }
+        if (pll >= 1.0f) {
+            pll -= 1.0f;
+        }
+    }
+}
+
+static int check_decoded(const char *label)
+{
+    int wrong = 0;
+    for (int p = 0; p < NUM_PACKETS; p++) {
+        uint8_t frame[AX25_MAX_FRAME_LEN];
+        const size_t len = ax25_ui_frame(frame, sizeof(frame),
+                APRS_DESTINATION, APRS_CALL, APRS_PATH, infos[p]);
+        if (p >= num_frames || frame_lens[p] != len || memcmp(frames[p], frame, len) != 0) {
+            wrong++;
+            continue;
+        }
+
+        // The info field follows the addresses, control and PID
+        const size_t info_len = len - 3 * AX25_ADDRESS_LEN - 2 - 2;
+        if (info_len != strlen(infos[p]) ||
+                memcmp(frames[p] + 3 * AX25_ADDRESS_LEN + 2, infos[p], info_len) != 0) {
+            wrong++;
+        }
+    }
+    printf("%s: %d frames decoded, %d wrong\n", label, num_frames, wrong);
+    return wrong == 0 && num_frames == NUM_PACKETS;
+}
+
+static void put_le(FILE *f, uint32_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        fputc((value >> (8 * i)) & 0xFF, f);
+    }
+}
+
+static void write_wav(const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        CHECK(0, "cannot open %s", path);
+        return;
+    }
+
+    const uint32_t data_len = num_samples * 2;
+    fputs("RIFF", f);
+    put_le(f, 36 + data_len, 4);
+    fputs("WAVEfmt ", f);
+    put_le(f, 16, 4);
+    put_le(f, 1, 2);
+    put_le(f, 1, 2);
+    put_le(f, SAMPLERATE, 4);
+    put_le(f, 2 * SAMPLERATE, 4);
+    put_le(f, 2, 2);
+    put_le(f, 16, 2);
+    fputs("data", f);
+    put_le(f, data_len, 4);
+
+    for (size_t i = 0; i < num_samples; i++) {
+        put_le(f, (uint16_t)(int16_t)audio[i], 2);
+    }
+    fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+    srand(1200);
+
+    check_info();
+    check_addresses();
+    modulate();
+
+    if (argc > 1) {
+        write_wav(argv[1]);
+    }
+
+    demodulate(audio, num_samples);
+    CHECK(check_decoded("clean"), "clean loopback");
+
+    // About 10 dB SNR over the audio bandwidth
+    num_frames = 0;
+    add_noise(2000.0f);
+    demodulate(audio, num_samples);
+    CHECK(check_decoded("noise"), "loopback with noise");
+
+    uint8_t bits[16];
+    CHECK(aprs_packet_bits(infos[0], bits, 8 * sizeof(bits)) == 0, "bits overflow");
+
+    return check_exit();
+}
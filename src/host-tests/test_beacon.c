@@ -0,0 +1,145 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Check the beacon policy: the content and the speed over the state of
+ * charge, the legibility limits, and the energy of a transmission.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "Core/beacon.h"
+#include "check.h"
+
+static struct beacon_plan plan_for(int qrp, int stats, int soc_valid, int32_t usable_mah, float voltage)
+{
+    const struct beacon_input in = {
+        .qrp = qrp,
+        .stats = stats,
+        .soc_valid = soc_valid,
+        .usable_mah = usable_mah,
+        .voltage = voltage,
+    };
+    struct beacon_plan plan;
+    beacon_plan(&in, &plan);
+    return plan;
+}
+
+static void check_without_soc(void)
+{
+    struct beacon_plan p = plan_for(0, 0, 0, 0, 12.8f);
+    CHECK(p.content == BEACON_CONTENT_FULL && p.dit_duration == BEACON_DIT_QRO_MS,
+            "QRO without state of charge: %d %d", p.content, p.dit_duration);
+
+    p = plan_for(1, 0, 0, 0, 12.3f);
+    CHECK(p.content == BEACON_CONTENT_SHORT && p.dit_duration == BEACON_DIT_QRP_MS,
+            "QRP without state of charge: %d %d", p.content, p.dit_duration);
+
+    p = plan_for(1, 0, 0, 0, 11.5f);
+    CHECK(p.content == BEACON_CONTENT_MINIMAL && p.dit_duration == BEACON_DIT_MIN_MS,
+            "low voltage: %d %d", p.content, p.dit_duration);
+
+    p = plan_for(0, 0, 0, 0, 0.0f);
+    CHECK(p.content == BEACON_CONTENT_FULL, "voltage not measured");
+}
+
+// Going down from full charge, the beacons only get shorter and faster
+static void check_discharge(void)
+{
+    int last_dit = BEACON_DIT_QRO_MS;
+    int last_content = BEACON_CONTENT_FULL;
+    int psk = 0;
+
+    for (int32_t mah = CHARGE_QRO + 100000; mah > BEACON_CRITICAL_MAH - 100000; mah -= 5000) {
+        const int qrp = mah < CHARGE_QRP;
+        const struct beacon_plan p = plan_for(qrp, 0, 1, mah, 12.4f);
+
+        CHECK((int)p.content >= last_content, "%d mAh: longer content", (int)mah);
+        last_content = p.content;
+
+        if (p.dit_duration < 0) {
+            CHECK(p.dit_duration == BEACON_PSK_MODE, "%d mAh: mode %d", (int)mah, p.dit_duration);
+            CHECK(mah < BEACON_CRITICAL_MAH, "%d mAh: PSK above critical", (int)mah);
+            CHECK(p.content == BEACON_CONTENT_MINIMAL, "%d mAh: long PSK", (int)mah);
+            psk = 1;
+        }
+        else {
+            CHECK(!psk, "%d mAh: back to CW", (int)mah);
+            CHECK(p.dit_duration <= last_dit, "%d mAh: slower", (int)mah);
+            CHECK(p.dit_duration >= BEACON_DIT_MIN_MS && p.dit_duration <= BEACON_DIT_QRO_MS,
+                    "%d mAh: dit %d ms", (int)mah, p.dit_duration);
+            last_dit = p.dit_duration;
+        }
+    }
+    CHECK(psk, "no PSK beacon when critical");
+
+    struct beacon_plan p = plan_for(0, 0, 1, CHARGE_QRO, 12.6f);
+    CHECK(p.dit_duration == BEACON_DIT_QRO_MS, "full speed at QRO: %d", p.dit_duration);
+    p = plan_for(1, 0, 1, CHARGE_QRP, 12.2f);
+    CHECK(p.content == BEACON_CONTENT_SHORT && p.dit_duration == BEACON_DIT_QRP_MS,
+            "QRP threshold: %d %d", p.content, p.dit_duration);
+    p = plan_for(1, 0, 1, (CHARGE_QRP + BEACON_LOW_MAH) / 2, 12.2f);
+    CHECK(p.dit_duration == (BEACON_DIT_QRP_MS + BEACON_DIT_MIN_MS) / 2,
+            "halfway to low: %d", p.dit_duration);
+
+    // The statistics are announced in CW, they follow in PSK anyway
+    p = plan_for(1, 1, 1, BEACON_CRITICAL_MAH - 50000, 12.0f);
+    CHECK(p.content == BEACON_CONTENT_MINIMAL && p.dit_duration == BEACON_DIT_MIN_MS,
+            "statistics when critical: %d %d", p.content, p.dit_duration);
+
+    // High SWR with a full battery
+    p = plan_for(1, 0, 1, CHARGE_QRO + 100000, 12.8f);
+    CHECK(p.content == BEACON_CONTENT_SHORT && p.dit_duration == BEACON_DIT_QRP_MS,
+            "high SWR: %d %d", p.content, p.dit_duration);
+}
+
+static void check_energy(void)
+{
+    // 30 s at 6 A and 12.5 V is 625 mWh
+    uint32_t e = beacon_energy_mwh(30000, 0, 0, 0.0f);
+    CHECK(e == 625, "nominal QRO energy %u", (unsigned)e);
+
+    e = beacon_energy_mwh(30000, 1, 0, 12.0f);
+    CHECK(e == 250, "nominal QRP energy %u", (unsigned)e);
+
+    // With the fit of the state of charge estimator
+    e = beacon_energy_mwh(36000, 0, -4000, 12.5f);
+    CHECK(e == 500, "fitted energy %u", (unsigned)e);
+
+    // A fit that does not discharge is not plausible
+    e = beacon_energy_mwh(30000, 0, 300, 12.5f);
+    CHECK(e == 625, "positive fit energy %u", (unsigned)e);
+
+    // Long transmissions do not overflow
+    e = beacon_energy_mwh(3600000, 0, 0, 12.5f);
+    CHECK(e == 75000, "one hour energy %u", (unsigned)e);
+}
+
+int main(void)
+{
+    check_without_soc();
+    check_discharge();
+    check_energy();
+
+    return check_exit();
+}
@@ -0,0 +1,234 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Run the coulomb counter tokenizer over a corpus of valid and malformed
+ * lines, and check the telemetry snapshot built from them, also while
+ * another thread reads it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "GPIO/ccounter.h"
+#include "GPIO/batterycharge.h"
+#include "Core/common.h"
+#include "check.h"
+
+static volatile uint64_t sim_now_ms = 1000;
+
+uint64_t timestamp_now(void)
+{
+    return sim_now_ms;
+}
+
+struct corpus_entry {
+    const char *line;
+    enum ccounter_type type;
+    uint32_t seconds;
+    int32_t value;
+    int num_cells;
+    const char *text;
+};
+
+static const struct corpus_entry corpus[] = {
+    {"CAPA,1234,1350000", CCOUNTER_CAPA, 1234, 1350000, 0, NULL},
+    {"CAPA,0,0", CCOUNTER_CAPA, 0, 0, 0, NULL},
+    {"DISJEOL,99,On", CCOUNTER_DISJEOL, 99, 1, 0, NULL},
+    {"DISJEOL,99,Off", CCOUNTER_DISJEOL, 99, 0, 0, NULL},
+    {"VBAT+,5,1520", CCOUNTER_VBAT_IN, 5, 1520, 0, NULL},
+    {"VBAT+,5,1520,3301,3298,3310,3305", CCOUNTER_VBAT_IN, 5, 1520, 4, NULL},
+    {"VBAT-,6,-250,3290", CCOUNTER_VBAT_OUT, 6, -250, 1, NULL},
+    {"VBAT-,6,+250", CCOUNTER_VBAT_OUT, 6, 250, 0, NULL},
+    {"TEXT,7,Hello, world", CCOUNTER_TEXT, 7, 0, 0, "Hello, world"},
+    {"TEXT,7,", CCOUNTER_TEXT, 7, 0, 0, ""},
+    {"ERROR,8,42", CCOUNTER_ERROR, 8, 42, 0, NULL},
+    {"ERROR,8,3,Shunt open", CCOUNTER_ERROR, 8, 3, 0, "Shunt open"},
+
+    {"", CCOUNTER_NONE, 0, 0, 0, NULL},
+    {"CAPA", CCOUNTER_NONE, 0, 0, 0, NULL},
+    {"CAPA,", CCOUNTER_NONE, 0, 0, 0, NULL},
+    {"CAPA,12", CCOUNTER_NONE, 0, 0, 0, NULL},
+    {"CAPA,12,", CCOUNTER_NONE, 0, 0, 0, NULL},
+    {"CAPA,12,-5", CCOUNTER_NONE, 0, 0, 0, NULL},
+    {"CAPA,12,13a", CCOUNTER_NONE, 0, 0, 0, NULL},
+    {"CAPA,12,99999999999", CCOUNTER_NONE, 0, 0, 0, NULL},
+    {"CAPA,12,5,6", CCOUNTER_NONE, 0, 0, 0, NULL},
+    {"CAPA,-1,5", CCOUNTER_NONE, 0, 0, 0, NULL},
+    {"CAPAX,12,5", CCOUNTER_NONE, 0, 0, 0, NULL},
+    {"capa,12,5", CCOUNTER_NONE, 0, 0, 0, NULL},
+    {"DISJEOL,1,ON", CCOUNTER_NONE, 0, 0, 0, NULL},
+    {"DISJEOL,1,Onn", CCOUNTER_NONE, 0, 0, 0, NULL},
+    {"VBAT+,1,-", CCOUNTER_NONE, 0, 0, 0, NULL},
+    {"VBAT+,1,10,3300,", CCOUNTER_NONE, 0, 0, 0, NULL},
+    {"VBAT+,1,10,1,2,3,4,5", CCOUNTER_NONE, 0, 0, 0, NULL},
+    {"VBAT,1,10", CCOUNTER_NONE, 0, 0, 0, NULL},
+    {"TEXT,1", CCOUNTER_NONE, 0, 0, 0, NULL},
+    {"ERROR,1,", CCOUNTER_NONE, 0, 0, 0, NULL},
+    {"ERROR,x,1", CCOUNTER_NONE, 0, 0, 0, NULL},
+};
+
+static void check_corpus(void)
+{
+    for (size_t i = 0; i < sizeof(corpus)/sizeof(corpus[0]); i++) {
+        const struct corpus_entry *e = &corpus[i];
+        const size_t len = strlen(e->line);
+
+        // Copy without terminator, so that reading past the end is caught
+        // by the address sanitizer or valgrind
+        char *line = malloc(len ? len : 1);
+        memcpy(line, e->line, len);
+
+        struct ccounter_msg msg;
+        const enum ccounter_type type = ccounter_parse(line, len, &msg);
+
+        CHECK(type == e->type, "'%s' type %d", e->line, type);
+        if (type == e->type && type != CCOUNTER_NONE) {
+            CHECK(msg.seconds == e->seconds, "'%s' seconds", e->line);
+            if (type != CCOUNTER_TEXT) {
+                CHECK(msg.value == e->value, "'%s' value %d", e->line, (int)msg.value);
+            }
+            CHECK(msg.num_cells == e->num_cells, "'%s' cells", e->line);
+            if (e->text) {
+                CHECK(msg.text_len == strlen(e->text) &&
+                        memcmp(msg.text, e->text, msg.text_len) == 0 &&
+                        msg.text >= line && msg.text + msg.text_len <= line + len,
+                        "'%s' text", e->line);
+            }
+            else {
+                CHECK(msg.text == NULL, "'%s' unexpected text", e->line);
+            }
+        }
+        free(line);
+    }
+
+    struct ccounter_msg msg;
+    ccounter_parse("VBAT+,5,1520,3301,3298,3310,3305", 32, &msg);
+    CHECK(msg.cell_mv[0] == 3301 && msg.cell_mv[3] == 3305, "cell voltages");
+
+    // The length is respected, not the terminator
+    CHECK(ccounter_parse("CAPA,1,23", 8, &msg) == CCOUNTER_CAPA && msg.value == 2,
+            "length not respected");
+}
+
+static void check_telemetry(void)
+{
+    struct batterycharge_telemetry t;
+
+    batterycharge_init();
+    CHECK(batterycharge_retrieve_last_capacity() == 0, "capacity before messages");
+    CHECK(batterycharge_too_low() == -1, "too low before messages");
+    CHECK(batterycharge_wind_disconnected() == -1, "breaker before messages");
+
+    batterycharge_push_message("CAPA,1,1320000");
+    batterycharge_push_message("DISJEOL,1,On");
+    batterycharge_push_message("VBAT+,1,800,3300,3310");
+    batterycharge_push_message("VBAT-,1,1200");
+    batterycharge_push_message("ERROR,1,7,Overtemp");
+    batterycharge_push_message("TEXT,1,v1.2");
+    batterycharge_push_message("CAPA,1,garbage");
+
+    batterycharge_telemetry(&t);
+    CHECK(t.capacity_updated && t.capacity_mah == 1320000, "capacity");
+    CHECK(t.breaker_updated && t.breaker_open == 0, "breaker");
+    CHECK(t.charge_updated && t.charge_ma == 800, "charge current");
+    CHECK(t.discharge_updated && t.discharge_ma == 1200, "discharge current");
+    CHECK(t.cells_updated && t.num_cells == 2 && t.cell_mv[1] == 3310, "cells");
+    CHECK(t.error_updated && t.error_code == 7 && t.num_errors == 1, "error");
+    CHECK(t.num_texts == 1 && t.num_malformed == 1, "counters");
+
+    // Hysteresis between CHARGE_QRP and CHARGE_QRO
+    CHECK(batterycharge_too_low() == 0, "QRP above the threshold");
+    batterycharge_push_message("CAPA,2,1299000");
+    CHECK(batterycharge_too_low() == 1, "not QRP below the threshold");
+    batterycharge_push_message("CAPA,3,1340000");
+    CHECK(batterycharge_too_low() == 1, "QRO inside the hysteresis");
+    batterycharge_push_message("CAPA,4,1350000");
+    CHECK(batterycharge_too_low() == 0, "QRP above the hysteresis");
+    batterycharge_push_message("DISJEOL,4,Off");
+    CHECK(batterycharge_too_low() == 1, "QRO with the breaker open");
+    CHECK(batterycharge_wind_disconnected() == 1, "breaker open");
+
+    // A silent counter invalidates everything, and old values do not come
+    // back with the next message
+    sim_now_ms += 61000;
+    CHECK(batterycharge_retrieve_last_capacity() == 0, "capacity of a silent counter");
+    CHECK(batterycharge_wind_disconnected() == -1, "breaker of a silent counter");
+    batterycharge_push_message("VBAT-,70,900");
+    batterycharge_telemetry(&t);
+    CHECK(t.discharge_updated && !t.capacity_updated && !t.breaker_updated &&
+            !t.cells_updated, "stale values after a silence");
+}
+
+#define NUM_UPDATES 1000000
+
+static volatile int writer_done = 0;
+
+static void *reader(void *arg)
+{
+    long *torn = arg;
+    long reads = 0;
+    while (!writer_done) {
+        struct batterycharge_telemetry t;
+        batterycharge_telemetry(&t);
+        if (t.cells_updated &&
+                (t.charge_ma != t.cell_mv[0] || t.charge_ma != t.cell_mv[3])) {
+            (*torn)++;
+        }
+        reads++;
+    }
+    printf("%ld snapshots read\n", reads);
+    return NULL;
+}
+
+// The writer publishes messages with all values equal, a torn snapshot
+// would have different ones
+static void check_concurrency(void)
+{
+    long torn = 0;
+    pthread_t thread;
+
+    batterycharge_init();
+    pthread_create(&thread, NULL, reader, &torn);
+
+    char line[64];
+    for (int i = 0; i < NUM_UPDATES; i++) {
+        const int v = i % 5000;
+        snprintf(line, sizeof(line), "VBAT+,%d,%d,%d,%d,%d,%d", i, v, v, v, v, v);
+        batterycharge_push_message(line);
+    }
+    writer_done = 1;
+    pthread_join(thread, NULL);
+
+    CHECK(torn == 0, "%ld torn snapshots", torn);
+}
+
+int main(void)
+{
+    check_corpus();
+    check_telemetry();
+    check_concurrency();
+
+    return check_exit();
+}
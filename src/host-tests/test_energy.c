@@ -0,0 +1,187 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Check the energy accounting: the time in the states with the TX on and
+ * off in QRO and QRP, the groups, the cross check with the capacity of the
+ * coulomb counter, and the record in the store.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Core/energy.h"
+#include "Core/store.h"
+#include "check.h"
+
+static uint8_t stored[STORE_MAX_RECORD];
+static uint32_t stored_len = 0;
+
+int store_write(uint8_t key, const void *data, uint32_t len)
+{
+    CHECK(key == STORE_KEY_ENERGY, "store key %d", key);
+    CHECK(len <= STORE_MAX_RECORD, "record of %d bytes", (int)len);
+    memcpy(stored, data, len);
+    stored_len = len;
+    return 1;
+}
+
+int store_read(uint8_t __attribute__((unused)) key, void *data, uint32_t len)
+{
+    if (stored_len != len) {
+        return -1;
+    }
+    memcpy(data, stored, len);
+    return len;
+}
+
+static uint64_t now_ms = 1000;
+
+// Stay in a state for a number of seconds, the FSM updates every 100 ms
+static void run(fsm_state_t state, int tx_on, int qrp, int seconds)
+{
+    for (int i = 0; i < seconds * 10; i++) {
+        energy_account(now_ms, state, tx_on, qrp);
+        now_ms += 100;
+    }
+}
+
+static void check_groups(void)
+{
+    run(FSM_OISIF, 0, 0, 3600);
+    run(FSM_QSO, 1, 0, 360);
+    run(FSM_BALISE_LONGUE, 1, 0, 30);
+    run(FSM_QSO, 1, 1, 360);
+    // Back to idle, to account the last interval of the QSO
+    energy_account(now_ms, FSM_OISIF, 0, 0);
+
+    const uint32_t idle = energy_group_mwh(ENERGY_IDLE, -1);
+    const uint32_t qso = energy_group_mwh(ENERGY_QSO, -1);
+    const uint32_t beacons = energy_group_mwh(ENERGY_BEACONS, -1);
+    printf("idle %u QSO %u beacons %u mWh\n", (unsigned)idle, (unsigned)qso, (unsigned)beacons);
+
+    CHECK(idle == 3000, "idle %u mWh", (unsigned)idle);
+    // 6 minutes at 75 W and at 31 W
+    CHECK(qso == 7500 + 3100, "QSO %u mWh", (unsigned)qso);
+    CHECK(beacons == 625, "beacons %u mWh", (unsigned)beacons);
+    CHECK(energy_group_mwh(ENERGY_QSO, 1) == 3100, "QSO in QRP");
+    CHECK(energy_group_mwh(ENERGY_IDLE, 1) == 0, "idle in QRP");
+    CHECK(energy_state_mwh(FSM_QSO, 0) == 7500, "QSO state in QRO");
+    CHECK(energy_state_mwh(FSM_BALISE_LONGUE, -1) == 625, "beacon state");
+    CHECK(energy_state_mwh(_NUM_FSM_STATES, -1) == 0, "invalid state");
+
+    // A stall of the FSM only counts ENERGY_MAX_INTERVAL_MS
+    now_ms += 60000;
+    energy_account(now_ms, FSM_OISIF, 0, 0);
+    const uint32_t stalled = energy_group_mwh(ENERGY_IDLE, -1) - idle;
+    CHECK(stalled == (uint32_t)(ENERGY_MAX_INTERVAL_MS / 1000 * ENERGY_IDLE_MW / 3600),
+            "stall accounted for %u mWh", (unsigned)stalled);
+}
+
+static void check_cross_check(void)
+{
+    energy_clear();
+
+    uint32_t measured, estimated;
+    CHECK(!energy_cross_check(&measured, &estimated), "cross check without capacity");
+
+    // Idle at 3 W and 12.5 V is 240 mA, one mAh every 15 s, during an hour
+    uint32_t capacity = 1300000;
+    for (int i = 0; i < 240; i++) {
+        energy_capacity(capacity, 0, 12.5f);
+        run(FSM_OISIF, 0, 0, 15);
+        capacity--;
+    }
+    energy_capacity(capacity, 0, 12.5f);
+
+    CHECK(energy_cross_check(&measured, &estimated), "no cross check");
+    printf("not charging: measured %u estimated %u mWh\n", (unsigned)measured, (unsigned)estimated);
+    CHECK(measured == 3000, "measured %u mWh", (unsigned)measured);
+    CHECK(abs((int)estimated - 3000) <= 15, "estimated %u mWh", (unsigned)estimated);
+
+    // While charging, the capacity rises and nothing is compared
+    for (int i = 0; i < 100; i++) {
+        run(FSM_QSO, 1, 0, 15);
+        capacity += 2;
+        energy_capacity(capacity, 1, 13.2f);
+    }
+
+    // Charging that stops within an interval spoils it
+    run(FSM_OISIF, 0, 0, 5);
+    energy_capacity(capacity, 0, 12.5f);
+    run(FSM_OISIF, 0, 0, 10);
+    capacity--;
+    energy_capacity(capacity, 0, 12.5f);
+
+    // The coulomb counter goes silent, then comes back
+    energy_capacity(0, -1, 12.5f);
+    run(FSM_OISIF, 0, 0, 15);
+    energy_capacity(capacity, 0, 12.5f);
+
+    uint32_t measured2, estimated2;
+    energy_cross_check(&measured2, &estimated2);
+    CHECK(measured2 == measured && estimated2 == estimated,
+            "charging counted: measured %u estimated %u mWh", (unsigned)measured2, (unsigned)estimated2);
+
+    // Then discharging again, with the TX on
+    for (int i = 0; i < 10; i++) {
+        run(FSM_QSO, 1, 0, 15);
+        capacity -= 25;
+        energy_capacity(capacity, 0, 12.5f);
+    }
+    energy_cross_check(&measured2, &estimated2);
+    printf("with TX: measured %u estimated %u mWh\n", (unsigned)measured2, (unsigned)estimated2);
+    CHECK(measured2 == measured + 250 * 12.5f, "measured with TX %u mWh", (unsigned)measured2);
+    CHECK(estimated2 - estimated >= 3100 && estimated2 - estimated <= 3150,
+            "estimated with TX %u mWh", (unsigned)(estimated2 - estimated));
+}
+
+static void check_store(void)
+{
+    energy_account(now_ms, FSM_OISIF, 0, 0);
+    energy_clear();
+    run(FSM_QSO, 1, 0, 360);
+    energy_account(now_ms, FSM_OISIF, 0, 0);
+    CHECK(energy_save(), "save");
+
+    energy_clear();
+    CHECK(energy_group_mwh(ENERGY_QSO, -1) == 0, "not cleared");
+
+    CHECK(energy_restore(), "restore");
+    CHECK(energy_group_mwh(ENERGY_QSO, -1) == 7500, "restored QSO %u mWh",
+            (unsigned)energy_group_mwh(ENERGY_QSO, -1));
+
+    // Another version is ignored
+    stored[0] ^= 0xFF;
+    energy_clear();
+    CHECK(!energy_restore(), "restored another version");
+}
+
+int main(void)
+{
+    check_groups();
+    check_cross_check();
+    check_store();
+
+    return check_exit();
+}
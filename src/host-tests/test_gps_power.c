@@ -0,0 +1,215 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Run the GPS power policy against a scripted receiver and PPS, one second
+ * per step, and check when the receiver is switched on and off.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "GPS/gps_power.h"
+#include "check.h"
+
+#define US_PER_S 1000000ull
+
+// Receiver and PPS model
+struct sim {
+    uint64_t now_s;
+    int on;
+    uint64_t on_since_s;
+    uint64_t off_since_s;
+    // Seconds from switch on to the first fix
+    int ttff_s;
+    // The PPS loop locks after this many seconds with a fix
+    int lock_s;
+    // Holdover uncertainty growth while off, in us per second
+    double drift_us_per_s;
+    // Forced conditions
+    int antenna_blocked;
+    int no_pps;
+};
+
+static void sim_init(struct sim *s)
+{
+    s->now_s = 1000;
+    s->on = 1;
+    s->on_since_s = s->now_s;
+    s->off_since_s = 0;
+    s->ttff_s = 40;
+    s->lock_s = 64;
+    s->drift_us_per_s = 0.5;
+    s->antenna_blocked = 0;
+    s->no_pps = 0;
+    gps_power_init(s->now_s * US_PER_S);
+}
+
+static void sim_step(struct sim *s)
+{
+    s->now_s++;
+
+    const uint64_t on_for_s = s->now_s - s->on_since_s;
+    const int fix = s->on && !s->antenna_blocked && on_for_s >= (uint64_t)s->ttff_s;
+    const int locked = fix && !s->no_pps && on_for_s >= (uint64_t)(s->ttff_s + s->lock_s);
+
+    uint32_t uncertainty_us;
+    if (s->on) {
+        uncertainty_us = locked ? 1 : UINT32_MAX;
+    }
+    else {
+        uncertainty_us = 1 + (uint32_t)(s->drift_us_per_s * (s->now_s - s->off_since_s));
+    }
+
+    const int on = gps_power_update(s->now_s * US_PER_S, fix, locked, uncertainty_us);
+    if (on && !s->on) {
+        s->on_since_s = s->now_s;
+    }
+    else if (!on && s->on) {
+        s->off_since_s = s->now_s;
+    }
+    s->on = on;
+}
+
+// Run until the receiver switches to the wanted state, return the elapsed
+// seconds or -1 if it did not within max_s
+static int sim_until(struct sim *s, int on, int max_s)
+{
+    for (int i = 1; i <= max_s; i++) {
+        sim_step(s);
+        if (s->on == on) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void check_duty_cycle(void)
+{
+    struct sim s;
+    sim_init(&s);
+    struct gps_power_stats st;
+
+    // First fix after 40s, then the long first track
+    int t = sim_until(&s, 0, 3600);
+    gps_power_get_stats(&st);
+    printf("boot: off after %d s, TTFF %u s\n", t, (unsigned)st.last_ttff_s);
+    CHECK(t == 40 + GPS_POWER_FIRST_TRACK_S, "first off after %d s", t);
+    CHECK(st.last_ttff_s == 40, "first TTFF %u", (unsigned)st.last_ttff_s);
+    CHECK(st.state == GPS_POWER_OFF, "not in OFF");
+
+    // The uncertainty reaches the bound after 2000s
+    t = sim_until(&s, 1, GPS_POWER_MAX_OFF_S);
+    printf("holdover: on after %d s\n", t);
+    CHECK(t == 1998, "woken by uncertainty after %d s", t);
+
+    // Hot start, then the short track
+    s.ttff_s = 5;
+    t = sim_until(&s, 0, 3600);
+    gps_power_get_stats(&st);
+    printf("hot start: off after %d s, TTFF %u s\n", t, (unsigned)st.last_ttff_s);
+    CHECK(t == 5 + GPS_POWER_TRACK_S, "off after %d s", t);
+    CHECK(st.wakeups == 1, "wakeups %u", (unsigned)st.wakeups);
+    CHECK(st.last_ttff_s == 5 && st.max_ttff_s == 40, "TTFF %u max %u",
+            (unsigned)st.last_ttff_s, (unsigned)st.max_ttff_s);
+
+    // A stable clock still wakes up to refresh the ephemeris
+    s.drift_us_per_s = 0;
+    t = sim_until(&s, 1, 2 * GPS_POWER_MAX_OFF_S);
+    printf("stable clock: on after %d s\n", t);
+    CHECK(t == GPS_POWER_MAX_OFF_S, "woken after %d s", t);
+
+    // Energy accounting
+    sim_until(&s, 0, 3600);
+    sim_until(&s, 1, 2 * GPS_POWER_MAX_OFF_S);
+    gps_power_get_stats(&st);
+    const uint64_t total_us = st.on_us + st.off_us;
+    const uint32_t expected = GPS_POWER_RECEIVER_MW * 24ull * st.off_us / total_us;
+    printf("off %.1f%%, saved %u mWh/day\n", 100.0 * st.off_us / total_us,
+            (unsigned)gps_power_saved_mwh_per_day());
+    CHECK(total_us == (s.now_s - 1000) * US_PER_S, "accounted %llu us",
+            (unsigned long long)total_us);
+    CHECK(gps_power_saved_mwh_per_day() == expected, "saved energy");
+    CHECK(st.off_us > 9 * st.on_us, "off less than 90%%");
+}
+
+static void check_fix_lost(void)
+{
+    struct sim s;
+    sim_init(&s);
+    s.ttff_s = 30;
+
+    // Fix lost during the first track
+    for (int i = 0; i < 300; i++) {
+        sim_step(&s);
+    }
+    s.antenna_blocked = 1;
+    for (int i = 0; i < GPS_POWER_FIX_LOST_S + 2; i++) {
+        sim_step(&s);
+    }
+    struct gps_power_stats st;
+    gps_power_get_stats(&st);
+    CHECK(st.state == GPS_POWER_ACQUIRE, "still tracking without fix");
+    CHECK(s.on, "off without fix");
+
+    // The receiver is still running, the fix comes back at once
+    s.antenna_blocked = 0;
+    sim_step(&s);
+    gps_power_get_stats(&st);
+    CHECK(st.state == GPS_POWER_TRACK, "not tracking again");
+
+    // A short interruption does not restart the acquisition
+    s.antenna_blocked = 1;
+    for (int i = 0; i < GPS_POWER_FIX_LOST_S - 1; i++) {
+        sim_step(&s);
+    }
+    s.antenna_blocked = 0;
+    sim_step(&s);
+    gps_power_get_stats(&st);
+    CHECK(st.state == GPS_POWER_TRACK, "short interruption left TRACK");
+
+    // Still the first track, the clock has not been switched off yet
+    const int t = sim_until(&s, 0, 3600);
+    CHECK(t == GPS_POWER_FIRST_TRACK_S - GPS_POWER_FIX_LOST_S, "off after %d s", t);
+}
+
+static void check_no_pps(void)
+{
+    struct sim s;
+    sim_init(&s);
+    s.no_pps = 1;
+
+    // The time is only kept in holdover with a disciplined clock
+    const int t = sim_until(&s, 0, 2 * 3600);
+    printf("no PPS: off after %d s\n", t);
+    CHECK(t == -1, "switched off without PPS lock");
+    CHECK(gps_power_saved_mwh_per_day() == 0, "saved energy without switching off");
+}
+
+int main(void)
+{
+    check_duty_cycle();
+    check_fix_lost();
+    check_no_pps();
+
+    return check_exit();
+}
@@ -0,0 +1,159 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Compare the percentiles of the log bucket histograms with the exact ones
+ * from sorted values, and measure the cost of adding a value.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "Core/histogram.h"
+#include "check.h"
+
+#define NUM_VALUES 20000
+static uint32_t values[NUM_VALUES];
+
+static int compare_u32(const void *a, const void *b)
+{
+    const uint32_t va = *(const uint32_t*)a;
+    const uint32_t vb = *(const uint32_t*)b;
+    return (va > vb) - (va < vb);
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Durations spread over several decades, like QSOs between 1s and 1h
+static uint32_t log_uniform(double min, double max)
+{
+    const double u = (double)rand() / RAND_MAX;
+    return (uint32_t)exp(log(min) + u * (log(max) - log(min)));
+}
+
+static void check_distribution(const char *name, double min, double max)
+{
+    static struct histogram h;
+    histogram_clear(&h);
+
+    for (int i = 0; i < NUM_VALUES; i++) {
+        values[i] = log_uniform(min, max);
+        histogram_add(&h, values[i]);
+    }
+    qsort(values, NUM_VALUES, sizeof(values[0]), compare_u32);
+
+    CHECK(h.total == NUM_VALUES, "%s: total %u", name, (unsigned)h.total);
+
+    const int percents[] = {1, 10, 50, 90, 99};
+    for (size_t i = 0; i < sizeof(percents)/sizeof(percents[0]); i++) {
+        const int p = percents[i];
+        const uint32_t exact = values[(NUM_VALUES * p + 99) / 100 - 1];
+        const uint32_t estimate = histogram_percentile(&h, p);
+        const double error = fabs((double)estimate - exact) / exact;
+
+        printf("%s p%d exact %u estimate %u error %.1f%%\n",
+                name, p, (unsigned)exact, (unsigned)estimate, error * 100.0);
+        // Half a bucket, small values are exact
+        CHECK(error <= 0.125, "%s: p%d error %.1f%%", name, p, error * 100.0);
+    }
+
+    CHECK(histogram_percentile(&h, 100) == values[NUM_VALUES - 1], "%s: max", name);
+}
+
+static void check_edges(void)
+{
+    static struct histogram h;
+    histogram_clear(&h);
+    CHECK(histogram_percentile(&h, 50) == 0, "empty histogram");
+
+    for (uint32_t v = 0; v < 4; v++) {
+        histogram_clear(&h);
+        histogram_add(&h, v);
+        CHECK(histogram_percentile(&h, 50) == v, "small value %u", (unsigned)v);
+    }
+
+    // Values beyond the last bucket share it, the maximum stays exact
+    histogram_clear(&h);
+    histogram_add(&h, UINT32_MAX);
+    histogram_add(&h, 100000000);
+    CHECK(histogram_percentile(&h, 50) <= 100000000, "large value p50 %u",
+            (unsigned)histogram_percentile(&h, 50));
+    CHECK(histogram_percentile(&h, 100) == UINT32_MAX, "large value max");
+
+    // Every value lands in a bucket which contains it
+    for (uint32_t v = 1; v < (1u << HISTOGRAM_MAX_BITS); v = v * 9 / 8 + 1) {
+        histogram_clear(&h);
+        histogram_add(&h, v);
+        histogram_add(&h, 1u << HISTOGRAM_MAX_BITS);
+        const uint32_t p = histogram_percentile(&h, 50);
+        CHECK(fabs((double)p - v) <= v * 0.125, "value %u gives %u", (unsigned)v, (unsigned)p);
+    }
+}
+
+static void benchmark(void)
+{
+    static struct histogram h;
+    histogram_clear(&h);
+
+    for (int i = 0; i < NUM_VALUES; i++) {
+        values[i] = rand();
+    }
+
+    const int rounds = 500;
+    const double t0 = now_s();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < NUM_VALUES; i++) {
+            histogram_add(&h, values[i]);
+        }
+    }
+    const double t1 = now_s();
+    volatile uint32_t sink = 0;
+    for (int r = 0; r < 10000; r++) {
+        sink += histogram_percentile(&h, r % 100);
+    }
+    const double t2 = now_s();
+    (void)sink;
+
+    printf("histogram_add %.2f ns/value, histogram_percentile %.1f ns/call, %d bytes\n",
+            (t1 - t0) * 1e9 / ((double)rounds * NUM_VALUES),
+            (t2 - t1) * 1e9 / 10000, (int)sizeof(h));
+}
+
+int main(void)
+{
+    srand(1750);
+
+    check_edges();
+    check_distribution("QSO ms", 1000, 3600000);
+    check_distribution("1750 latency ms", 50, 5000);
+    check_distribution("occupancy permille", 1, 1000);
+    benchmark();
+
+    return check_exit();
+}
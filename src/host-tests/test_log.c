@@ -0,0 +1,99 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Check the compile time and run time filtering of the debug messages */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define LOG_LEVEL_DEFAULT LOG_INFO
+#define LOG_LEVEL_GPS LOG_WARNING
+#define LOG_LEVEL_AUDIO LOG_DEBUG
+#include "Core/log.h"
+#include "Core/log_ring.h"
+#include "Core/common.h"
+#include "check.h"
+
+uint64_t timestamp_now(void)
+{
+    return 0;
+}
+
+void usart_debug_kick(void)
+{
+}
+
+// Replaces the formatting of text messages
+void usart_debug(const char *format, ...)
+{
+    log_ring_write(format, 1);
+}
+
+static int evaluated = 0;
+
+static int argument(void)
+{
+    evaluated++;
+    return 1;
+}
+
+static int messages(void)
+{
+    int n = 0;
+    uint32_t len;
+    while (log_ring_peek(&len)) {
+        log_ring_release();
+        n++;
+    }
+    return n;
+}
+
+int main(void)
+{
+    log_bin_msg(GPS, LOG_ERROR, "%d\r\n", argument());
+    log_bin_msg(GPS, LOG_WARNING, "%d\r\n", argument());
+    log_bin_msg(GPS, LOG_INFO, "%d\r\n", argument());
+    log_msg(GPS, LOG_DEBUG, "%d\r\n", argument());
+    CHECK(messages() == 2, "GPS level");
+    CHECK(evaluated == 2, "arguments of removed messages evaluated");
+
+    log_msg(FSM, LOG_INFO, "%d\r\n", argument());
+    log_bin_msg(FSM, LOG_DEBUG, "%d\r\n", argument());
+    log_bin_msg(AUDIO, LOG_DEBUG, "%d\r\n", argument());
+    CHECK(messages() == 2, "default and AUDIO levels");
+
+    // The run time ceiling only lowers the levels
+    log_set_level(LOG_WARNING);
+    log_bin_msg(AUDIO, LOG_INFO, "%d\r\n", argument());
+    log_bin_msg(AUDIO, LOG_WARNING, "%d\r\n", argument());
+    log_bin_msg(GPS, LOG_ERROR, "%d\r\n", argument());
+    CHECK(messages() == 2, "ceiling WARNING");
+
+    log_set_level(LOG_DEBUG + 3);
+    log_bin_msg(GPS, LOG_INFO, "%d\r\n", argument());
+    log_bin_msg(AUDIO, LOG_DEBUG, "%d\r\n", argument());
+    CHECK(messages() == 1, "ceiling above LOG_DEBUG");
+
+    return check_exit();
+}
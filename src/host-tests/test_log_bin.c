@@ -0,0 +1,169 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Write binary debug messages through the log ring, render them back, and
+ * compare with the text usart_debug() would have sent. With a file name as
+ * argument, also write the records for decoder/logdecode.py.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "Core/log_bin.h"
+#include "Core/log_ring.h"
+#include "Core/common.h"
+#include "check.h"
+
+static uint64_t sim_now_ms = 0;
+
+uint64_t timestamp_now(void)
+{
+    return sim_now_ms;
+}
+
+void usart_debug_kick(void)
+{
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static FILE *stream = NULL;
+
+// Render the next record and compare with the expected text
+static void expect(const char *expected)
+{
+    uint32_t len;
+    const char *msg = log_ring_peek(&len);
+    CHECK(msg != NULL, "no record for %s", expected);
+    if (msg == NULL) {
+        return;
+    }
+
+    if (stream) {
+        fwrite(msg, 1, len, stream);
+    }
+
+    char text[256];
+    const int n = log_bin_render((const uint8_t*)msg, len, text, sizeof(text));
+    CHECK(n == (int)strlen(expected) && strcmp(text, expected) == 0,
+            "rendered '%s' instead of '%s'", n >= 0 ? text : "", expected);
+    log_ring_release();
+}
+
+static void check_render(void)
+{
+    sim_now_ms = 1234;
+    log_bin("In SQ %d\r\n", 1);
+    expect("[1234] In SQ 1\r\n");
+
+    sim_now_ms = 4000000000ull;
+    log_bin("Tones: % 3d % 3d % 3d % 3d % 3d since %d\r\n", 12, -3, 150, 7, 0, -25);
+    expect("[4000000000] Tones:  12  -3  150   7   0 since -25\r\n");
+
+    // Timestamps are sent modulo 2^32 ms
+    sim_now_ms = (1ull << 32) + 5;
+    log_bin("No argument\r\n");
+    expect("[5] No argument\r\n");
+
+    log_bin("%u%% %lu %x %04X %c%c\r\n", 4000000000u, (uint32_t)12, 0xbeef, 0x1f, 'o', 'k');
+    expect("[5] 4000000000% 12 beef 001F ok\r\n");
+
+    const int32_t negative = -2000000000;
+    log_bin("%ld %5d|%-5d|\r\n", negative, 42, 42);
+    expect("[5] -2000000000    42|42   |\r\n");
+
+    // Corrupted records
+    log_bin("In QRP %d\r\n", 0);
+    uint32_t len;
+    char *msg = (char*)log_ring_peek(&len);
+    char text[64];
+    msg[len - 2] ^= 0x10;
+    CHECK(log_bin_render((const uint8_t*)msg, len, text, sizeof(text)) == -1, "bad sum accepted");
+    msg[len - 2] ^= 0x10;
+    CHECK(log_bin_render((const uint8_t*)msg, len - 1, text, sizeof(text)) == -1, "short record accepted");
+    CHECK(log_bin_render((const uint8_t*)msg, len, text, 8) == 7, "output not truncated");
+    if (stream) {
+        fwrite(msg, 1, len, stream);
+        fputs("[5] Text messages pass through\r\n", stream);
+    }
+    log_ring_release();
+}
+
+static void compare_text(void)
+{
+    const int iterations = 20000;
+    char text[80];
+    volatile int sink = 0;
+    uint32_t bin_bytes = 0;
+    uint32_t text_bytes = 0;
+
+    sim_now_ms = 123456789;
+
+    double t0 = now_s();
+    for (int i = 0; i < iterations; i++) {
+        // What usart_debug() does before copying into the ring
+        const int n = snprintf(text, sizeof(text), "[%u] Tones: % 3d % 3d % 3d % 3d % 3d since %d\r\n",
+                (unsigned)sim_now_ms, i % 100, 2, 3, 4, 5, i);
+        text_bytes += n;
+        sink += text[n - 3];
+    }
+    double t1 = now_s();
+    for (int i = 0; i < iterations; i++) {
+        log_bin("Tones: % 3d % 3d % 3d % 3d % 3d since %d\r\n", i % 100, 2, 3, 4, 5, i);
+
+        uint32_t len;
+        log_ring_peek(&len);
+        bin_bytes += len;
+        log_ring_release();
+    }
+    double t2 = now_s();
+
+    printf("tone message: text %.1f bytes %.0f ns, binary %.1f bytes %.0f ns\n",
+            (double)text_bytes / iterations, (t1 - t0) * 1e9 / iterations,
+            (double)bin_bytes / iterations, (t2 - t1) * 1e9 / iterations);
+    CHECK(bin_bytes * 2 < text_bytes, "binary messages not shorter");
+    (void)sink;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) {
+        stream = fopen(argv[1], "wb");
+    }
+
+    check_render();
+    compare_text();
+
+    if (stream) {
+        fclose(stream);
+    }
+
+    return check_exit();
+}
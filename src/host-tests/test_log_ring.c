@@ -0,0 +1,254 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Exercise the log ring with one and with several producer threads, and
+ * check that every message arrives intact and in order, or is counted as
+ * dropped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "Core/log_ring.h"
+#include "check.h"
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Messages are "<producer> <seq> " followed by a pattern derived from both,
+ * with a length between 12 and 140 bytes.
+ */
+static uint32_t make_message(char *buf, int producer, uint32_t seq)
+{
+    const uint32_t len = 12 + (seq * 7 + producer * 13) % 129;
+    int n = snprintf(buf, len + 1, "%d %u ", producer, (unsigned)seq);
+    for (uint32_t i = n; i < len; i++) {
+        buf[i] = 'a' + (producer + seq + i) % 26;
+    }
+    return len;
+}
+
+static int check_message(const char *msg, uint32_t len, int *producer, uint32_t *seq)
+{
+    char copy[LOG_RING_MAX_MSG + 1];
+    memcpy(copy, msg, len);
+    copy[len] = '\0';
+
+    unsigned s;
+    if (sscanf(copy, "%d %u ", producer, &s) != 2) {
+        return 0;
+    }
+    *seq = s;
+
+    char expected[LOG_RING_MAX_MSG + 1];
+    const uint32_t expected_len = make_message(expected, *producer, *seq);
+    return expected_len == len && memcmp(expected, msg, len) == 0;
+}
+
+static uint32_t drain(int *producer_seen, uint32_t *next_seq, int producers)
+{
+    uint32_t received = 0;
+    uint32_t len;
+    const char *msg;
+
+    while ((msg = log_ring_peek(&len)) != NULL) {
+        int producer;
+        uint32_t seq;
+        if (!check_message(msg, len, &producer, &seq) || producer >= producers) {
+            printf("FAIL: corrupted message of %u bytes\n", (unsigned)len);
+            failures++;
+        }
+        else {
+            CHECK(seq >= next_seq[producer], "producer %d: %u after %u",
+                    producer, (unsigned)seq, (unsigned)next_seq[producer]);
+            next_seq[producer] = seq + 1;
+            producer_seen[producer] = 1;
+        }
+        log_ring_release();
+        received++;
+    }
+
+    return received;
+}
+
+static void check_single(void)
+{
+    char buf[LOG_RING_MAX_MSG];
+    int seen[1] = {0};
+    uint32_t next_seq[1] = {0};
+
+    // The consumer lags by a varying number of messages, wraps many times
+    uint32_t seq = 0;
+    uint32_t received = 0;
+    for (int round = 0; round < 20000; round++) {
+        const int burst = 1 + round % 23;
+        for (int i = 0; i < burst; i++, seq++) {
+            const uint32_t len = make_message(buf, 0, seq);
+            CHECK(log_ring_write(buf, len), "dropped message %u", (unsigned)seq);
+        }
+        received += drain(seen, next_seq, 1);
+    }
+    CHECK(received == seq, "received %u of %u", (unsigned)received, (unsigned)seq);
+    CHECK(log_ring_empty(), "not empty");
+
+    // Fill without consumer
+    uint32_t written = 0;
+    uint32_t bytes = 0;
+    for (int i = 0; i < 200; i++, seq++) {
+        const uint32_t len = make_message(buf, 0, seq);
+        if (log_ring_write(buf, len)) {
+            written++;
+            bytes += len;
+        }
+    }
+
+    uint32_t dropped, dropped_bytes;
+    log_ring_dropped(&dropped, &dropped_bytes);
+    printf("full ring: %u messages, %u bytes, %u dropped\n",
+            (unsigned)written, (unsigned)bytes, (unsigned)dropped);
+    CHECK(written + dropped == 200, "written %u dropped %u", (unsigned)written, (unsigned)dropped);
+    CHECK(bytes > LOG_RING_LEN * 3 / 4, "ring only holds %u bytes", (unsigned)bytes);
+
+    received = drain(seen, next_seq, 1);
+    CHECK(received == written, "received %u of %u", (unsigned)received, (unsigned)written);
+
+    // Too long and empty messages
+    uint32_t token;
+    CHECK(log_ring_reserve(LOG_RING_MAX_MSG + 1, &token) == NULL, "too long message accepted");
+    CHECK(log_ring_reserve(0, &token) == NULL, "empty message accepted");
+    CHECK(log_ring_empty(), "not empty");
+}
+
+#define PRODUCERS 4
+#define MESSAGES_PER_PRODUCER 20000
+
+static volatile int producers_done = 0;
+// Refused writes, and messages given up after several of them
+static uint32_t refused = 0;
+static uint32_t given_up = 0;
+
+static void *producer_thread(void *arg)
+{
+    const int producer = (int)(intptr_t)arg;
+    char buf[LOG_RING_MAX_MSG];
+
+    for (uint32_t seq = 0; seq < MESSAGES_PER_PRODUCER; seq++) {
+        const uint32_t len = make_message(buf, producer, seq);
+
+        // Let the consumer run when the ring is full, as the DMA does
+        int tries = 0;
+        while (!log_ring_write(buf, len)) {
+            __atomic_fetch_add(&refused, 1, __ATOMIC_RELAXED);
+            if (++tries == 4) {
+                __atomic_fetch_add(&given_up, 1, __ATOMIC_RELAXED);
+                break;
+            }
+            sched_yield();
+        }
+    }
+
+    __atomic_fetch_add(&producers_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void check_concurrent(void)
+{
+    uint32_t dropped_before, dropped_bytes_before;
+    log_ring_dropped(&dropped_before, &dropped_bytes_before);
+
+    int seen[PRODUCERS] = {0};
+    uint32_t next_seq[PRODUCERS] = {0};
+
+    pthread_t threads[PRODUCERS];
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_create(&threads[i], NULL, producer_thread, (void*)(intptr_t)i);
+    }
+
+    uint32_t received = 0;
+    while (__atomic_load_n(&producers_done, __ATOMIC_ACQUIRE) < PRODUCERS) {
+        const uint32_t n = drain(seen, next_seq, PRODUCERS);
+        if (n == 0) {
+            sched_yield();
+        }
+        received += n;
+    }
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    received += drain(seen, next_seq, PRODUCERS);
+
+    uint32_t dropped, dropped_bytes;
+    log_ring_dropped(&dropped, &dropped_bytes);
+    dropped -= dropped_before;
+
+    const uint32_t sent = PRODUCERS * MESSAGES_PER_PRODUCER;
+    printf("%d producers: %u received, %u given up, %u refused writes\n",
+            PRODUCERS, (unsigned)received, (unsigned)given_up, (unsigned)dropped);
+    CHECK(dropped == refused, "counted %u drops for %u refused writes",
+            (unsigned)dropped, (unsigned)refused);
+    CHECK(received + given_up == sent, "lost %d messages", (int)(sent - received - given_up));
+    for (int i = 0; i < PRODUCERS; i++) {
+        CHECK(seen[i], "nothing from producer %d", i);
+    }
+    CHECK(log_ring_empty(), "not empty");
+}
+
+static void benchmark(void)
+{
+    char buf[LOG_RING_MAX_MSG];
+    const int rounds = 20000;
+    const int burst = 40;
+    double write_s = 0;
+
+    for (int round = 0; round < rounds; round++) {
+        const double t0 = now_s();
+        for (int i = 0; i < burst; i++) {
+            log_ring_write(buf, 60);
+        }
+        write_s += now_s() - t0;
+
+        uint32_t len;
+        while (log_ring_peek(&len)) {
+            log_ring_release();
+        }
+    }
+
+    printf("write of 60 bytes: %.1f ns\n", write_s * 1e9 / (rounds * burst));
+}
+
+int main(void)
+{
+    check_single();
+    check_concurrent();
+    benchmark();
+
+    return check_exit();
+}
@@ -0,0 +1,127 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Feed the PPS discipline loop with edges from a drifting clock, and check
+ * the frequency estimate and the holdover error over several days.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "GPS/pps.h"
+#include "Core/common.h"
+#include "check.h"
+
+static uint64_t sim_now_us = 0;
+
+uint64_t timestamp_now_us(void)
+{
+    return sim_now_us;
+}
+
+// Local clock of the simulation: starts at 1000s, runs with drift_ppm
+static double drift_ppm;
+static uint64_t local_us(double true_s)
+{
+    return 1000000000ull + (uint64_t)(true_s * 1e6 * (1.0 + drift_ppm * 1e-6));
+}
+
+static double jitter_us(double amplitude)
+{
+    return amplitude * (2.0 * rand() / RAND_MAX - 1.0);
+}
+
+static int true_second = 0;
+
+static void run_edges(int count, double jitter)
+{
+    for (int i = 0; i < count; i++) {
+        true_second++;
+        const uint64_t edge = local_us(true_second) + (int64_t)jitter_us(jitter);
+        sim_now_us = edge + 5;
+        pps_push_edge(edge);
+    }
+}
+
+int main(void)
+{
+    srand(1750);
+
+    drift_ppm = 12.5;
+    run_edges(600, 2.0);
+
+    int32_t ppb = pps_frequency_error_ppb();
+    printf("drift 12.5 ppm: estimate %d ppb, locked %d\n", (int)ppb, pps_locked());
+    CHECK(pps_locked(), "not locked after 600 edges");
+    CHECK(abs(ppb - 12500) < 100, "frequency estimate %d ppb", (int)ppb);
+
+    // An edge a quarter second late is rejected, one less than half a
+    // second after the previous is ignored
+    sim_now_us = local_us(true_second + 0.25);
+    pps_push_edge(sim_now_us);
+    sim_now_us = local_us(true_second + 1.3);
+    pps_push_edge(sim_now_us);
+    run_edges(1, 2.0);
+    CHECK(pps_locked(), "outliers broke the lock");
+    CHECK(abs(pps_frequency_error_ppb() - 12500) < 100, "outliers moved the frequency");
+
+    // Missed edges
+    true_second += 5;
+    run_edges(60, 2.0);
+    CHECK(pps_locked(), "not locked after missed edges");
+
+    const uint64_t last_edge = local_us(true_second);
+    CHECK(pps_edge_before(last_edge + 300000) != 0, "no edge before a message");
+    CHECK(pps_edge_before(last_edge + 1200000) == 0, "edge too old");
+
+    // Holdover during three days
+    for (int day = 1; day <= 3; day++) {
+        const double true_elapsed_s = day * 86400.0;
+        sim_now_us = local_us(true_second + true_elapsed_s);
+
+        const uint64_t corrected = pps_correct_interval_us(sim_now_us - last_edge);
+        const double error_s = corrected * 1e-6 - true_elapsed_s;
+        const double uncorrected_error_s = (sim_now_us - last_edge) * 1e-6 - true_elapsed_s;
+        const uint32_t uncertainty = pps_holdover_uncertainty_us(sim_now_us);
+
+        printf("holdover %d days: error %.6f s (uncorrected %.3f s), uncertainty %.3f s\n",
+                day, error_s, uncorrected_error_s, uncertainty * 1e-6);
+
+        CHECK(error_s < 0.01 && error_s > -0.01, "holdover error %f s", error_s);
+        CHECK(uncertainty * 1e-6 > error_s && uncertainty * 1e-6 > -error_s,
+                "uncertainty below the error");
+        CHECK(day > 2 || uncertainty < 1000000, "uncertainty above one second");
+    }
+    CHECK(!pps_locked(), "locked without edges");
+
+    // Reacquire after the gap, with a large negative drift
+    drift_ppm = -30.0;
+    true_second += 3 * 86400;
+    run_edges(600, 2.0);
+    ppb = pps_frequency_error_ppb();
+    printf("drift -30 ppm: estimate %d ppb, locked %d\n", (int)ppb, pps_locked());
+    CHECK(pps_locked(), "not locked after reacquisition");
+    CHECK(abs(ppb + 30000) < 100, "frequency estimate %d ppb", (int)ppb);
+
+    return check_exit();
+}
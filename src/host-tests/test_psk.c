@@ -0,0 +1,258 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Check the PSK modulator: BPSK125 as generated before the QPSK modes, the
+ * QPSK phase changes of the convolutional code, and a loopback through a
+ * differential demodulator for every mode.
+ *
+ * With a mode number and a file name as arguments, a text is written there
+ * as 16 kHz WAV audio at 588 Hz, for decoder/pskdemod.py.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+#include "Audio/psk.h"
+#include "Audio/varicode.h"
+#include "Core/common.h"
+#include "check.h"
+
+#define SAMPLERATE 16000
+#define FREQUENCY 588
+#define IDLE_SYMBOLS 20
+
+static const char *text = "HB9G www.glutte.ch HB9G www.glutte.ch\nU min,max= 11V8,13V6\n";
+
+// Varicode bits of the text between idle symbols
+static size_t text_bits(uint8_t *bits, size_t size)
+{
+    size_t n = 0;
+    for (int i = 0; i < IDLE_SYMBOLS && n < size; i++) {
+        bits[n++] = 0;
+    }
+    for (const char *c = text; *c; c++) {
+        n += varicode_encode(*c, bits + n, size - n);
+    }
+    for (int i = 0; i < IDLE_SYMBOLS && n < size; i++) {
+        bits[n++] = 0;
+    }
+    return n;
+}
+
+/* Previous BPSK generator of Audio/cw.c: the amplitude follows a cosine
+ * during a phase reversal.
+ */
+static float ref_nco = 0.0f;
+static int ref_phase = 1;
+static int16_t ref_psk_generate_audio(float omega, uint8_t symbol, int t, int samples_per_symbol)
+{
+    const float base_ampl = 10000.0f;
+    float ampl = base_ampl;
+    if (symbol == 0) {
+        ampl = base_ampl * cosf(FLOAT_PI*(float)t/(float)samples_per_symbol);
+    }
+
+    ref_nco += omega;
+    if (ref_nco > FLOAT_PI) {
+        ref_nco -= 2.0f * FLOAT_PI;
+    }
+
+    return ampl * sinf(ref_nco + (ref_phase == 1 ? 0.0f : FLOAT_PI));
+}
+
+static void check_bpsk_unchanged(const uint8_t *bits, size_t num_bits)
+{
+    const float omega = 2.0f * FLOAT_PI * FREQUENCY / (float)SAMPLERATE;
+    const int sps = SAMPLERATE * 25 / 3125;
+
+    struct psk_modulator m;
+    psk_init(&m, PSK_BPSK125, omega, SAMPLERATE);
+    CHECK(m.samples_per_symbol == sps, "PSK125 samples per symbol %d", m.samples_per_symbol);
+
+    int max_error = 0;
+    for (size_t i = 0; i < num_bits; i++) {
+        psk_symbol(&m, bits[i]);
+        for (int t = 0; t < sps; t++) {
+            const int error = abs(psk_sample(&m, t) -
+                    ref_psk_generate_audio(omega, bits[i], t, sps));
+            if (error > max_error) {
+                max_error = error;
+            }
+        }
+        if (bits[i] == 0) {
+            ref_phase *= -1;
+        }
+    }
+    CHECK(max_error <= 2, "BPSK125 differs from the previous generator by %d", max_error);
+}
+
+/* QPSK of fldigi: the encoder gives sym = parity(0x17) | parity(0x19) << 1,
+ * inverted to (4 - sym) & 3, which selects a change of 180, 270, 0 or 90
+ * degrees.
+ */
+static void check_qpsk_phases(const uint8_t *bits, size_t num_bits)
+{
+    static const int fldigi_quarter_turns[4] = {2, 3, 0, 1};
+
+    struct psk_modulator m;
+    psk_init(&m, PSK_QPSK63, 0.1f, SAMPLERATE);
+
+    unsigned shreg = 0;
+    int wrong = 0;
+    for (size_t i = 0; i < num_bits; i++) {
+        shreg = (shreg << 1) | bits[i];
+        int sym = __builtin_parity(shreg & 0x17) | (__builtin_parity(shreg & 0x19) << 1);
+        sym = (4 - sym) & 3;
+
+        psk_symbol(&m, bits[i]);
+        if (((m.phase_to - m.phase_from) & 3) != fldigi_quarter_turns[sym]) {
+            wrong++;
+        }
+    }
+    CHECK(wrong == 0, "%d QPSK phase changes differ from fldigi", wrong);
+
+    // Idle is a reversal at every symbol, like BPSK
+    for (int i = 0; i < IDLE_SYMBOLS; i++) {
+        psk_symbol(&m, 0);
+    }
+    psk_symbol(&m, 0);
+    CHECK(((m.phase_to - m.phase_from) & 3) == 2, "QPSK idle is not a reversal");
+}
+
+/* Mix down with the carrier, integrate the last quarter of every symbol and
+ * compare the phase changes with the ones of the modulator. The carrier is
+ * high enough for PSK500 to stay clear of 0 Hz.
+ */
+static void check_loopback(int mode, const uint8_t *bits, size_t num_bits)
+{
+    const float omega = 2.0f * FLOAT_PI * 1500 / (float)SAMPLERATE;
+    struct psk_modulator m;
+    psk_init(&m, mode, omega, SAMPLERATE);
+
+    const int sps = m.samples_per_symbol;
+    CHECK(sps * psk_mode_baud_x100(mode) == SAMPLERATE * 100,
+            "%s: %d samples per symbol", psk_mode_name(mode), sps);
+
+    float complex previous = 0;
+    float phase = 0.0f;
+    int wrong = 0;
+    for (size_t i = 0; i < num_bits; i++) {
+        psk_symbol(&m, bits[i]);
+
+        float complex z = 0;
+        for (int t = 0; t < sps; t++) {
+            const int16_t s = psk_sample(&m, t);
+            // Same rounding as the modulator
+            phase += omega;
+            if (phase > FLOAT_PI) {
+                phase -= 2.0f * FLOAT_PI;
+            }
+            if (t >= 3 * sps / 4) {
+                z += s * cexpf(-I * phase);
+            }
+        }
+
+        if (i > 0) {
+            // The carrier phase is delayed, z turns the other way
+            const float complex d = z * conjf(previous);
+            const int quarter_turns = (int)lroundf(-cargf(d) / (FLOAT_PI / 2)) & 3;
+            if (quarter_turns != ((m.phase_to - m.phase_from) & 3)) {
+                wrong++;
+            }
+        }
+        previous = z;
+    }
+
+    printf("%-8s %3d samples per symbol, %d symbols in %.2f s\n",
+            psk_mode_name(mode), sps, (int)num_bits,
+            num_bits * 100.0 / psk_mode_baud_x100(mode));
+    CHECK(wrong == 0, "%s: %d wrong phase changes", psk_mode_name(mode), wrong);
+}
+
+static void put_le(FILE *f, uint32_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        fputc((value >> (8 * i)) & 0xFF, f);
+    }
+}
+
+static void write_wav(const char *path, int mode, const uint8_t *bits, size_t num_bits)
+{
+    const float omega = 2.0f * FLOAT_PI * FREQUENCY / (float)SAMPLERATE;
+    struct psk_modulator m;
+    psk_init(&m, mode, omega, SAMPLERATE);
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        CHECK(0, "cannot open %s", path);
+        return;
+    }
+
+    const uint32_t data_len = num_bits * m.samples_per_symbol * 2;
+    fputs("RIFF", f);
+    put_le(f, 36 + data_len, 4);
+    fputs("WAVEfmt ", f);
+    put_le(f, 16, 4);
+    put_le(f, 1, 2);
+    put_le(f, 1, 2);
+    put_le(f, SAMPLERATE, 4);
+    put_le(f, 2 * SAMPLERATE, 4);
+    put_le(f, 2, 2);
+    put_le(f, 16, 2);
+    fputs("data", f);
+    put_le(f, data_len, 4);
+
+    for (size_t i = 0; i < num_bits; i++) {
+        psk_symbol(&m, bits[i]);
+        for (int t = 0; t < m.samples_per_symbol; t++) {
+            put_le(f, (uint16_t)psk_sample(&m, t), 2);
+        }
+    }
+    fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t bits[4096];
+    const size_t num_bits = text_bits(bits, sizeof(bits));
+
+    check_bpsk_unchanged(bits, num_bits);
+    check_qpsk_phases(bits, num_bits);
+
+    const int modes[] = {PSK_BPSK31, PSK_BPSK63, PSK_BPSK125, PSK_BPSK250, PSK_BPSK500,
+        PSK_QPSK31, PSK_QPSK63, PSK_QPSK125};
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        CHECK(psk_mode_valid(modes[i]), "mode %d", modes[i]);
+        check_loopback(modes[i], bits, num_bits);
+    }
+    CHECK(!psk_mode_valid(0) && !psk_mode_valid(-9) && !psk_mode_valid(50), "invalid modes");
+
+    if (argc > 2) {
+        write_wav(argv[2], -atoi(argv[1]), bits, num_bits);
+    }
+
+    return check_exit();
+}
@@ -0,0 +1,310 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Simulate the battery of the repeater over several days, and compare the
+ * state of charge estimator against the reactive capacity thresholds.
+ *
+ * A recorded battery log can be replayed instead, one line per sample:
+ *   seconds,capacity_mah,voltage_mv,temp_centidegrees,tx_on_ms
+ * The capacity does not react to the decisions then, the forecasts are
+ * compared with the time the capacity actually crossed CHARGE_QRP.
+ *   test_soc battery.csv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "Core/soc.h"
+#include "GPIO/batterycharge.h"
+#include "GPIO/analog.h"
+#include "check.h"
+
+#define SAMPLE_S 20
+
+static double random_uniform(void)
+{
+    return (double)rand() / RAND_MAX;
+}
+
+static struct soc_input input(uint64_t t_s, double capacity, double temp, double tx_on_ms)
+{
+    struct soc_input in;
+    in.now_ms = t_s * 1000;
+    in.capacity_mah = capacity;
+    in.breaker_open = 0;
+    in.voltage = capacity ? 11.8f + capacity / 1650000.0 : 0.0f;
+    in.temp_valid = 1;
+    in.temp = temp;
+    in.tx_on_ms = tx_on_ms;
+    return in;
+}
+
+// Constant discharge: the fit must find both rates, and the forecast the
+// crossing time
+static void check_forecast(void)
+{
+    const double base_rate = -5000.0;
+    const double tx_rate = -20000.0;
+
+    soc_init();
+    double capacity = 1400000.0;
+    double tx_on_ms = 0.0;
+    double duty = 0.0;
+
+    struct soc_estimate e = {0};
+    for (uint64_t t = 0; t <= 5 * 3600; t += SAMPLE_S) {
+        if (t % SOC_STEP_S == 0) {
+            duty = 0.3 * random_uniform();
+        }
+        struct soc_input in = input(t, capacity, 15.0, tx_on_ms);
+        soc_update(&in);
+
+        capacity += (base_rate + duty * tx_rate) * SAMPLE_S / 3600.0;
+        tx_on_ms += duty * SAMPLE_S * 1000.0;
+    }
+    soc_get_estimate(&e);
+
+    // Average duty 15%
+    const double rate = base_rate + 0.15 * tx_rate;
+    const double expected_min = (capacity - CHARGE_QRP) / -rate * 60.0;
+
+    printf("fit base %d tx %d mAh/h, duty %d%%, QRP in %d min, expected %d min\n",
+            (int)e.base_rate_mah_h, (int)e.tx_rate_mah_h, (int)e.duty_percent,
+            (int)e.minutes_to_qrp, (int)expected_min);
+
+    CHECK(fabs(e.base_rate_mah_h - base_rate) < 500, "base rate %d", (int)e.base_rate_mah_h);
+    CHECK(fabs(e.tx_rate_mah_h - tx_rate) < 3000, "tx rate %d", (int)e.tx_rate_mah_h);
+    CHECK(fabs(e.minutes_to_qrp - expected_min) < 0.15 * expected_min + 10,
+            "forecast %d min instead of %d", (int)e.minutes_to_qrp, (int)expected_min);
+}
+
+static void check_inputs(void)
+{
+    struct soc_input in = input(0, 0, 15.0, 0);
+
+    soc_init();
+    CHECK(soc_update(&in) == -1, "decision without capacity");
+    in.breaker_open = 1;
+    CHECK(soc_update(&in) == 1, "QRO with the breaker open");
+
+    in = input(10, 1500000, 15.0, 0);
+    CHECK(soc_update(&in) == 0, "QRP with a full battery");
+
+    // The voltage overrides the capacity of a drifted counter
+    for (int i = 0; i < 60; i++) {
+        in.now_ms += 1000;
+        in.voltage = 11.9f;
+        soc_update(&in);
+    }
+    CHECK(soc_update(&in) == 1, "QRO below SUPPLY_QRP");
+    for (int i = 0; i < 60; i++) {
+        in.now_ms += 1000;
+        in.voltage = 12.8f;
+        soc_update(&in);
+    }
+    CHECK(soc_update(&in) == 0, "QRP above SUPPLY_QRO");
+
+    // The cold reduces the usable capacity
+    in = input(2000, CHARGE_QRP + 20000, -5.0, 0);
+    CHECK(soc_update(&in) == 1, "QRO at -5C just above CHARGE_QRP");
+}
+
+struct sim_result {
+    int switches;
+    // Minutes with the usable capacity below CHARGE_QRP while in QRO
+    int deficit_min;
+    // Minutes in QRP
+    int qrp_min;
+    // Time of the first QRP, in hours
+    double first_qrp_h;
+};
+
+/* Three days of wind during the day, a night colder than the others, and
+ * a transmitter which uses less in QRP.
+ */
+#define SIM_DAYS 4
+
+static double sim_temp(double hours)
+{
+    const double h = fmod(hours, 24.0);
+    double t = 8.0 + 7.0 * cos(2.0 * M_PI * (h - 15.0) / 24.0);
+    // The second night is cold
+    if (hours > 36.0 && hours < 60.0) {
+        t -= 10.0 * sin(M_PI * (hours - 36.0) / 24.0);
+    }
+    return t;
+}
+
+static struct sim_result simulate(int predictive)
+{
+    struct sim_result r = {0};
+    double capacity = 1390000.0;
+    double tx_on_ms = 0.0;
+    int qrp = 0;
+    int reactive_qrp = 0;
+    double duty = 0.0;
+
+    srand(1750);
+    soc_init();
+    r.first_qrp_h = -1.0;
+
+    for (uint64_t t = 0; t < SIM_DAYS * 86400; t += SAMPLE_S) {
+        const double hours = t / 3600.0;
+        const double h = fmod(hours, 24.0);
+        const double temp = sim_temp(hours);
+
+        if (t % 300 == 0) {
+            duty = (h > 7 && h < 22 ? 0.25 : 0.05) * random_uniform();
+        }
+
+        struct soc_input in = input(t, capacity, temp, tx_on_ms);
+        const int soc_qrp = soc_update(&in);
+
+        // batterycharge_too_low()
+        if (reactive_qrp == 0 && capacity < CHARGE_QRP) {
+            reactive_qrp = 1;
+        }
+        else if (reactive_qrp == 1 && capacity >= CHARGE_QRO) {
+            reactive_qrp = 0;
+        }
+
+        const int new_qrp = predictive ? soc_qrp : reactive_qrp;
+        if (new_qrp != qrp) {
+            r.switches++;
+            if (new_qrp && r.first_qrp_h < 0.0) {
+                r.first_qrp_h = hours;
+            }
+        }
+        qrp = new_qrp;
+
+        double usable = capacity;
+        if (temp < SOC_DERATE_BELOW_C) {
+            usable -= (SOC_DERATE_BELOW_C - temp) * SOC_DERATE_MAH_PER_C;
+        }
+        if (!qrp && usable < CHARGE_QRP) {
+            r.deficit_min += SAMPLE_S;
+        }
+        if (qrp) {
+            r.qrp_min += SAMPLE_S;
+        }
+
+        const double wind = (h > 9 && h < 17) ? 16000.0 : 0.0;
+        const double tx_rate = qrp ? -8000.0 : -25000.0;
+        capacity += (wind - 4000.0 + duty * tx_rate) * SAMPLE_S / 3600.0;
+        tx_on_ms += duty * SAMPLE_S * 1000.0;
+    }
+
+    r.deficit_min /= 60;
+    r.qrp_min /= 60;
+    return r;
+}
+
+static void check_simulation(void)
+{
+    const struct sim_result reactive = simulate(0);
+    const struct sim_result predictive = simulate(1);
+
+    printf("reactive:   first QRP after %5.1fh, %3d switches, %5d min QRP, "
+            "%5d min below the usable threshold in QRO\n",
+            reactive.first_qrp_h, reactive.switches, reactive.qrp_min, reactive.deficit_min);
+    printf("predictive: first QRP after %5.1fh, %3d switches, %5d min QRP, "
+            "%5d min below the usable threshold in QRO\n",
+            predictive.first_qrp_h, predictive.switches, predictive.qrp_min, predictive.deficit_min);
+
+    CHECK(predictive.deficit_min * 4 < reactive.deficit_min,
+            "predictive not better than reactive");
+    CHECK(predictive.first_qrp_h >= 0.0 && predictive.first_qrp_h < reactive.first_qrp_h,
+            "predictive QRP not earlier");
+    CHECK(predictive.switches <= 3 * SIM_DAYS, "%d switches", predictive.switches);
+}
+
+static void replay(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+
+    soc_init();
+
+    unsigned long seconds, capacity, tx_on_ms;
+    long voltage_mv, temp_cdeg;
+    int forecasts = 0;
+    int pending = 0;
+    unsigned long forecast_at = 0, forecast_s = 0;
+    while (fscanf(f, "%lu,%lu,%ld,%ld,%lu", &seconds, &capacity,
+                &voltage_mv, &temp_cdeg, &tx_on_ms) == 5) {
+        struct soc_input in;
+        in.now_ms = seconds * 1000ull;
+        in.capacity_mah = capacity;
+        in.breaker_open = -1;
+        in.voltage = voltage_mv / 1000.0f;
+        in.temp_valid = 1;
+        in.temp = temp_cdeg / 100.0f;
+        in.tx_on_ms = tx_on_ms;
+        const int qrp = soc_update(&in);
+
+        struct soc_estimate e;
+        soc_get_estimate(&e);
+        if (!pending && e.minutes_to_qrp > 0) {
+            pending = 1;
+            forecast_at = seconds;
+            forecast_s = e.minutes_to_qrp * 60;
+        }
+        else if (pending && capacity < CHARGE_QRP) {
+            printf("%lu: forecast %lu min, reached after %lu min\n", forecast_at,
+                    forecast_s / 60, (seconds - forecast_at) / 60);
+            forecasts++;
+            pending = 0;
+        }
+        else if (pending && e.minutes_to_qrp < 0) {
+            pending = 0;
+        }
+
+        static int last_qrp = -2;
+        if (qrp != last_qrp) {
+            printf("%lu: QRP %d capacity %lu usable %d\n", seconds, qrp, capacity, (int)e.usable_mah);
+            last_qrp = qrp;
+        }
+    }
+    fclose(f);
+    printf("%d forecasts verified\n", forecasts);
+}
+
+int main(int argc, char **argv)
+{
+    srand(1750);
+
+    if (argc > 1) {
+        replay(argv[1]);
+        return 0;
+    }
+
+    check_forecast();
+    check_inputs();
+    check_simulation();
+
+    return check_exit();
+}
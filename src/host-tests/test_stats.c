@@ -0,0 +1,268 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Pull the statistics report in pieces of different sizes, and check that
+ * it is complete and identical, and that every report starts afresh.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Core/stats.h"
+#include "Core/energy.h"
+#include "Core/store.h"
+#include "Core/common.h"
+#include "vc.h"
+#include "check.h"
+
+static uint64_t sim_now_ms = 0;
+
+uint64_t timestamp_now(void)
+{
+    return sim_now_ms;
+}
+
+// Without a fix, the time is derived from the last one
+static int gps_fix = 1;
+
+int local_derived_time(struct tm *time)
+{
+    memset(time, 0, sizeof(*time));
+    time->tm_year = 2020 - 1900;
+    time->tm_mon = 10;
+    time->tm_mday = 3;
+    time->tm_hour = 22;
+    return 1;
+}
+
+int local_time(struct tm *time)
+{
+    local_derived_time(time);
+    return gps_fix;
+}
+
+const char* vc_get_version(void)
+{
+    return "v1.2.3-45-gdeadbeef";
+}
+
+int store_write(uint8_t __attribute__((unused)) key,
+        const void __attribute__((unused)) *data, uint32_t __attribute__((unused)) len)
+{
+    return 1;
+}
+
+int store_read(uint8_t __attribute__((unused)) key,
+        void __attribute__((unused)) *data, uint32_t __attribute__((unused)) len)
+{
+    return -1;
+}
+
+#define REPORT_MAX 4096
+static char report[REPORT_MAX];
+
+/* Statistics of a busy day, every hour known. The channel activity of a
+ * day continues that of the previous one.
+ */
+static void feed_day(void)
+{
+    if (sim_now_ms == 0) {
+        sim_now_ms = 3ull * 24 * 3600 * 1000 + 5 * 3600 * 1000 + 7 * 60 * 1000;
+    }
+    else {
+        sim_now_ms += 60000;
+    }
+
+    for (int h = 0; h < 24; h++) {
+        stats_battery_at_full_hour(h, 12.0f + h * 0.05f, 123456 + h * 1000);
+    }
+    stats_voltage(11.84f);
+    stats_voltage(13.61f);
+    stats_temp(-5.25f);
+    stats_temp(21.0f);
+    stats_qrp(1);
+    stats_qrp(0);
+    stats_qrp(0);
+    stats_qrp(0);
+    stats_beacon_sent();
+    stats_beacon_energy(625);
+    stats_beacon_energy(150);
+    stats_anti_bavard_triggered();
+    stats_num_gnss_sv(9);
+
+    stats_tx_switched(1);
+    sim_now_ms += 125000;
+    stats_tx_switched(0);
+
+    // Two openings with a 1750 detection, as far apart as the last one of
+    // the previous day
+    stats_channel_sample(1, 0, 5);
+    sim_now_ms += 400;
+    stats_channel_sample(1, 1, 5);
+    sim_now_ms += 7600;
+    stats_channel_sample(0, 0, 5);
+    sim_now_ms += 185000;
+    stats_channel_sample(1, 0, 5);
+    sim_now_ms += 4000;
+    stats_channel_sample(0, 0, 5);
+
+    // A beacon, QSO in QRO and QRP, and two hours idle while the battery
+    // discharges
+    const struct {
+        fsm_state_t state;
+        int tx_on;
+        int qrp;
+        int seconds;
+    } activity[] = {
+        {FSM_BALISE_LONGUE, 1, 0, 60},
+        {FSM_QSO, 1, 0, 600},
+        {FSM_QSO, 1, 1, 240},
+        {FSM_OISIF, 0, 0, 7200},
+    };
+    // The energy is accounted with its own clock
+    static uint64_t energy_ms = 1000;
+    for (size_t i = 0; i < sizeof(activity)/sizeof(activity[0]); i++) {
+        if (activity[i].state == FSM_OISIF) {
+            energy_capacity(100000, 0, 12.5f);
+        }
+        for (int s = 0; s < activity[i].seconds; s++) {
+            energy_account(energy_ms, activity[i].state, activity[i].tx_on, activity[i].qrp);
+            energy_ms += 1000;
+        }
+    }
+    energy_account(energy_ms, FSM_OISIF, 0, 0);
+    energy_capacity(99520, 0, 12.5f);
+}
+
+static size_t pull_report(size_t chunk)
+{
+    size_t len = 0;
+    size_t n;
+    stats_report_begin(0);
+    while ((n = stats_report_read(report + len, chunk)) > 0) {
+        CHECK(n <= chunk, "read %d characters for %d", (int)n, (int)chunk);
+        len += n;
+        if (len + chunk >= REPORT_MAX) {
+            printf("FAIL: report too long\n");
+            failures++;
+            break;
+        }
+    }
+    report[len] = '\0';
+    // Like the FSM once the report is sent
+    stats_report_sent();
+    return len;
+}
+
+// Remove the uptime line, which changes from one report to the next
+static void remove_uptime(char *text)
+{
+    char *line = strstr(text, "Uptime=");
+    if (line) {
+        const char *end = strchr(line, '\n');
+        memmove(line, end + 1, strlen(end + 1) + 1);
+    }
+}
+
+static void check_contains(const char *expected)
+{
+    CHECK(strstr(report, expected) != NULL, "report without \"%s\"", expected);
+}
+
+int main(void)
+{
+    static char first[REPORT_MAX];
+
+    feed_day();
+    const size_t first_len = pull_report(1);
+    strcpy(first, report);
+    printf("%s", first);
+    remove_uptime(first);
+    printf("report of %d characters\n", (int)first_len);
+
+    CHECK(strncmp(report, "HB9G www.glutte.ch HB9G www.glutte.ch\n", 38) == 0, "header");
+    check_contains("Statistiques du 2020-11-03\n");
+    check_contains("Version= v1.2.3-45-gdeadbeef\nUptime= 3j5h");
+    check_contains("U min,max= 11V8,13V6\n");
+    check_contains("Temps QRP= 25%\n");
+    check_contains("U heures pleines=  12V0 12V0 12V1");
+    check_contains(" 13V1\nCapa heures pleines=  123 124 125");
+    check_contains("Temp min,max= -5C2,21C0\n");
+    check_contains("Energie par balise moy,max= 387,625mWh\n");
+    check_contains("Energie balises,QSO,repos= 1,14,6Wh\n");
+    check_contains("Energie en QRP= 2Wh\n");
+    check_contains("Energie mesuree,estimee= 6,6Wh\n");
+    check_contains("Nbre de TX ON/OFF= 2\n");
+    check_contains("QSO le plus long= 0h2m5s\n");
+    check_contains("Sat GPS= 9\n");
+    check_contains("QSO p50,p90= 122s,122s\n");
+    check_contains("SQ ouvert p50,p90= 3s,7s\n");
+    check_contains("SQ pause p50,p90= 180s,180s\n");
+    check_contains("Latence 1750 p50,p90= 400ms,400ms\n");
+    CHECK(first_len > 25 && strcmp(report + first_len - 25, "Disjoncteur eolienne= On\n") == 0,
+            "report does not end with the breaker");
+
+    // The same statistics in other pieces give the same text
+    const size_t chunks[] = {7, 16, 1000};
+    for (size_t i = 0; i < sizeof(chunks)/sizeof(chunks[0]); i++) {
+        feed_day();
+        pull_report(chunks[i]);
+        remove_uptime(report);
+        CHECK(strcmp(first, report) == 0, "report differs in pieces of %d", (int)chunks[i]);
+    }
+
+    /* Without a fix the date is derived, and values that change while the
+     * report is sent do not appear in it.
+     */
+    feed_day();
+    gps_fix = 0;
+    stats_report_begin(0);
+    size_t len = stats_report_read(report, 16);
+    stats_voltage(5.0f);
+    stats_battery_at_full_hour(0, 5.0f, 999000);
+    size_t n;
+    while ((n = stats_report_read(report + len, 16)) > 0 && len + 16 < REPORT_MAX) {
+        len += n;
+    }
+    report[len] = '\0';
+    stats_report_sent();
+    gps_fix = 1;
+    check_contains("Statistiques du 2020-11-03\n");
+    check_contains("U min,max= 11V8,13V6\n");
+    check_contains("U heures pleines=  12V0 12V0 12V1");
+    check_contains("Capa heures pleines=  123 124 125");
+
+    // Without new values the report starts afresh, and says we are alive
+    const size_t alive_len = pull_report(16);
+    printf("%s", report);
+    CHECK(strncmp(report, "HB9G www.glutte.ch", 18) == 0, "second report header");
+    CHECK(strstr(report, "U min") == NULL, "second report has old values");
+    CHECK(alive_len < 120, "second report of %d characters", (int)alive_len);
+
+    // Reading past the end gives nothing
+    char c;
+    CHECK(stats_report_read(&c, 1) == 0, "read after the end");
+
+    return check_exit();
+}
@@ -0,0 +1,260 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Exercise the flash store over the file-backed flash of the simulator:
+ * recovery at boot, wear levelling, write amplification, and a power cut
+ * at every word of a sequence of writes that includes compactions.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "Core/store.h"
+#include "Core/flash.h"
+#include "src/Core/flash_sim.h"
+#include "check.h"
+
+// About the size of the statistics
+#define RECORD_LEN 252
+
+struct record {
+    uint32_t value;
+    uint8_t fill[RECORD_LEN - 4];
+};
+
+static void make_record(struct record *r, uint32_t value)
+{
+    r->value = value;
+    for (size_t i = 0; i < sizeof(r->fill); i++) {
+        r->fill[i] = value + i;
+    }
+}
+
+// Return the value of the record of the key, -1 if absent, -2 if wrong
+static int64_t read_value(uint8_t key)
+{
+    struct record r;
+    const int len = store_read(key, &r, sizeof(r));
+    if (len == -1) {
+        return -1;
+    }
+
+    struct record expected;
+    make_record(&expected, r.value);
+    if (len != sizeof(r) || memcmp(&r, &expected, sizeof(r)) != 0) {
+        return -2;
+    }
+    return r.value;
+}
+
+static int write_value(uint8_t key, uint32_t value)
+{
+    struct record r;
+    make_record(&r, value);
+    return store_write(key, &r, sizeof(r));
+}
+
+static char image_path[] = "/tmp/test_store_XXXXXX";
+static char base_path[] = "/tmp/test_store_base_XXXXXX";
+
+static void copy_file(const char *from, const char *to)
+{
+    static uint8_t buf[FLASH_STORE_SECTORS * FLASH_STORE_SECTOR_LEN];
+    FILE *f = fopen(from, "rb");
+    const size_t len = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+    f = fopen(to, "wb");
+    fwrite(buf, 1, len, f);
+    fclose(f);
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void check_basic(void)
+{
+    flash_sim_open(image_path);
+    CHECK(store_init(), "init of a blank image");
+    CHECK(read_value(STORE_KEY_STATS) == -1, "record in a blank store");
+    CHECK(store_write(STORE_MAX_KEYS, "x", 1) == 0, "invalid key accepted");
+
+    CHECK(write_value(5, 10) && write_value(6, 20) && write_value(5, 11), "write");
+    CHECK(read_value(5) == 11 && read_value(6) == 20, "read back");
+
+    // Reboot
+    flash_sim_open(image_path);
+    CHECK(store_init(), "init after reboot");
+    CHECK(read_value(5) == 11 && read_value(6) == 20, "read after reboot");
+    CHECK(read_value(3) == -1, "unwritten key");
+
+    // A short record of the same key, and an empty one
+    CHECK(store_write(3, "abc", 3), "short record");
+    char buf[4] = {0};
+    CHECK(store_read(3, buf, sizeof(buf)) == 3 && memcmp(buf, "abc", 3) == 0, "short read");
+    CHECK(store_write(4, NULL, 0) && store_read(4, buf, sizeof(buf)) == 0, "empty record");
+}
+
+// One year of statistics every 15 minutes
+static void check_wear(void)
+{
+    const int writes = 365 * 96;
+    const uint32_t programmed_before = flash_sim_programmed_words();
+
+    for (int i = 0; i < writes; i++) {
+        if (!write_value(STORE_KEY_STATS, i)) {
+            CHECK(0, "write %d failed", i);
+            break;
+        }
+    }
+
+    struct store_stats stats;
+    store_get_stats(&stats);
+    const uint32_t e0 = flash_sim_erase_count(0);
+    const uint32_t e1 = flash_sim_erase_count(1);
+    const double amplification = (flash_sim_programmed_words() - programmed_before) * 4.0 /
+        ((double)writes * RECORD_LEN);
+
+    printf("one year: %u compactions, erases %u and %u, %.3f bytes written per byte\n",
+            (unsigned)stats.compactions, (unsigned)e0, (unsigned)e1, amplification);
+
+    CHECK(read_value(STORE_KEY_STATS) == writes - 1, "latest after a year");
+    CHECK(read_value(5) == 11 && read_value(6) == 20, "other keys lost in compactions");
+    CHECK(e0 - e1 + 1 <= 2, "unequal wear");
+    CHECK(amplification < 1.1, "write amplification %.3f", amplification);
+    // 10000 cycles guaranteed by the datasheet
+    CHECK(e0 < 10000 / 20, "%u erases per year", (unsigned)e0);
+
+    // Boot on a full sector
+    const int boots = 200;
+    const double t0 = now_s();
+    for (int i = 0; i < boots; i++) {
+        store_init();
+    }
+    printf("boot: %.1f us\n", (now_s() - t0) * 1e6 / boots);
+    CHECK(read_value(STORE_KEY_STATS) == writes - 1, "latest after boot");
+}
+
+/* From the same state, cut the power after a number of programmed words,
+ * during a sequence of writes long enough to compact twice. Every word of
+ * the first writes is tried, then a stride prime to the record length
+ * places the cuts at all positions within the records.
+ */
+#define CUT_ALL_WORDS 400
+#define CUT_STRIDE 11
+static void check_power_cuts(void)
+{
+    flash_sim_cut_after(-1);
+    flash_sim_open(image_path);
+    store_init();
+    const int64_t first = read_value(STORE_KEY_STATS);
+    copy_file(image_path, base_path);
+
+    struct store_stats stats;
+    store_get_stats(&stats);
+    const uint32_t free_words = FLASH_STORE_SECTOR_WORDS - stats.used_words;
+    // Enough writes to fill the sector and compact twice
+    const int writes = free_words / (RECORD_LEN / 4 + 2) + 2 * FLASH_STORE_SECTOR_WORDS / (RECORD_LEN / 4 + 2);
+
+    int cuts = 0;
+    int lost = 0;
+    for (int32_t cut = 0; ; cut += cut < CUT_ALL_WORDS ? 1 : CUT_STRIDE) {
+        copy_file(base_path, image_path);
+        flash_sim_open(image_path);
+        store_init();
+
+        flash_sim_cut_after(cut);
+        int acknowledged = 0;
+        int i;
+        for (i = 0; i < writes; i++) {
+            if (!write_value(STORE_KEY_STATS, first + 1 + i)) {
+                break;
+            }
+            acknowledged = i + 1;
+        }
+        flash_sim_cut_after(-1);
+
+        if (i == writes) {
+            break;
+        }
+        cuts++;
+
+        flash_sim_open(image_path);
+        if (!store_init()) {
+            CHECK(0, "cut %d: store unusable", (int)cut);
+            continue;
+        }
+
+        const int64_t v = read_value(STORE_KEY_STATS);
+        const int64_t last = first + acknowledged;
+        if (v != last && v != last + 1) {
+            CHECK(0, "cut %d: value %d after %d acknowledged writes", (int)cut, (int)v, acknowledged);
+            continue;
+        }
+        if (read_value(5) != 11 || read_value(6) != 20) {
+            CHECK(0, "cut %d: other keys lost", (int)cut);
+        }
+        if (v == last + 1) {
+            lost++;
+        }
+
+        // Still writable after the cut
+        if (!write_value(STORE_KEY_STATS, 1000000) || read_value(STORE_KEY_STATS) != 1000000) {
+            CHECK(0, "cut %d: not writable", (int)cut);
+        }
+        flash_sim_open(image_path);
+        store_init();
+        if (read_value(STORE_KEY_STATS) != 1000000) {
+            CHECK(0, "cut %d: write after the cut lost", (int)cut);
+        }
+    }
+
+    printf("%d power cuts during %d writes, %d writes completed despite the cut\n",
+            cuts, writes, lost);
+}
+
+int main(void)
+{
+    srand(1750);
+
+    const int fd_image = mkstemp(image_path);
+    const int fd_base = mkstemp(base_path);
+    close(fd_image);
+    close(fd_base);
+    unlink(image_path);
+
+    check_basic();
+    check_wear();
+    check_power_cuts();
+
+    unlink(image_path);
+    unlink(base_path);
+
+    return check_exit();
+}
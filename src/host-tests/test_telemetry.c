@@ -0,0 +1,332 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Pack and encode a telemetry frame, decode it with a Viterbi decoder after
+ * adding errors, and compare its airtime with the text report.
+ *
+ * With a file name as argument, the symbols of a frame with errors are
+ * written there one per byte, like the psk125.bit that decoder/telemdecode.py
+ * reads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Core/telemetry.h"
+#include "Core/histogram.h"
+#include "Core/crc.h"
+#include "Audio/varicode.h"
+#include "check.h"
+
+// Text report of test_stats, for the same day as sample_report()
+static const char *report_text =
+    "HB9G www.glutte.ch HB9G www.glutte.ch\n"
+    "Statistiques du 2020-11-03\n"
+    "Version= v1.2.3-45-gdeadbeef\n"
+    "Uptime= 3j5h12m\n"
+    "U min,max= 11V8,13V6\n"
+    "Temps QRP= 25%\n"
+    "U heures pleines=  12V0 12V0 12V1 12V1 12V2 12V2 12V3 12V3 12V4 12V4 12V5 12V5"
+    " 12V6 12V6 12V7 12V7 12V8 12V8 12V9 12V9 13V0 13V0 13V1 13V1\n"
+    "Capa heures pleines=  123 124 125 126 127 128 129 130 131 132 133 134 135 136"
+    " 137 138 139 140 141 142 143 144 145 146\n"
+    "Nbre de commutations eolienne= 0\n"
+    "Temp min,max= -5C2,21C0\n"
+    "Nbre de balises= 1\n"
+    "Nbre de TX ON/OFF= 2\n"
+    "Nbre anti-bavard= 1\n"
+    "QSO le plus long= 0h2m5s\n"
+    "Sat GPS= 9\n"
+    "QSO p50,p90= 122s,122s\n"
+    "SQ ouvert p50,p90= 3s,7s\n"
+    "SQ pause p50,p90= 180s,180s\n"
+    "Latence 1750 p50,p90= 400ms,400ms\n"
+    "Disjoncteur eolienne= On\n";
+
+// Idle symbols sent by the PSK generator before and after every message
+#define PSK_IDLE_SYMBOLS 40
+
+static void sample_report(struct telemetry_report *r)
+{
+    memset(r, 0, sizeof(*r));
+    r->date = 7612; // 2020-11-03
+    r->uptime_s = (3 * 24 + 5) * 3600 + 12 * 60;
+    r->values_valid = 1;
+    r->voltage_min = 118;
+    r->voltage_max = 136;
+    for (int hour = 0; hour < 24; hour++) {
+        r->voltage_hourly[hour] = 120 + hour / 2;
+        r->capacity_hourly[hour] = 123 + hour;
+    }
+    r->temp_valid = 1;
+    r->temp_min = -52;
+    r->temp_max = 210;
+    r->qrp_percent = 25;
+    r->beacons = 1;
+    r->tx_switch = 2;
+    r->antibavard = 1;
+    r->sv_used = 9;
+    r->max_qso_s = 125;
+    const int32_t percentiles[TELEMETRY_PERCENTILES] = {
+        122000, 122000, 3000, 7000, 180000, 180000, 400, 400, -1, -1};
+    memcpy(r->percentiles, percentiles, sizeof(percentiles));
+}
+
+static int get_symbol(const uint8_t *symbols, int index)
+{
+    return (symbols[index / 8] >> (7 - index % 8)) & 1;
+}
+
+// Hourly series as decoded by telemdecode.py, -1 for missing values
+static void unpack_hourly(int32_t reference, const uint8_t *nibbles, int32_t *values)
+{
+    int32_t previous = reference;
+    for (int hour = 0; hour < 24; hour++) {
+        int delta = (hour % 2 == 0) ? nibbles[hour / 2] >> 4 : nibbles[hour / 2] & 0x0F;
+        if (delta >= 8) {
+            delta -= 16;
+        }
+
+        if (delta == -8) {
+            values[hour] = -1;
+        }
+        else {
+            previous += delta;
+            values[hour] = previous;
+        }
+    }
+}
+
+#define INFO_BITS (8 * TELEMETRY_FRAME_LEN + TELEMETRY_CONSTRAINT - 1)
+#define NUM_STATES (1 << (TELEMETRY_CONSTRAINT - 1))
+
+/* Deinterleave and decode the symbols after the sync word with hard
+ * decisions. Returns the number of corrected bits.
+ */
+static int viterbi(const uint8_t *symbols, uint8_t *frame)
+{
+    static uint8_t decisions[INFO_BITS][NUM_STATES];
+    int metrics[NUM_STATES];
+    for (int s = 0; s < NUM_STATES; s++) {
+        metrics[s] = s ? 1000000 : 0;
+    }
+
+    for (int step = 0; step < INFO_BITS; step++) {
+        int received[2];
+        for (int k = 0; k < 2; k++) {
+            const int n = 2 * step + k;
+            const int row = n / TELEMETRY_INTERLEAVER_COLUMNS;
+            const int column = n % TELEMETRY_INTERLEAVER_COLUMNS;
+            received[k] = get_symbol(symbols,
+                    TELEMETRY_SYNC_BITS + column * TELEMETRY_INTERLEAVER_ROWS + row);
+        }
+
+        int next_metrics[NUM_STATES];
+        for (int s = 0; s < NUM_STATES; s++) {
+            next_metrics[s] = 2000000;
+        }
+
+        for (int s = 0; s < NUM_STATES; s++) {
+            for (int bit = 0; bit < 2; bit++) {
+                const uint32_t reg = (s << 1) | bit;
+                const int distance =
+                    (__builtin_parity(reg & TELEMETRY_POLY_A) != received[0]) +
+                    (__builtin_parity(reg & TELEMETRY_POLY_B) != received[1]);
+                const int next = reg & (NUM_STATES - 1);
+                if (metrics[s] + distance < next_metrics[next]) {
+                    next_metrics[next] = metrics[s] + distance;
+                    decisions[step][next] = s;
+                }
+            }
+        }
+        memcpy(metrics, next_metrics, sizeof(metrics));
+    }
+
+    memset(frame, 0, TELEMETRY_FRAME_LEN);
+    int state = 0;
+    for (int step = INFO_BITS - 1; step >= 0; step--) {
+        if (step < 8 * TELEMETRY_FRAME_LEN && (state & 1)) {
+            frame[step / 8] |= 0x80 >> (step % 8);
+        }
+        state = decisions[step][state];
+    }
+
+    return metrics[0];
+}
+
+static void flip(uint8_t *symbols, int index)
+{
+    symbols[index / 8] ^= 0x80 >> (index % 8);
+}
+
+static int decodes(const uint8_t *symbols, const uint8_t *frame)
+{
+    uint8_t decoded[TELEMETRY_FRAME_LEN];
+    viterbi(symbols, decoded);
+    return memcmp(decoded, frame, TELEMETRY_FRAME_LEN) == 0;
+}
+
+static void check_pack(void)
+{
+    struct telemetry_report r;
+    sample_report(&r);
+
+    // Missing hours and a jump larger than a delta
+    r.voltage_hourly[0] = -1;
+    r.voltage_hourly[5] = 135;
+    r.capacity_hourly[23] = 0;
+
+    uint8_t frame[TELEMETRY_FRAME_LEN];
+    telemetry_pack(&r, frame);
+
+    const uint32_t crc = crc32(frame, TELEMETRY_PAYLOAD_LEN);
+    CHECK(frame[TELEMETRY_PAYLOAD_LEN] == (uint8_t)(crc >> 24) &&
+            frame[TELEMETRY_FRAME_LEN - 1] == (uint8_t)crc, "CRC");
+
+    CHECK(frame[0] == ((TELEMETRY_VERSION << 4) | 0x05), "flags 0x%02x", frame[0]);
+    CHECK(frame[1] == 7612 >> 8 && frame[2] == (7612 & 0xFF), "date");
+    CHECK(frame[3] == 0 && frame[4] == 77, "uptime hours %d", frame[4]);
+    CHECK(frame[5] == 118 && frame[6] == 136, "voltage");
+    CHECK((int8_t)frame[7] == -10 && (int8_t)frame[8] == 42,
+            "temperature %d %d", (int8_t)frame[7], (int8_t)frame[8]);
+    CHECK(frame[9] == 25 && frame[11] == 1 && frame[15] == 9, "counters");
+    CHECK(frame[16] == 0 && frame[17] == 125, "longest QSO");
+
+    int32_t values[24];
+    unpack_hourly(frame[18], frame + 19, values);
+    CHECK(values[0] == -1, "missing voltage");
+    CHECK(values[1] == 120 && values[2] == 121, "voltage %d %d", (int)values[1], (int)values[2]);
+    // The jump of +1.3 V at 5h saturates, the following hours catch up
+    CHECK(values[5] == 129 && values[6] == 123, "voltage jump %d %d",
+            (int)values[5], (int)values[6]);
+    CHECK(values[23] == 131, "voltage at 23h %d", (int)values[23]);
+
+    unpack_hourly((frame[31] << 8) | frame[32], frame + 33, values);
+    CHECK(values[0] == 123 && values[22] == 145 && values[23] == -1, "capacity");
+
+    CHECK(histogram_bucket_middle(frame[45]) / 1000 == 122, "QSO p50");
+    CHECK(abs((int)histogram_bucket_middle(frame[51]) - 400) <= 50, "1750 latency");
+    CHECK(frame[53] == 0xFF && frame[54] == 0xFF, "empty occupancy");
+
+    // Only the date and uptime without values
+    r.values_valid = 0;
+    telemetry_pack(&r, frame);
+    CHECK(frame[0] == ((TELEMETRY_VERSION << 4) | 0x04) && frame[5] == 0 && frame[18] == 0,
+            "invalid values");
+}
+
+static void check_coding(const char *bit_file)
+{
+    struct telemetry_report r;
+    sample_report(&r);
+
+    uint8_t frame[TELEMETRY_FRAME_LEN];
+    uint8_t symbols[TELEMETRY_SYMBOLS_LEN];
+    telemetry_pack(&r, frame);
+    telemetry_encode(frame, symbols);
+
+    uint32_t sync = 0;
+    for (int i = 0; i < TELEMETRY_SYNC_BITS; i++) {
+        sync = (sync << 1) | get_symbol(symbols, i);
+    }
+    CHECK(sync == TELEMETRY_SYNC, "sync word 0x%08x", (unsigned)sync);
+
+    uint8_t decoded[TELEMETRY_FRAME_LEN];
+    CHECK(viterbi(symbols, decoded) == 0, "errors without noise");
+    CHECK(memcmp(decoded, frame, sizeof(frame)) == 0, "decoding without noise");
+
+    // A burst as long as the interleaver is spread over the frame
+    uint8_t noisy[TELEMETRY_SYMBOLS_LEN];
+    memcpy(noisy, symbols, sizeof(noisy));
+    for (int i = 0; i < TELEMETRY_INTERLEAVER_ROWS; i++) {
+        flip(noisy, TELEMETRY_SYNC_BITS + 400 + i);
+    }
+    CHECK(decodes(noisy, frame), "burst of %d errors", TELEMETRY_INTERLEAVER_ROWS);
+
+    // Random errors: plain varicode loses a character to every error
+    const int ber_percent[] = {1, 2, 3, 5};
+    for (size_t b = 0; b < sizeof(ber_percent) / sizeof(ber_percent[0]); b++) {
+        const int trials = 50;
+        int good = 0;
+        for (int t = 0; t < trials; t++) {
+            memcpy(noisy, symbols, sizeof(noisy));
+            for (int i = TELEMETRY_SYNC_BITS; i < TELEMETRY_SYMBOLS; i++) {
+                if (rand() % 1000 < ber_percent[b] * 10) {
+                    flip(noisy, i);
+                }
+            }
+            good += decodes(noisy, frame);
+        }
+        printf("bit error rate %d%%: %d of %d frames decoded\n", ber_percent[b], good, trials);
+        if (ber_percent[b] <= 2) {
+            CHECK(good == trials, "frames lost at %d%% bit errors", ber_percent[b]);
+        }
+    }
+
+    if (bit_file) {
+        FILE *f = fopen(bit_file, "wb");
+        if (f == NULL) {
+            CHECK(0, "cannot open %s", bit_file);
+            return;
+        }
+        for (int i = 0; i < PSK_IDLE_SYMBOLS / 2; i++) {
+            fputc(0, f);
+        }
+        for (int i = 0; i < TELEMETRY_SYMBOLS; i++) {
+            const int error = i >= TELEMETRY_SYNC_BITS && rand() % 100 < 2;
+            fputc(get_symbol(symbols, i) ^ error, f);
+        }
+        for (int i = 0; i < PSK_IDLE_SYMBOLS / 2; i++) {
+            fputc(0, f);
+        }
+        fclose(f);
+    }
+}
+
+static void check_airtime(void)
+{
+    size_t text_symbols = PSK_IDLE_SYMBOLS;
+    uint8_t buf[32];
+    for (const char *c = report_text; *c; c++) {
+        text_symbols += varicode_encode(*c, buf, sizeof(buf));
+    }
+    const size_t frame_symbols = PSK_IDLE_SYMBOLS + TELEMETRY_SYMBOLS;
+
+    printf("PSK125 airtime: text %d symbols (%.1f s), telemetry %d symbols (%.1f s)\n",
+            (int)text_symbols, text_symbols / 125.0,
+            (int)frame_symbols, frame_symbols / 125.0);
+    CHECK(text_symbols >= 5 * frame_symbols, "airtime reduced only %.1f times",
+            (double)text_symbols / frame_symbols);
+}
+
+int main(int argc, char **argv)
+{
+    srand(1750);
+
+    check_pack();
+    check_coding(argc > 1 ? argv[1] : NULL);
+    check_airtime();
+
+    return check_exit();
+}
@@ -0,0 +1,204 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Feed a month of battery voltage samples every 20 seconds into a time
+ * series, and compare the points of every tier with exact averages.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "Core/timeseries.h"
+#include "check.h"
+
+#define SAMPLE_PERIOD_MS 20000
+#define DAYS 31
+#define NUM_MINUTES (DAYS * 24 * 60)
+
+static struct timeseries ts;
+
+// Exact average of every minute, INT16_MIN when there was no sample
+static int16_t minutes[NUM_MINUTES];
+
+// Battery voltage in 10mV, charged during the day, with a step when the
+// wind generator is switched
+static int16_t voltage(uint64_t t_ms)
+{
+    const double hours = t_ms / 3600000.0;
+    double u = 1250.0 + 80.0 * sin(2 * M_PI * hours / 24.0) + 3.0 * rand() / RAND_MAX;
+    if (fmod(hours, 72.0) > 40.0 && fmod(hours, 72.0) < 41.0) {
+        u += 250.0;
+    }
+    return (int16_t)lround(u);
+}
+
+// Average of the exact minutes covered by a point of a tier ending at minute end
+static int exact_point(int tier, int end, double *avg)
+{
+    const int len = timeseries_period_s(tier) / 60;
+
+    /* Upper tiers average the averages of the tier below, which each hold
+     * the same number of samples unless some were missing.
+     */
+    double sum = 0;
+    int count = 0;
+    for (int m = end - len; m < end; m++) {
+        if (minutes[m] != INT16_MIN) {
+            sum += minutes[m];
+            count++;
+        }
+    }
+    if (count == 0) {
+        return 0;
+    }
+    *avg = sum / count;
+    return 1;
+}
+
+static void check_tier(int tier, int end_minute, int expected_count)
+{
+    const int count = timeseries_count(&ts, tier);
+    const int len = timeseries_period_s(tier) / 60;
+
+    CHECK(count >= expected_count, "tier %d holds %d points, expected %d", tier, count, expected_count);
+
+    struct timeseries_iter it;
+    timeseries_iter_init(&it, &ts, tier);
+
+    double max_error = 0;
+    int16_t value;
+    int i = 0;
+    int missing = 0;
+    while (timeseries_iter_next(&it, &value)) {
+        const int end = end_minute - (count - i - 1) * len;
+        double avg;
+        if (!exact_point(tier, end, &avg)) {
+            CHECK(value == TIMESERIES_MISSING, "tier %d point %d should be missing", tier, i);
+        }
+        else if (value == TIMESERIES_MISSING) {
+            missing++;
+        }
+        else {
+            const double error = fabs(value - avg);
+            if (error > max_error) {
+                max_error = error;
+            }
+        }
+        i++;
+    }
+
+    CHECK(i == count, "tier %d: iterated %d of %d points", tier, i, count);
+    CHECK(missing == 0, "tier %d: %d points missing", tier, missing);
+
+    printf("tier %d: %d points of %us, max error %.2f\n",
+            tier, count, (unsigned)timeseries_period_s(tier), max_error);
+    // Averages of rounded averages are within one unit
+    CHECK(max_error <= 1.5, "tier %d: max error %.2f", tier, max_error);
+}
+
+static void check_steps(void)
+{
+    timeseries_init(&ts);
+
+    // A 3V step does not fit in a difference
+    uint64_t t = 0;
+    for (int m = 0; m < 10; m++) {
+        for (int s = 0; s < 3; s++, t += SAMPLE_PERIOD_MS) {
+            timeseries_add(&ts, t, m < 5 ? 1200 : 1500);
+        }
+    }
+    timeseries_add(&ts, t, TIMESERIES_MISSING);
+
+    const int16_t expected[] = {1200, 1200, 1200, 1200, 1200, 1500, 1500, 1500, 1500, 1500};
+    struct timeseries_iter it;
+    timeseries_iter_init(&it, &ts, 0);
+    int16_t value;
+    for (int i = 0; i < 10; i++) {
+        CHECK(timeseries_iter_next(&it, &value) && value == expected[i],
+                "step point %d: %d instead of %d", i, value, expected[i]);
+    }
+    CHECK(!timeseries_iter_next(&it, &value), "step: too many points");
+
+    // Gaps and a series starting with missing samples
+    timeseries_init(&ts);
+    timeseries_add(&ts, 0, TIMESERIES_MISSING);
+    timeseries_add(&ts, 60000, TIMESERIES_MISSING);
+    timeseries_add(&ts, 120000, -52);
+    timeseries_add(&ts, 300000, -48);
+    timeseries_add(&ts, 360000, TIMESERIES_MISSING);
+
+    const int16_t expected_gap[] = {TIMESERIES_MISSING, TIMESERIES_MISSING, -52,
+        TIMESERIES_MISSING, TIMESERIES_MISSING, -48};
+    timeseries_iter_init(&it, &ts, 0);
+    for (int i = 0; i < 6; i++) {
+        CHECK(timeseries_iter_next(&it, &value) && value == expected_gap[i],
+                "gap point %d: %d instead of %d", i, value, expected_gap[i]);
+    }
+    CHECK(!timeseries_iter_next(&it, &value), "gap: too many points");
+}
+
+int main(void)
+{
+    srand(1750);
+
+    printf("time series: %d bytes for %d+%d+%d blocks\n", (int)sizeof(ts),
+            TIMESERIES_TIER0_BLOCKS, TIMESERIES_TIER1_BLOCKS, TIMESERIES_TIER2_BLOCKS);
+    CHECK(sizeof(ts) < 2048, "time series of %d bytes", (int)sizeof(ts));
+
+    check_steps();
+
+    timeseries_init(&ts);
+
+    // Samples every 20s, the temperature sensor sometimes fails
+    uint64_t t = 0;
+    int32_t sum = 0;
+    int count = 0;
+    int minute = 0;
+    while (minute < NUM_MINUTES) {
+        const int16_t v = voltage(t);
+        const int valid = rand() % 50 != 0;
+        timeseries_add(&ts, t, valid ? v : TIMESERIES_MISSING);
+
+        if (valid) {
+            sum += v;
+            count++;
+        }
+
+        t += SAMPLE_PERIOD_MS;
+        if (t / 60000 != (uint64_t)minute) {
+            minutes[minute] = count ? (int16_t)lround((double)sum / count) : INT16_MIN;
+            sum = 0;
+            count = 0;
+            minute++;
+        }
+    }
+    // The last minute is only stored with the next sample
+    timeseries_add(&ts, t, TIMESERIES_MISSING);
+
+    check_tier(0, NUM_MINUTES, 6 * 60);
+    check_tier(1, NUM_MINUTES, 3 * 24 * 6);
+    check_tier(2, NUM_MINUTES, 30 * 24);
+
+    return check_exit();
+}
@@ -0,0 +1,172 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Parse UBX frames built with ubx_frame(), interleaved with NMEA and split
+ * at every position, and compare the byte rate with the NMEA output.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "GPS/ubx.h"
+#include "check.h"
+
+static uint32_t build_timeutc(uint8_t *out, int valid)
+{
+    uint8_t pl[UBX_NAV_TIMEUTC_LEN] = {0};
+    // tAcc 25ns
+    pl[4] = 25;
+    // 2020-05-20 18:40:00
+    pl[12] = 2020 & 0xFF;
+    pl[13] = 2020 >> 8;
+    pl[14] = 5;
+    pl[15] = 20;
+    pl[16] = 18;
+    pl[17] = 40;
+    pl[18] = 0;
+    pl[19] = valid ? 0x07 : 0x03;
+    return ubx_frame(out, UBX_CLASS_NAV, UBX_NAV_TIMEUTC, pl, sizeof(pl));
+}
+
+static uint32_t build_pvt(uint8_t *out)
+{
+    uint8_t pl[UBX_NAV_PVT_LEN] = {0};
+    pl[4] = 2020 & 0xFF;
+    pl[5] = 2020 >> 8;
+    pl[11] = 0x03;
+    pl[20] = 3;
+    pl[21] = 0x01;
+    pl[23] = 9;
+    // A '$' in the payload must not confuse the NMEA side
+    pl[30] = '$';
+    return ubx_frame(out, UBX_CLASS_NAV, UBX_NAV_PVT, pl, sizeof(pl));
+}
+
+// Feed the stream in two chunks split at split, like the GPS task does
+static int parse_stream(const uint8_t *stream, uint32_t len, uint32_t split,
+        enum ubx_message *found, struct ubx_parser *last)
+{
+    struct ubx_parser p;
+    ubx_init(&p);
+    int n = 0;
+
+    const uint32_t chunks[2][2] = { {0, split}, {split, len} };
+    for (int c = 0; c < 2; c++) {
+        const uint8_t *rx = stream + chunks[c][0];
+        uint32_t rx_len = chunks[c][1] - chunks[c][0];
+
+        while (rx_len > 0) {
+            uint32_t consumed = 0;
+            if (ubx_receiving(&p) || rx[0] == UBX_SYNC_1) {
+                const enum ubx_message msg = ubx_parse(&p, rx, rx_len, &consumed);
+                if (msg != UBX_NONE) {
+                    found[n++] = msg;
+                    *last = p;
+                }
+            }
+            else {
+                // NMEA side, skipped to the next sync
+                const uint8_t *sync = memchr(rx, UBX_SYNC_1, rx_len);
+                consumed = sync ? (uint32_t)(sync - rx) : rx_len;
+            }
+            CHECK(consumed > 0 && consumed <= rx_len, "consumed %u of %u",
+                    (unsigned)consumed, (unsigned)rx_len);
+            rx += consumed;
+            rx_len -= consumed;
+        }
+    }
+    return n;
+}
+
+int main(void)
+{
+    uint8_t stream[512];
+    uint32_t len = 0;
+
+    const char *txt = "$GPTXT,01,01,02,ANTSTATUS=OK*3B\r\n";
+    memcpy(stream, txt, strlen(txt));
+    len += strlen(txt);
+    len += build_pvt(stream + len);
+    // A lone sync byte, then a repeated one before a frame
+    stream[len++] = UBX_SYNC_1;
+    stream[len++] = 'x';
+    stream[len++] = UBX_SYNC_1;
+    len += build_timeutc(stream + len, 1);
+
+    const uint8_t ack_payload[2] = { UBX_CLASS_CFG, UBX_CFG_MSG };
+    len += ubx_frame(stream + len, UBX_CLASS_ACK, UBX_ACK_ACK, ack_payload, 2);
+    len += ubx_frame(stream + len, UBX_CLASS_ACK, UBX_ACK_NAK, ack_payload, 2);
+
+    // A corrupted frame is dropped
+    const uint32_t corrupt_at = len + 10;
+    len += build_timeutc(stream + len, 0);
+    stream[corrupt_at] ^= 0x01;
+
+    memcpy(stream + len, txt, strlen(txt));
+    len += strlen(txt);
+
+    for (uint32_t split = 0; split <= len; split++) {
+        enum ubx_message found[16];
+        struct ubx_parser last;
+        const int n = parse_stream(stream, len, split, found, &last);
+
+        CHECK(n == 4, "split %u: %d messages", (unsigned)split, n);
+        if (n == 4) {
+            CHECK(found[0] == UBX_MSG_NAV_PVT, "split %u: no PVT", (unsigned)split);
+            CHECK(found[1] == UBX_MSG_NAV_TIMEUTC, "split %u: no TIMEUTC", (unsigned)split);
+            CHECK(found[2] == UBX_MSG_ACK && found[3] == UBX_MSG_NAK, "split %u: no ACK/NAK", (unsigned)split);
+            CHECK(last.ack_class == UBX_CLASS_CFG && last.ack_id == UBX_CFG_MSG, "ack id");
+        }
+    }
+
+    // Decoded values
+    struct ubx_parser p;
+    ubx_init(&p);
+    uint8_t frame[UBX_NAV_PVT_LEN + UBX_FRAME_OVERHEAD];
+    uint32_t frame_len = build_timeutc(frame, 1);
+    uint32_t consumed;
+    CHECK(ubx_parse(&p, frame, frame_len, &consumed) == UBX_MSG_NAV_TIMEUTC, "TIMEUTC");
+    CHECK(consumed == frame_len, "TIMEUTC length");
+    CHECK(p.year == 2020 && p.month == 5 && p.day == 20 && p.hours == 18 &&
+            p.minutes == 40 && p.seconds == 0, "TIMEUTC date");
+    CHECK(p.utc_valid && p.time_accuracy_ns == 25, "TIMEUTC validity");
+
+    frame_len = build_pvt(frame);
+    CHECK(ubx_parse(&p, frame, frame_len, &consumed) == UBX_MSG_NAV_PVT, "PVT");
+    CHECK(p.fix_ok && p.satellites == 9, "PVT satellites %d", p.satellites);
+
+    // A corrupted length gives up the frame at once
+    const uint8_t long_header[] = { UBX_SYNC_1, UBX_SYNC_2, UBX_CLASS_NAV,
+        UBX_NAV_PVT, 0xFF, 0xFF, '$', 'G' };
+    CHECK(ubx_parse(&p, long_header, sizeof(long_header), &consumed) == UBX_NONE,
+            "long frame decoded");
+    CHECK(consumed == 6 && !ubx_receiving(&p), "long frame still receiving");
+
+    // Byte rate of one navigation epoch, NMEA as in the u-blox default output
+    const int nmea_bytes = 70 + 38 + 78 + 66 + 3 * 70 + 50;
+    const int ubx_bytes = (UBX_NAV_TIMEUTC_LEN + UBX_FRAME_OVERHEAD) +
+        (UBX_NAV_PVT_LEN + UBX_FRAME_OVERHEAD) / 10;
+    printf("bytes per second: NMEA about %d, UBX %d\n", nmea_bytes, ubx_bytes);
+
+    return check_exit();
+}
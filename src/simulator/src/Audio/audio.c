@@ -111,6 +111,15 @@ void audio_play_with_callback(AudioCallbackFunction *callback, void *context) {
         callback_function(callback_context, buffer_number);
 }
 
+void audio_resume(void) {
+    if (callback_function && !next_buffer_samples) {
+        if (!dma_running) {
+            buffer_number = 0;
+        }
+        callback_function(callback_context, buffer_number);
+    }
+}
+
 bool audio_provide_buffer_without_blocking(void *samples, int numsamples) {
     if (next_buffer_samples)
         return false;
@@ -1,4 +1,21 @@
 #include "Core/common.h"
+#include <time.h>
+
+static struct timespec timestamp_start;
+
+void timestamp_init(void)
+{
+    clock_gettime(CLOCK_MONOTONIC, &timestamp_start);
+}
+
+uint64_t timestamp_now_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)(now.tv_sec - timestamp_start.tv_sec) * 1000000ull +
+        (now.tv_nsec - timestamp_start.tv_nsec) / 1000;
+}
 
 // Fake the function
 void __disable_irq() {
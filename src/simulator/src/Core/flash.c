@@ -0,0 +1,152 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "Core/flash.h"
+#include "src/Core/flash_sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FLASH_SIM_DEFAULT_PATH "flash_store.bin"
+
+static uint32_t image[FLASH_STORE_SECTORS][FLASH_STORE_SECTOR_WORDS];
+static const char *image_path = NULL;
+static int32_t words_before_cut = -1;
+static uint32_t erase_count[FLASH_STORE_SECTORS];
+static uint32_t programmed_words;
+
+// A new image is not erased, like a flash that was never used
+static void load(void)
+{
+    FILE *f = fopen(image_path, "rb");
+    if (f) {
+        if (fread(image, sizeof(image), 1, f) != 1) {
+            memset(image, 0, sizeof(image));
+        }
+        fclose(f);
+    }
+    else {
+        memset(image, 0, sizeof(image));
+    }
+}
+
+static void save(int sector)
+{
+    FILE *f = fopen(image_path, "r+b");
+    if (!f) {
+        f = fopen(image_path, "w+b");
+    }
+    if (!f) {
+        return;
+    }
+
+    if (fseek(f, 0, SEEK_END) == 0 && ftell(f) < (long)sizeof(image)) {
+        rewind(f);
+        fwrite(image, sizeof(image), 1, f);
+    }
+    else {
+        fseek(f, sector * FLASH_STORE_SECTOR_LEN, SEEK_SET);
+        fwrite(image[sector], FLASH_STORE_SECTOR_LEN, 1, f);
+    }
+    fclose(f);
+}
+
+static void ensure_open(void)
+{
+    if (image_path == NULL) {
+        flash_sim_open(FLASH_SIM_DEFAULT_PATH);
+    }
+}
+
+void flash_sim_open(const char *path)
+{
+    image_path = path;
+    memset(erase_count, 0, sizeof(erase_count));
+    programmed_words = 0;
+    load();
+}
+
+void flash_sim_cut_after(int32_t num_words)
+{
+    words_before_cut = num_words;
+}
+
+uint32_t flash_sim_erase_count(int sector)
+{
+    return erase_count[sector];
+}
+
+uint32_t flash_sim_programmed_words(void)
+{
+    return programmed_words;
+}
+
+int flash_store_erase(int sector)
+{
+    ensure_open();
+
+    if (words_before_cut == 0) {
+        // Cut during the erase
+        for (uint32_t i = 0; i < FLASH_STORE_SECTOR_WORDS; i++) {
+            image[sector][i] |= (uint32_t)rand() ^ ((uint32_t)rand() << 16);
+        }
+        save(sector);
+        return 0;
+    }
+
+    memset(image[sector], 0xFF, FLASH_STORE_SECTOR_LEN);
+    erase_count[sector]++;
+    save(sector);
+    return 1;
+}
+
+int flash_store_program(int sector, uint32_t offset, const uint32_t *words, uint32_t num_words)
+{
+    ensure_open();
+
+    int ok = 1;
+    for (uint32_t i = 0; i < num_words && offset + i < FLASH_STORE_SECTOR_WORDS; i++) {
+        if (words_before_cut == 0) {
+            // Cut during this word, only some of its bits are programmed
+            image[sector][offset + i] &= words[i] | (uint32_t)rand();
+            ok = 0;
+            break;
+        }
+        if (words_before_cut > 0) {
+            words_before_cut--;
+        }
+        // Programming can only clear bits
+        image[sector][offset + i] &= words[i];
+        programmed_words++;
+    }
+
+    save(sector);
+    return ok && offset + num_words <= FLASH_STORE_SECTOR_WORDS;
+}
+
+const uint32_t *flash_store_sector(int sector)
+{
+    ensure_open();
+    return image[sector];
+}
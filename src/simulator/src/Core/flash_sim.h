@@ -0,0 +1,45 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/* Flash of the simulator, kept in a file so that the store survives a
+ * restart. Power cuts can be simulated for the host tests.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Use another image file than flash_store.bin, and read it
+void flash_sim_open(const char *path);
+
+// Lose power after num_words more words were programmed: the word being
+// programmed then gets only some of its bits, an erase leaves random bits,
+// and everything after fails. -1 disables the cut.
+void flash_sim_cut_after(int32_t num_words);
+
+// Number of erases of the sector since the image was opened
+uint32_t flash_sim_erase_count(int sector);
+
+// Number of words programmed since the image was opened
+uint32_t flash_sim_programmed_words(void);
@@ -24,13 +24,14 @@
 
 #include "Core/fsm.h"
 #include "GPIO/usart.h"
+#include "Core/log.h"
 #include <time.h>
 
 extern const char * gui_last_fsm_states[];
 extern int gui_last_fsm_states_timestamps[];
 
 void fsm_state_switched(const char *new_state) {
-    usart_debug_puts_header("FSM: ", new_state);
+    log_msg(FSM, LOG_INFO, "FSM: %s\r\n", new_state);
 
     for (int i = 8; i >= 0; i--) {
         gui_last_fsm_states[i + 1] = gui_last_fsm_states[i];
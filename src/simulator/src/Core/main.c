@@ -34,6 +34,8 @@
 #include "semphr.h"
 #include "src/GPS/gps_sim.h"
 #include "src/Gui/gui.h"
+#include "GPS/pps.h"
+#include "Core/common.h"
 
 
 void init(void);
@@ -53,6 +55,14 @@ extern char gui_gps_lon[64];
 extern int gui_gps_lon_len;
 extern int gui_gps_lon_hem;
 extern int gui_gps_send_current_time;
+extern int gui_gps_send_pps;
+extern int gui_gps_ubx;
+extern char gui_gps_ttff[16];
+extern int gui_gps_ttff_len;
+extern char gui_gps_pps_drift[16];
+extern int gui_gps_pps_drift_len;
+extern char gui_gps_pps_jitter[16];
+extern int gui_gps_pps_jitter_len;
 
 extern int gui_gps_custom_hour_on;
 extern int gui_gps_custom_min_on;
@@ -73,16 +83,78 @@ extern int gui_gps_custom_month_len;
 extern char gui_gps_custom_year[4];
 extern int gui_gps_custom_year_len;
 
+// The nuklear edit fields are not null-terminated
+static double gui_edit_value(const char *buf, int len) {
+    char value[16];
+    memcpy(value, buf, len);
+    value[len] = '\0';
+    return atof(value);
+}
+
+/* Synthetic PPS: the edges are one second apart for a clock whose frequency
+ * error relative to timestamp_now_us() is the configured drift, plus a random
+ * jitter. The time in the RMC frame is the one of the edge.
+ */
+static uint64_t pps_next_edge_us = 0;
+static time_t pps_second = 0;
+
+static time_t pps_sim_wait_edge(void) {
+    const double drift_ppm = gui_edit_value(gui_gps_pps_drift, gui_gps_pps_drift_len);
+    const double jitter_us = gui_edit_value(gui_gps_pps_jitter, gui_gps_pps_jitter_len);
+
+    uint64_t now_us = timestamp_now_us();
+
+    if (pps_next_edge_us == 0 || pps_next_edge_us + 1000000 < now_us) {
+        pps_next_edge_us = now_us + 1000000;
+        pps_second = time(NULL) + 1;
+    }
+
+    if (pps_next_edge_us > now_us) {
+        // Round up, the edge must not be in the future when the frame is sent
+        vTaskDelay(pdMS_TO_TICKS((pps_next_edge_us - now_us) / 1000) + 1);
+    }
+
+    const int64_t jitter = jitter_us * (2.0 * rand() / RAND_MAX - 1.0);
+
+    taskENTER_CRITICAL();
+    pps_push_edge(pps_next_edge_us + jitter);
+    taskEXIT_CRITICAL();
+
+    pps_next_edge_us += 1000000.0 * (1.0 + drift_ppm * 1e-6);
+
+    return pps_second++;
+}
+
 static void thread_gui_gps(void __attribute__ ((unused))*arg) {
 
     while(1) {
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        time_t now;
+
+        // Nothing is sent while the receiver is in reset or backup, and the
+        // PPS and the valid frames start once it has a fix
+        const int ttff_s = gui_edit_value(gui_gps_ttff, gui_gps_ttff_len);
+        const int has_fix = gps_sim_has_fix(ttff_s);
+        const int valid = gui_gps_frames_valid && has_fix;
 
-        if (gui_gps_send_frame) {
+        if (gui_gps_send_frame && gui_gps_send_pps && has_fix) {
+            now = pps_sim_wait_edge();
+        }
+        else {
+            vTaskDelay(pdMS_TO_TICKS(1000));
+            now = time(NULL);
+            pps_next_edge_us = 0;
+        }
+
+        if (gui_gps_send_frame && gps_sim_running()) {
 
-            time_t now = time(NULL);
             struct tm *t = gmtime(&now);
 
+            // The custom time only applies to the NMEA frames
+            if (gui_gps_ubx) {
+                gps_sim_send_ubx(t, valid);
+                continue;
+            }
+
             char gps_frame_buffer[128];
             int gps_buffer_pointer = 0;
 
@@ -116,7 +188,7 @@ static void thread_gui_gps(void __attribute__ ((unused))*arg) {
             gps_frame_buffer[gps_buffer_pointer] = ',';
             gps_buffer_pointer++;
 
-            if (gui_gps_frames_valid) {
+            if (valid) {
                 gps_frame_buffer[gps_buffer_pointer] = 'A';
             } else {
                 gps_frame_buffer[gps_buffer_pointer] = 'V';
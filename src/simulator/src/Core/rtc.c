@@ -0,0 +1,70 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Matthias P. Braendli, Maximilien Cuony
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include "Core/rtc.h"
+
+/* The RTC is saved as an offset to the host clock, so that it keeps running
+ * while the simulator is stopped, like a battery-backed RTC.
+ */
+#define RTC_FILE "rtc.txt"
+
+void rtc_init(void)
+{
+}
+
+int rtc_available(void)
+{
+    return 1;
+}
+
+int rtc_get_utc(calendar_epoch_t *utc)
+{
+    FILE *fd = fopen(RTC_FILE, "r");
+    if (fd == NULL) {
+        return 0;
+    }
+
+    long offset = 0;
+    const int success = fscanf(fd, "%ld", &offset) == 1;
+    fclose(fd);
+
+    if (success) {
+        *utc = time(NULL) + offset;
+    }
+
+    return success;
+}
+
+void rtc_set_utc(calendar_epoch_t utc)
+{
+    FILE *fd = fopen(RTC_FILE, "w");
+    if (fd == NULL) {
+        return;
+    }
+
+    fprintf(fd, "%ld\n", (long)utc - (long)time(NULL));
+    fclose(fd);
+}
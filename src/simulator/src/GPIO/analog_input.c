@@ -23,7 +23,6 @@
 */
 
 #include "GPIO/analog.h"
-#include <math.h>
 
 extern float gui_measured_voltage;
 extern int gui_swr_forward;
@@ -33,15 +32,11 @@ void analog_init(void)
 {
 }
 
-float analog_measure_12v(void)
+int analog_get_snapshot(struct analog_snapshot *snapshot)
 {
-    return gui_measured_voltage;
-}
-
-int analog_measure_swr(int *forward_mv, int *reflected_mv)
-{
-    *forward_mv = gui_swr_forward;
-    *reflected_mv = gui_swr_reflected;
+    snapshot->supply = gui_measured_voltage;
+    snapshot->swr_forward_mv = gui_swr_forward;
+    snapshot->swr_reflected_mv = gui_swr_reflected;
 
     return 1;
 }
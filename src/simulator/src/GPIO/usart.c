@@ -23,8 +23,15 @@
 */
 
 
+#include <stdio.h>
+#include <string.h>
 #include "GPIO/usart.h"
+#include "Core/log_ring.h"
+#include "Core/log_bin.h"
+#include "FreeRTOS.h"
+#include "task.h"
 #include "src/Gui/gui.h"
+#include "src/GPS/gps_sim.h"
 
 extern char uart_recv_txt[4096];
 int uart_recv_pointer = 0;
@@ -33,6 +40,8 @@ int uart_recv_pointer = 0;
 void usart_move_buffer_up(void);
 void gui_usart_send(char *);
 
+static void usart_debug_tx_task(void *pvParameters);
+
 
 void usart_init() {
 
@@ -41,9 +50,54 @@ void usart_init() {
         uart_recv_txt[i] = '\0';
     }
 
+    xTaskCreate(
+            usart_debug_tx_task,
+            "TaskDebugTX",
+            configMINIMAL_STACK_SIZE,
+            (void*) NULL,
+            tskIDLE_PRIORITY + 1UL,
+            NULL);
+}
+
+// Drain the log ring into the GUI, at about the rate of the debug USART.
+// The binary messages are rendered here, instead of by the PC.
+static void usart_debug_tx_task(void __attribute__ ((unused))*pvParameters) {
+    while (1) {
+        uint32_t len;
+        const char *msg;
+        while ((msg = log_ring_peek(&len)) != NULL) {
+            if (msg[0] == LOG_BIN_SYNC) {
+                char text[256];
+                if (log_bin_render((const uint8_t*)msg, len, text, sizeof(text)) >= 0) {
+                    fprintf(stderr, "DEBUG: %s", text);
+                    usart_puts(USART2, text);
+                }
+            }
+            else {
+                usart_write(USART2, (const uint8_t*)msg, len);
+            }
+            log_ring_release();
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+void usart_debug_kick() {
+}
+
+void usart_debug_flush() {
+    // Bounded, the drain task may not run
+    for (volatile uint32_t i = 0; i < 10000000ul && !log_ring_empty(); i++) {
+    }
 }
 
 void usart_gps_remove_reset() {
+    gps_sim_power(1);
+}
+
+void usart_gps_hold_reset() {
+    gps_sim_power(0);
 }
 
 void usart_gps_specific_init() {
@@ -62,21 +116,26 @@ void usart_move_buffer_up() {
 
 // Make sure Tasks are suspended when this is called!
 void usart_puts(USART_TypeDef* USART, const char* str) {
+    usart_write(USART, (const uint8_t*)str, strlen(str));
+}
 
+void usart_write(USART_TypeDef* USART, const uint8_t *data, uint32_t len) {
     if (USART == USART2) {
-        while(*str) {
-            if (*str != '\r') {
+        for (uint32_t i = 0; i < len; i++) {
+            if (data[i] != '\r') {
                 uart_recv_txt[uart_recv_pointer+1] = '\0';
-                uart_recv_txt[uart_recv_pointer] = *str;
+                uart_recv_txt[uart_recv_pointer] = data[i];
                 uart_recv_pointer++;
 
                 if (uart_recv_pointer >= 4000) {
                     usart_move_buffer_up();
                 }
             }
-            str++;
         }
     }
+    else if (USART == USART3) {
+        gps_sim_receive(data, len);
+    }
 }
 
 void gui_usart_send(char * string) {
@@ -1,12 +1,130 @@
+#include <time.h>
+#include <string.h>
 #include "GPIO/usart.h"
+#include "GPS/ubx.h"
 #include "src/GPS/gps_sim.h"
 
+extern int gui_gps_ubx;
+
+// Write into the ring like the DMA does
+static uint32_t gps_rx_pos = 0;
+
+// In reset until the GPS task starts
+static int gps_sim_powered = 0;
+static time_t gps_sim_powered_since = 0;
+
+void gps_sim_power(int on) {
+    if (on && !gps_sim_powered) {
+        gps_sim_powered_since = time(NULL);
+    }
+    gps_sim_powered = on;
+}
+
+int gps_sim_running() {
+    return gps_sim_powered;
+}
+
+int gps_sim_has_fix(int ttff_s) {
+    return gps_sim_powered && time(NULL) - gps_sim_powered_since >= ttff_s;
+}
+
+void gps_usart_send_bytes(const uint8_t *data, uint32_t len) {
+
+    for (uint32_t i = 0; i < len; i++) {
+        usart_gps_rx_ring[gps_rx_pos] = data[i];
+        gps_rx_pos = (gps_rx_pos + 1) % GPS_RX_RING_LEN;
+
+        // Half and full ring interrupts
+        if (gps_rx_pos % (GPS_RX_RING_LEN / 2) == 0) {
+            usart_gps_rx_advance(gps_rx_pos);
+        }
+    }
+
+    // Idle line interrupt
+    usart_gps_rx_advance(gps_rx_pos);
+}
+
 void gps_usart_send(char * string) {
+    gps_usart_send_bytes((const uint8_t*)string, strlen(string));
+}
+
+static void gps_sim_send_frame(uint8_t msg_class, uint8_t msg_id,
+        const uint8_t *payload, uint16_t len) {
+    uint8_t frame[UBX_NAV_PVT_LEN + UBX_FRAME_OVERHEAD];
+    const uint32_t frame_len = ubx_frame(frame, msg_class, msg_id, payload, len);
+    gps_usart_send_bytes(frame, frame_len);
+}
 
-    while(*string) {
-        usart_gps_process_char(*string);
+static void put_u2(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
 
-        string++;
+static void put_u4(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = v >> (8 * i);
     }
+}
+
+void gps_sim_send_ubx(const struct tm *t, int valid) {
+    const uint32_t time_accuracy_ns = valid ? 25 : 0xFFFFFFFF;
+
+    uint8_t pvt[UBX_NAV_PVT_LEN];
+    memset(pvt, 0, sizeof(pvt));
+    put_u2(pvt + 4, t->tm_year + 1900);
+    pvt[6] = t->tm_mon + 1;
+    pvt[7] = t->tm_mday;
+    pvt[8] = t->tm_hour;
+    pvt[9] = t->tm_min;
+    pvt[10] = t->tm_sec;
+    // validDate, validTime
+    pvt[11] = valid ? 0x03 : 0x00;
+    put_u4(pvt + 12, time_accuracy_ns);
+    // fixType 3D, gnssFixOK
+    pvt[20] = valid ? 3 : 0;
+    pvt[21] = valid ? 0x01 : 0x00;
+    pvt[23] = valid ? 8 : 0;
+    gps_sim_send_frame(UBX_CLASS_NAV, UBX_NAV_PVT, pvt, sizeof(pvt));
 
+    uint8_t timeutc[UBX_NAV_TIMEUTC_LEN];
+    memset(timeutc, 0, sizeof(timeutc));
+    put_u4(timeutc + 4, time_accuracy_ns);
+    put_u2(timeutc + 12, t->tm_year + 1900);
+    timeutc[14] = t->tm_mon + 1;
+    timeutc[15] = t->tm_mday;
+    timeutc[16] = t->tm_hour;
+    timeutc[17] = t->tm_min;
+    timeutc[18] = t->tm_sec;
+    // validTOW, validWKN, validUTC
+    timeutc[19] = valid ? 0x07 : 0x00;
+    gps_sim_send_frame(UBX_CLASS_NAV, UBX_NAV_TIMEUTC, timeutc, sizeof(timeutc));
+}
+
+void gps_sim_receive(const uint8_t *data, uint32_t len) {
+    // Only a receiver that speaks UBX acknowledges the configuration
+    if (!gui_gps_ubx) {
+        return;
+    }
+
+    uint32_t i = 0;
+    while (i + UBX_FRAME_OVERHEAD <= len) {
+        if (data[i] == UBX_SYNC_1 && data[i + 1] == UBX_SYNC_2) {
+            const uint8_t msg_class = data[i + 2];
+            const uint8_t msg_id = data[i + 3];
+
+            if (msg_class == UBX_CLASS_CFG) {
+                const uint8_t ack[2] = { msg_class, msg_id };
+                gps_sim_send_frame(UBX_CLASS_ACK, UBX_ACK_ACK, ack, sizeof(ack));
+            }
+            else if (msg_class == UBX_CLASS_RXM && msg_id == UBX_RXM_PMREQ) {
+                // Backup mode until the next reset
+                gps_sim_power(0);
+            }
+
+            i += UBX_FRAME_OVERHEAD + (data[i + 4] | (data[i + 5] << 8));
+        }
+        else {
+            i++;
+        }
+    }
 }
@@ -24,4 +24,21 @@
 
 #pragma once
 
+#include <stdint.h>
+#include <time.h>
+
 void gps_usart_send(char *);
+void gps_usart_send_bytes(const uint8_t *data, uint32_t len);
+
+// Send NAV-PVT and NAV-TIMEUTC frames for the given time
+void gps_sim_send_ubx(const struct tm *t, int valid);
+
+// Receive the data sent to the GPS receiver
+void gps_sim_receive(const uint8_t *data, uint32_t len);
+
+// Reset line and backup mode of the receiver
+void gps_sim_power(int on);
+int gps_sim_running(void);
+
+// The receiver has a fix ttff_s seconds after it was switched on
+int gps_sim_has_fix(int ttff_s);
@@ -39,6 +39,7 @@
 
 #include "gui.h"
 #include "Core/common.h"
+#include "Core/log.h"
 
 #define NK_INCLUDE_FIXED_TYPES
 #define NK_INCLUDE_STANDARD_IO
@@ -105,6 +106,14 @@ int gui_gps_lon_len = 10;
 static const char *gps_EW[] = {"East", "West"};
 int gui_gps_lon_hem = 0;
 int gui_gps_send_current_time = 1;
+int gui_gps_send_pps = 0;
+int gui_gps_ubx = 0;
+char gui_gps_ttff[16] = "5";
+int gui_gps_ttff_len = 1;
+char gui_gps_pps_drift[16] = "12.5";
+int gui_gps_pps_drift_len = 4;
+char gui_gps_pps_jitter[16] = "2";
+int gui_gps_pps_jitter_len = 1;
 int gui_gps_custom_hour_on = 0;
 int gui_gps_custom_min_on = 0;
 int gui_gps_custom_sec_on = 0;
@@ -197,6 +206,8 @@ int gui_swr_reflected;
 
 
 int auto_scroll_uart = 1;
+// Everything is compiled in, the debug level floods the output
+static int gui_log_level = LOG_INFO;
 int auto_scroll_cw = 1;
 
 
@@ -433,9 +444,11 @@ void main_gui() {
                 }
 
 
-                nk_layout_row_dynamic(ctx, 25, 2);
+                nk_layout_row_dynamic(ctx, 25, 3);
                 nk_label(ctx, "UART Output:", NK_TEXT_LEFT);
                 nk_checkbox_label(ctx, "(Auto scroll)", &auto_scroll_uart);
+                nk_property_int(ctx, "Level", LOG_ERROR, &gui_log_level, LOG_DEBUG, 1, 1);
+                log_set_level(gui_log_level);
 
                 nk_menubar_end(ctx);
 
@@ -566,6 +579,22 @@ void main_gui() {
                 nk_layout_row_dynamic(ctx, 30, 1);
                 nk_checkbox_label(ctx, "Send frames", &gui_gps_send_frame);
                 nk_checkbox_label(ctx, "Valid frames", &gui_gps_frames_valid);
+                nk_checkbox_label(ctx, "Send PPS", &gui_gps_send_pps);
+                nk_checkbox_label(ctx, "UBX protocol", &gui_gps_ubx);
+
+                nk_layout_row_dynamic(ctx, 30, 2);
+                nk_label(ctx, "Time to fix s:", NK_TEXT_LEFT);
+                nk_edit_string(ctx, NK_EDIT_SIMPLE, gui_gps_ttff, &gui_gps_ttff_len, 15, nk_filter_decimal);
+                nk_layout_row_dynamic(ctx, 30, 1);
+
+                if (gui_gps_send_pps) {
+                    nk_layout_row_dynamic(ctx, 30, 2);
+
+                    nk_label(ctx, "Drift ppm:", NK_TEXT_LEFT);
+                    nk_edit_string(ctx, NK_EDIT_SIMPLE, gui_gps_pps_drift, &gui_gps_pps_drift_len, 15, nk_filter_float);
+                    nk_label(ctx, "Jitter us:", NK_TEXT_LEFT);
+                    nk_edit_string(ctx, NK_EDIT_SIMPLE, gui_gps_pps_jitter, &gui_gps_pps_jitter_len, 15, nk_filter_float);
+                }
 
                 nk_layout_row_dynamic(ctx, 30, 2);
 